@@ -0,0 +1,403 @@
+/**
+ * Kage Microbenchmarks
+ *
+ * Runs the extension's hot paths inside an embedded PHP request, over
+ * input sizes from 64 B to 64 MB (powers of four), and reports ns/op,
+ * throughput and request-heap allocations per call. Inputs are generated
+ * and prepared outside the timed region.
+ *
+ * Usage: kage_bench [--json] [--filter=NAME] [--min-size=BYTES]
+ *                   [--max-size=BYTES] [--min-time=SECONDS]
+ *
+ * --json prints one JSON document on stdout instead of the table, for
+ * comparing releases; progress goes to stderr either way.
+ */
+
+#include "sapi/embed/php_embed.h"
+#include "config.h"
+#include "kage_context.h"
+#include "kage_test.h"
+#include "base64.h"
+#include "crypto.h"
+#include "bytecode_crypto.h"
+#include "ast.h"
+#include "kage_memory.h"
+#include "kage_validation.h"
+#include <getopt.h>
+
+#define KAGE_BENCH_MIN_SIZE ((size_t)64)
+#define KAGE_BENCH_MAX_SIZE ((size_t)64 * 1024 * 1024)
+
+// Everything a benchmark works on; each case fills what it needs
+typedef struct {
+    zend_string *key;
+    zend_string *input;
+    zend_string *prepared;
+    php_bytecode_package *package;
+    kage_ast_node *ast;
+    kage_compiled_program *program;
+    size_t size;
+} kage_bench_arg;
+
+typedef struct {
+    const char *name;
+    size_t max_size;        // larger inputs are skipped
+    bool (*setup)(kage_bench_arg *arg, size_t size);
+    kage_benchmark_func run;
+} kage_bench_case;
+
+// --- Input generators ---
+
+static zend_string* kage_bench_random(size_t size) {
+    zend_string *data = zend_string_alloc(size, 0);
+    randombytes_buf(ZSTR_VAL(data), size);
+    ZSTR_VAL(data)[size] = '\0';
+    return data;
+}
+
+// Repeats a pattern to exactly size bytes; the tail is spaces, which every
+// generated format treats as insignificant
+static zend_string* kage_bench_repeat(const char *prefix, const char *pattern, size_t size) {
+    size_t prefix_length = strlen(prefix);
+    size_t pattern_length = strlen(pattern);
+    zend_string *data = zend_string_alloc(size, 0);
+    char *p = ZSTR_VAL(data);
+    char *end = p + size;
+
+    if (prefix_length > size) {
+        prefix_length = size;
+    }
+    memcpy(p, prefix, prefix_length);
+    p += prefix_length;
+
+    while ((size_t)(end - p) >= pattern_length) {
+        memcpy(p, pattern, pattern_length);
+        p += pattern_length;
+    }
+    memset(p, ' ', end - p);
+    *end = '\0';
+    return data;
+}
+
+static const char kage_bench_vld_function[] =
+    "function name:  kage_bench\n"
+    "number of ops:  6\n"
+    "compiled vars:  !0 = $a\n"
+    "line      #* E I O op                           fetch          ext  return  operands\n"
+    "-------------------------------------------------------------------------------------\n"
+    "    3     0  E >   ASSIGN                                                   !0, 'Hello, world'\n"
+    "    4     1        CONCAT                                           ~2      !0, '+'\n"
+    "          2        ECHO                                                     ~2\n"
+    "    5     3        INIT_FCALL                                               'strlen'\n"
+    "          4        SEND_VAR                                                 !0\n"
+    "    6     5      > RETURN                                                   1\n"
+    "\n\n";
+
+// --- Cases ---
+
+static bool kage_bench_setup_random(kage_bench_arg *arg, size_t size) {
+    arg->input = kage_bench_random(size);
+    return true;
+}
+
+static bool kage_bench_setup_encoded(kage_bench_arg *arg, size_t size) {
+    size_t length;
+    zend_string *raw = kage_bench_random(size);
+    char *encoded = kage_base64_encode((unsigned char*)ZSTR_VAL(raw), size, &length);
+    zend_string_release(raw);
+    if (!encoded) {
+        return false;
+    }
+    arg->prepared = zend_string_init(encoded, length, 0);
+    efree(encoded);
+    return true;
+}
+
+static bool kage_bench_setup_encrypted(kage_bench_arg *arg, size_t size) {
+    zval data, encrypted;
+    ZVAL_STR(&data, kage_bench_random(size));
+    int status = kage_internal_encrypt(&encrypted, &data, arg->key);
+    zval_ptr_dtor(&data);
+    if (status != SUCCESS) {
+        return false;
+    }
+    arg->prepared = Z_STR(encrypted);
+    return true;
+}
+
+static bool kage_bench_setup_package(kage_bench_arg *arg, size_t size) {
+    zend_string *source = kage_bench_repeat("<?php\n", "$kage = 'The quick brown fox';\n", size);
+    arg->package = kage_create_php_package(ZSTR_VAL(source), ZSTR_LEN(source));
+    zend_string_release(source);
+    return arg->package != NULL;
+}
+
+static bool kage_bench_setup_serialized(kage_bench_arg *arg, size_t size) {
+    if (!kage_bench_setup_package(arg, size)) {
+        return false;
+    }
+    char *serialized = kage_serialize_php_package(arg->package);
+    if (!serialized) {
+        return false;
+    }
+    arg->prepared = zend_string_init(serialized, strlen(serialized), 0);
+    efree(serialized);
+    return true;
+}
+
+static bool kage_bench_setup_vld(kage_bench_arg *arg, size_t size) {
+    arg->input = kage_bench_repeat("filename:       /in/bench.php\n", kage_bench_vld_function, size);
+    return true;
+}
+
+static bool kage_bench_setup_source(kage_bench_arg *arg, size_t size) {
+    arg->input = kage_bench_repeat("", "encrypt \"The quick brown fox\"\ndecrypt encrypt \"x\" ", size);
+    return true;
+}
+
+static bool kage_bench_setup_ast(kage_bench_arg *arg, size_t size) {
+    kage_bench_setup_source(arg, size);
+    arg->ast = kage_ast_parse_ex(ZSTR_VAL(arg->input), ZSTR_LEN(arg->input));
+    return arg->ast != NULL;
+}
+
+// Literals only, so the run measures dispatch rather than libsodium
+static bool kage_bench_setup_program(kage_bench_arg *arg, size_t size) {
+    arg->input = kage_bench_repeat("", "\"The quick brown fox\" ", size);
+    arg->ast = kage_ast_parse_ex(ZSTR_VAL(arg->input), ZSTR_LEN(arg->input));
+    if (!arg->ast) {
+        return false;
+    }
+    arg->program = kage_ast_compile(arg->ast);
+    return arg->program != NULL;
+}
+
+// Mostly ASCII with two- and three-byte characters, like real source
+static bool kage_bench_setup_text(kage_bench_arg *arg, size_t size) {
+    arg->input = kage_bench_repeat("", "echo 'Gr\xc3\xbc\xc3\x9f" "e, \xe2\x82\xac" "5';\n", size);
+    return true;
+}
+
+// One registration per 64 bytes of "input", released in one scope cleanup
+static bool kage_bench_setup_count(kage_bench_arg *arg, size_t size) {
+    arg->size = size;
+    return true;
+}
+
+static void kage_bench_scope_cleanup(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    kage_scope *scope = kage_scope_create(NULL);
+    for (size_t i = 0; i < arg->size / 64; i++) {
+        kage_scope_register_buffer(scope, emalloc(16));
+    }
+    kage_scope_destroy(scope);
+}
+
+static void kage_bench_validate(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    kage_validate_bytes(ZSTR_VAL(arg->input), ZSTR_LEN(arg->input), KAGE_CHECK_UTF8 | KAGE_CHECK_NO_CONTROL);
+}
+
+static void kage_bench_base64_encode(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    size_t length;
+    efree(kage_base64_encode((unsigned char*)ZSTR_VAL(arg->input), ZSTR_LEN(arg->input), &length));
+}
+
+static void kage_bench_base64_decode(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    size_t length;
+    efree(kage_base64_decode(ZSTR_VAL(arg->prepared), ZSTR_LEN(arg->prepared), &length));
+}
+
+static void kage_bench_encrypt(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    zval data, result;
+    ZVAL_STR(&data, arg->input);
+    if (kage_internal_encrypt(&result, &data, arg->key) == SUCCESS) {
+        zval_ptr_dtor(&result);
+    }
+}
+
+static void kage_bench_decrypt(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    zval data, result;
+    ZVAL_STR(&data, arg->prepared);
+    if (kage_internal_decrypt(&result, &data, arg->key) == SUCCESS) {
+        zval_ptr_dtor(&result);
+    }
+}
+
+static void kage_bench_package_serialize(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    efree(kage_serialize_php_package(arg->package));
+}
+
+static void kage_bench_package_unserialize(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    kage_free_php_package(kage_unserialize_php_package(ZSTR_VAL(arg->prepared)));
+}
+
+static void kage_bench_vld_parse(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    kage_free_bytecode_info(kage_parse_vld_output(ZSTR_VAL(arg->input), ZSTR_LEN(arg->input)));
+}
+
+static void kage_bench_ast_parse(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    kage_ast_free(kage_ast_parse_ex(ZSTR_VAL(arg->input), ZSTR_LEN(arg->input)));
+}
+
+static void kage_bench_lower(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    kage_compiled_program_free(kage_ast_compile(arg->ast));
+}
+
+static void kage_bench_vm_execute(void *ptr) {
+    kage_bench_arg *arg = ptr;
+    zval result;
+    if (kage_compiled_program_execute(arg->program, arg->key, &result) == SUCCESS) {
+        zval_ptr_dtor(&result);
+    }
+}
+
+// Package creation compiles the source with the engine, which keeps every
+// opcode of a multi-megabyte script in memory twice; 16 MB is plenty
+static const kage_bench_case kage_bench_cases[] = {
+    {"base64_encode",       KAGE_BENCH_MAX_SIZE,      kage_bench_setup_random,     kage_bench_base64_encode},
+    {"base64_decode",       KAGE_BENCH_MAX_SIZE,      kage_bench_setup_encoded,    kage_bench_base64_decode},
+    {"encrypt",             KAGE_BENCH_MAX_SIZE,      kage_bench_setup_random,     kage_bench_encrypt},
+    {"decrypt",             KAGE_BENCH_MAX_SIZE,      kage_bench_setup_encrypted,  kage_bench_decrypt},
+    {"package_serialize",   16 * 1024 * 1024,         kage_bench_setup_package,    kage_bench_package_serialize},
+    {"package_unserialize", 16 * 1024 * 1024,         kage_bench_setup_serialized, kage_bench_package_unserialize},
+    {"vld_parse",           KAGE_BENCH_MAX_SIZE,      kage_bench_setup_vld,        kage_bench_vld_parse},
+    {"ast_parse",           KAGE_BENCH_MAX_SIZE,      kage_bench_setup_source,     kage_bench_ast_parse},
+    {"lower",               KAGE_BENCH_MAX_SIZE,      kage_bench_setup_ast,        kage_bench_lower},
+    {"vm_execute",          KAGE_BENCH_MAX_SIZE,      kage_bench_setup_program,    kage_bench_vm_execute},
+    {"scope_cleanup",       KAGE_BENCH_MAX_SIZE,      kage_bench_setup_count,      kage_bench_scope_cleanup},
+    {"validate",            KAGE_BENCH_MAX_SIZE,      kage_bench_setup_text,       kage_bench_validate},
+};
+
+static void kage_bench_teardown(kage_bench_arg *arg) {
+    if (arg->input) {
+        zend_string_release(arg->input);
+    }
+    if (arg->prepared) {
+        zend_string_release(arg->prepared);
+    }
+    if (arg->package) {
+        kage_free_php_package(arg->package);
+    }
+    if (arg->program) {
+        kage_compiled_program_free(arg->program);
+    }
+    if (arg->ast) {
+        kage_ast_free(arg->ast);
+    }
+}
+
+static size_t kage_bench_size_option(const char *value) {
+    char *end;
+    unsigned long long size = strtoull(value, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': size <<= 10; break;
+        case 'm': case 'M': size <<= 20; break;
+    }
+    return (size_t)size;
+}
+
+// Starts the engine with the extension registered, as if it were loaded
+// from php.ini, so GINIT, MINIT and RINIT run before the benchmarks
+static int kage_bench_startup(sapi_module_struct *sapi_module) {
+#if PHP_VERSION_ID >= 80200
+    return php_module_startup(sapi_module, &kage_module_entry);
+#else
+    return php_module_startup(sapi_module, &kage_module_entry, 1);
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        {"json",     no_argument,       NULL, 'j'},
+        {"filter",   required_argument, NULL, 'f'},
+        {"min-size", required_argument, NULL, 's'},
+        {"max-size", required_argument, NULL, 'S'},
+        {"min-time", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    bool json = false;
+    const char *filter = NULL;
+    size_t min_size = KAGE_BENCH_MIN_SIZE;
+    size_t max_size = KAGE_BENCH_MAX_SIZE;
+    double min_time = 0.2;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'j': json = true; break;
+            case 'f': filter = optarg; break;
+            case 's': min_size = kage_bench_size_option(optarg); break;
+            case 'S': max_size = kage_bench_size_option(optarg); break;
+            case 't': min_time = strtod(optarg, NULL); break;
+            default:
+                fprintf(stderr, "Usage: %s [--json] [--filter=NAME] [--min-size=BYTES] [--max-size=BYTES] [--min-time=SECONDS]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    int status = 0;
+
+    php_embed_module.startup = kage_bench_startup;
+    PHP_EMBED_START_BLOCK(0, NULL)
+        // The largest inputs need several times 64 MB of request memory,
+        // past both memory_limit and the kage.max_memory budget
+        zend_string *name = zend_string_init("memory_limit", sizeof("memory_limit") - 1, 0);
+        zend_alter_ini_entry_chars(name, "-1", sizeof("-1") - 1, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
+        zend_string_release(name);
+        kage_memory_set_limit(0);
+
+        if (sodium_init() == -1) {
+            fprintf(stderr, "kage_bench: libsodium initialization failed\n");
+            status = 1;
+        } else {
+            kage_bench_arg arg = {0};
+            zend_string *key = kage_bench_random(crypto_secretbox_KEYBYTES);
+
+            for (size_t c = 0; c < sizeof(kage_bench_cases) / sizeof(kage_bench_cases[0]); c++) {
+                const kage_bench_case *bench = &kage_bench_cases[c];
+                if (filter && strstr(bench->name, filter) == NULL) {
+                    continue;
+                }
+
+                for (size_t size = KAGE_BENCH_MIN_SIZE; size <= max_size && size <= bench->max_size; size *= 4) {
+                    if (size < min_size) {
+                        continue;
+                    }
+
+                    memset(&arg, 0, sizeof(arg));
+                    arg.key = key;
+                    fprintf(stderr, "%s/%zu...\n", bench->name, size);
+
+                    if (bench->setup(&arg, size)) {
+                        kage_test_benchmark(bench->name, size, bench->run, &arg, min_time);
+                    } else {
+                        fprintf(stderr, "kage_bench: setup of %s/%zu failed\n", bench->name, size);
+                        status = 1;
+                    }
+                    kage_bench_teardown(&arg);
+                }
+            }
+
+            zend_string_release(key);
+
+            if (json) {
+                kage_test_write_benchmarks_json(stdout);
+            } else {
+                kage_test_print_benchmarks();
+            }
+            kage_test_free_benchmarks();
+        }
+    PHP_EMBED_END_BLOCK()
+
+    return status;
+}
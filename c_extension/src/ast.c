@@ -2,13 +2,15 @@
  * Kage AST (Abstract Syntax Tree) Parser and Bytecode Generator
  *
  * This module provides comprehensive AST parsing and bytecode generation
- * for the Kage PHP encryption language. It implements a recursive descent
- * parser with proper error handling and memory management.
+ * for the Kage PHP encryption language. Parsing, lowering and freeing are
+ * all iterative, so C stack usage does not depend on the nesting depth or
+ * the number of statements in the input.
  *
  * Architecture:
  * - AST Node: Represents language constructs (strings, encrypt/decrypt operations)
- * - Parser: Converts source text to AST using recursive descent
- * - Bytecode Generator: Converts AST to VM instructions
+ * - Lexer: Classifies the source in 64-byte blocks into token bitmasks (lexer.c)
+ * - Parser: Converts the token stream to AST, one unary chain per statement
+ * - Bytecode Generator: Converts AST to VM instructions in a growable buffer
  *
  * Key Features:
  * - Memory-safe parsing with automatic cleanup
@@ -28,14 +30,27 @@
 #include "vm.h"
 #include "crypto.h"
 #include "kage_memory.h"
+#include "kage_stats.h"
+#include "kage_probes.h"
+#include "kage_config.h"
 #include <stddef.h> /* For ptrdiff_t */
 #include <stdbool.h> /* For bool and true */
 #include <math.h> /* For fmin */
-#include <ctype.h> /* For isspace */
+#include "zend_smart_str.h"
 
 /* Internal constants */
 #define KAGE_PARSER_MAX_ERROR_LENGTH 256
-#define KAGE_PARSER_DEFAULT_STACK_SIZE 100
+#define KAGE_BYTECODE_INITIAL_CAPACITY 64 /* instructions before first growth */
+#define KAGE_AST_POOL_FIRST_CHUNK (64 * sizeof(kage_ast_node)) /* first pool chunk, doubling after */
+#define KAGE_COMPILED_POOL_FIRST_CHUNK (KAGE_BYTECODE_INITIAL_CAPACITY * sizeof(kage_instruction) + 64)
+
+/* Growable instruction buffer used while lowering */
+typedef struct {
+    kage_instruction *instructions;
+    size_t count;
+    size_t capacity;
+    kage_memory_pool *pool;  /* grow in this pool instead of the heap, if set */
+} kage_bytecode_buffer;
 
 /* Error codes for consistent error handling */
 typedef enum {
@@ -48,39 +63,51 @@ typedef enum {
 } kage_parser_error_t;
 
 /* Forward declarations for internal functions */
-static kage_parser_error_t validate_parser_state(const kage_ast_parser *parser);
 static void report_parser_error(kage_parser_error_t error, size_t position, const char *context);
-static bool skip_whitespace(kage_ast_parser *parser);
-static kage_ast_node* parse_string_internal(kage_ast_parser *parser, kage_parser_error_t *error);
-static kage_ast_node* parse_expression(kage_ast_parser *parser, kage_scope *scope);
-static kage_ast_node* parse_encrypt_operation(kage_ast_parser *parser, kage_parser_error_t *error);
-static kage_ast_node* parse_decrypt_operation(kage_ast_parser *parser, kage_parser_error_t *error);
-static int add_instruction(kage_vm_state *state, kage_opcode opcode, zval *operand);
-static int convert_string_node(kage_ast_node *node, kage_vm_state *state);
-static int convert_encrypt_node(kage_ast_node *node, kage_vm_state *state);
-static int convert_decrypt_node(kage_ast_node *node, kage_vm_state *state);
-static int convert_program_node(kage_ast_node *node, kage_vm_state *state);
-static int ast_to_bytecode(kage_ast_node *node, kage_vm_state *state);
+static kage_ast_node* parse_string_internal(kage_ast_parser *parser, const kage_token *token);
+static kage_ast_node* parse_expression(kage_ast_parser *parser, const kage_token *first);
+static kage_instruction* reserve_instructions(kage_bytecode_buffer *buffer, size_t count);
+static int convert_expression(kage_ast_node *node, kage_bytecode_buffer *buffer);
+static int convert_program_node(kage_ast_node *node, kage_bytecode_buffer *buffer);
+static int ast_to_bytecode(kage_ast_node *node, kage_bytecode_buffer *buffer);
+
+/**
+ * Releases the value held by a node.
+ *
+ * @param object The node, as passed by kage_memory_pool_walk()
+ */
+static void kage_ast_node_dtor(void *object) {
+    zval_ptr_dtor(&((kage_ast_node *)object)->value);
+}
+
+/**
+ * Releases every node value in one linear sweep, then the pool.
+ *
+ * @param pool The node pool to destroy
+ */
+static void kage_ast_pool_destroy(kage_memory_pool *pool) {
+    kage_memory_pool_walk(pool, sizeof(kage_ast_node), kage_ast_node_dtor);
+    kage_memory_pool_destroy(pool);
+}
 
 /**
  * Creates a new AST node with proper initialization.
+ * Nodes are bump-allocated from the parser's pool and are never
+ * freed individually.
  *
+ * @param pool The pool to allocate from
  * @param type The AST node type to create
- * @return Pointer to the new node, or NULL on allocation failure
+ * @return Pointer to the new node, or NULL on invalid type
  */
-static kage_ast_node* kage_ast_node_create(kage_ast_type type) {
+static kage_ast_node* kage_ast_node_create(kage_memory_pool *pool, kage_ast_type type) {
     /* Validate input */
     if (type < KAGE_AST_PROGRAM || type > KAGE_AST_CALL) {
         zend_error(E_WARNING, "Kage AST: Invalid node type %d", type);
         return NULL;
     }
 
-    /* Allocate and initialize node */
-    kage_ast_node *node = (kage_ast_node *)emalloc(sizeof(kage_ast_node));
-    if (node == NULL) {
-        zend_error(E_WARNING, "Kage AST: Memory allocation failed for AST node");
-        return NULL;
-    }
+    /* Same-size allocations only, so kage_ast_pool_destroy() can walk them */
+    kage_ast_node *node = (kage_ast_node *)kage_memory_pool_alloc(pool, sizeof(kage_ast_node));
 
     /* Initialize all fields to prevent undefined behavior */
     node->type = type;
@@ -92,25 +119,6 @@ static kage_ast_node* kage_ast_node_create(kage_ast_type type) {
     return node;
 }
 
-/**
- * Validates parser state before operations.
- *
- * @param parser The parser to validate
- * @return Error code indicating validation result
- */
-static kage_parser_error_t validate_parser_state(const kage_ast_parser *parser) {
-    if (parser == NULL) {
-        return KAGE_PARSER_ERROR_NULL_POINTER;
-    }
-    if (parser->source == NULL) {
-        return KAGE_PARSER_ERROR_NULL_POINTER;
-    }
-    if (parser->position > parser->length) {
-        return KAGE_PARSER_ERROR_SYNTAX_ERROR;
-    }
-    return KAGE_PARSER_SUCCESS;
-}
-
 /**
  * Reports parser errors with consistent formatting.
  *
@@ -149,273 +157,202 @@ static void report_parser_error(kage_parser_error_t error, size_t position, cons
 }
 
 /**
- * Skips whitespace characters in the parser input.
+ * Frees a whole AST. The program root returned by kage_ast_parse() owns
+ * the memory pool of every node in the tree (kept in its value as a pointer),
+ * so the tree is released in bulk without walking it.
+ * Passing any other node is a no-op.
  *
- * @param parser The parser instance
- * @return true if whitespace was found and skipped, false otherwise
- */
-static bool skip_whitespace(kage_ast_parser *parser) {
-    bool skipped = false;
-    while (parser->position < parser->length &&
-           isspace((unsigned char)parser->source[parser->position])) {
-        parser->position++;
-        skipped = true;
-    }
-    return skipped;
-}
-
-/**
- * Frees an AST node and all its children recursively.
- * Uses post-order traversal to ensure safe cleanup.
- *
- * @param node The root node to free
+ * @param node The program root to free
  */
 PHPAPI void kage_ast_free(kage_ast_node *node) {
-    if (node == NULL) {
+    if (node == NULL || node->type != KAGE_AST_PROGRAM || Z_TYPE(node->value) != IS_PTR) {
         return;
     }
 
-    /* Recursively free children first (post-order traversal) */
-    kage_ast_free(node->left);
-    kage_ast_free(node->right);
-    kage_ast_free(node->next);
-
-    /* Clean up node value and free node itself */
-    zval_ptr_dtor(&node->value);
-    efree(node);
+    kage_ast_pool_destroy((kage_memory_pool *)Z_PTR(node->value));
 }
 
 /**
- * Internal string parsing implementation with detailed error handling.
+ * Returns the value of a hexadecimal digit, or -1.
  *
- * @param parser The parser instance
- * @param error Pointer to store error code
- * @return Parsed AST node or NULL on error
+ * @param c The character to convert
+ * @return Digit value 0-15, or -1 if c is not a hex digit
  */
-static kage_ast_node* parse_string_internal(kage_ast_parser *parser, kage_parser_error_t *error) {
-    *error = validate_parser_state(parser);
-    if (*error != KAGE_PARSER_SUCCESS) {
-        return NULL;
+static int hex_digit_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
     }
-
-    /* Create string node */
-    kage_ast_node *node = kage_ast_node_create(KAGE_AST_STRING);
-    if (node == NULL) {
-        *error = KAGE_PARSER_ERROR_MEMORY_ALLOCATION;
-        return NULL;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
     }
-
-    /* Skip opening quote */
-    parser->position++;
-
-    /* Validate we have content after opening quote */
-    if (parser->position >= parser->length) {
-        *error = KAGE_PARSER_ERROR_UNCLOSED_STRING;
-        kage_ast_free(node);
-        return NULL;
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
     }
-
-    /* Find closing quote */
-    const char *start = parser->source + parser->position;
-    const char *end = (const char *)memchr(start, '"', parser->length - parser->position);
-
-    if (end == NULL) {
-        report_parser_error(KAGE_PARSER_ERROR_UNCLOSED_STRING, parser->position - 1, NULL);
-        kage_ast_free(node);
-        parser->position = parser->length; /* Prevent infinite loops */
-        *error = KAGE_PARSER_ERROR_UNCLOSED_STRING;
-        return NULL;
-    }
-
-    /* Extract and validate string content */
-    size_t len = (size_t)(end - start);
-    if (len == 0) {
-        /* Empty string is valid */
-        ZVAL_EMPTY_STRING(&node->value);
-    } else {
-        char *str = (char *)estrndup(start, len);
-        if (str == NULL) {
-            kage_ast_free(node);
-            *error = KAGE_PARSER_ERROR_MEMORY_ALLOCATION;
-            return NULL;
-        }
-        ZVAL_STRING(&node->value, str);
-        efree(str);
-    }
-
-    /* Update parser position */
-    parser->position += len + 1;
-    *error = KAGE_PARSER_SUCCESS;
-    return node;
+    return -1;
 }
 
-
 /**
- * Parses an encrypt operation with its operand.
+ * Decodes the body of a string literal that contains escape sequences.
+ * Runs between escapes are appended in one piece. Supported escapes:
+ * \" \\ \n \r \t \0 and \xHH; any other backslash is kept literally,
+ * as in PHP.
  *
- * @param parser The parser instance
- * @param error Pointer to store error code
- * @return Parsed encrypt node or NULL on error
+ * @param start Start of the literal body
+ * @param escape First backslash in the body
+ * @param end End of the body (the closing quote)
+ * @param value Receives the decoded string
  */
-static kage_ast_node* parse_encrypt_operation(kage_ast_parser *parser, kage_parser_error_t *error) {
-    *error = validate_parser_state(parser);
-    if (*error != KAGE_PARSER_SUCCESS) {
-        return NULL;
-    }
+static void decode_escaped_string(const char *start, const char *escape, const char *end, zval *value) {
+    const char *cursor = escape;
+    smart_str buf = {0};
 
-    /* Create encrypt node */
-    kage_ast_node *node = kage_ast_node_create(KAGE_AST_ENCRYPT);
-    if (node == NULL) {
-        *error = KAGE_PARSER_ERROR_MEMORY_ALLOCATION;
-        return NULL;
-    }
-
-    /* Consume "encrypt" keyword */
-    parser->position += 7;
+    /* Copy the escape-free prefix */
+    smart_str_appendl(&buf, start, escape - start);
 
-    /* Skip whitespace after keyword */
-    skip_whitespace(parser);
+    while (cursor < end) {
+        const char *run = cursor;
+        while (cursor < end && *cursor != '\\') {
+            cursor++;
+        }
+        smart_str_appendl(&buf, run, cursor - run);
 
-    /* Validate we have an operand */
-    if (parser->position >= parser->length) {
-        report_parser_error(KAGE_PARSER_ERROR_SYNTAX_ERROR, parser->position, "missing operand for encrypt");
-        kage_ast_free(node);
-        *error = KAGE_PARSER_ERROR_SYNTAX_ERROR;
-        return NULL;
-    }
+        /* The lexer guarantees a backslash is never the last byte */
+        if (cursor == end) {
+            break;
+        }
 
-    /* Parse operand (can be nested) */
-    node->left = parse_expression(parser, NULL); // No scope needed for sub-expressions
-    if (node->left == NULL) {
-        kage_ast_free(node);
-        *error = KAGE_PARSER_ERROR_SYNTAX_ERROR;
-        return NULL;
+        /* Backslash: decode one escape sequence */
+        cursor++;
+        switch (*cursor) {
+            case '"':  smart_str_appendc(&buf, '"');  cursor++; break;
+            case '\\': smart_str_appendc(&buf, '\\'); cursor++; break;
+            case 'n':  smart_str_appendc(&buf, '\n'); cursor++; break;
+            case 'r':  smart_str_appendc(&buf, '\r'); cursor++; break;
+            case 't':  smart_str_appendc(&buf, '\t'); cursor++; break;
+            case '0':  smart_str_appendc(&buf, '\0'); cursor++; break;
+            case 'x': {
+                int hi = cursor + 1 < end ? hex_digit_value(cursor[1]) : -1;
+                int lo = cursor + 2 < end ? hex_digit_value(cursor[2]) : -1;
+                if (hi >= 0 && lo >= 0) {
+                    smart_str_appendc(&buf, (char)((hi << 4) | lo));
+                    cursor += 3;
+                } else {
+                    smart_str_appendc(&buf, '\\');
+                }
+                break;
+            }
+            default:
+                /* Unknown escape: keep the backslash, the character follows as text */
+                smart_str_appendc(&buf, '\\');
+                break;
+        }
     }
 
-    *error = KAGE_PARSER_SUCCESS;
-    return node;
+    ZVAL_STR(value, smart_str_extract(&buf));
 }
 
 /**
- * Parses a decrypt operation with its operand.
+ * Builds a string node from a STRING token.
+ * Literals without escapes are created straight from the source buffer
+ * with a single allocation (none for empty and one-byte literals, which
+ * use the interned strings); only literals with escapes are decoded.
  *
  * @param parser The parser instance
- * @param error Pointer to store error code
- * @return Parsed decrypt node or NULL on error
+ * @param token The STRING token
+ * @return String node, or NULL on error
  */
-static kage_ast_node* parse_decrypt_operation(kage_ast_parser *parser, kage_parser_error_t *error) {
-    *error = validate_parser_state(parser);
-    if (*error != KAGE_PARSER_SUCCESS) {
-        return NULL;
-    }
-
-    /* Create decrypt node */
-    kage_ast_node *node = kage_ast_node_create(KAGE_AST_DECRYPT);
+static kage_ast_node* parse_string_internal(kage_ast_parser *parser, const kage_token *token) {
+    /* Create string node */
+    kage_ast_node *node = kage_ast_node_create(parser->pool, KAGE_AST_STRING);
     if (node == NULL) {
-        *error = KAGE_PARSER_ERROR_MEMORY_ALLOCATION;
         return NULL;
     }
 
-    /* Consume "decrypt" keyword */
-    parser->position += 7;
-
-    /* Skip whitespace after keyword */
-    skip_whitespace(parser);
-
-    /* Validate we have an operand */
-    if (parser->position >= parser->length) {
-        report_parser_error(KAGE_PARSER_ERROR_SYNTAX_ERROR, parser->position, "missing operand for decrypt");
-        kage_ast_free(node);
-        *error = KAGE_PARSER_ERROR_SYNTAX_ERROR;
-        return NULL;
-    }
+    const char *start = parser->source + token->start;
 
-    /* Parse operand (can be nested) */
-    node->left = parse_expression(parser, NULL); // No scope needed for sub-expressions
-    if (node->left == NULL) {
-        kage_ast_free(node);
-        *error = KAGE_PARSER_ERROR_SYNTAX_ERROR;
-        return NULL;
+    if (token->escape != SIZE_MAX) {
+        /* Slow path: decode escapes from the first backslash on */
+        decode_escaped_string(start, parser->source + token->escape, start + token->length, &node->value);
+    } else if (token->length == 0) {
+        ZVAL_EMPTY_STRING(&node->value);
+    } else if (token->length == 1) {
+        ZVAL_CHAR(&node->value, (unsigned char)*start);
+    } else {
+        ZVAL_STRINGL(&node->value, start, token->length);
     }
 
-    *error = KAGE_PARSER_SUCCESS;
     return node;
 }
 
 /**
- * Parses a complete expression from the input stream.
- * This is the main expression parser that handles all expression types.
- * Uses memory scope for automatic cleanup.
+ * Parses a complete expression starting at the given token.
+ * An expression is a chain of encrypt/decrypt operations ending in a
+ * string literal. The chain is built in a loop by threading a pointer to
+ * the slot that receives the next operand, so arbitrarily deep nesting
+ * uses constant C stack. Nodes come from the parser's pool, so nothing
+ * needs to be released here when parsing fails.
  *
  * @param parser The parser instance
- * @param scope Memory scope for automatic resource management
+ * @param first The first token of the expression (not EOF)
  * @return Parsed expression node or NULL on error
  */
-static kage_ast_node* parse_expression(kage_ast_parser *parser, kage_scope *scope) {
-    kage_parser_error_t error;
-
-    /* Validate parser state */
-    error = validate_parser_state(parser);
-    if (error != KAGE_PARSER_SUCCESS) {
-        report_parser_error(error, parser->position, "invalid parser state");
-        return NULL;
-    }
-
-    /* Skip leading whitespace */
-    skip_whitespace(parser);
-
-    /* Check for end of input */
-    if (parser->position >= parser->length) {
-        return NULL;
-    }
-
-    /* Dispatch to appropriate parser based on next token */
-    char current_char = parser->source[parser->position];
-
-    if (current_char == '"') {
-        /* String literal */
-        kage_ast_node *node = parse_string_internal(parser, &error);
-        if (node && scope) {
-            kage_scope_register_ast_node(scope, node);
-        }
-        return node;
-    }
-    else if (parser->position + 6 < parser->length &&
-             strncmp(parser->source + parser->position, "encrypt", 7) == 0) {
-        /* Encrypt operation */
-        kage_ast_node *node = parse_encrypt_operation(parser, &error);
-        if (node && scope) {
-            kage_scope_register_ast_node(scope, node);
-        }
-        return node;
-    }
-    else if (parser->position + 6 < parser->length &&
-             strncmp(parser->source + parser->position, "decrypt", 7) == 0) {
-        /* Decrypt operation */
-        kage_ast_node *node = parse_decrypt_operation(parser, &error);
-        if (node && scope) {
-            kage_scope_register_ast_node(scope, node);
-        }
-        return node;
-    }
-    else {
-        /* Invalid token */
-        report_parser_error(KAGE_PARSER_ERROR_INVALID_TOKEN, parser->position,
-                           "expected string, 'encrypt', or 'decrypt'");
-        /* Skip invalid token to prevent infinite loops */
-        while (parser->position < parser->length &&
-               !isspace((unsigned char)parser->source[parser->position]) &&
-               parser->source[parser->position] != '"') {
-            parser->position++;
+static kage_ast_node* parse_expression(kage_ast_parser *parser, const kage_token *first) {
+    kage_ast_node *root = NULL;
+    kage_ast_node **slot = &root;
+    kage_token token = *first;
+    kage_ast_type operation = KAGE_AST_PROGRAM;
+
+    for (;;) {
+        kage_ast_node *node;
+
+        switch (token.type) {
+            case KAGE_TOKEN_STRING:
+                /* String literal terminates the chain */
+                node = parse_string_internal(parser, &token);
+                if (node == NULL) {
+                    return NULL;
+                }
+                *slot = node;
+                return root;
+
+            case KAGE_TOKEN_ENCRYPT:
+            case KAGE_TOKEN_DECRYPT:
+                operation = token.type == KAGE_TOKEN_ENCRYPT ? KAGE_AST_ENCRYPT : KAGE_AST_DECRYPT;
+                node = kage_ast_node_create(parser->pool, operation);
+                if (node == NULL) {
+                    return NULL;
+                }
+                /* The operand of this operation is parsed on the next iteration */
+                *slot = node;
+                slot = &node->left;
+                break;
+
+            case KAGE_TOKEN_UNCLOSED_STRING:
+                report_parser_error(KAGE_PARSER_ERROR_UNCLOSED_STRING, token.start, NULL);
+                return NULL;
+
+            case KAGE_TOKEN_EOF:
+                /* Only reachable after a keyword */
+                report_parser_error(KAGE_PARSER_ERROR_SYNTAX_ERROR, token.start,
+                                   operation == KAGE_AST_ENCRYPT ? "missing operand for encrypt" : "missing operand for decrypt");
+                return NULL;
+
+            default:
+                report_parser_error(KAGE_PARSER_ERROR_INVALID_TOKEN, token.start,
+                                   "expected string, 'encrypt', or 'decrypt'");
+                return NULL;
         }
-        return NULL;
+
+        kage_lexer_next(&parser->lexer, &token);
     }
 }
 
 /**
  * Parses source code into an Abstract Syntax Tree (AST).
  * This is the main entry point for parsing Kage language source code.
- * Uses memory scope for automatic resource management.
+ * Tokens are pulled from the block-classifying lexer (see lexer.h), and
+ * all nodes are bump-allocated from a memory pool owned by the returned
+ * program root; kage_ast_free() on the root releases them in bulk.
  *
  * The parser supports:
  * - String literals: "hello world"
@@ -423,191 +360,187 @@ static kage_ast_node* parse_expression(kage_ast_parser *parser, kage_scope *scop
  * - Decrypt operations: decrypt "encrypted_data"
  * - Nested operations: encrypt decrypt "data"
  *
- * @param source The source code string to parse
+ * String literals support the escapes \" \\ \n \r \t \0 and \xHH.
+ * The source does not need to be NUL-terminated.
+ *
+ * @param source The source code buffer to parse
+ * @param source_length Length of the source in bytes
  * @return Root AST node on success, NULL on error (errors are logged)
  */
-PHPAPI kage_ast_node* kage_ast_parse(const char *source) {
+static kage_ast_node* kage_ast_parse_source(const char *source, size_t source_length) {
     /* Input validation */
     if (source == NULL) {
         zend_error(E_WARNING, "Kage AST: Cannot parse NULL source");
         return NULL;
     }
 
-    size_t source_length = strlen(source);
     if (source_length == 0) {
         zend_error(E_WARNING, "Kage AST: Cannot parse empty source");
         return NULL;
     }
 
-    /* Create memory scope for automatic cleanup */
-    kage_scope *scope = kage_scope_create(NULL);
-    if (!scope) {
-        return NULL;
-    }
-
-    /* Initialize parser */
+    /* Initialize parser with a fresh node pool */
     kage_ast_parser parser = {
         .source = source,
-        .position = 0,
         .length = source_length,
+        .pool = kage_memory_pool_create(KAGE_AST_POOL_FIRST_CHUNK, KAGE_MEMORY_TAG_AST),
         .error_handling = {0}
     };
+    kage_lexer_init(&parser.lexer, source, source_length);
 
-    /* Create program root node */
-    KAGE_SCOPE_ALLOC_AST_NODE(scope, program);
-    if (!program) {
-        kage_scope_destroy(scope);
-        return NULL; /* Error already logged */
-    }
-    program->type = KAGE_AST_PROGRAM;
+    /* Create program root node; it is the first node in the pool and owns it */
+    kage_ast_node *program = kage_ast_node_create(parser.pool, KAGE_AST_PROGRAM);
+    ZVAL_PTR(&program->value, parser.pool);
 
     kage_ast_node *current = program;
-    bool found_expression = false;
+    kage_token token;
 
     /* Parse expressions until end of input */
-    while (parser.position < parser.length) {
-        /* Skip whitespace between expressions */
-        skip_whitespace(&parser);
-        if (parser.position >= parser.length) {
-            break;
-        }
-
-        /* Parse next expression */
-        kage_ast_node *expr = parse_expression(&parser, scope);
+    for (kage_lexer_next(&parser.lexer, &token);
+         token.type != KAGE_TOKEN_EOF;
+         kage_lexer_next(&parser.lexer, &token)) {
+        kage_ast_node *expr = parse_expression(&parser, &token);
         if (expr == NULL) {
-            /* Parse error - scope will clean up automatically */
-            kage_scope_destroy(scope);
+            /* Parse error - drop everything parsed so far */
+            kage_ast_pool_destroy(parser.pool);
             return NULL;
         }
 
         /* Add expression to program */
         current->next = expr;
         current = expr;
-        found_expression = true;
     }
 
     /* Validate that we parsed at least one expression */
-    if (!found_expression) {
+    if (current == program) {
         zend_error(E_WARNING, "Kage AST: No valid expressions found in source");
-        kage_scope_destroy(scope);
+        kage_ast_pool_destroy(parser.pool);
         return NULL;
     }
 
-    /* Return the program node (scope will keep it alive) */
-    scope->cleanup_on_exit = false; // Don't clean up the result
-    kage_scope_destroy(scope);
     return program;
-
-    /* Should not reach here */
-    return NULL;
 }
 
 /**
- * Adds an instruction to the VM state with bounds checking.
+ * Timed wrapper around kage_ast_parse_source(); see there.
  *
- * @param state The VM state
- * @param opcode The operation code
- * @param operand The operand value (can be NULL)
- * @return SUCCESS on success, FAILURE on error
+ * @param source The source code buffer to parse
+ * @param source_length Length of the source in bytes
+ * @return Root AST node on success, NULL on error (errors are logged)
  */
-static int add_instruction(kage_vm_state *state, kage_opcode opcode, zval *operand) {
-    if (state == NULL || state->instructions == NULL) {
-        return FAILURE;
-    }
-
-    /* Check bounds - this is a simple check, in production you'd want dynamic resizing */
-    if (state->instruction_count >= KAGE_PARSER_DEFAULT_STACK_SIZE) {
-        zend_error(E_WARNING, "Kage AST: Too many instructions generated");
-        return FAILURE;
-    }
-
-    kage_instruction *instr = &state->instructions[state->instruction_count++];
-    instr->opcode = opcode;
-
-    if (operand != NULL) {
-        ZVAL_COPY(&instr->operand, operand);
-    } else {
-        ZVAL_NULL(&instr->operand);
-    }
-
-    return SUCCESS;
+PHPAPI kage_ast_node* kage_ast_parse_ex(const char *source, size_t source_length) {
+    KAGE_PROBE1(parse__entry, source_length);
+    uint64_t started = kage_stats_now();
+    kage_ast_node *root = kage_ast_parse_source(source, source_length);
+    kage_stats_record(KAGE_STAT_PARSE, source_length, started, root != NULL);
+    KAGE_PROBE2(parse__return, source_length, root ? SUCCESS : FAILURE);
+    return root;
 }
 
 /**
- * Converts a string AST node to bytecode.
+ * Parses a NUL-terminated source string; see kage_ast_parse_ex().
  *
- * @param node The string node
- * @param state The VM state
- * @return SUCCESS on success, FAILURE on error
+ * @param source The source code string to parse
+ * @return Root AST node on success, NULL on error (errors are logged)
  */
-static int convert_string_node(kage_ast_node *node, kage_vm_state *state) {
-    if (node == NULL || state == NULL) {
-        return FAILURE;
+PHPAPI kage_ast_node* kage_ast_parse(const char *source) {
+    if (source == NULL) {
+        zend_error(E_WARNING, "Kage AST: Cannot parse NULL source");
+        return NULL;
     }
-    return add_instruction(state, KAGE_OP_PUSH, &node->value);
+    return kage_ast_parse_ex(source, strlen(source));
 }
 
 /**
- * Converts an encrypt AST node to bytecode.
+ * Reserves room for count more instructions, growing the buffer
+ * geometrically so lowering stays linear in the program size.
  *
- * @param node The encrypt node
- * @param state The VM state
- * @return SUCCESS on success, FAILURE on error
+ * @param buffer The instruction buffer
+ * @param count Number of instructions to append
+ * @return Pointer to the first reserved instruction
  */
-static int convert_encrypt_node(kage_ast_node *node, kage_vm_state *state) {
-    if (node == NULL || state == NULL || node->left == NULL) {
-        return FAILURE;
-    }
-
-    /* Convert operand first */
-    if (ast_to_bytecode(node->left, state) != SUCCESS) {
-        return FAILURE;
+static kage_instruction* reserve_instructions(kage_bytecode_buffer *buffer, size_t count) {
+    if (count > buffer->capacity - buffer->count) {
+        size_t capacity = buffer->capacity ? buffer->capacity : KAGE_BYTECODE_INITIAL_CAPACITY;
+        while (count > capacity - buffer->count) {
+            capacity *= 2;
+        }
+        if (buffer->pool) {
+            /* The buffer is the pool's latest allocation, so it grows in place */
+            buffer->instructions = (kage_instruction *)kage_memory_pool_realloc(buffer->pool, buffer->instructions,
+                buffer->capacity * sizeof(kage_instruction), zend_safe_address_guarded(capacity, sizeof(kage_instruction), 0));
+        } else {
+            buffer->instructions = (kage_instruction *)safe_erealloc(buffer->instructions, capacity, sizeof(kage_instruction), 0);
+        }
+        buffer->capacity = capacity;
     }
 
-    /* Add encrypt instruction */
-    return add_instruction(state, KAGE_OP_ENCRYPT, NULL);
+    kage_instruction *instr = &buffer->instructions[buffer->count];
+    buffer->count += count;
+    return instr;
 }
 
 /**
- * Converts a decrypt AST node to bytecode.
+ * Converts one expression (a chain of encrypt/decrypt operations ending
+ * in a string) to bytecode without recursion.
+ * The operand has to execute before the outermost operation, so the chain
+ * is measured first and the instructions are then filled in back to front
+ * while walking it from the outside in.
  *
- * @param node The decrypt node
- * @param state The VM state
+ * @param node The expression node
+ * @param buffer The instruction buffer
  * @return SUCCESS on success, FAILURE on error
  */
-static int convert_decrypt_node(kage_ast_node *node, kage_vm_state *state) {
-    if (node == NULL || state == NULL || node->left == NULL) {
+static int convert_expression(kage_ast_node *node, kage_bytecode_buffer *buffer) {
+    size_t depth = 0;
+    kage_ast_node *cursor = node;
+
+    /* Measure the chain and validate its shape */
+    while (cursor != NULL && cursor->type != KAGE_AST_STRING) {
+        if (cursor->type != KAGE_AST_ENCRYPT && cursor->type != KAGE_AST_DECRYPT) {
+            zend_error(E_WARNING, "Kage AST: Unknown AST node type: %d", cursor->type);
+            return FAILURE;
+        }
+        depth++;
+        cursor = cursor->left;
+    }
+    if (cursor == NULL) {
         return FAILURE;
     }
 
-    /* Convert operand first */
-    if (ast_to_bytecode(node->left, state) != SUCCESS) {
-        return FAILURE;
+    /* PUSH of the literal first, then operations from the inside out */
+    kage_instruction *instr = reserve_instructions(buffer, depth + 1);
+    instr[0].opcode = KAGE_OP_PUSH;
+    ZVAL_COPY(&instr[0].operand, &cursor->value);
+
+    for (cursor = node; depth > 0; cursor = cursor->left, depth--) {
+        instr[depth].opcode = cursor->type == KAGE_AST_ENCRYPT ? KAGE_OP_ENCRYPT : KAGE_OP_DECRYPT;
+        ZVAL_NULL(&instr[depth].operand);
     }
 
-    /* Add decrypt instruction */
-    return add_instruction(state, KAGE_OP_DECRYPT, NULL);
+    return SUCCESS;
 }
 
 /**
  * Converts a program AST node to bytecode.
+ * Statements are lowered in a loop; every statement but the last is
+ * followed by a POP, so the VM stack depth stays bounded no matter how
+ * many statements the program has and the last value is the result.
  *
  * @param node The program node
- * @param state The VM state
+ * @param buffer The instruction buffer
  * @return SUCCESS on success, FAILURE on error
  */
-static int convert_program_node(kage_ast_node *node, kage_vm_state *state) {
-    if (node == NULL || state == NULL) {
-        return FAILURE;
-    }
-
-    /* Process all statements in the program */
-    kage_ast_node *stmt = node->next;
-    while (stmt != NULL) {
-        if (ast_to_bytecode(stmt, state) != SUCCESS) {
+static int convert_program_node(kage_ast_node *node, kage_bytecode_buffer *buffer) {
+    for (kage_ast_node *stmt = node->next; stmt != NULL; stmt = stmt->next) {
+        if (convert_expression(stmt, buffer) != SUCCESS) {
             return FAILURE;
         }
-        stmt = stmt->next;
+        if (stmt->next != NULL) {
+            kage_instruction *instr = reserve_instructions(buffer, 1);
+            instr->opcode = KAGE_OP_POP;
+            ZVAL_NULL(&instr->operand);
+        }
     }
 
     return SUCCESS;
@@ -615,40 +548,26 @@ static int convert_program_node(kage_ast_node *node, kage_vm_state *state) {
 
 /**
  * Converts an AST node to bytecode instructions for VM execution.
- * This function dispatches to specialized handlers based on node type.
+ * This function dispatches on the root node type.
  *
  * @param node The AST node to convert
- * @param state The VM state to store generated instructions
+ * @param buffer The instruction buffer
  * @return SUCCESS on success, FAILURE on error
  */
-static int ast_to_bytecode(kage_ast_node *node, kage_vm_state *state) {
-    if (node == NULL || state == NULL) {
+static int ast_to_bytecode(kage_ast_node *node, kage_bytecode_buffer *buffer) {
+    if (node == NULL || buffer == NULL) {
         return FAILURE;
     }
 
-    /* Dispatch to appropriate conversion function based on node type */
-    switch (node->type) {
-        case KAGE_AST_STRING:
-            return convert_string_node(node, state);
-
-        case KAGE_AST_ENCRYPT:
-            return convert_encrypt_node(node, state);
-
-        case KAGE_AST_DECRYPT:
-            return convert_decrypt_node(node, state);
-
-        case KAGE_AST_PROGRAM:
-            return convert_program_node(node, state);
-
-        default:
-            zend_error(E_WARNING, "Kage AST: Unknown AST node type: %d", node->type);
-            return FAILURE;
+    if (node->type == KAGE_AST_PROGRAM) {
+        return convert_program_node(node, buffer);
     }
+    return convert_expression(node, buffer);
 }
 
 /**
  * Converts an AST to bytecode instructions for VM execution.
- * This function allocates instruction memory and performs the conversion.
+ * The instruction buffer grows as needed and is trimmed to size on success.
  *
  * @param node The root AST node to convert
  * @param state The VM state to populate with instructions
@@ -661,27 +580,193 @@ PHPAPI int kage_ast_to_bytecode(kage_ast_node *node, kage_vm_state *state) {
         return FAILURE;
     }
 
-    /* Allocate instruction buffer */
-    state->instructions = (kage_instruction *)emalloc(KAGE_PARSER_DEFAULT_STACK_SIZE * sizeof(kage_instruction));
-    if (state->instructions == NULL) {
-        zend_error(E_WARNING, "Kage AST: Failed to allocate instruction memory");
+    kage_bytecode_buffer buffer = {NULL, 0, 0, NULL};
+
+    /* Perform conversion */
+    if (ast_to_bytecode(node, &buffer) != SUCCESS || buffer.count == 0) {
+        for (size_t i = 0; i < buffer.count; i++) {
+            zval_ptr_dtor(&buffer.instructions[i].operand);
+        }
+        if (buffer.instructions) {
+            efree(buffer.instructions);
+        }
+        state->instructions = NULL;
+        state->instruction_count = 0;
         return FAILURE;
     }
 
-    /* Initialize instruction counter */
-    state->instruction_count = 0;
+    /* Hand the trimmed buffer over to the VM state */
+    if (buffer.count < buffer.capacity) {
+        buffer.instructions = (kage_instruction *)erealloc(buffer.instructions, buffer.count * sizeof(kage_instruction));
+    }
+    state->instructions = buffer.instructions;
+    state->instruction_count = buffer.count;
+    state->owns_instructions = true;
 
-    /* Perform conversion */
-    int result = ast_to_bytecode(node, state);
+    return SUCCESS;
+}
 
-    /* Clean up on failure */
-    if (result != SUCCESS) {
-        efree(state->instructions);
-        state->instructions = NULL;
-        state->instruction_count = 0;
+/**
+ * Folds ENCRYPT immediately followed by DECRYPT: with the same key the pair
+ * is an identity, so only the key length check has to survive.
+ * Compaction is done in place and handles cascades such as
+ * "decrypt decrypt encrypt encrypt ...".
+ *
+ * @param program The program to optimise
+ */
+static void optimize_program(kage_compiled_program *program) {
+    size_t write = 0;
+
+    for (size_t read = 0; read < program->instruction_count; read++) {
+        kage_instruction *instr = &program->instructions[read];
+
+        if (instr->opcode == KAGE_OP_DECRYPT && write > 0 &&
+            program->instructions[write - 1].opcode == KAGE_OP_ENCRYPT) {
+            /* Both instructions carry NULL operands, nothing to release */
+            write--;
+            program->requires_key_check = true;
+            continue;
+        }
+
+        if (write != read) {
+            program->instructions[write] = *instr;
+        }
+        write++;
+    }
+
+    program->instruction_count = write;
+}
+
+/**
+ * Lowers an AST into an optimised, reusable instruction buffer.
+ * The result does not depend on the key, so it can be cached for the
+ * lifetime of the AST and executed any number of times. The program and
+ * its instructions share one memory pool and are released together.
+ *
+ * @param node The root AST node to compile
+ * @return Compiled program, or NULL on error
+ */
+PHPAPI kage_compiled_program* kage_ast_compile(kage_ast_node *node) {
+    uint64_t started = kage_stats_now();
+
+    if (node == NULL) {
+        zend_error(E_WARNING, "Kage AST: Invalid parameters for bytecode conversion");
+        kage_stats_record(KAGE_STAT_LOWER, 0, started, false);
+        return NULL;
+    }
+
+    kage_memory_pool *pool = kage_memory_pool_create(KAGE_COMPILED_POOL_FIRST_CHUNK, KAGE_MEMORY_TAG_VM);
+    kage_compiled_program *program = kage_memory_pool_alloc(pool, sizeof(kage_compiled_program));
+
+    /* Allocated after the program, so the buffer grows in place */
+    kage_bytecode_buffer buffer = {NULL, 0, 0, pool};
+
+    if (ast_to_bytecode(node, &buffer) != SUCCESS || buffer.count == 0) {
+        for (size_t i = 0; i < buffer.count; i++) {
+            zval_ptr_dtor(&buffer.instructions[i].operand);
+        }
+        kage_memory_pool_destroy(pool);
+        kage_stats_record(KAGE_STAT_LOWER, 0, started, false);
+        return NULL;
+    }
+
+    program->instructions = buffer.instructions;
+    program->instruction_count = buffer.count;
+    program->requires_key_check = false;
+    program->local_count = 0;
+    program->pool = pool;
+
+    optimize_program(program);
+    kage_stats_record(KAGE_STAT_LOWER, 0, started, true);
+    return program;
+}
+
+/**
+ * Releases a compiled program and its instruction operands.
+ *
+ * @param program The program to free (may be NULL)
+ */
+PHPAPI void kage_compiled_program_free(kage_compiled_program *program) {
+    if (program == NULL) {
+        return;
     }
 
-    return result;
+    for (size_t i = 0; i < program->instruction_count; i++) {
+        zval_ptr_dtor(&program->instructions[i].operand);
+    }
+    if (program->pool) {
+        /* The program itself lives in the pool */
+        kage_memory_pool_destroy(program->pool);
+        return;
+    }
+    efree(program->instructions);
+    efree(program);
+}
+
+/**
+ * Releases the payload of a "Kage AST" resource.
+ *
+ * @param resource The resource payload to free (may be NULL)
+ */
+PHPAPI void kage_ast_resource_free(kage_ast_resource *resource) {
+    if (resource == NULL) {
+        return;
+    }
+
+    kage_compiled_program_free(resource->program);
+    kage_ast_free(resource->root);
+    efree(resource);
+}
+
+/**
+ * Returns the program behind a resource, lowering the tree on first use.
+ * Resources created by kage_vm_load() carry a program but no tree.
+ *
+ * @param resource The resource payload
+ * @return Cached program, or NULL on error
+ */
+PHPAPI kage_compiled_program* kage_ast_resource_program(kage_ast_resource *resource) {
+    if (resource == NULL) {
+        return NULL;
+    }
+
+    if (resource->program == NULL && resource->root != NULL) {
+        kage_stats_cache(KAGE_CACHE_PROGRAM, false);
+        resource->program = kage_ast_compile(resource->root);
+    } else {
+        kage_stats_cache(KAGE_CACHE_PROGRAM, resource->program != NULL);
+    }
+
+    return resource->program;
+}
+
+/**
+ * Runs a compiled program on a fresh VM that borrows its instructions.
+ *
+ * @param program The program to run
+ * @param key Encryption/decryption key made available to the VM
+ * @param result Receives the value left on top of the stack
+ * @return SUCCESS on success, FAILURE on error
+ */
+PHPAPI int kage_compiled_program_execute(kage_compiled_program *program, zend_string *key, zval *result) {
+    kage_vm_state state;
+    if (kage_vm_init(&state, KAGE_CONFIG(stack_size)) != SUCCESS) {
+        return FAILURE;
+    }
+
+    state.key = key;
+    state.instructions = program->instructions;
+    state.instruction_count = program->instruction_count;
+    state.owns_instructions = false;
+    state.local_count = program->local_count;
+
+    int status = kage_vm_execute(&state);
+    if (status == SUCCESS) {
+        status = kage_vm_pop(&state, result);
+    }
+
+    kage_vm_destroy(&state);
+    return status;
 }
 
 // PHP Function: Parse AST
@@ -692,13 +777,17 @@ PHP_FUNCTION(kage_ast_parse) {
         RETURN_FALSE;
     }
     
-    kage_ast_node *ast = kage_ast_parse(ZSTR_VAL(source));
+    kage_ast_node *ast = kage_ast_parse_ex(ZSTR_VAL(source), ZSTR_LEN(source));
     if (ast == NULL) { // MISRA23_10.1
         RETURN_FALSE;
     }
     
-    // Convert AST to resource
-    zend_resource *res = zend_register_resource(ast, le_kage_ast);
+    // Convert AST to resource; the program is lowered lazily on first execution
+    kage_ast_resource *payload = emalloc(sizeof(kage_ast_resource));
+    payload->root = ast;
+    payload->program = NULL;
+
+    zend_resource *res = zend_register_resource(payload, le_kage_ast);
     RETURN_RES(res);
 }
 
@@ -754,8 +843,10 @@ static void fully_decrypt_result(zval *result, zend_string *key) {
 /**
  * PHP Function: kage_ast_to_bytecode
  * Converts an AST resource to bytecode and executes it.
+ * The lowered program is cached on the resource, so repeated calls
+ * only pay for VM execution.
  *
- * @param resource $ast AST resource from kage_ast_parse()
+ * @param resource $ast AST resource from kage_ast_parse() or kage_vm_load()
  * @param string $key Encryption/decryption key
  * @return mixed Execution result or FALSE on error
  */
@@ -769,37 +860,31 @@ PHP_FUNCTION(kage_ast_to_bytecode) {
     }
 
     /* Extract AST from resource */
-    kage_ast_node *ast = (kage_ast_node*)zend_fetch_resource(Z_RES_P(ast_zv), "Kage AST", le_kage_ast);
-    if (ast == NULL) {
+    kage_ast_resource *payload = (kage_ast_resource*)zend_fetch_resource(Z_RES_P(ast_zv), "Kage AST", le_kage_ast);
+    if (payload == NULL) {
         RETURN_FALSE;
     }
 
-    /* Initialize VM state */
-    kage_vm_state state;
-    if (kage_vm_init(&state, KAGE_VM_STACK_SIZE) != SUCCESS) {
+    /* Lower the AST once and keep the program on the resource */
+    kage_compiled_program *program = kage_ast_resource_program(payload);
+    if (program == NULL) {
         RETURN_FALSE;
     }
 
-    /* Set encryption key */
-    state.key = key;
-
-    /* Convert AST to bytecode */
-    if (kage_ast_to_bytecode(ast, &state) != SUCCESS) {
-        kage_vm_destroy(&state);
+    /* Folded crypto pairs would otherwise have rejected a bad key */
+    if (program->requires_key_check && ZSTR_LEN(key) != crypto_secretbox_KEYBYTES) {
+        zend_error(E_WARNING, "Kage: Invalid encryption key length");
         RETURN_FALSE;
     }
 
-    /* Execute VM */
+    /* Execute the cached program */
     zval result;
-    if (kage_vm_execute(&state) != SUCCESS || kage_vm_pop(&state, &result) != SUCCESS) {
-        kage_vm_destroy(&state);
+    if (kage_compiled_program_execute(program, key, &result) != SUCCESS) {
         RETURN_FALSE;
     }
 
     /* Fully decrypt the result */
     fully_decrypt_result(&result, key);
 
-    /* Clean up and return result */
-    kage_vm_destroy(&state);
     RETURN_ZVAL(&result, 0, 1);
 } 
\ No newline at end of file
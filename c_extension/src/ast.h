@@ -12,6 +12,7 @@
 
 #include "config.h"
 #include "vm.h"
+#include "lexer.h"
 
 // AST Node Types
 typedef enum {
@@ -34,18 +35,43 @@ typedef struct kage_ast_node {
     struct kage_ast_node *next;
 } kage_ast_node;
 
+// Bump-pointer arena (kage_memory.h, which includes this header)
+struct kage_memory_pool;
+
 // AST Parser Structure
 typedef struct {
     const char *source;
-    size_t position;
     size_t length;
+    kage_lexer lexer;
+    struct kage_memory_pool *pool;  // node storage, owned by the program root
     zend_error_handling error_handling;
 } kage_ast_parser;
 
+// Lowered and optimised instruction buffer, built once per parsed program
+typedef struct {
+    kage_instruction *instructions;
+    size_t instruction_count;
+    bool requires_key_check;  // crypto ops were folded away, validate the key up front
+    uint32_t local_count;     // local variable slots used by LOAD/STORE
+    struct kage_memory_pool *pool;  // holds the program and its instructions; NULL if emalloc'd
+} kage_compiled_program;
+
+// Payload of the "Kage AST" resource: the immutable tree and its cached program
+typedef struct {
+    kage_ast_node *root;
+    kage_compiled_program *program;
+} kage_ast_resource;
+
 // AST Functions
 PHPAPI kage_ast_node* kage_ast_parse(const char *source);
+PHPAPI kage_ast_node* kage_ast_parse_ex(const char *source, size_t length);
 PHPAPI void kage_ast_free(kage_ast_node *node);
 PHPAPI int kage_ast_to_bytecode(kage_ast_node *node, kage_vm_state *state);
+PHPAPI kage_compiled_program* kage_ast_compile(kage_ast_node *node);
+PHPAPI void kage_compiled_program_free(kage_compiled_program *program);
+PHPAPI void kage_ast_resource_free(kage_ast_resource *resource);
+PHPAPI kage_compiled_program* kage_ast_resource_program(kage_ast_resource *resource);
+PHPAPI int kage_compiled_program_execute(kage_compiled_program *program, zend_string *key, zval *result);
 
 // PHP Functions
 PHP_FUNCTION(kage_ast_parse);
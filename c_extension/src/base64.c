@@ -8,30 +8,14 @@
  */
 
 #include "base64.h"
+#include "kage_stats.h"
+#include "kage_probes.h"
 
-char* kage_base64_encode(const unsigned char *input, size_t input_length, size_t *output_length) {
-    if (input == NULL) {
-        if (output_length != NULL) {
-            *output_length = 0;
-        }
-        return NULL;
-    }
-    if (output_length == NULL) {
-        return NULL;
-    }
+// Encodes into output, which has room for KAGE_BASE64_ENCODED_SIZE(input_length)
+static size_t kage_base64_encode_raw(const unsigned char *input, size_t input_length, char *encoded_data) {
     static const char base64_chars[] = 
         "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
     
-    // Calculate output length (4 * ceil(n/3))
-    *output_length = 4 * ((input_length + 2) / 3);
-    
-    // Allocate memory for output
-    char *encoded_data = emalloc(*output_length + 1);  // +1 for null terminator
-    if (!encoded_data) {
-        *output_length = 0;
-        return NULL;
-    }
-    
     // Encode the input data
     size_t i = 0;
     size_t j = 0;
@@ -65,144 +49,186 @@ char* kage_base64_encode(const unsigned char *input, size_t input_length, size_t
     // Add null terminator
     encoded_data[j] = '\0';
     
-    return encoded_data;
+    return j;
 }
 
-// Base64 decoding lookup table
-static const char BASE64_DECODE_TABLE[] = {
-    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63,52,53,54,55,56,57,58,59,60,61,-1,-1,-1,-1,-1,-1,
-    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1,
-    -1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1
-};
-
-// Helper function to validate base64 input
-static int kage_base64_validate_input(const char *data, size_t input_length, size_t *padding) {
-    if (!data || input_length == 0) {
-        return 0;
+static char* kage_base64_encode_ex(const unsigned char *input, size_t input_length, size_t *output_length) {
+    if (input == NULL) {
+        if (output_length != NULL) {
+            *output_length = 0;
+        }
+        return NULL;
     }
-
-    // Check length is multiple of 4
-    if (input_length % 4 != 0) {
-        return 0;
+    if (output_length == NULL) {
+        return NULL;
     }
 
-    // Count padding characters
-    *padding = 0;
-    if (data[input_length - 1] == '=') {
-        (*padding)++;
-    }
-    if (input_length > 1 && data[input_length - 2] == '=') {
-        (*padding)++;
-    }
+    // Calculate output length (4 * ceil(n/3))
+    *output_length = KAGE_BASE64_ENCODED_SIZE(input_length) - 1;
 
-    return 1;
-}
+    // Allocate memory for output
+    char *encoded_data = emalloc(*output_length + 1);  // +1 for null terminator
 
-// Helper function to decode a single base64 character
-static int kage_base64_decode_char(char c) {
-    // No need to check c >= 128 since char can be negative
-    return BASE64_DECODE_TABLE[(unsigned char)c];
+    kage_base64_encode_raw(input, input_length, encoded_data);
+    return encoded_data;
 }
 
-// Helper function to decode a base64 quartet
-static int kage_base64_decode_quartet(const char *input, unsigned char *output, size_t *output_pos, int *remaining) {
-    int b1 = kage_base64_decode_char(input[0]);
-    int b2 = kage_base64_decode_char(input[1]);
-    int b3 = kage_base64_decode_char(input[2]);
-    int b4 = kage_base64_decode_char(input[3]);
+// Base64 decoding lookup table, 0xFF for bytes outside the alphabet
+#define X 0xFF
+static const unsigned char kage_base64_decode_table[256] = {
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X,62, X, X, X,63,
+    52,53,54,55,56,57,58,59,60,61, X, X, X, X, X, X,
+     X, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
+    15,16,17,18,19,20,21,22,23,24,25, X, X, X, X, X,
+     X,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
+    41,42,43,44,45,46,47,48,49,50,51, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+     X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X
+};
+#undef X
 
-    if (b1 < 0 || b2 < 0) {
-        return 0; // Invalid characters
-    }
+static inline bool kage_base64_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
 
-    // First byte
-    output[(*output_pos)++] = (b1 << 2) | (b2 >> 4);
+// Offset of the first of four sextets that is outside the alphabet
+static size_t kage_base64_bad_sextet(unsigned a, unsigned b, unsigned c) {
+    return a > 63 ? 0 : b > 63 ? 1 : c > 63 ? 2 : 3;
+}
 
-    if (input[2] == '=') {
-        *remaining = 1;
-        return 1; // End of data
+// Decodes into output, which has room for KAGE_BASE64_DECODED_SIZE(input_length).
+// Validation happens in the same loop: each byte is looked up once and the
+// quartet is rejected if any lookup has the high bit set. On failure,
+// error_offset is the first offending byte of data, or the end of the
+// trimmed input when its length is not a multiple of 4.
+static int kage_base64_decode_raw(const char *data, size_t input_length, unsigned char *decoded_data,
+                                  size_t *output_length, size_t *error_offset) {
+    const unsigned char *table = kage_base64_decode_table;
+    *output_length = 0;
+
+    // Surrounding whitespace is allowed
+    size_t start = 0;
+    size_t end = input_length;
+    while (start < end && kage_base64_is_space(data[start])) {
+        start++;
     }
-
-    if (b3 < 0) {
-        return 0; // Invalid character
+    while (end > start && kage_base64_is_space(data[end - 1])) {
+        end--;
     }
 
-    // Second byte
-    output[(*output_pos)++] = ((b2 & 0x0F) << 4) | (b3 >> 2);
-
-    if (input[3] == '=') {
-        *remaining = 2;
-        return 1; // End of data
+    if ((end - start) % 4 != 0) {
+        *error_offset = end;
+        return FAILURE;
     }
-
-    if (b4 < 0) {
-        return 0; // Invalid character
+    if (start == end) {
+        decoded_data[0] = '\0';
+        return SUCCESS;
     }
 
-    // Third byte
-    output[(*output_pos)++] = ((b3 & 0x03) << 6) | b4;
-
-    *remaining = 3;
-    return 1;
+    // Every quartet but the last is four sextets
+    const unsigned char *in = (const unsigned char*)data;
+    unsigned char *out = decoded_data;
+    size_t last = end - 4;
+    for (size_t i = start; i < last; i += 4) {
+        unsigned a = table[in[i]];
+        unsigned b = table[in[i + 1]];
+        unsigned c = table[in[i + 2]];
+        unsigned d = table[in[i + 3]];
+        if (UNEXPECTED((a | b | c | d) & 0x80)) {
+            *error_offset = i + kage_base64_bad_sextet(a, b, c);
+            return FAILURE;
+        }
+        uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = (unsigned char)(triple >> 16);
+        out[1] = (unsigned char)(triple >> 8);
+        out[2] = (unsigned char)triple;
+        out += 3;
+    }
+
+    // The last one may end in "=" or "=="
+    size_t padding = in[last + 3] != '=' ? 0 : in[last + 2] == '=' ? 2 : 1;
+    unsigned a = table[in[last]];
+    unsigned b = table[in[last + 1]];
+    unsigned c = padding == 2 ? 0 : table[in[last + 2]];
+    unsigned d = padding != 0 ? 0 : table[in[last + 3]];
+    if ((a | b | c | d) & 0x80) {
+        *error_offset = last + kage_base64_bad_sextet(a, b, c);
+        return FAILURE;
+    }
+    uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+    out[0] = (unsigned char)(triple >> 16);
+    if (padding < 2) {
+        out[1] = (unsigned char)(triple >> 8);
+    }
+    if (padding < 1) {
+        out[2] = (unsigned char)triple;
+    }
+    out += 3 - padding;
+
+    *out = '\0';
+    *output_length = (size_t)(out - decoded_data);
+    return SUCCESS;
 }
 
-unsigned char* kage_base64_decode(const char *data, size_t input_length, size_t *output_length) {
+static unsigned char* kage_base64_decode_ex(const char *data, size_t input_length, size_t *output_length) {
     if (!data || !output_length) {
         if (output_length) *output_length = 0;
         return NULL;
     }
 
-    // Trim whitespace
-    const char *start = data;
-    const char *end = data + input_length - 1;
-
-    while (start <= end && (*start == ' ' || *start == '\t' || *start == '\n' || *start == '\r')) {
-        start++;
-    }
-    while (end >= start && (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r')) {
-        end--;
-    }
-
-    size_t trimmed_length = end - start + 1;
-    if (trimmed_length == 0) {
-        *output_length = 0;
-        return emalloc(1); // Return empty buffer
-    }
-
-    // Validate input
-    size_t padding = 0;
-    if (!kage_base64_validate_input(start, trimmed_length, &padding)) {
-        *output_length = 0;
+    size_t error_offset;
+    unsigned char *decoded_data = emalloc(KAGE_BASE64_DECODED_SIZE(input_length));
+    if (kage_base64_decode_raw(data, input_length, decoded_data, output_length, &error_offset) != SUCCESS) {
+        efree(decoded_data);
         return NULL;
     }
 
-    // Calculate output size
-    *output_length = (trimmed_length / 4) * 3 - padding;
+    return decoded_data;
+}
 
-    // Allocate output buffer
-    unsigned char *decoded_data = emalloc(*output_length + 1);
-    if (!decoded_data) {
-        *output_length = 0;
-        return NULL;
-    }
+// Timed entry points
+char* kage_base64_encode(const unsigned char *input, size_t input_length, size_t *output_length) {
+    uint64_t started = kage_stats_now();
+    char *encoded = kage_base64_encode_ex(input, input_length, output_length);
+    kage_stats_record(KAGE_STAT_BASE64_ENCODE, input_length, started, encoded != NULL);
+    return encoded;
+}
 
-    // Decode in quartets
-    size_t output_pos = 0;
-    for (size_t i = 0; i < trimmed_length; i += 4) {
-        int remaining = 0;
-        if (!kage_base64_decode_quartet(start + i, decoded_data, &output_pos, &remaining)) {
-            efree(decoded_data);
-            *output_length = 0;
-            return NULL;
-        }
+unsigned char* kage_base64_decode(const char *data, size_t input_length, size_t *output_length) {
+    KAGE_PROBE1(base64_decode__entry, input_length);
+    uint64_t started = kage_stats_now();
+    unsigned char *decoded = kage_base64_decode_ex(data, input_length, output_length);
+    kage_stats_record(KAGE_STAT_BASE64_DECODE, input_length, started, decoded != NULL);
+    KAGE_PROBE2(base64_decode__return, decoded ? *output_length : 0, decoded ? SUCCESS : FAILURE);
+    return decoded;
+}
 
-        if (remaining < 3) {
-            break; // Reached padding
-        }
-    }
+size_t kage_base64_encode_to(const unsigned char *input, size_t input_length, char *output) {
+    uint64_t started = kage_stats_now();
+    size_t encoded_length = kage_base64_encode_raw(input, input_length, output);
+    kage_stats_record(KAGE_STAT_BASE64_ENCODE, input_length, started, true);
+    return encoded_length;
+}
 
-    // Null terminate
-    decoded_data[*output_length] = '\0';
-    return decoded_data;
-} 
\ No newline at end of file
+int kage_base64_decode_to(const char *data, size_t input_length, unsigned char *output, size_t *output_length) {
+    size_t error_offset;
+    return kage_base64_decode_to_ex(data, input_length, output, output_length, &error_offset);
+}
+
+int kage_base64_decode_to_ex(const char *data, size_t input_length, unsigned char *output, size_t *output_length,
+                             size_t *error_offset) {
+    KAGE_PROBE1(base64_decode__entry, input_length);
+    uint64_t started = kage_stats_now();
+    int status = kage_base64_decode_raw(data, input_length, output, output_length, error_offset);
+    kage_stats_record(KAGE_STAT_BASE64_DECODE, input_length, started, status == SUCCESS);
+    KAGE_PROBE2(base64_decode__return, *output_length, status);
+    return status;
+}
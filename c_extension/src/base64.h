@@ -12,6 +12,10 @@
 
 #include "config.h"
 
+// Buffer sizes for the _to variants, terminating NUL included
+#define KAGE_BASE64_ENCODED_SIZE(n) (4 * (((n) + 2) / 3) + 1)
+#define KAGE_BASE64_DECODED_SIZE(n) (((n) / 4) * 3 + 1)
+
 /**
  * Custom Base64 encoding function
  * @param input Input data to encode
@@ -30,4 +34,38 @@ char* kage_base64_encode(const unsigned char *input, size_t input_length, size_t
  */
 unsigned char* kage_base64_decode(const char *data, size_t input_length, size_t *output_length);
 
+/**
+ * Base64 encoding into a caller-provided buffer
+ * @param input Input data to encode
+ * @param input_length Length of input data
+ * @param output Buffer of KAGE_BASE64_ENCODED_SIZE(input_length) bytes
+ * @return Encoded length, excluding the terminating NUL
+ */
+size_t kage_base64_encode_to(const unsigned char *input, size_t input_length, char *output);
+
+/**
+ * Base64 decoding into a caller-provided buffer
+ * @param data Base64 encoded input string
+ * @param input_length Length of input string
+ * @param output Buffer of KAGE_BASE64_DECODED_SIZE(input_length) bytes
+ * @param output_length Pointer to store output length
+ * @return SUCCESS or FAILURE
+ */
+int kage_base64_decode_to(const char *data, size_t input_length, unsigned char *output, size_t *output_length);
+
+/**
+ * As kage_base64_decode_to(), reporting where the input went wrong. The
+ * input is validated and decoded in one pass; surrounding whitespace is
+ * skipped and '=' padding is only accepted at the end.
+ * @param data Base64 encoded input string
+ * @param input_length Length of input string
+ * @param output Buffer of KAGE_BASE64_DECODED_SIZE(input_length) bytes
+ * @param output_length Pointer to store output length
+ * @param error_offset Set on FAILURE to the offset of the first invalid
+ *                     byte, or to the end of the data for a bad length
+ * @return SUCCESS or FAILURE
+ */
+int kage_base64_decode_to_ex(const char *data, size_t input_length, unsigned char *output, size_t *output_length,
+                             size_t *error_offset);
+
 #endif /* PHP_KAGE_BASE64_H */ 
\ No newline at end of file
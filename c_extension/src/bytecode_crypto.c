@@ -3,11 +3,260 @@
  */
 
 #include "bytecode_crypto.h"
+#include "opcode_profile.h"
 #include "zend_compile.h"
 #include "zend_execute.h"
+#include "zend_smart_str.h"
+#include "ext/standard/php_var.h"
+#include <errno.h>
+#include <limits.h>
+
+// Таблица имён опкодов сгенерирована tools/gen_opcode_table.php и лежит в
+// репозитории; CMake обновляет её, если есть php CLI
+#include "kage_opcode_table.h"
+
+// FNV-1a с затравкой, та же что fnv1a() в генераторе таблицы
+static zend_always_inline uint32_t kage_opcode_hash(const char *name, size_t length, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Номер опкода по имени без префикса ZEND_, как его печатает VLD; -1 если имя неизвестно
+static int kage_opcode_lookup(const char *name, size_t length) {
+    uint32_t bucket = kage_opcode_hash(name, length, 0) & (KAGE_OPCODE_TABLE_BUCKETS - 1);
+    uint32_t slot = kage_opcode_hash(name, length, kage_opcode_table_seeds[bucket]) & (KAGE_OPCODE_TABLE_SLOTS - 1);
+    const kage_opcode_table_entry *entry = &kage_opcode_table[slot];
+
+    if (entry->name && entry->length == length && memcmp(entry->name, name, length) == 0) {
+        return entry->opcode;
+    }
+    return -1;
+}
+
+// Смещения столбцов таблицы опкодов, берутся из строки заголовка
+// "line #* E I O op fetch ext return operands"
+typedef struct {
+    size_t ext;
+    size_t ret;
+    size_t operands;
+    bool known;
+} kage_vld_columns;
+
+// Состояние разбора между строками
+typedef struct {
+    kage_vld_columns columns;
+    int lineno;            // VLD не повторяет номер строки для опкодов той же строки
+    const char *class_name;
+    size_t class_length;
+} kage_vld_scanner;
+
+static zend_always_inline const char* kage_vld_skip_spaces(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+static zend_always_inline const char* kage_vld_trim_right(const char *start, const char *end) {
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    return end;
+}
+
+static zend_always_inline bool kage_vld_starts_with(const char *p, const char *end, const char *prefix, size_t prefix_length) {
+    return (size_t)(end - p) >= prefix_length && memcmp(p, prefix, prefix_length) == 0;
+}
+
+// Целое без знака или с минусом, занимающее весь фрагмент. Фрагмент не
+// завершён нулём, поэтому ZEND_STRTOL разбирает его копию; числа вне
+// zend_long не принимаются
+static bool kage_vld_parse_long(const char *p, const char *end, zend_long *value) {
+    char digits[MAX_LENGTH_OF_LONG + 1];
+    size_t length = end - p;
+    const char *c = p < end && *p == '-' ? p + 1 : p;
+
+    if (c == end || length >= sizeof(digits)) return false;
+    for (; c < end; c++) {
+        if (*c < '0' || *c > '9') return false;
+    }
+
+    memcpy(digits, p, length);
+    digits[length] = '\0';
+    errno = 0;
+    zend_long result = ZEND_STRTOL(digits, NULL, 10);
+    if (errno == ERANGE) return false;
+
+    *value = result;
+    return true;
+}
+
+// Операнд в нотации VLD: 'строка' и числа становятся значениями,
+// !0, ~1, $2, ->5 и прочее сохраняется как есть
+static void kage_vld_operand(zval *operand, const char *p, const char *end) {
+    p = kage_vld_skip_spaces(p, end);
+    end = kage_vld_trim_right(p, end);
+
+    zend_long value;
+    if (p == end) {
+        ZVAL_UNDEF(operand);
+    } else if (end - p >= 2 && *p == '\'' && end[-1] == '\'') {
+        ZVAL_STRINGL(operand, p + 1, end - p - 2);
+    } else if (kage_vld_parse_long(p, end, &value)) {
+        ZVAL_LONG(operand, value);
+    } else {
+        ZVAL_STRINGL(operand, p, end - p);
+    }
+}
+
+// Столбец по смещению из заголовка; смещение, попавшее внутрь значения,
+// отодвигается к его началу
+static const char* kage_vld_column(const char *line, const char *end, size_t offset, const char *min) {
+    const char *p = line + offset;
+    if (p <= min) return min;
+    if (p > end) return end;
+    while (p > min && p[-1] != ' ' && p[-1] != '\t') p--;
+    return p;
+}
+
+// Строка таблицы опкодов: "  3     0  E >   ASSIGN   !0, 'Hello'"
+static void kage_vld_parse_op(vld_bytecode_info *info, kage_vld_scanner *scanner, const char *line, const char *p, const char *end) {
+    // Номер строки (может отсутствовать) и номер опкода
+    const char *first = p;
+    while (p < end && *p >= '0' && *p <= '9') p++;
+    const char *first_end = p;
+    p = kage_vld_skip_spaces(p, end);
+
+    if (p < end && *p >= '0' && *p <= '9') {
+        zend_long lineno;
+        if (kage_vld_parse_long(first, first_end, &lineno) && lineno <= INT_MAX) {
+            scanner->lineno = (int)lineno;
+        }
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    if (p < end && *p == '*') p++;
+
+    // Флаги E, I, O и метки переходов > до имени опкода
+    const char *name, *name_end;
+    for (;;) {
+        p = kage_vld_skip_spaces(p, end);
+        if (p == end) return;
+        name = p;
+        while (p < end && *p != ' ' && *p != '\t') p++;
+        name_end = p;
+        const char *flag = name;
+        while (flag < name_end && memchr("EIO>*", *flag, 5)) flag++;
+        if (flag < name_end) break;
+    }
+
+    zend_op_encrypted *op = ecalloc(1, sizeof(zend_op_encrypted));
+    int opcode = kage_opcode_lookup(name, name_end - name);
+
+    op->lineno = scanner->lineno;
+    op->opcode = opcode < 0 ? ZEND_NOP : (unsigned char)opcode;
 
-// Парсер VLD вывода в структурированные опкоды
-PHPAPI vld_bytecode_info* kage_parse_vld_output(const char *vld_output) {
+    if (scanner->columns.known) {
+        const char *ext = kage_vld_column(line, end, scanner->columns.ext, name_end);
+        const char *ret = kage_vld_column(line, end, scanner->columns.ret, ext);
+        const char *operands = kage_vld_column(line, end, scanner->columns.operands, ret);
+        zend_long value;
+
+        const char *ext_start = kage_vld_skip_spaces(ext, ret);
+        // extended_value 32-битный: со знаком или без
+        if (kage_vld_parse_long(ext_start, kage_vld_trim_right(ext_start, ret), &value)
+                && value >= INT32_MIN && value <= UINT32_MAX) {
+            op->extended_value = (uint32_t)value;
+        }
+        kage_vld_operand(&op->result, ret, operands);
+        p = operands;
+    } else {
+        p = name_end;
+    }
+
+    // "op1, op2"; запятая внутри 'строки' не разделяет операнды
+    const char *comma = NULL;
+    bool quoted = false;
+    for (const char *c = p; c < end; c++) {
+        if (*c == '\'') {
+            quoted = !quoted;
+        } else if (*c == ',' && !quoted) {
+            comma = c;
+            break;
+        }
+    }
+
+    if (comma) {
+        kage_vld_operand(&op->op1, p, comma);
+        kage_vld_operand(&op->op2, comma + 1, end);
+    } else {
+        kage_vld_operand(&op->op1, p, end);
+    }
+
+    zend_hash_index_add_new_ptr(info->opcodes, info->total_opcodes++, op);
+}
+
+// Заголовок таблицы задаёт смещения столбцов
+static void kage_vld_parse_header(kage_vld_scanner *scanner, const char *line, const char *end) {
+    const char *ext = zend_memnstr(line, " ext ", sizeof(" ext ") - 1, end);
+    const char *ret = zend_memnstr(line, " return ", sizeof(" return ") - 1, end);
+    const char *operands = zend_memnstr(line, " operands", sizeof(" operands") - 1, end);
+
+    scanner->columns.known = ext && ret && operands && ext < ret && ret < operands;
+    if (scanner->columns.known) {
+        scanner->columns.ext = ext + 1 - line;
+        scanner->columns.ret = ret + 1 - line;
+        scanner->columns.operands = operands + 1 - line;
+    }
+}
+
+// Функции записываются как в kage_extract_opcodes: имя => индекс первого опкода
+static void kage_vld_parse_function(vld_bytecode_info *info, kage_vld_scanner *scanner, const char *p, const char *end) {
+    zend_string *name;
+    zval first;
+
+    p = kage_vld_skip_spaces(p, end);
+    end = kage_vld_trim_right(p, end);
+
+    if (end - p == sizeof("(null)") - 1 && memcmp(p, "(null)", end - p) == 0) {
+        name = zend_string_init("{main}", sizeof("{main}") - 1, 0);
+    } else if (scanner->class_name) {
+        name = zend_strpprintf(0, "%.*s::%.*s", (int)scanner->class_length, scanner->class_name, (int)(end - p), p);
+    } else {
+        name = zend_string_init(p, end - p, 0);
+    }
+
+    ZVAL_LONG(&first, (zend_long)info->total_opcodes);
+    zend_hash_update(info->functions, name, &first);
+    zend_string_release(name);
+}
+
+static void kage_vld_parse_line(vld_bytecode_info *info, kage_vld_scanner *scanner, const char *line, const char *end) {
+    if (end > line && end[-1] == '\r') end--;
+
+    const char *p = kage_vld_skip_spaces(line, end);
+    if (p == end) return;
+
+    if (*p >= '0' && *p <= '9') {
+        kage_vld_parse_op(info, scanner, line, p, end);
+    } else if (kage_vld_starts_with(p, end, "line ", sizeof("line ") - 1)) {
+        kage_vld_parse_header(scanner, line, end);
+    } else if (kage_vld_starts_with(p, end, "filename:", sizeof("filename:") - 1)) {
+        if (!info->source_file) {
+            p = kage_vld_skip_spaces(p + sizeof("filename:") - 1, end);
+            info->source_file = estrndup(p, kage_vld_trim_right(p, end) - p);
+        }
+    } else if (kage_vld_starts_with(p, end, "function name:", sizeof("function name:") - 1)) {
+        kage_vld_parse_function(info, scanner, p + sizeof("function name:") - 1, end);
+    } else if (kage_vld_starts_with(p, end, "Class ", sizeof("Class ") - 1) && end[-1] == ':') {
+        scanner->class_name = p + sizeof("Class ") - 1;
+        scanner->class_length = end - 1 - scanner->class_name;
+    } else if (kage_vld_starts_with(p, end, "End of class", sizeof("End of class") - 1)) {
+        scanner->class_name = NULL;
+    }
+}
+
+// Парсер VLD вывода в структурированные опкоды. Один проход по строкам
+// без копирования входа; имена опкодов ищутся в совершенной хэш-таблице
+PHPAPI vld_bytecode_info* kage_parse_vld_output(const char *vld_output, size_t length) {
     if (!vld_output) return NULL;
 
     vld_bytecode_info *info = emalloc(sizeof(vld_bytecode_info));
@@ -21,65 +270,36 @@ PHPAPI vld_bytecode_info* kage_parse_vld_output(const char *vld_output) {
     zend_hash_init(info->functions, 8, NULL, NULL, 0);
     zend_hash_init(info->opcodes, 64, NULL, NULL, 0);
 
-    // Парсим VLD вывод построчно
-    char *output_copy = estrndup(vld_output, strlen(vld_output));
-    char *line = strtok(output_copy, "\n");
-    int lineno, op_num;
-    char opcode_str[256];
-
-    while (line) {
-        // Парсим строку таблицы опкодов
-        // Формат: line #* E I O op fetch ext return operands
-        if (sscanf(line, "%d %d %*s %*s %*s %255s", &lineno, &op_num, opcode_str) == 3) {
-            // Создаём зашифрованный опкод
-            zend_op_encrypted *op = emalloc(sizeof(zend_op_encrypted));
-            memset(op, 0, sizeof(zend_op_encrypted));
-
-            op->lineno = lineno;
-            // Простая конвертация строки в opcode (в реальности нужна таблица)
-            if (strcmp(opcode_str, "ASSIGN") == 0) op->opcode = 38; // ZEND_ASSIGN
-            else if (strcmp(opcode_str, "ECHO") == 0) op->opcode = 40; // ZEND_ECHO
-            else if (strcmp(opcode_str, "ADD") == 0) op->opcode = 1; // ZEND_ADD
-            else if (strcmp(opcode_str, "SUB") == 0) op->opcode = 2; // ZEND_SUB
-            else if (strcmp(opcode_str, "MUL") == 0) op->opcode = 3; // ZEND_MUL
-            else if (strcmp(opcode_str, "RETURN") == 0) op->opcode = 62; // ZEND_RETURN
-            else op->opcode = 0; // NOP
-
-            // Парсим операнды из остатка строки
-            char *operands = strstr(line, opcode_str);
-            if (operands) {
-                operands += strlen(opcode_str);
-                // Простой парсер операндов
-                if (strstr(operands, "!")) {
-                    // Это переменная
-                    ZVAL_STRING(&op->op1, "!VAR");
-                }
-                if (strstr(operands, "'") || strstr(operands, "\"")) {
-                    // Это строка
-                    ZVAL_STRING(&op->op1, "'STRING'");
-                }
-            }
+    kage_vld_scanner scanner = {0};
+    const char *p = vld_output;
+    const char *end = vld_output + length;
 
-            // Сохраняем опкод
-            zend_hash_index_add_ptr(info->opcodes, op_num, op);
-            info->total_opcodes++;
-        }
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        kage_vld_parse_line(info, &scanner, p, eol);
+        p = eol + 1;
+    }
 
-        // Ищем имя файла
-        if (strstr(line, "filename:") && !info->source_file) {
-            char *filename_start = strstr(line, "filename:");
-            if (filename_start) {
-                filename_start += 9; // strlen("filename:")
-                while (*filename_start == ' ') filename_start++;
-                info->source_file = estrndup(filename_start, strlen(filename_start));
-            }
-        }
+    return info;
+}
+
+// XOR строкового операнда на месте. Общая строка (интернированная или
+// с другими ссылками) сначала копируется, чтобы не испортить чужие данные
+static void kage_xor_operand(zval *operand, const char *key, size_t key_len) {
+    if (Z_TYPE_P(operand) != IS_STRING) return;
 
-        line = strtok(NULL, "\n");
+    zend_string *str = Z_STR_P(operand);
+    if (ZSTR_IS_INTERNED(str) || GC_REFCOUNT(str) > 1) {
+        ZVAL_NEW_STR(operand, zend_string_init(ZSTR_VAL(str), ZSTR_LEN(str), 0));
+        zend_string_release(str);
     }
 
-    efree(output_copy);
-    return info;
+    char *value = Z_STRVAL_P(operand);
+    size_t len = Z_STRLEN_P(operand);
+    for (size_t i = 0; i < len; i++) {
+        value[i] ^= key[i % key_len];
+    }
 }
 
 // XOR шифрование опкода (простой и быстрый)
@@ -95,38 +315,129 @@ static void kage_xor_encrypt_op(zend_op_encrypted *op, const char *key, size_t k
     // Шифруем lineno (немного)
     op->lineno ^= (key[2 % key_len] | (key[3 % key_len] << 8));
 
-    // Шифруем операнды (если они есть)
-    if (Z_TYPE(op->op1) == IS_STRING && Z_STRVAL(op->op1)) {
-        size_t len = Z_STRLEN(op->op1);
-        for (size_t i = 0; i < len; i++) {
-            Z_STRVAL(op->op1)[i] ^= key[i % key_len];
-        }
+    // Шифруем операнды и результат (если они есть)
+    kage_xor_operand(&op->op1, key, key_len);
+    kage_xor_operand(&op->op2, key, key_len);
+    kage_xor_operand(&op->result, key, key_len);
+}
+
+// Ключ secretbox для холодных опкодов: BLAKE2b от ключа любой длины
+static void kage_cold_key(unsigned char *cold_key, const kage_bytecode_crypto_config *config) {
+    crypto_generichash(cold_key, crypto_secretbox_KEYBYTES,
+                       (const unsigned char *)config->key, config->key_length, NULL, 0);
+}
+
+// Переносит операнд в массив полей запечатываемого опкода
+static void kage_seal_operand(zval *fields, const char *name, zval *operand) {
+    if (Z_TYPE_P(operand) != IS_UNDEF) {
+        add_assoc_zval(fields, name, operand);
+        ZVAL_UNDEF(operand);
     }
+}
 
-    if (Z_TYPE(op->op2) == IS_STRING && Z_STRVAL(op->op2)) {
-        size_t len = Z_STRLEN(op->op2);
-        for (size_t i = 0; i < len; i++) {
-            Z_STRVAL(op->op2)[i] ^= key[i % key_len];
-        }
+// Холодный опкод запечатывается целиком: поля и операнды сериализуются и
+// шифруются secretbox (XSalsa20-Poly1305) со случайным nonce, как в
+// kage_internal_encrypt. В op1 остаётся nonce || шифротекст, прочие поля
+// обнуляются, так что ни опкод, ни литералы не видны.
+static bool kage_seal_op(zend_op_encrypted *op, const unsigned char *cold_key) {
+    zval fields;
+    array_init_size(&fields, 6);
+    add_assoc_long(&fields, "opcode", op->opcode);
+    add_assoc_long(&fields, "extended_value", op->extended_value);
+    add_assoc_long(&fields, "line", op->lineno);
+    kage_seal_operand(&fields, "op1", &op->op1);
+    kage_seal_operand(&fields, "op2", &op->op2);
+    kage_seal_operand(&fields, "result", &op->result);
+
+    smart_str buffer = {0};
+    php_serialize_data_t var_hash;
+    PHP_VAR_SERIALIZE_INIT(var_hash);
+    php_var_serialize(&buffer, &fields, &var_hash);
+    PHP_VAR_SERIALIZE_DESTROY(var_hash);
+    zval_ptr_dtor(&fields);
+    if (!buffer.s) {
+        return false;
     }
 
-    // Шифруем результат
-    if (Z_TYPE(op->result) == IS_STRING && Z_STRVAL(op->result)) {
-        size_t len = Z_STRLEN(op->result);
-        for (size_t i = 0; i < len; i++) {
-            Z_STRVAL(op->result)[i] ^= key[i % key_len];
-        }
+    size_t length = ZSTR_LEN(buffer.s);
+    zend_string *sealed = zend_string_alloc(crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES + length, 0);
+    unsigned char *nonce = (unsigned char *)ZSTR_VAL(sealed);
+    randombytes_buf(nonce, crypto_secretbox_NONCEBYTES);
+    crypto_secretbox_easy(nonce + crypto_secretbox_NONCEBYTES, (const unsigned char *)ZSTR_VAL(buffer.s),
+                          length, nonce, cold_key);
+    ZSTR_VAL(sealed)[ZSTR_LEN(sealed)] = '\0';
+    sodium_memzero(ZSTR_VAL(buffer.s), length);
+    smart_str_free(&buffer);
+
+    op->opcode = ZEND_NOP;
+    op->extended_value = 0;
+    op->lineno = 0;
+    ZVAL_STR(&op->op1, sealed);
+    return true;
+}
+
+// Возвращает операнд из полей вскрытого опкода
+static void kage_open_operand(zval *operand, HashTable *fields, const char *name) {
+    zval *value = zend_hash_str_find(fields, name, strlen(name));
+    if (value) {
+        ZVAL_COPY(operand, value);
+    } else {
+        ZVAL_UNDEF(operand);
     }
 }
 
-// AES шифрование опкода (более безопасное)
-static void kage_aes_encrypt_op(zend_op_encrypted *op, const char *key, size_t key_len) {
-    // Используем существующие функции Kage для AES
-    // В реальности нужно сериализовать опкод и зашифровать
+// Обратное kage_seal_op; false, если op1 не вскрывается этим ключом
+static bool kage_open_op(zend_op_encrypted *op, const unsigned char *cold_key) {
+    if (Z_TYPE(op->op1) != IS_STRING
+            || Z_STRLEN(op->op1) < crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES) {
+        return false;
+    }
+
+    const unsigned char *nonce = (const unsigned char *)Z_STRVAL(op->op1);
+    size_t ciphertext_length = Z_STRLEN(op->op1) - crypto_secretbox_NONCEBYTES;
+    zend_string *plain = zend_string_alloc(ciphertext_length - crypto_secretbox_MACBYTES, 0);
+    if (crypto_secretbox_open_easy((unsigned char *)ZSTR_VAL(plain), nonce + crypto_secretbox_NONCEBYTES,
+                                   ciphertext_length, nonce, cold_key) != 0) {
+        zend_string_efree(plain);
+        return false;
+    }
+    ZSTR_VAL(plain)[ZSTR_LEN(plain)] = '\0';
+
+    zval fields;
+    ZVAL_UNDEF(&fields);
+    const unsigned char *p = (const unsigned char *)ZSTR_VAL(plain);
+    php_unserialize_data_t var_hash;
+    PHP_VAR_UNSERIALIZE_INIT(var_hash);
+    bool valid = php_var_unserialize(&fields, &p, p + ZSTR_LEN(plain), &var_hash) && Z_TYPE(fields) == IS_ARRAY;
+    PHP_VAR_UNSERIALIZE_DESTROY(var_hash);
+    sodium_memzero(ZSTR_VAL(plain), ZSTR_LEN(plain));
+    zend_string_efree(plain);
+    if (!valid) {
+        zval_ptr_dtor(&fields);
+        return false;
+    }
+
+    zval *value;
+    op->opcode = (value = zend_hash_str_find(Z_ARRVAL(fields), "opcode", sizeof("opcode") - 1))
+        ? (unsigned char)zval_get_long(value) : ZEND_NOP;
+    op->extended_value = (value = zend_hash_str_find(Z_ARRVAL(fields), "extended_value", sizeof("extended_value") - 1))
+        ? (uint32_t)zval_get_long(value) : 0;
+    op->lineno = (value = zend_hash_str_find(Z_ARRVAL(fields), "line", sizeof("line") - 1))
+        ? (int)zval_get_long(value) : 0;
+
+    zval_ptr_dtor(&op->op1);
+    kage_open_operand(&op->op1, Z_ARRVAL(fields), "op1");
+    kage_open_operand(&op->op2, Z_ARRVAL(fields), "op2");
+    kage_open_operand(&op->result, Z_ARRVAL(fields), "result");
+
+    zval_ptr_dtor(&fields);
+    return true;
 }
 
-// Основная функция шифрования опкодов
-PHPAPI kage_result_t kage_encrypt_opcodes(vld_bytecode_info *bytecode, kage_bytecode_crypto_config *config) {
+// Общий проход шифрования и дешифрования. Выборочный режим: самые
+// горячие по профилю опкоды получают дешёвый XOR (быстрый путь),
+// остальные запечатываются secretbox. Без профиля горячих нет.
+static kage_result_t kage_transform_opcodes(vld_bytecode_info *bytecode, kage_bytecode_crypto_config *config, bool decrypt) {
     kage_result_t result = {KAGE_SUCCESS, {NULL}};
 
     if (!bytecode || !config || !config->key) {
@@ -134,61 +445,84 @@ PHPAPI kage_result_t kage_encrypt_opcodes(vld_bytecode_info *bytecode, kage_byte
         return result;
     }
 
+    // Для AES нет реализации; раньше такие опкоды молча оставались открытыми
+    if (!config->selective_encryption && config->algorithm == KAGE_OPCODE_ENCRYPT_AES) {
+        zend_error(E_WARNING, "Kage: AES opcode encryption is not implemented; use selective mode for sealed opcodes");
+        result.error = KAGE_ERROR_INVALID_INPUT;
+        return result;
+    }
+
+    bool *hot = config->selective_encryption
+        ? kage_opcode_profile_hot_set(bytecode, config->profile, config->hot_percent)
+        : NULL;
+
+    unsigned char cold_key[crypto_secretbox_KEYBYTES];
+    if (config->selective_encryption) {
+        kage_cold_key(cold_key, config);
+    }
+
     // Проходим по всем опкодам
     zend_op_encrypted *op;
+    zend_ulong index;
     int encrypted_count = 0;
+    int fast_path_count = 0;
 
-    ZEND_HASH_FOREACH_PTR(bytecode->opcodes, op) {
-        int should_encrypt = 1;
+    ZEND_HASH_FOREACH_NUM_KEY_PTR(bytecode->opcodes, index, op) {
+        if (hot && index < bytecode->total_opcodes && hot[index]) {
+            kage_xor_encrypt_op(op, config->key, config->key_length);
+            fast_path_count++;
+            continue;
+        }
 
         if (config->selective_encryption) {
-            // Выборочное шифрование - шифруем только определённые опкоды
-            switch (op->opcode) {
-                case 40: // ZEND_ECHO - часто используется, можно не шифровать для производительности
-                case 62: // ZEND_RETURN - тоже часто используется
-                    should_encrypt = 0;
-                    break;
-                default:
-                    should_encrypt = 1;
-                    break;
+            if (!(decrypt ? kage_open_op(op, cold_key) : kage_seal_op(op, cold_key))) {
+                result.error = KAGE_ERROR_CRYPTO;
+                break;
             }
+            encrypted_count++;
+            continue;
         }
 
-        if (should_encrypt) {
-            switch (config->algorithm) {
-                case KAGE_OPCODE_ENCRYPT_XOR:
-                    kage_xor_encrypt_op(op, config->key, config->key_length);
-                    encrypted_count++;
-                    break;
-
-                case KAGE_OPCODE_ENCRYPT_AES:
-                    kage_aes_encrypt_op(op, config->key, config->key_length);
-                    encrypted_count++;
-                    break;
-
-                case KAGE_OPCODE_ENCRYPT_ROTATE:
-                    // Битовый сдвиг
-                    op->opcode = (op->opcode << 3) | (op->opcode >> 5);
-                    op->extended_value = (op->extended_value << 3) | (op->extended_value >> 29);
-                    encrypted_count++;
-                    break;
-
-                case KAGE_OPCODE_ENCRYPT_CUSTOM:
-                    // Кастомный алгоритм - комбинация XOR + ROTATE
-                    kage_xor_encrypt_op(op, config->key, config->key_length);
-                    op->opcode = (op->opcode << 2) | (op->opcode >> 6);
-                    encrypted_count++;
-                    break;
-            }
+        switch (config->algorithm) {
+            case KAGE_OPCODE_ENCRYPT_XOR:
+                kage_xor_encrypt_op(op, config->key, config->key_length);
+                encrypted_count++;
+                break;
+
+            case KAGE_OPCODE_ENCRYPT_ROTATE:
+                // Битовый сдвиг
+                op->opcode = (op->opcode << 3) | (op->opcode >> 5);
+                op->extended_value = (op->extended_value << 3) | (op->extended_value >> 29);
+                encrypted_count++;
+                break;
+
+            case KAGE_OPCODE_ENCRYPT_CUSTOM:
+                // Кастомный алгоритм - комбинация XOR + ROTATE
+                kage_xor_encrypt_op(op, config->key, config->key_length);
+                op->opcode = (op->opcode << 2) | (op->opcode >> 6);
+                encrypted_count++;
+                break;
+
+            default:
+                break;
         }
     } ZEND_HASH_FOREACH_END();
 
+    sodium_memzero(cold_key, sizeof(cold_key));
+    if (hot) {
+        efree(hot);
+    }
+    if (result.error != KAGE_SUCCESS) {
+        return result;
+    }
+
     // Создаём результат с информацией о шифровании
     zval *result_data = emalloc(sizeof(zval));
     array_init(result_data);
 
     add_assoc_long(result_data, "total_opcodes", bytecode->total_opcodes);
     add_assoc_long(result_data, "encrypted_opcodes", encrypted_count);
+    add_assoc_long(result_data, "fast_path_opcodes", fast_path_count);
     add_assoc_double(result_data, "encryption_ratio", (double)encrypted_count / bytecode->total_opcodes);
     add_assoc_string(result_data, "algorithm",
         config->algorithm == KAGE_OPCODE_ENCRYPT_XOR ? "XOR" :
@@ -199,18 +533,15 @@ PHPAPI kage_result_t kage_encrypt_opcodes(vld_bytecode_info *bytecode, kage_byte
     return result;
 }
 
-// Дешифрование опкодов (симметричные алгоритмы)
-PHPAPI kage_result_t kage_decrypt_opcodes(vld_bytecode_info *bytecode, kage_bytecode_crypto_config *config) {
-    kage_result_t result = {KAGE_SUCCESS, {NULL}};
-
-    if (!bytecode || !config || !config->key) {
-        result.error = KAGE_ERROR_INVALID_INPUT;
-        return result;
-    }
+// Основная функция шифрования опкодов
+PHPAPI kage_result_t kage_encrypt_opcodes(vld_bytecode_info *bytecode, kage_bytecode_crypto_config *config) {
+    return kage_transform_opcodes(bytecode, config, false);
+}
 
-    // Для симметричных алгоритмов шифрование/дешифрование одинаково
-    // XOR, ROTATE - симметричны
-    return kage_encrypt_opcodes(bytecode, config);
+// Дешифрование опкодов: XOR симметричен, запечатанные холодные опкоды
+// вскрываются. Конфигурация должна совпадать с той, что шифровала.
+PHPAPI kage_result_t kage_decrypt_opcodes(vld_bytecode_info *bytecode, kage_bytecode_crypto_config *config) {
+    return kage_transform_opcodes(bytecode, config, true);
 }
 
 // Runtime дешифрование отдельного опкода
@@ -43,11 +43,13 @@ typedef struct {
     size_t key_length;
     bool encrypt_operands;     // Шифровать операнды
     bool encrypt_handlers;     // Шифровать обработчики
-    bool selective_encryption; // Выборочное шифрование
+    bool selective_encryption; // Выборочное шифрование по профилю
+    struct kage_opcode_profile *profile; // Профиль выполнения (opcode_profile.h)
+    double hot_percent;        // Доля самых горячих опкодов на быстром пути, %
 } kage_bytecode_crypto_config;
 
 // API функции
-PHPAPI vld_bytecode_info* kage_parse_vld_output(const char *vld_output);
+PHPAPI vld_bytecode_info* kage_parse_vld_output(const char *vld_output, size_t length);
 PHPAPI kage_result_t kage_encrypt_opcodes(vld_bytecode_info *bytecode, kage_bytecode_crypto_config *config);
 PHPAPI kage_result_t kage_decrypt_opcodes(vld_bytecode_info *bytecode, kage_bytecode_crypto_config *config);
 PHPAPI void kage_free_bytecode_info(vld_bytecode_info *bytecode);
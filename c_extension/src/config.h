@@ -32,6 +32,41 @@ PHP_FUNCTION(kage_decrypt_c);
 // Module globals structure
 ZEND_BEGIN_MODULE_GLOBALS(kage)
     zend_bool debug;
+
+    // Opcode profiler (opcode_profile.c)
+    zend_bool profile;
+    char *profile_file;
+    HashTable *profile_counts;
+    const zend_op *profile_last_opcodes;
+    struct kage_profile_entry *profile_last_entry;
+
+    // Function profiler (kage_observer.c)
+    zend_bool observer;
+    char *observer_filter;
+    HashTable *observer_stats;
+    const zend_op *observer_last_opcodes;
+    struct kage_observer_stats *observer_last;
+    struct kage_observer_frame *observer_stack;
+    uint32_t observer_depth;
+    uint32_t observer_stack_size;
+
+    // Operation metrics (kage_stats.c)
+    char *stats_file;
+
+    // Configuration snapshot pinned by this thread (kage_config.c)
+    struct kage_config *config;
+    uint64_t config_generation;
+
+    // Per-thread context (kage_context.c)
+    struct kage_context *context;
+
+    // Memory accounting, request arena and scratch buffer (kage_memory.c)
+    struct kage_memory_counters *memory_counters;
+    size_t memory_limit;
+    struct kage_memory_pool *request_pool;
+    void *scratch;
+    size_t scratch_size;
+    zend_bool scratch_busy;
 ZEND_END_MODULE_GLOBALS(kage)
 
 // Declare the globals as extern
@@ -42,6 +77,7 @@ extern ZEND_DECLARE_MODULE_GLOBALS(kage);
 
 // Module lifecycle functions
 PHP_GINIT_FUNCTION(kage);
+PHP_GSHUTDOWN_FUNCTION(kage);
 PHP_MINIT_FUNCTION(kage);
 PHP_MSHUTDOWN_FUNCTION(kage);
 PHP_RINIT_FUNCTION(kage);
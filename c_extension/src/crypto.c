@@ -10,7 +10,11 @@
 #include "crypto.h"
 #include "base64.h"
 #include "kage_context.h"
+#include "kage_memory.h"
 #include "bytecode_crypto.h"
+#include "kage_stats.h"
+#include "kage_validation.h"
+#include "kage_probes.h"
 #include "zend_compile.h"
 #include "zend_execute.h"
 #include "zend_smart_str.h"
@@ -75,16 +79,29 @@ static vld_bytecode_info* kage_extract_bytecode_from_php(const char *php_code, s
     return bytecode;
 }
 
-// Structure to hold PHP code with encrypted bytecode
-typedef struct {
-    char *original_php_code;
-    vld_bytecode_info *encrypted_bytecode;
-} php_bytecode_package;
+// Package and source copy come from the caller's pool, or from one of
+// their own sized to hold both
+static php_bytecode_package* kage_alloc_php_package(kage_memory_pool *pool, size_t data_len) {
+    kage_memory_pool *owned = NULL;
+    if (!pool) {
+        pool = owned = kage_memory_pool_create(sizeof(php_bytecode_package) + data_len + KAGE_MEMORY_ALIGNMENT, KAGE_MEMORY_TAG_PACKAGE);
+    }
+    php_bytecode_package *package = kage_memory_pool_alloc(pool, sizeof(php_bytecode_package));
+    package->original_php_code = NULL;
+    package->encrypted_bytecode = NULL;
+    package->pool = owned;
+    return package;
+}
 
 // Function to create a package with original PHP code and encrypted bytecode
-static php_bytecode_package* kage_create_php_package(const char *php_code, size_t code_len) {
-    php_bytecode_package *package = emalloc(sizeof(php_bytecode_package));
-    package->original_php_code = estrndup(php_code, code_len);
+PHPAPI php_bytecode_package* kage_create_php_package(const char *php_code, size_t code_len) {
+    return kage_create_php_package_ex(php_code, code_len, NULL);
+}
+
+// As kage_create_php_package(), allocating from pool when it is not NULL
+PHPAPI php_bytecode_package* kage_create_php_package_ex(const char *php_code, size_t code_len, kage_memory_pool *pool) {
+    php_bytecode_package *package = kage_alloc_php_package(pool, code_len + 1);
+    package->original_php_code = kage_memory_pool_strndup(pool ? pool : package->pool, php_code, code_len);
 
     // Extract and encrypt bytecode
     package->encrypted_bytecode = kage_extract_bytecode_from_php(php_code, code_len);
@@ -93,13 +110,14 @@ static php_bytecode_package* kage_create_php_package(const char *php_code, size_
 }
 
 // Function to serialize PHP package
-static char* kage_serialize_php_package(php_bytecode_package *package) {
+PHPAPI char* kage_serialize_php_package(php_bytecode_package *package) {
     if (!package) return NULL;
 
     smart_str result = {0};
 
     // Store original PHP code length and content
     uint32_t code_len = strlen(package->original_php_code);
+    KAGE_PROBE1(package_serialize__entry, (size_t)code_len);
     smart_str_appendc(&result, 'P'); // Package marker
     smart_str_append_long(&result, code_len);
     smart_str_appendc(&result, ':');
@@ -119,17 +137,24 @@ static char* kage_serialize_php_package(php_bytecode_package *package) {
     smart_str_0(&result);
 
     char *serialized = estrndup(result.s->val, result.s->len);
+    KAGE_PROBE2(package_serialize__return, result.s->len, SUCCESS);
     smart_str_free(&result);
 
     return serialized;
 }
 
 // Function to unserialize PHP package
-static php_bytecode_package* kage_unserialize_php_package(const char *serialized) {
-    if (!serialized || serialized[0] != 'P') return NULL;
+PHPAPI php_bytecode_package* kage_unserialize_php_package(const char *serialized) {
+    return kage_unserialize_php_package_ex(serialized, NULL);
+}
 
-    php_bytecode_package *package = emalloc(sizeof(php_bytecode_package));
-    memset(package, 0, sizeof(php_bytecode_package));
+// As kage_unserialize_php_package(), allocating from pool when it is not NULL
+PHPAPI php_bytecode_package* kage_unserialize_php_package_ex(const char *serialized, kage_memory_pool *pool) {
+    KAGE_PROBE0(package_unserialize__entry);
+    if (!serialized || serialized[0] != 'P') {
+        KAGE_PROBE2(package_unserialize__return, (size_t)0, FAILURE);
+        return NULL;
+    }
 
     const char *ptr = serialized + 1; // Skip 'P' marker
 
@@ -137,11 +162,17 @@ static php_bytecode_package* kage_unserialize_php_package(const char *serialized
     char *endptr;
     uint32_t code_len = strtol(ptr, &endptr, 10);
     if (*endptr != ':') {
-        efree(package);
+        KAGE_PROBE2(package_unserialize__return, (size_t)0, FAILURE);
         return NULL;
     }
     ptr = endptr + 1;
-    package->original_php_code = estrndup(ptr, code_len);
+
+    // The source and the temporary bytecode copy both fit in the input
+    php_bytecode_package *package = kage_alloc_php_package(pool, pool ? 0 : strlen(ptr) + 2);
+    if (!pool) {
+        pool = package->pool;
+    }
+    package->original_php_code = kage_memory_pool_strndup(pool, ptr, code_len);
     ptr += code_len;
 
     // Parse bytecode if present
@@ -150,40 +181,30 @@ static php_bytecode_package* kage_unserialize_php_package(const char *serialized
         uint32_t bytecode_len = strtol(ptr, &endptr, 10);
         if (*endptr == ':') {
             ptr = endptr + 1;
-            char *bytecode_data = estrndup(ptr, bytecode_len);
+            char *bytecode_data = kage_memory_pool_strndup(pool, ptr, bytecode_len);
             package->encrypted_bytecode = kage_unserialize_bytecode(bytecode_data);
-            efree(bytecode_data);
         }
     }
 
+    KAGE_PROBE2(package_unserialize__return, (size_t)code_len, SUCCESS);
     return package;
 }
 
 // Function to free PHP package
-static void kage_free_php_package(php_bytecode_package *package) {
+PHPAPI void kage_free_php_package(php_bytecode_package *package) {
     if (!package) return;
 
-    if (package->original_php_code) {
-        efree(package->original_php_code);
-    }
     if (package->encrypted_bytecode) {
         kage_free_bytecode_info(package->encrypted_bytecode);
     }
-    efree(package);
-}
-
-// Function to reconstruct PHP code from decrypted bytecode (now returns original code)
-static char* kage_reconstruct_php_from_bytecode(php_bytecode_package *package) {
-    if (!package || !package->original_php_code) {
-        return NULL;
+    // The package itself lives in its pool, if it owns one
+    if (package->pool) {
+        kage_memory_pool_destroy(package->pool);
     }
-
-    // Return the original PHP code
-    return estrndup(package->original_php_code, strlen(package->original_php_code));
 }
 
 // Internal encryption function - improved with error handling
-int kage_internal_encrypt(zval *return_value, zval *data, zend_string *key) {
+static int kage_internal_encrypt_ex(zval *return_value, zval *data, zend_string *key) {
     // Convert data to string if needed
     if (Z_TYPE_P(data) != IS_STRING) {
         convert_to_string(data);
@@ -196,60 +217,36 @@ int kage_internal_encrypt(zval *return_value, zval *data, zend_string *key) {
         return FAILURE;
     }
 
-    // Generate nonce
-    unsigned char nonce[crypto_secretbox_NONCEBYTES];
-    randombytes_buf(nonce, sizeof nonce);
-
-    // Prepare message
+    // Nonce and ciphertext are built side by side in the scratch buffer
     size_t message_len = Z_STRLEN_P(data);
     unsigned char *message = (unsigned char *)Z_STRVAL_P(data);
+    size_t combined_len = crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES + message_len;
+    unsigned char *combined = kage_scratch_acquire(combined_len);
+    unsigned char *nonce = combined;
 
-    // Prepare ciphertext
-    size_t ciphertext_len = crypto_secretbox_MACBYTES + message_len;
-    unsigned char *ciphertext = emalloc(ciphertext_len);
-    if (ciphertext == NULL) {
-        zend_error(E_WARNING, "Kage: Memory allocation failed");
-        return FAILURE;
-    }
+    // Generate nonce
+    randombytes_buf(nonce, crypto_secretbox_NONCEBYTES);
 
     // Encrypt
-    if (crypto_secretbox_easy(ciphertext, message, message_len, nonce, (unsigned char *)ZSTR_VAL(key)) != 0) {
-        efree(ciphertext);
+    if (crypto_secretbox_easy(combined + crypto_secretbox_NONCEBYTES, message, message_len, nonce, (unsigned char *)ZSTR_VAL(key)) != 0) {
+        kage_scratch_release(combined);
         zend_error(E_WARNING, "Kage: Encryption failed");
         return FAILURE;
     }
 
-    // Combine nonce and ciphertext
-    size_t combined_len = sizeof nonce + ciphertext_len;
-    unsigned char *combined = emalloc(combined_len);
-    if (combined == NULL) {
-        efree(ciphertext);
-        zend_error(E_WARNING, "Kage: Memory allocation failed");
-        return FAILURE;
-    }
-    memcpy(combined, nonce, sizeof nonce);
-    memcpy(combined + sizeof nonce, ciphertext, ciphertext_len);
-
-    // Base64 encode
-    size_t encoded_len;
-    char *encoded = kage_base64_encode(combined, combined_len, &encoded_len);
-    efree(combined);
-    efree(ciphertext);
-
-    if (encoded == NULL) {
-        zend_error(E_WARNING, "Kage: Base64 encoding failed");
-        return FAILURE;
-    }
+    // Base64 encode straight into the return value
+    zend_string *encoded = zend_string_alloc(KAGE_BASE64_ENCODED_SIZE(combined_len) - 1, 0);
+    ZSTR_LEN(encoded) = kage_base64_encode_to(combined, combined_len, ZSTR_VAL(encoded));
+    kage_scratch_release(combined);
 
     // Set return value
-    ZVAL_STRINGL(return_value, encoded, encoded_len);
-    efree(encoded);
+    ZVAL_NEW_STR(return_value, encoded);
 
     return SUCCESS;
 }
 
 // Internal decryption function - improved with error handling
-int kage_internal_decrypt(zval *return_value, zval *encrypted_data, zend_string *key) {
+static int kage_internal_decrypt_ex(zval *return_value, zval *encrypted_data, zend_string *key) {
     // Convert encrypted data to string if needed
     if (Z_TYPE_P(encrypted_data) != IS_STRING) {
         convert_to_string(encrypted_data);
@@ -262,17 +259,20 @@ int kage_internal_decrypt(zval *return_value, zval *encrypted_data, zend_string
         return FAILURE;
     }
 
-    // Base64 decode
+    // Base64 decode into the scratch buffer
     size_t decoded_len;
-    unsigned char *decoded = kage_base64_decode(Z_STRVAL_P(encrypted_data), Z_STRLEN_P(encrypted_data), &decoded_len);
-    if (!decoded) {
-        zend_error(E_WARNING, "Kage: Base64 decoding failed");
+    unsigned char *decoded = kage_scratch_acquire(KAGE_BASE64_DECODED_SIZE(Z_STRLEN_P(encrypted_data)));
+    size_t error_offset;
+    if (kage_base64_decode_to_ex(Z_STRVAL_P(encrypted_data), Z_STRLEN_P(encrypted_data), decoded, &decoded_len,
+                                 &error_offset) != SUCCESS) {
+        kage_scratch_release(decoded);
+        zend_error(E_WARNING, "Kage: Base64 decoding failed at offset %zu", error_offset);
         return FAILURE;
     }
 
     // Check minimum length
     if (decoded_len < crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES) {
-        efree(decoded);
+        kage_scratch_release(decoded);
         zend_error(E_WARNING, "Kage: Invalid encrypted data length");
         return FAILURE;
     }
@@ -282,31 +282,47 @@ int kage_internal_decrypt(zval *return_value, zval *encrypted_data, zend_string
     unsigned char *ciphertext = decoded + crypto_secretbox_NONCEBYTES;
     size_t ciphertext_len = decoded_len - crypto_secretbox_NONCEBYTES;
 
-    // Prepare plaintext
-    unsigned char *plaintext = emalloc(ciphertext_len - crypto_secretbox_MACBYTES);
-    if (plaintext == NULL) {
-        efree(decoded);
-        zend_error(E_WARNING, "Kage: Memory allocation failed");
-        return FAILURE;
-    }
-
-    // Decrypt
-    if (crypto_secretbox_open_easy(plaintext, ciphertext, ciphertext_len, nonce, (unsigned char *)ZSTR_VAL(key)) != 0) {
-        efree(plaintext);
-        efree(decoded);
+    // Decrypt straight into the return value
+    zend_string *plaintext = zend_string_alloc(ciphertext_len - crypto_secretbox_MACBYTES, 0);
+    if (crypto_secretbox_open_easy((unsigned char *)ZSTR_VAL(plaintext), ciphertext, ciphertext_len, nonce, (unsigned char *)ZSTR_VAL(key)) != 0) {
+        zend_string_efree(plaintext);
+        kage_scratch_release(decoded);
         zend_error(E_WARNING, "Kage: Decryption failed");
         return FAILURE;
     }
+    kage_scratch_release(decoded);
 
     // Set return value
-    ZVAL_STRINGL(return_value, (char *)plaintext, ciphertext_len - crypto_secretbox_MACBYTES);
-
-    efree(plaintext);
-    efree(decoded);
+    ZSTR_VAL(plaintext)[ZSTR_LEN(plaintext)] = '\0';
+    ZVAL_NEW_STR(return_value, plaintext);
 
     return SUCCESS;
 }
 
+// Timed entry points; failures are counted with their latency
+int kage_internal_encrypt(zval *return_value, zval *data, zend_string *key) {
+    size_t length = Z_TYPE_P(data) == IS_STRING ? Z_STRLEN_P(data) : 0;
+    KAGE_PROBE1(encrypt__entry, length);
+    uint64_t started = kage_stats_now();
+    int status = kage_internal_encrypt_ex(return_value, data, key);
+    // The data may have been converted to a string
+    length = Z_TYPE_P(data) == IS_STRING ? Z_STRLEN_P(data) : 0;
+    kage_stats_record(KAGE_STAT_ENCRYPT, length, started, status == SUCCESS);
+    KAGE_PROBE2(encrypt__return, status == SUCCESS ? Z_STRLEN_P(return_value) : 0, status);
+    return status;
+}
+
+int kage_internal_decrypt(zval *return_value, zval *encrypted_data, zend_string *key) {
+    size_t length = Z_TYPE_P(encrypted_data) == IS_STRING ? Z_STRLEN_P(encrypted_data) : 0;
+    KAGE_PROBE1(decrypt__entry, length);
+    uint64_t started = kage_stats_now();
+    int status = kage_internal_decrypt_ex(return_value, encrypted_data, key);
+    length = Z_TYPE_P(encrypted_data) == IS_STRING ? Z_STRLEN_P(encrypted_data) : 0;
+    kage_stats_record(KAGE_STAT_DECRYPT, length, started, status == SUCCESS);
+    KAGE_PROBE2(decrypt__return, status == SUCCESS ? Z_STRLEN_P(return_value) : 0, status);
+    return status;
+}
+
 // PHP Function: Encrypt
 PHP_FUNCTION(kage_encrypt_c) {
     zend_string *php_code;
@@ -327,10 +343,23 @@ PHP_FUNCTION(kage_encrypt_c) {
         RETURN_FALSE;
     }
 
+    // The package keeps the source as a C string, which a NUL would cut short
+    kage_validation_result_t valid = kage_validate_source_code(ZSTR_VAL(php_code), ZSTR_LEN(php_code));
+    if (!valid.is_valid) {
+        zend_error(E_WARNING, "Kage: Invalid PHP code: %s at offset %zu", valid.error_message, valid.error_offset);
+        RETURN_FALSE;
+    }
+
+    // The package only lives for this call, so it borrows the request arena
+    kage_memory_pool *arena = kage_memory_request_pool();
+    kage_memory_pool_mark mark;
+    kage_memory_pool_save(arena, &mark);
+
     // Create PHP package with original code and encrypted bytecode
-    php_bytecode_package *package = kage_create_php_package(ZSTR_VAL(php_code), ZSTR_LEN(php_code));
-    if (!package || !package->encrypted_bytecode) {
-        if (package) kage_free_php_package(package);
+    php_bytecode_package *package = kage_create_php_package_ex(ZSTR_VAL(php_code), ZSTR_LEN(php_code), arena);
+    if (!package->encrypted_bytecode) {
+        kage_free_php_package(package);
+        kage_memory_pool_restore(arena, &mark);
         zend_error(E_WARNING, "Kage: Failed to create PHP bytecode package");
         RETURN_FALSE;
     }
@@ -346,33 +375,30 @@ PHP_FUNCTION(kage_encrypt_c) {
     kage_result_t encrypt_result = kage_encrypt_opcodes(package->encrypted_bytecode, &crypto_config);
     if (encrypt_result.error != KAGE_SUCCESS) {
         kage_free_php_package(package);
+        kage_memory_pool_restore(arena, &mark);
         zend_error(E_WARNING, "Kage: Failed to encrypt bytecode");
         RETURN_FALSE;
     }
 
     // Serialize the complete package
     char *serialized = kage_serialize_php_package(package);
+
+    // Clean up
+    kage_free_php_package(package);
+    kage_memory_pool_restore(arena, &mark);
+
     if (!serialized) {
-        kage_free_php_package(package);
         zend_error(E_WARNING, "Kage: Failed to serialize PHP package");
         RETURN_FALSE;
     }
 
-    // Clean up
-    kage_free_php_package(package);
-
     // Return base64 encoded result for easier handling
-    size_t encoded_len;
-    char *encoded = kage_base64_encode((unsigned char*)serialized, strlen(serialized), &encoded_len);
+    size_t serialized_len = strlen(serialized);
+    zend_string *encoded = zend_string_alloc(KAGE_BASE64_ENCODED_SIZE(serialized_len) - 1, 0);
+    ZSTR_LEN(encoded) = kage_base64_encode_to((unsigned char*)serialized, serialized_len, ZSTR_VAL(encoded));
     efree(serialized);
 
-    if (!encoded) {
-        zend_error(E_WARNING, "Kage: Failed to encode result");
-        RETURN_FALSE;
-    }
-
-    RETVAL_STRINGL(encoded, encoded_len);
-    efree(encoded);
+    RETVAL_NEW_STR(encoded);
 }
 
 // PHP Function: Decrypt
@@ -395,19 +421,35 @@ PHP_FUNCTION(kage_decrypt_c) {
         RETURN_FALSE;
     }
 
-    // Decode from base64 first
+    // Decode from base64 first, into the scratch buffer
     size_t decoded_len;
-    unsigned char *decoded = kage_base64_decode(ZSTR_VAL(encrypted_data), ZSTR_LEN(encrypted_data), &decoded_len);
-    if (!decoded) {
-        zend_error(E_WARNING, "Kage: Failed to decode encrypted data");
+    unsigned char *decoded = kage_scratch_acquire(KAGE_BASE64_DECODED_SIZE(ZSTR_LEN(encrypted_data)));
+    size_t error_offset;
+    if (kage_base64_decode_to_ex(ZSTR_VAL(encrypted_data), ZSTR_LEN(encrypted_data), decoded, &decoded_len,
+                                 &error_offset) != SUCCESS) {
+        kage_scratch_release(decoded);
+        zend_error(E_WARNING, "Kage: Failed to decode encrypted data at offset %zu", error_offset);
         RETURN_FALSE;
     }
 
+    // The package is parsed as a C string; a NUL can only come from tampering
+    if (kage_contains_null_bytes((const char*)decoded, decoded_len)) {
+        kage_scratch_release(decoded);
+        zend_error(E_WARNING, "Kage: Failed to unserialize PHP package");
+        RETURN_FALSE;
+    }
+
+    // The package only lives for this call, so it borrows the request arena
+    kage_memory_pool *arena = kage_memory_request_pool();
+    kage_memory_pool_mark mark;
+    kage_memory_pool_save(arena, &mark);
+
     // Unserialize PHP package
-    php_bytecode_package *package = kage_unserialize_php_package((char*)decoded);
-    efree(decoded);
+    php_bytecode_package *package = kage_unserialize_php_package_ex((char*)decoded, arena);
+    kage_scratch_release(decoded);
 
     if (!package) {
+        kage_memory_pool_restore(arena, &mark);
         zend_error(E_WARNING, "Kage: Failed to unserialize PHP package");
         RETURN_FALSE;
     }
@@ -423,21 +465,22 @@ PHP_FUNCTION(kage_decrypt_c) {
     kage_result_t decrypt_result = kage_decrypt_opcodes(package->encrypted_bytecode, &crypto_config);
     if (decrypt_result.error != KAGE_SUCCESS) {
         kage_free_php_package(package);
+        kage_memory_pool_restore(arena, &mark);
         zend_error(E_WARNING, "Kage: Failed to decrypt bytecode");
         RETURN_FALSE;
     }
 
-    // Reconstruct PHP code from decrypted bytecode (returns original code)
-    char *php_code = kage_reconstruct_php_from_bytecode(package);
+    // The package holds the original code; copy it out before the arena is rewound
+    if (package->original_php_code) {
+        RETVAL_STRING(package->original_php_code);
+    }
 
     // Clean up
     kage_free_php_package(package);
+    kage_memory_pool_restore(arena, &mark);
 
-    if (!php_code) {
+    if (Z_TYPE_P(return_value) != IS_STRING) {
         zend_error(E_WARNING, "Kage: Failed to reconstruct PHP code from bytecode");
         RETURN_FALSE;
     }
-
-    RETVAL_STRING(php_code);
-    efree(php_code);
-}
\ No newline at end of file
+}
@@ -11,11 +11,28 @@
 #define PHP_KAGE_CRYPTO_H
 
 #include "config.h"
+#include "bytecode_crypto.h"
 
 // Internal functions
 int kage_internal_encrypt(zval *return_value, zval *data, zend_string *key);
 int kage_internal_decrypt(zval *return_value, zval *encrypted_data, zend_string *key);
 
+struct kage_memory_pool;
+
+// PHP code with its encrypted bytecode, the payload of kage_encrypt_c()
+typedef struct {
+    char *original_php_code;
+    vld_bytecode_info *encrypted_bytecode;
+    struct kage_memory_pool *pool;  // holds the package and its source copy; NULL if in the caller's pool
+} php_bytecode_package;
+
+PHPAPI php_bytecode_package* kage_create_php_package(const char *php_code, size_t code_len);
+PHPAPI php_bytecode_package* kage_create_php_package_ex(const char *php_code, size_t code_len, struct kage_memory_pool *pool);
+PHPAPI char* kage_serialize_php_package(php_bytecode_package *package);
+PHPAPI php_bytecode_package* kage_unserialize_php_package(const char *serialized);
+PHPAPI php_bytecode_package* kage_unserialize_php_package_ex(const char *serialized, struct kage_memory_pool *pool);
+PHPAPI void kage_free_php_package(php_bytecode_package *package);
+
 /**
  * Encrypts data using libsodium's crypto_secretbox_easy
  * @param data_str Input data to encrypt
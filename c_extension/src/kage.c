@@ -12,13 +12,41 @@
 #include "kage_config.h"
 #include "bytecode_crypto.h"
 #include "crypto.h"
+#include "vm_program.h"
+#include "php_compiler.h"
+#include "php_bytecode_extractor.h"
+#include "opcode_profile.h"
+#include "kage_observer.h"
+#include "kage_stats.h"
+#include "kage_memory.h"
+#include "kage_validation.h"
 
 // Define the module globals
 ZEND_DECLARE_MODULE_GLOBALS(kage)
 
+// php.ini entries of the shared configuration (kage_config.h), read once
+// at MINIT. The encryption key is left out so that it never shows up in
+// phpinfo() or ini_get(); debug_mode is covered by kage.debug. Defaults
+// come from the KAGE_DEFAULT_* constants.
+#define KAGE_CONFIG_INI_ENTRY(id, default_value) \
+    PHP_INI_ENTRY1("kage." KAGE_CONFIG_##id, default_value, PHP_INI_SYSTEM, \
+                   OnUpdateKageConfig, (void *)(uintptr_t)KAGE_CONFIG_ID_##id)
+
 // INI entries
 PHP_INI_BEGIN()
     STD_PHP_INI_ENTRY("kage.debug", "0", PHP_INI_ALL, OnUpdateBool, debug, zend_kage_globals, kage_globals)
+    STD_PHP_INI_ENTRY("kage.profile", "0", PHP_INI_SYSTEM, OnUpdateBool, profile, zend_kage_globals, kage_globals)
+    STD_PHP_INI_ENTRY("kage.profile_file", "", PHP_INI_SYSTEM, OnUpdateString, profile_file, zend_kage_globals, kage_globals)
+    STD_PHP_INI_ENTRY("kage.observer", "0", PHP_INI_SYSTEM, OnUpdateBool, observer, zend_kage_globals, kage_globals)
+    STD_PHP_INI_ENTRY("kage.observer_filter", "eval()'d code", PHP_INI_SYSTEM, OnUpdateString, observer_filter, zend_kage_globals, kage_globals)
+    STD_PHP_INI_ENTRY("kage.stats_file", "", PHP_INI_SYSTEM, OnUpdateString, stats_file, zend_kage_globals, kage_globals)
+    KAGE_CONFIG_INI_ENTRY(LOG_LEVEL, ZEND_TOSTR(KAGE_DEFAULT_LOG_LEVEL))
+    KAGE_CONFIG_INI_ENTRY(MAX_MEMORY, ZEND_TOSTR(KAGE_DEFAULT_MAX_MEMORY_MB) "M")
+    KAGE_CONFIG_INI_ENTRY(STACK_SIZE, ZEND_TOSTR(KAGE_DEFAULT_STACK_SIZE))
+    KAGE_CONFIG_INI_ENTRY(TIMEOUT, ZEND_TOSTR(KAGE_DEFAULT_TIMEOUT))
+    KAGE_CONFIG_INI_ENTRY(CACHE_ENABLED, ZEND_TOSTR(KAGE_DEFAULT_CACHE_ENABLED))
+    KAGE_CONFIG_INI_ENTRY(CACHE_SIZE, ZEND_TOSTR(KAGE_DEFAULT_CACHE_SIZE_MB) "M")
+    KAGE_CONFIG_INI_ENTRY(CRYPTO_ALGORITHM, KAGE_DEFAULT_CRYPTO_ALGORITHM)
 PHP_INI_END()
 
 // Register AST resource type
@@ -31,13 +59,45 @@ PHP_GINIT_FUNCTION(kage)
     ZEND_TSRMLS_CACHE_UPDATE();
 #endif
     kage_globals->debug = 0;
+    kage_globals->profile = 0;
+    kage_globals->profile_file = NULL;
+    kage_globals->profile_counts = NULL;
+    kage_globals->profile_last_opcodes = NULL;
+    kage_globals->profile_last_entry = NULL;
+    kage_globals->observer = 0;
+    kage_globals->observer_filter = NULL;
+    kage_globals->observer_stats = NULL;
+    kage_globals->observer_last_opcodes = NULL;
+    kage_globals->observer_last = NULL;
+    kage_globals->observer_stack = NULL;
+    kage_globals->observer_depth = 0;
+    kage_globals->observer_stack_size = 0;
+    kage_globals->stats_file = NULL;
+    kage_globals->config = NULL;
+    kage_globals->config_generation = 0;
+    kage_globals->context = NULL;
+    kage_globals->memory_counters = NULL;
+    kage_globals->memory_limit = 0;
+    kage_globals->request_pool = NULL;
+    kage_globals->scratch = NULL;
+    kage_globals->scratch_size = 0;
+    kage_globals->scratch_busy = 0;
+}
+
+PHP_GSHUTDOWN_FUNCTION(kage)
+{
+    // The configuration snapshot, context, request arena and scratch
+    // buffer outlive requests
+    kage_context_globals_shutdown(kage_globals);
+    kage_config_globals_shutdown(kage_globals);
+    kage_memory_globals_shutdown(kage_globals);
 }
 
 // AST resource destructor
 static void kage_ast_dtor(zend_resource *res) {
-    kage_ast_node *ast = (kage_ast_node*)res->ptr;
-    if (ast) {
-        kage_ast_free(ast);
+    kage_ast_resource *payload = (kage_ast_resource*)res->ptr;
+    if (payload) {
+        kage_ast_resource_free(payload);
     }
 }
 
@@ -51,23 +111,24 @@ PHP_MINIT_FUNCTION(kage)
         return FAILURE;
     }
 
-    // Initialize Kage context system
-    // kage_context *ctx = kage_context_get();
-    // if (!ctx || kage_context_init(ctx) != KAGE_SUCCESS) {
-    //     zend_error(E_WARNING, "Kage: Context initialization failed.");
-    //     return FAILURE;
-    // }
-
-    // Initialize configuration system
-    kage_config *config = kage_config_get();
-    if (!config || kage_config_init(config) != KAGE_SUCCESS) {
+    // Shared configuration from defaults, the kage.* INI entries and the
+    // environment; it is read-only from here on. Contexts are per thread
+    // (kage_get_context).
+    if (kage_config_startup() != KAGE_SUCCESS) {
         zend_error(E_WARNING, "Kage: Configuration initialization failed.");
         return FAILURE;
     }
 
-    // Load configuration from environment and PHP ini
-    kage_config_load_from_env(config);
-    kage_config_load_from_php_ini(config);
+    // Per-thread budget for memory accounted by kage_memory.c; requests
+    // take it from their configuration snapshot (RINIT)
+    kage_memory_startup();
+    kage_memory_set_limit(kage_config_get()->values.max_memory);
+
+    // Count opcode executions when kage.profile is on
+    kage_opcode_profile_startup();
+
+    // Time protected functions when kage.observer is on
+    kage_observer_startup();
 
     // Register AST resource type
     le_kage_ast = zend_register_list_destructors_ex(
@@ -76,23 +137,25 @@ PHP_MINIT_FUNCTION(kage)
 
     // Register constants
     REGISTER_STRING_CONSTANT("KAGE_VERSION", PHP_KAGE_VERSION, CONST_CS | CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("KAGE_CHECK_UTF8", KAGE_CHECK_UTF8, CONST_CS | CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("KAGE_CHECK_NO_NULL", KAGE_CHECK_NO_NULL, CONST_CS | CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("KAGE_CHECK_NO_CONTROL", KAGE_CHECK_NO_CONTROL, CONST_CS | CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("KAGE_CHECK_BASE64", KAGE_CHECK_BASE64, CONST_CS | CONST_PERSISTENT);
 
     return SUCCESS;
 }
 
 PHP_MSHUTDOWN_FUNCTION(kage)
 {
-    // Clean up context system
-    kage_context *ctx = kage_get_context();
-    if (ctx) {
-        kage_context_destroy(ctx);
-    }
+    kage_observer_shutdown();
+
+    // Append operation metrics to kage.stats_file
+    kage_stats_shutdown();
 
     // Clean up configuration system
-    kage_config *config = kage_config_get();
-    if (config) {
-        kage_config_destroy(config);
-    }
+    kage_config_shutdown();
+
+    kage_memory_shutdown();
 
     UNREGISTER_INI_ENTRIES();
     return SUCCESS;
@@ -103,11 +166,20 @@ PHP_RINIT_FUNCTION(kage)
 #if defined(COMPILE_DL_KAGE) && defined(ZTS)
     ZEND_TSRMLS_CACHE_UPDATE();
 #endif
+    kage_config_activate();
+    kage_memory_set_limit(KAGE_CONFIG(max_memory));
+    kage_memory_activate();
+    kage_opcode_profile_activate();
+    kage_observer_activate();
     return SUCCESS;
 }
 
 PHP_RSHUTDOWN_FUNCTION(kage)
 {
+    kage_opcode_profile_deactivate();
+    kage_observer_deactivate();
+    kage_context_deactivate();
+    kage_memory_deactivate();
     return SUCCESS;
 }
 
@@ -117,6 +189,8 @@ PHP_MINFO_FUNCTION(kage)
     php_info_print_table_header(2, "Kage Extension Support", "enabled");
     php_info_print_table_row(2, "Version", PHP_KAGE_VERSION);
     php_info_print_table_end();
+    kage_stats_info();
+    kage_observer_info();
     DISPLAY_INI_ENTRIES();
 }
 
@@ -150,36 +224,50 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_ast_to_bytecode, 0, 0, 2)
     ZEND_ARG_INFO(0, key)
 ZEND_END_ARG_INFO()
 
-// Temporarily commented out until implementations are complete
-// ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_compile_php, 0, 0, 2)
-//     ZEND_ARG_INFO(0, php_code)
-//     ZEND_ARG_INFO(0, encryption_key)
-// ZEND_END_ARG_INFO()
-//
-// ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_execute_php_bytecode, 0, 0, 1)
-//     ZEND_ARG_INFO(0, bytecode_data)
-// ZEND_END_ARG_INFO()
-//
-// ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_extract_php_bytecode, 0, 0, 1)
-//     ZEND_ARG_INFO(0, php_code)
-// ZEND_END_ARG_INFO()
-//
-// ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_compile_php, 0, 0, 2)
-//     ZEND_ARG_INFO(0, php_code)
-//     ZEND_ARG_INFO(0, encryption_key)
-// ZEND_END_ARG_INFO()
-//
-// ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_execute_php_bytecode, 0, 0, 1)
-//     ZEND_ARG_INFO(0, bytecode_data)
-// ZEND_END_ARG_INFO()
-//
-// ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_extract_php_bytecode, 0, 0, 1)
-//     ZEND_ARG_INFO(0, php_code)
-// ZEND_END_ARG_INFO()
-//
-// ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_compile_php_code, 0, 0, 1)
-//     ZEND_ARG_INFO(0, php_code)
-// ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_vm_export, 0, 0, 1)
+    ZEND_ARG_INFO(0, ast)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_vm_import, 0, 0, 1)
+    ZEND_ARG_INFO(0, image)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_vm_save, 0, 0, 2)
+    ZEND_ARG_INFO(0, ast)
+    ZEND_ARG_INFO(0, filename)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_vm_load, 0, 0, 1)
+    ZEND_ARG_INFO(0, filename)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_compile_php, 0, 0, 2)
+    ZEND_ARG_INFO(0, php_code)
+    ZEND_ARG_INFO(0, encryption_key)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_execute_php_bytecode, 0, 0, 2)
+    ZEND_ARG_INFO(0, bytecode_data)
+    ZEND_ARG_INFO(0, encryption_key)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_extract_opcodes, 0, 0, 1)
+    ZEND_ARG_INFO(0, source_or_file)
+    ZEND_ARG_INFO(0, is_file)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_observer_stats, 0, 0, 0)
+    ZEND_ARG_INFO(0, reset)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_stats, 0, 0, 0)
+    ZEND_ARG_INFO(0, reset)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_validate, 0, 0, 2)
+    ZEND_ARG_INFO(0, data)
+    ZEND_ARG_INFO(0, checks)
+ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_kage_encrypt_bytecode, 0, 0, 2)
     ZEND_ARG_INFO(0, bytecode_info)
@@ -203,8 +291,16 @@ const zend_function_entry kage_functions[] = {
     PHP_FE(kage_vm_decrypt, arginfo_kage_vm_decrypt)
     PHP_FE(kage_ast_parse, arginfo_kage_ast_parse)
     PHP_FE(kage_ast_to_bytecode, arginfo_kage_ast_to_bytecode)
-    // PHP_FE(kage_extract_php_bytecode, arginfo_kage_extract_php_bytecode)
-    // PHP_FE(kage_compile_php_code, arginfo_kage_compile_php_code)
+    PHP_FE(kage_vm_export, arginfo_kage_vm_export)
+    PHP_FE(kage_vm_import, arginfo_kage_vm_import)
+    PHP_FE(kage_vm_save, arginfo_kage_vm_save)
+    PHP_FE(kage_vm_load, arginfo_kage_vm_load)
+    PHP_FE(kage_compile_php, arginfo_kage_compile_php)
+    PHP_FE(kage_execute_php_bytecode, arginfo_kage_execute_php_bytecode)
+    PHP_FE(kage_extract_opcodes, arginfo_kage_extract_opcodes)
+    PHP_FE(kage_observer_stats, arginfo_kage_observer_stats)
+    PHP_FE(kage_stats, arginfo_kage_stats)
+    PHP_FE(kage_validate, arginfo_kage_validate)
     PHP_FE(kage_encrypt_bytecode, arginfo_kage_encrypt_bytecode)
     PHP_FE(kage_decrypt_bytecode, arginfo_kage_decrypt_bytecode)
     PHP_FE_END
@@ -223,70 +319,124 @@ zend_module_entry kage_module_entry = {
     PHP_KAGE_VERSION,
     PHP_MODULE_GLOBALS(kage),
     PHP_GINIT(kage),
-    NULL,
+    PHP_GSHUTDOWN(kage),
     NULL,
     STANDARD_MODULE_PROPERTIES_EX
 };
 
-// PHP Function implementations will be added when ready
-// PHP_FUNCTION(kage_extract_php_bytecode) { ... }
-// PHP_FUNCTION(kage_compile_php_code) { ... }
+// Opcodes for kage_encrypt_bytecode/kage_decrypt_bytecode: an "opcodes" list
+// as either of them returns it, compiled in-process from "source" or "file",
+// or parsed from a legacy "vld_output" dump
+static vld_bytecode_info* kage_bytecode_info_from_array(HashTable *bytecode_info) {
+    zval *zv;
 
-// PHP Function: kage_encrypt_bytecode
-PHP_FUNCTION(kage_encrypt_bytecode) {
-    zval *bytecode_zv, *config_zv;
+    // Already extracted opcodes, e.g. what kage_encrypt_bytecode() returned
+    zv = zend_hash_str_find(bytecode_info, "opcodes", sizeof("opcodes") - 1);
+    if (zv && Z_TYPE_P(zv) == IS_ARRAY) {
+        return kage_bytecode_info_import(bytecode_info);
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS(), "aa", &bytecode_zv, &config_zv) == FAILURE) {
-        RETURN_FALSE;
+    zv = zend_hash_str_find(bytecode_info, "source", sizeof("source") - 1);
+    if (zv && Z_TYPE_P(zv) == IS_STRING) {
+        return kage_extract_opcodes(Z_STR_P(zv));
     }
 
-    // Получаем VLD вывод из массива
-    zval *vld_output_zv = zend_hash_str_find(Z_ARRVAL_P(bytecode_zv), "vld_output", sizeof("vld_output") - 1);
-    if (!vld_output_zv || Z_TYPE_P(vld_output_zv) != IS_STRING) {
-        RETURN_FALSE;
+    zv = zend_hash_str_find(bytecode_info, "file", sizeof("file") - 1);
+    if (zv && Z_TYPE_P(zv) == IS_STRING) {
+        return kage_extract_opcodes_from_file(Z_STR_P(zv));
     }
 
-    // Создаём конфигурацию шифрования
-    kage_bytecode_crypto_config crypto_config = {0};
+    zv = zend_hash_str_find(bytecode_info, "vld_output", sizeof("vld_output") - 1);
+    if (zv && Z_TYPE_P(zv) == IS_STRING) {
+        return kage_parse_vld_output(Z_STRVAL_P(zv), Z_STRLEN_P(zv));
+    }
 
-    zval *algorithm_zv = zend_hash_str_find(Z_ARRVAL_P(config_zv), "algorithm", sizeof("algorithm") - 1);
+    return NULL;
+}
+
+// Opcode encryption options shared by kage_encrypt_bytecode/kage_decrypt_bytecode:
+// algorithm, key, and the profile-guided split ("selective", "profile",
+// "hot_percent"). Decryption must get the same options to undo the split.
+static int kage_crypto_config_from_array(HashTable *options, kage_bytecode_crypto_config *crypto_config) {
+    memset(crypto_config, 0, sizeof(kage_bytecode_crypto_config));
+
+    zval *algorithm_zv = zend_hash_str_find(options, "algorithm", sizeof("algorithm") - 1);
     if (algorithm_zv && Z_TYPE_P(algorithm_zv) == IS_STRING) {
         if (strcmp(Z_STRVAL_P(algorithm_zv), "XOR") == 0) {
-            crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_XOR;
+            crypto_config->algorithm = KAGE_OPCODE_ENCRYPT_XOR;
         } else if (strcmp(Z_STRVAL_P(algorithm_zv), "AES") == 0) {
-            crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_AES;
+            crypto_config->algorithm = KAGE_OPCODE_ENCRYPT_AES;
         } else if (strcmp(Z_STRVAL_P(algorithm_zv), "ROTATE") == 0) {
-            crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_ROTATE;
+            crypto_config->algorithm = KAGE_OPCODE_ENCRYPT_ROTATE;
         } else {
-            crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_CUSTOM;
+            crypto_config->algorithm = KAGE_OPCODE_ENCRYPT_CUSTOM;
         }
     } else {
-        crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_XOR; // default
+        crypto_config->algorithm = KAGE_OPCODE_ENCRYPT_XOR; // default
     }
 
-    zval *key_zv = zend_hash_str_find(Z_ARRVAL_P(config_zv), "key", sizeof("key") - 1);
+    zval *key_zv = zend_hash_str_find(options, "key", sizeof("key") - 1);
     if (key_zv && Z_TYPE_P(key_zv) == IS_STRING) {
-        crypto_config.key = Z_STRVAL_P(key_zv);
-        crypto_config.key_length = Z_STRLEN_P(key_zv);
+        crypto_config->key = Z_STRVAL_P(key_zv);
+        crypto_config->key_length = Z_STRLEN_P(key_zv);
     } else {
-        crypto_config.key = "DEFAULT_KAGE_KEY_123";
-        crypto_config.key_length = strlen(crypto_config.key);
+        crypto_config->key = "DEFAULT_KAGE_KEY_123";
+        crypto_config->key_length = strlen(crypto_config->key);
+    }
+
+    // A profile turns selective mode on; without one nothing is hot
+    zval *profile_zv = zend_hash_str_find(options, "profile", sizeof("profile") - 1);
+    if (profile_zv && Z_TYPE_P(profile_zv) == IS_STRING) {
+        crypto_config->profile = kage_opcode_profile_load(Z_STRVAL_P(profile_zv));
+        if (!crypto_config->profile) {
+            return FAILURE;
+        }
+        crypto_config->selective_encryption = 1;
     }
 
-    zval *selective_zv = zend_hash_str_find(Z_ARRVAL_P(config_zv), "selective", sizeof("selective") - 1);
-    crypto_config.selective_encryption = selective_zv && Z_TYPE_P(selective_zv) == IS_TRUE;
+    zval *selective_zv = zend_hash_str_find(options, "selective", sizeof("selective") - 1);
+    if (selective_zv && Z_TYPE_P(selective_zv) == IS_TRUE) {
+        crypto_config->selective_encryption = 1;
+    }
+
+    zval *hot_zv = zend_hash_str_find(options, "hot_percent", sizeof("hot_percent") - 1);
+    crypto_config->hot_percent = hot_zv ? zval_get_double(hot_zv) : 10.0;
+
+    return SUCCESS;
+}
+
+// PHP Function: kage_encrypt_bytecode
+PHP_FUNCTION(kage_encrypt_bytecode) {
+    zval *bytecode_zv, *config_zv;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "aa", &bytecode_zv, &config_zv) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    // Создаём конфигурацию шифрования
+    kage_bytecode_crypto_config crypto_config;
+    if (kage_crypto_config_from_array(Z_ARRVAL_P(config_zv), &crypto_config) == FAILURE) {
+        RETURN_FALSE;
+    }
 
-    // Парсим VLD вывод
-    vld_bytecode_info *bytecode = kage_parse_vld_output(Z_STRVAL_P(vld_output_zv));
+    // Получаем опкоды
+    vld_bytecode_info *bytecode = kage_bytecode_info_from_array(Z_ARRVAL_P(bytecode_zv));
     if (!bytecode) {
+        kage_opcode_profile_free(crypto_config.profile);
         RETURN_FALSE;
     }
 
     // Шифруем опкоды
     kage_result_t result = kage_encrypt_opcodes(bytecode, &crypto_config);
 
+    // Вместе со статистикой отдаём сами опкоды: их же принимает обратная функция
+    if (result.error == KAGE_SUCCESS) {
+        kage_bytecode_info_export(bytecode, result.result.value);
+    }
+
     // Освобождаем память
     kage_free_bytecode_info(bytecode);
+    kage_opcode_profile_free(crypto_config.profile);
 
     if (result.error != KAGE_SUCCESS) {
         RETURN_FALSE;
@@ -304,52 +454,30 @@ PHP_FUNCTION(kage_decrypt_bytecode) {
         RETURN_FALSE;
     }
 
-    // Получаем VLD вывод из массива
-    zval *vld_output_zv = zend_hash_str_find(Z_ARRVAL_P(encrypted_zv), "vld_output", sizeof("vld_output") - 1);
-    if (!vld_output_zv || Z_TYPE_P(vld_output_zv) != IS_STRING) {
+    // Та же конфигурация, что и для шифрования: горячие опкоды снимаются XOR
+    kage_bytecode_crypto_config crypto_config;
+    if (kage_crypto_config_from_array(Z_ARRVAL_P(config_zv), &crypto_config) == FAILURE) {
         RETURN_FALSE;
     }
 
-    // Создаём конфигурацию шифрования (та же что и для дешифрования)
-    kage_bytecode_crypto_config crypto_config = {0};
-
-    zval *algorithm_zv = zend_hash_str_find(Z_ARRVAL_P(config_zv), "algorithm", sizeof("algorithm") - 1);
-    if (algorithm_zv && Z_TYPE_P(algorithm_zv) == IS_STRING) {
-        if (strcmp(Z_STRVAL_P(algorithm_zv), "XOR") == 0) {
-            crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_XOR;
-        } else if (strcmp(Z_STRVAL_P(algorithm_zv), "AES") == 0) {
-            crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_AES;
-        } else if (strcmp(Z_STRVAL_P(algorithm_zv), "ROTATE") == 0) {
-            crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_ROTATE;
-        } else {
-            crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_CUSTOM;
-        }
-    } else {
-        crypto_config.algorithm = KAGE_OPCODE_ENCRYPT_XOR; // default
-    }
-
-    zval *key_zv = zend_hash_str_find(Z_ARRVAL_P(config_zv), "key", sizeof("key") - 1);
-    if (key_zv && Z_TYPE_P(key_zv) == IS_STRING) {
-        crypto_config.key = Z_STRVAL_P(key_zv);
-        crypto_config.key_length = Z_STRLEN_P(key_zv);
-    } else {
-        crypto_config.key = "DEFAULT_KAGE_KEY_123";
-        crypto_config.key_length = strlen(crypto_config.key);
-    }
-
-    crypto_config.selective_encryption = 0; // Для дешифрования шифруем все
-
-    // Парсим VLD вывод
-    vld_bytecode_info *bytecode = kage_parse_vld_output(Z_STRVAL_P(vld_output_zv));
+    // Получаем опкоды
+    vld_bytecode_info *bytecode = kage_bytecode_info_from_array(Z_ARRVAL_P(encrypted_zv));
     if (!bytecode) {
+        kage_opcode_profile_free(crypto_config.profile);
         RETURN_FALSE;
     }
 
     // Дешифруем опкоды (симметричный алгоритм)
     kage_result_t result = kage_decrypt_opcodes(bytecode, &crypto_config);
 
+    // Вместе со статистикой отдаём сами опкоды: их же принимает обратная функция
+    if (result.error == KAGE_SUCCESS) {
+        kage_bytecode_info_export(bytecode, result.result.value);
+    }
+
     // Освобождаем память
     kage_free_bytecode_info(bytecode);
+    kage_opcode_profile_free(crypto_config.profile);
 
     if (result.error != KAGE_SUCCESS) {
         RETURN_FALSE;
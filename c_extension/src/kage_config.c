@@ -13,67 +13,131 @@
 #include "kage_config.h"
 #include "kage_context.h"
 #include <stdlib.h>
-
-// Static configuration definitions
-static struct {
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <strings.h>
+#include <stdatomic.h>
+
+// Static configuration definitions, indexed by kage_config_id
+static const struct {
     const char *key;
     kage_config_type type;
+    size_t offset;
     kage_config_value default_value;
-} config_definitions[] = {
-    {KAGE_CONFIG_ENCRYPTION_KEY, KAGE_CONFIG_TYPE_STRING, {.string_val = NULL}},
-    {KAGE_CONFIG_DEBUG_MODE, KAGE_CONFIG_TYPE_BOOL, {.bool_val = KAGE_DEFAULT_DEBUG_MODE}},
-    {KAGE_CONFIG_LOG_LEVEL, KAGE_CONFIG_TYPE_INT, {.int_val = KAGE_DEFAULT_LOG_LEVEL}},
-    {KAGE_CONFIG_MAX_MEMORY, KAGE_CONFIG_TYPE_SIZE, {.size_val = KAGE_DEFAULT_MAX_MEMORY}},
-    {KAGE_CONFIG_STACK_SIZE, KAGE_CONFIG_TYPE_SIZE, {.size_val = KAGE_DEFAULT_STACK_SIZE}},
-    {KAGE_CONFIG_TIMEOUT, KAGE_CONFIG_TYPE_INT, {.int_val = KAGE_DEFAULT_TIMEOUT}},
-    {KAGE_CONFIG_CACHE_ENABLED, KAGE_CONFIG_TYPE_BOOL, {.bool_val = KAGE_DEFAULT_CACHE_ENABLED}},
-    {KAGE_CONFIG_CACHE_SIZE, KAGE_CONFIG_TYPE_SIZE, {.size_val = KAGE_DEFAULT_CACHE_SIZE}},
-    {KAGE_CONFIG_CRYPTO_ALGORITHM, KAGE_CONFIG_TYPE_STRING, {.string_val = KAGE_DEFAULT_CRYPTO_ALGORITHM}},
-    {NULL, 0, {0}} // Sentinel
+} config_definitions[KAGE_CONFIG_ID_COUNT] = {
+#define KAGE_CONFIG_X_DEFINITION(id, field, type, def) \
+    [KAGE_CONFIG_ID_##id] = {KAGE_CONFIG_##id, KAGE_CONFIG_TYPE_##type, \
+                             offsetof(kage_config_values, field), {.KAGE_CONFIG_MEMBER_##type = def}},
+    KAGE_CONFIG_KEYS(KAGE_CONFIG_X_DEFINITION)
+#undef KAGE_CONFIG_X_DEFINITION
 };
 
-// Global configuration instance
-static kage_config *global_config = NULL;
+// Snapshot of the shared configuration. A request pins the snapshot that
+// was current when it started (kage_config_activate); an update publishes
+// a new one, and the old one is freed when the last thread lets go of it.
+typedef struct {
+    kage_config config;         // first, so the kage_config* converts back
+    _Atomic uint32_t refcount;
+    uint64_t generation;
+} kage_config_snapshot;
+
+// Current snapshot and its generation, which threads compare at RINIT
+static kage_config_snapshot *kage_config_shared = NULL;
+static _Atomic uint64_t kage_config_generation = 0;
+
+// Generations of private snapshots, which hold the values set for a single
+// request (kage_config_override). The top bit keeps them apart from the
+// published ones.
+#define KAGE_CONFIG_PRIVATE ((uint64_t)1 << 63)
+#define KAGE_CONFIG_IS_PRIVATE(generation) (((generation) & KAGE_CONFIG_PRIVATE) != 0)
+static _Atomic uint64_t kage_config_private_generation = 0;
+
+// The update mutex serialises updates. The snapshot mutex is only held
+// to pin the current snapshot, so an update never delays a request.
+#ifdef ZTS
+static MUTEX_T kage_config_update_mutex = NULL;
+static MUTEX_T kage_config_snapshot_mutex = NULL;
+# define KAGE_CONFIG_UPDATE_LOCK()     tsrm_mutex_lock(kage_config_update_mutex)
+# define KAGE_CONFIG_UPDATE_UNLOCK()   tsrm_mutex_unlock(kage_config_update_mutex)
+# define KAGE_CONFIG_SNAPSHOT_LOCK()   tsrm_mutex_lock(kage_config_snapshot_mutex)
+# define KAGE_CONFIG_SNAPSHOT_UNLOCK() tsrm_mutex_unlock(kage_config_snapshot_mutex)
+#else
+# define KAGE_CONFIG_UPDATE_LOCK()
+# define KAGE_CONFIG_UPDATE_UNLOCK()
+# define KAGE_CONFIG_SNAPSHOT_LOCK()
+# define KAGE_CONFIG_SNAPSHOT_UNLOCK()
+#endif
+
+/**
+ * Maps a key name to its id. A linear scan; the string-keyed API is for
+ * PHP-facing code, C code reads KAGE_CONFIG() or config->values.
+ *
+ * @param key Key name, e.g. "max_memory"
+ * @return The id, or KAGE_CONFIG_ID_INVALID for unknown keys
+ */
+PHPAPI kage_config_id kage_config_lookup(const char *key) {
+    if (!key) return KAGE_CONFIG_ID_INVALID;
 
-// Helper function to find config definition
-static const char* get_config_definition_type(const char *key, kage_config_type *type, kage_config_value *default_value) {
-    for (int i = 0; config_definitions[i].key != NULL; i++) {
+    for (int i = 0; i < KAGE_CONFIG_ID_COUNT; i++) {
         if (strcmp(config_definitions[i].key, key) == 0) {
-            if (type) *type = config_definitions[i].type;
-            if (default_value) *default_value = config_definitions[i].default_value;
-            return config_definitions[i].key;
+            return (kage_config_id)i;
         }
     }
-    return NULL;
+    return KAGE_CONFIG_ID_INVALID;
 }
 
-// Configuration management functions
-PHPAPI kage_config* kage_config_create(void) {
-    kage_config *config = emalloc(sizeof(kage_config));
-    if (!config) return NULL;
+static kage_config_value kage_config_load(const kage_config_values *values, kage_config_id id) {
+    const char *field = (const char *)values + config_definitions[id].offset;
+    kage_config_value value;
 
-    config->entries = emalloc(sizeof(HashTable));
-    if (!config->entries) {
-        efree(config);
-        return NULL;
+    switch (config_definitions[id].type) {
+        case KAGE_CONFIG_TYPE_BOOL:   value.bool_val = *(const bool *)field; break;
+        case KAGE_CONFIG_TYPE_INT:    value.int_val = *(const int *)field; break;
+        case KAGE_CONFIG_TYPE_SIZE:   value.size_val = *(const size_t *)field; break;
+        case KAGE_CONFIG_TYPE_STRING: value.string_val = *(char * const *)field; break;
+        case KAGE_CONFIG_TYPE_DOUBLE: value.double_val = *(const double *)field; break;
     }
+    return value;
+}
 
-    zend_hash_init(config->entries, 16, NULL, NULL, 0);
-    config->initialized = false;
+// Stores a value; strings are copied and the previous copy freed
+static void kage_config_store(kage_config_values *values, kage_config_id id, kage_config_value value) {
+    char *field = (char *)values + config_definitions[id].offset;
+
+    switch (config_definitions[id].type) {
+        case KAGE_CONFIG_TYPE_BOOL:   *(bool *)field = value.bool_val; break;
+        case KAGE_CONFIG_TYPE_INT:    *(int *)field = value.int_val; break;
+        case KAGE_CONFIG_TYPE_SIZE:   *(size_t *)field = value.size_val; break;
+        case KAGE_CONFIG_TYPE_DOUBLE: *(double *)field = value.double_val; break;
+        case KAGE_CONFIG_TYPE_STRING: {
+            char **string = (char **)field;
+            if (*string) {
+                pefree(*string, 1);
+            }
+            *string = value.string_val ? pestrdup(value.string_val, 1) : NULL;
+            break;
+        }
+    }
+}
 
-    return config;
+// Configuration management functions. Configurations are persistent:
+// they are built at startup and outlive every request.
+PHPAPI kage_config* kage_config_create(void) {
+    return pecalloc(1, sizeof(kage_config), 1);
 }
 
 PHPAPI void kage_config_destroy(kage_config *config) {
     if (!config) return;
 
-    if (config->entries) {
-        // Clean up all entries
-        zend_hash_clean(config->entries);
-        efree(config->entries);
+    for (int i = 0; i < KAGE_CONFIG_ID_COUNT; i++) {
+        if (config_definitions[i].type == KAGE_CONFIG_TYPE_STRING) {
+            kage_config_value none = {.string_val = NULL};
+            kage_config_store(&config->values, i, none);
+        }
     }
 
-    efree(config);
+    pefree(config, 1);
 }
 
 PHPAPI kage_error_t kage_config_init(kage_config *config) {
@@ -90,73 +154,163 @@ PHPAPI kage_error_t kage_config_init(kage_config *config) {
 }
 
 PHPAPI kage_error_t kage_config_load_defaults(kage_config *config) {
-    if (!config || !config->entries) return KAGE_ERROR_INVALID_INPUT;
-
-    for (int i = 0; config_definitions[i].key != NULL; i++) {
-        kage_config_entry *entry = emalloc(sizeof(kage_config_entry));
-        if (!entry) return KAGE_ERROR_MEMORY;
-
-        entry->key = config_definitions[i].key;
-        entry->type = config_definitions[i].type;
-        entry->value = config_definitions[i].default_value;
-        entry->default_value = config_definitions[i].default_value;
-        entry->is_set = false;
-
-        // Handle string defaults specially (need to duplicate)
-        if (entry->type == KAGE_CONFIG_TYPE_STRING && entry->default_value.string_val) {
-            entry->default_value.string_val = estrndup(entry->default_value.string_val,
-                                                     strlen(entry->default_value.string_val));
-            entry->value.string_val = estrndup(entry->default_value.string_val,
-                                             strlen(entry->default_value.string_val));
-        }
+    if (!config) return KAGE_ERROR_INVALID_INPUT;
+
+    if (config->immutable) return KAGE_ERROR_CONFIG;
 
-        zend_hash_str_add_ptr(config->entries, entry->key, strlen(entry->key), entry);
+    for (int i = 0; i < KAGE_CONFIG_ID_COUNT; i++) {
+        kage_config_store(&config->values, i, config_definitions[i].default_value);
+        config->is_set[i] = false;
     }
 
     return KAGE_SUCCESS;
 }
 
-PHPAPI kage_config* kage_config_get(void) {
-    if (!global_config) {
-        global_config = kage_config_create();
-        if (global_config) {
-            kage_config_init(global_config);
-        }
+// Freezes a configuration; the setters fail from then on
+PHPAPI void kage_config_freeze(kage_config *config) {
+    if (config) {
+        config->immutable = true;
     }
-    return global_config;
 }
 
-// Generic setter function
-static kage_error_t kage_config_set_value(kage_config *config, const char *key, kage_config_value value, kage_config_type expected_type) {
-    if (!config || !key) return KAGE_ERROR_INVALID_INPUT;
+static kage_config_snapshot* kage_config_snapshot_create(void) {
+    kage_config_snapshot *snapshot = pecalloc(1, sizeof(kage_config_snapshot), 1);
+    atomic_init(&snapshot->refcount, 1);
+    return snapshot;
+}
 
-    kage_config_type key_type;
-    if (!get_config_definition_type(key, &key_type, NULL)) {
-        return KAGE_ERROR_INVALID_INPUT;
+// Unfrozen copy of a configuration, for an update to modify
+static kage_config_snapshot* kage_config_snapshot_copy(const kage_config *source) {
+    kage_config_snapshot *snapshot = kage_config_snapshot_create();
+
+    for (int i = 0; i < KAGE_CONFIG_ID_COUNT; i++) {
+        kage_config_store(&snapshot->config.values, i, kage_config_load(&source->values, i));
     }
+    memcpy(snapshot->config.is_set, source->is_set, sizeof(source->is_set));
+    snapshot->config.initialized = true;
 
-    if (key_type != expected_type) {
-        return KAGE_ERROR_INVALID_INPUT;
+    return snapshot;
+}
+
+static void kage_config_snapshot_release(kage_config_snapshot *snapshot) {
+    if (snapshot && atomic_fetch_sub_explicit(&snapshot->refcount, 1, memory_order_acq_rel) == 1) {
+        kage_config_destroy(&snapshot->config);
     }
+}
 
-    kage_config_entry *entry = zend_hash_str_find_ptr(config->entries, key, strlen(key));
-    if (!entry) {
-        return KAGE_ERROR_INVALID_INPUT;
+// Takes a reference to the current snapshot
+static kage_config_snapshot* kage_config_snapshot_acquire(void) {
+    KAGE_CONFIG_SNAPSHOT_LOCK();
+    kage_config_snapshot *snapshot = kage_config_shared;
+    if (snapshot) {
+        atomic_fetch_add_explicit(&snapshot->refcount, 1, memory_order_relaxed);
     }
+    KAGE_CONFIG_SNAPSHOT_UNLOCK();
+    return snapshot;
+}
 
-    // Free old string value if needed
-    if (entry->type == KAGE_CONFIG_TYPE_STRING && entry->value.string_val) {
-        efree(entry->value.string_val);
+/**
+ * Configuration seen by the calling thread: the snapshot pinned by the
+ * current request, or the current shared snapshot before the thread's
+ * first request (MINIT, MSHUTDOWN). NULL before MINIT and after
+ * MSHUTDOWN.
+ *
+ * @return Frozen configuration; do not keep it past the request
+ */
+PHPAPI kage_config* kage_config_get(void) {
+    kage_config *config = KAGE_G(config);
+    if (EXPECTED(config != NULL)) {
+        return config;
     }
+    return kage_config_shared ? &kage_config_shared->config : NULL;
+}
 
-    // Handle string values specially
-    if (expected_type == KAGE_CONFIG_TYPE_STRING && value.string_val) {
-        entry->value.string_val = estrndup(value.string_val, strlen(value.string_val));
-    } else {
-        entry->value = value;
+/**
+ * Builds the shared configuration from defaults, php.ini and the
+ * environment, then freezes and publishes it. Called once from MINIT,
+ * before any thread reads it.
+ *
+ * @return KAGE_SUCCESS, or the error of the step that failed
+ */
+PHPAPI kage_error_t kage_config_startup(void) {
+    kage_config_snapshot *snapshot = kage_config_snapshot_create();
+    kage_config *config = &snapshot->config;
+
+    kage_error_t result = kage_config_init(config);
+    if (result != KAGE_SUCCESS) {
+        kage_config_destroy(config);
+        return result;
     }
 
-    entry->is_set = true;
+    // The environment overrides php.ini
+    kage_config_load_from_php_ini(config);
+    kage_config_load_from_env(config);
+    kage_config_freeze(config);
+
+#ifdef ZTS
+    kage_config_update_mutex = tsrm_mutex_alloc();
+    kage_config_snapshot_mutex = tsrm_mutex_alloc();
+#endif
+
+    snapshot->generation = 1;
+    kage_config_shared = snapshot;
+    atomic_store_explicit(&kage_config_generation, 1, memory_order_release);
+    return KAGE_SUCCESS;
+}
+
+// MSHUTDOWN. Threads still holding a snapshot release it in GSHUTDOWN,
+// which needs no lock.
+PHPAPI void kage_config_shutdown(void) {
+    kage_config_snapshot_release(kage_config_shared);
+    kage_config_shared = NULL;
+
+#ifdef ZTS
+    tsrm_mutex_free(kage_config_update_mutex);
+    tsrm_mutex_free(kage_config_snapshot_mutex);
+    kage_config_update_mutex = NULL;
+    kage_config_snapshot_mutex = NULL;
+#endif
+}
+
+// RINIT: moves the thread to the newest snapshot if there was an update.
+// The snapshot then stays fixed for the whole request. A private snapshot
+// is kept: the SAPI applies the request's own settings before RINIT.
+void kage_config_activate(void) {
+    uint64_t generation = atomic_load_explicit(&kage_config_generation, memory_order_acquire);
+    if (EXPECTED(KAGE_G(config_generation) == generation) || KAGE_CONFIG_IS_PRIVATE(KAGE_G(config_generation))) {
+        return;
+    }
+
+    kage_config_snapshot *snapshot = kage_config_snapshot_acquire();
+    kage_config_snapshot *previous = (kage_config_snapshot *)KAGE_G(config);
+
+    KAGE_G(config) = snapshot ? &snapshot->config : NULL;
+    KAGE_G(config_generation) = snapshot ? snapshot->generation : 0;
+    kage_config_snapshot_release(previous);
+}
+
+// GSHUTDOWN
+void kage_config_globals_shutdown(zend_kage_globals *globals) {
+    kage_config_snapshot_release((kage_config_snapshot *)globals->config);
+    globals->config = NULL;
+    globals->config_generation = 0;
+}
+
+// Generic setter function
+static kage_error_t kage_config_set_value(kage_config *config, const char *key, kage_config_value value, kage_config_type expected_type) {
+    if (!config || !key) return KAGE_ERROR_INVALID_INPUT;
+
+    kage_config_id id = kage_config_lookup(key);
+    if (id == KAGE_CONFIG_ID_INVALID || config_definitions[id].type != expected_type) {
+        return KAGE_ERROR_INVALID_INPUT;
+    }
+
+    if (config->immutable) {
+        return KAGE_ERROR_CONFIG;
+    }
+
+    kage_config_store(&config->values, id, value);
+    config->is_set[id] = true;
     return KAGE_SUCCESS;
 }
 
@@ -186,56 +340,242 @@ PHPAPI kage_error_t kage_config_set_double(kage_config *config, const char *key,
     return kage_config_set_value(config, key, val, KAGE_CONFIG_TYPE_DOUBLE);
 }
 
-// Generic getter function
-static kage_config_value kage_config_get_value(kage_config *config, const char *key, kage_config_value default_val) {
-    if (!config || !key || !config->entries) {
+// Generic getter function; unknown keys and type mismatches read as default_val
+static kage_config_value kage_config_get_value(kage_config *config, const char *key, kage_config_value default_val, kage_config_type expected_type) {
+    if (!config || !key) {
         return default_val;
     }
 
-    kage_config_entry *entry = zend_hash_str_find_ptr(config->entries, key, strlen(key));
-    if (!entry) {
+    kage_config_id id = kage_config_lookup(key);
+    if (id == KAGE_CONFIG_ID_INVALID || config_definitions[id].type != expected_type) {
         return default_val;
     }
 
-    return entry->value;
+    return kage_config_load(&config->values, id);
 }
 
 // Getter functions
 PHPAPI bool kage_config_get_bool(kage_config *config, const char *key) {
     kage_config_value default_val = {.bool_val = false};
-    return kage_config_get_value(config, key, default_val).bool_val;
+    return kage_config_get_value(config, key, default_val, KAGE_CONFIG_TYPE_BOOL).bool_val;
 }
 
 PHPAPI int kage_config_get_int(kage_config *config, const char *key) {
     kage_config_value default_val = {.int_val = 0};
-    return kage_config_get_value(config, key, default_val).int_val;
+    return kage_config_get_value(config, key, default_val, KAGE_CONFIG_TYPE_INT).int_val;
 }
 
 PHPAPI size_t kage_config_get_size(kage_config *config, const char *key) {
     kage_config_value default_val = {.size_val = 0};
-    return kage_config_get_value(config, key, default_val).size_val;
+    return kage_config_get_value(config, key, default_val, KAGE_CONFIG_TYPE_SIZE).size_val;
 }
 
 PHPAPI const char* kage_config_get_string(kage_config *config, const char *key) {
     kage_config_value default_val = {.string_val = NULL};
-    return kage_config_get_value(config, key, default_val).string_val;
+    return kage_config_get_value(config, key, default_val, KAGE_CONFIG_TYPE_STRING).string_val;
 }
 
 PHPAPI double kage_config_get_double(kage_config *config, const char *key) {
     kage_config_value default_val = {.double_val = 0.0};
-    return kage_config_get_value(config, key, default_val).double_val;
+    return kage_config_get_value(config, key, default_val, KAGE_CONFIG_TYPE_DOUBLE).double_val;
+}
+
+// Parses a byte count with an optional K, M or G suffix, as in php.ini
+static bool kage_config_parse_size(const char *str, size_t *size) {
+    char *end;
+
+    if (*str == '-' || !isdigit((unsigned char)*str)) {
+        return false;
+    }
+
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    unsigned int shift = 0;
+    switch (*end) {
+        case 'g': case 'G': shift = 30; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'k': case 'K': shift = 10; end++; break;
+    }
+
+    if (errno || *end != '\0' || value > (SIZE_MAX >> shift)) {
+        return false;
+    }
+    *size = (size_t)value << shift;
+    return true;
+}
+
+static bool kage_config_parse_bool(const char *str, bool *result) {
+    if (!strcasecmp(str, "1") || !strcasecmp(str, "on") || !strcasecmp(str, "yes") || !strcasecmp(str, "true")) {
+        *result = true;
+    } else if (!*str || !strcasecmp(str, "0") || !strcasecmp(str, "off") || !strcasecmp(str, "no") || !strcasecmp(str, "false")) {
+        *result = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Converts the text form of a value (php.ini, environment) to its type.
+ * Strings are not copied; an empty string reads as unset (NULL).
+ *
+ * @param id Key the value is for
+ * @param str Text to parse
+ * @param value Parsed value
+ * @return true if str is valid for the key's type
+ */
+static bool kage_config_parse(kage_config_id id, const char *str, kage_config_value *value) {
+    char *end;
+
+    switch (config_definitions[id].type) {
+        case KAGE_CONFIG_TYPE_BOOL:
+            return kage_config_parse_bool(str, &value->bool_val);
+        case KAGE_CONFIG_TYPE_INT: {
+            errno = 0;
+            long number = strtol(str, &end, 10);
+            if (errno || end == str || *end != '\0' || number < INT_MIN || number > INT_MAX) {
+                return false;
+            }
+            value->int_val = (int)number;
+            return true;
+        }
+        case KAGE_CONFIG_TYPE_SIZE:
+            return kage_config_parse_size(str, &value->size_val);
+        case KAGE_CONFIG_TYPE_DOUBLE:
+            value->double_val = zend_strtod(str, (const char **)&end);
+            return end != str && *end == '\0';
+        case KAGE_CONFIG_TYPE_STRING:
+            value->string_val = *str ? (char *)str : NULL;
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Applies a value set for the current request only (Apache php_admin_value,
+ * .htaccess, FastCGI PHP_ADMIN_VALUE) to a private copy of the thread's
+ * configuration. Other threads and later requests never see it.
+ *
+ * @param id Key to change
+ * @param value New value; strings are copied
+ */
+static void kage_config_override(kage_config_id id, kage_config_value value) {
+    kage_config_snapshot *current = (kage_config_snapshot *)KAGE_G(config);
+    bool is_private = current && KAGE_CONFIG_IS_PRIVATE(KAGE_G(config_generation));
+
+    // The first override of a request starts from the newest shared values
+    kage_config_snapshot *base = is_private ? current : kage_config_snapshot_acquire();
+    if (!base) {
+        return;
+    }
+
+    kage_config_snapshot *next = kage_config_snapshot_copy(&base->config);
+    kage_config_store(&next->config.values, id, value);
+    next->config.is_set[id] = true;
+    kage_config_freeze(&next->config);
+    next->generation = KAGE_CONFIG_PRIVATE
+        | (atomic_fetch_add_explicit(&kage_config_private_generation, 1, memory_order_relaxed) + 1);
+
+    KAGE_G(config) = &next->config;
+    KAGE_G(config_generation) = next->generation;
+    if (!is_private) {
+        kage_config_snapshot_release(base);
+    }
+    kage_config_snapshot_release(current);
+}
+
+// Drops the request's private configuration when its values are restored;
+// the next RINIT pins the shared one again
+static void kage_config_restore(void) {
+    if (!KAGE_CONFIG_IS_PRIVATE(KAGE_G(config_generation))) {
+        return;
+    }
+
+    kage_config_snapshot_release((kage_config_snapshot *)KAGE_G(config));
+    KAGE_G(config) = NULL;
+    KAGE_G(config_generation) = 0;
+}
+
+// on_modify of the kage.* entries mirroring configuration keys (mh_arg1
+// is the kage_config_id). At startup it only validates, as
+// kage_config_startup() reads php.ini itself.
+//
+// A php-fpm pool's php_admin_value is applied once per worker, before its
+// first request, and never restored (the entry is not marked modified);
+// it is the worker's php.ini, so it is published. Any other change is
+// marked modified and restored at DEACTIVATE: it belongs to one request,
+// and only that request's thread sees it.
+ZEND_INI_MH(OnUpdateKageConfig) {
+    kage_config_id id = (kage_config_id)(uintptr_t)mh_arg1;
+    kage_config_value value;
+
+    if (!kage_config_parse(id, ZSTR_VAL(new_value), &value)) {
+        zend_error(E_WARNING, "Kage: Invalid value \"%s\" for %s, using the default",
+                   ZSTR_VAL(new_value), ZSTR_VAL(entry->name));
+        return FAILURE;
+    }
+
+    if (stage == ZEND_INI_STAGE_STARTUP || stage == ZEND_INI_STAGE_SHUTDOWN || !kage_config_shared) {
+        return SUCCESS;
+    }
+
+    if (!entry->modified) {
+        return kage_config_update(id, value) == KAGE_SUCCESS ? SUCCESS : FAILURE;
+    }
+
+    if (stage == ZEND_INI_STAGE_DEACTIVATE) {
+        kage_config_restore();
+    } else {
+        kage_config_override(id, value);
+    }
+    return SUCCESS;
 }
 
 // PHP integration functions
+
+// Applies the kage.<key> settings given in php.ini or with -d. Values
+// OnUpdateKageConfig rejected are skipped; unset keys keep their value.
 PHPAPI kage_error_t kage_config_load_from_php_ini(kage_config *config) {
     if (!config) return KAGE_ERROR_INVALID_INPUT;
 
-    // Load from PHP ini settings
-    // This would integrate with PHP's ini system
-    // For now, just return success
+    for (int i = 0; i < KAGE_CONFIG_ID_COUNT; i++) {
+        char name[64];
+        kage_config_value value;
+
+        int length = snprintf(name, sizeof(name), "kage.%s", config_definitions[i].key);
+        zval *configured = cfg_get_entry(name, length);
+        if (!configured || Z_TYPE_P(configured) != IS_STRING
+                || !kage_config_parse(i, Z_STRVAL_P(configured), &value)) {
+            continue;
+        }
+
+        if (config->immutable) {
+            return KAGE_ERROR_CONFIG;
+        }
+        kage_config_store(&config->values, i, value);
+        config->is_set[i] = true;
+    }
+
     return KAGE_SUCCESS;
 }
 
+// Replaces the value of a php.ini entry with one taken from the
+// environment, so that ini_get() and phpinfo() show the value in effect.
+// MINIT only: threads copy the entries when they start.
+static void kage_config_show_in_ini(const char *name, const char *value) {
+    zend_ini_entry *entry = zend_hash_str_find_ptr(EG(ini_directives), name, strlen(name));
+    if (!entry) {
+        return;
+    }
+
+    if (entry->value) {
+        zend_string_release(entry->value);
+    }
+    entry->value = zend_string_init(value, strlen(value), 1);
+}
+
+// Called from kage_config_startup(); the variables it reads replace the
+// matching php.ini values, which are updated to match
 PHPAPI kage_error_t kage_config_load_from_env(kage_config *config) {
     if (!config) return KAGE_ERROR_INVALID_INPUT;
 
@@ -250,15 +590,81 @@ PHPAPI kage_error_t kage_config_load_from_env(kage_config *config) {
         kage_config_set_bool(config, KAGE_CONFIG_DEBUG_MODE, atoi(env_debug) != 0);
     }
 
+    // Same syntax as kage.max_memory, e.g. 512M
+    const char *env_max_memory = getenv("KAGE_MAX_MEMORY");
+    size_t max_memory;
+    if (env_max_memory) {
+        if (kage_config_parse_size(env_max_memory, &max_memory)) {
+            kage_config_set_size(config, KAGE_CONFIG_MAX_MEMORY, max_memory);
+            kage_config_show_in_ini("kage." KAGE_CONFIG_MAX_MEMORY, env_max_memory);
+        } else {
+            zend_error(E_WARNING, "Kage: Invalid value \"%s\" for KAGE_MAX_MEMORY, ignored", env_max_memory);
+        }
+    }
+
     return KAGE_SUCCESS;
 }
 
+/**
+ * Sets values from a PHP array keyed by configuration key. Booleans and
+ * numbers are converted as PHP would; sizes must not be negative.
+ *
+ * @param config Configuration to update; must not be frozen
+ * @param array Key => value pairs
+ * @return KAGE_SUCCESS, or KAGE_ERROR_INVALID_INPUT at the first unknown
+ *         key or invalid value (earlier pairs stay applied)
+ */
 PHPAPI kage_error_t kage_config_load_from_array(kage_config *config, HashTable *array) {
     if (!config || !array) return KAGE_ERROR_INVALID_INPUT;
 
-    // Load from PHP array
-    // This would iterate through the array and set config values
-    // For now, just return success
+    if (config->immutable) return KAGE_ERROR_CONFIG;
+
+    zend_string *key;
+    zval *entry;
+    ZEND_HASH_FOREACH_STR_KEY_VAL(array, key, entry) {
+        kage_config_id id = key ? kage_config_lookup(ZSTR_VAL(key)) : KAGE_CONFIG_ID_INVALID;
+        if (id == KAGE_CONFIG_ID_INVALID) {
+            return KAGE_ERROR_INVALID_INPUT;
+        }
+
+        kage_config_value value;
+        zend_string *str = NULL;
+        switch (config_definitions[id].type) {
+            case KAGE_CONFIG_TYPE_BOOL:
+                value.bool_val = zend_is_true(entry);
+                break;
+            case KAGE_CONFIG_TYPE_INT: {
+                zend_long number = zval_get_long(entry);
+                if (number < INT_MIN || number > INT_MAX) {
+                    return KAGE_ERROR_INVALID_INPUT;
+                }
+                value.int_val = (int)number;
+                break;
+            }
+            case KAGE_CONFIG_TYPE_SIZE: {
+                zend_long number = zval_get_long(entry);
+                if (number < 0) {
+                    return KAGE_ERROR_INVALID_INPUT;
+                }
+                value.size_val = (size_t)number;
+                break;
+            }
+            case KAGE_CONFIG_TYPE_DOUBLE:
+                value.double_val = zval_get_double(entry);
+                break;
+            case KAGE_CONFIG_TYPE_STRING:
+                str = zval_get_string(entry);
+                value.string_val = ZSTR_LEN(str) ? ZSTR_VAL(str) : NULL;
+                break;
+        }
+
+        kage_config_store(&config->values, id, value);
+        config->is_set[id] = true;
+        if (str) {
+            zend_string_release(str);
+        }
+    } ZEND_HASH_FOREACH_END();
+
     return KAGE_SUCCESS;
 }
 
@@ -272,24 +678,38 @@ PHPAPI kage_error_t kage_config_validate(kage_config *config) {
 }
 
 PHPAPI bool kage_config_is_valid_key(const char *key) {
-    return get_config_definition_type(key, NULL, NULL) != NULL;
+    return kage_config_lookup(key) != KAGE_CONFIG_ID_INVALID;
 }
 
 PHPAPI kage_config_type kage_config_get_key_type(const char *key) {
-    kage_config_type type;
-    if (get_config_definition_type(key, &type, NULL)) {
-        return type;
+    kage_config_id id = kage_config_lookup(key);
+    if (id != KAGE_CONFIG_ID_INVALID) {
+        return config_definitions[id].type;
     }
     return KAGE_CONFIG_TYPE_BOOL; // Default
 }
 
 // Utility functions
 PHPAPI void kage_config_dump(kage_config *config) {
-    if (!config || !config->entries) return;
+    if (!config) return;
 
     php_printf("Kage Configuration Dump:\n");
-    // Iterate through all entries and print them
-    // Implementation would depend on HashTable iteration
+    for (int i = 0; i < KAGE_CONFIG_ID_COUNT; i++) {
+        kage_config_value value = kage_config_load(&config->values, i);
+        php_printf("  %s = ", config_definitions[i].key);
+        switch (config_definitions[i].type) {
+            case KAGE_CONFIG_TYPE_BOOL:   php_printf("%s", value.bool_val ? "true" : "false"); break;
+            case KAGE_CONFIG_TYPE_INT:    php_printf("%d", value.int_val); break;
+            case KAGE_CONFIG_TYPE_SIZE:   php_printf("%zu", value.size_val); break;
+            case KAGE_CONFIG_TYPE_DOUBLE: php_printf("%g", value.double_val); break;
+            case KAGE_CONFIG_TYPE_STRING:
+                // The key is not printed
+                php_printf("%s", i == KAGE_CONFIG_ID_ENCRYPTION_KEY && value.string_val ? "(set)"
+                                 : (value.string_val ? value.string_val : "(null)"));
+                break;
+        }
+        php_printf("%s\n", config->is_set[i] ? "" : " (default)");
+    }
 }
 
 PHPAPI kage_error_t kage_config_reset_to_defaults(kage_config *config) {
@@ -300,20 +720,55 @@ PHPAPI kage_error_t kage_config_reset_to_defaults(kage_config *config) {
 }
 
 PHPAPI bool kage_config_is_modified(kage_config *config) {
-    if (!config || !config->entries) return false;
+    if (!config) return false;
 
-    // Check if any entries have been modified from defaults
-    // Implementation would iterate through entries
+    for (int i = 0; i < KAGE_CONFIG_ID_COUNT; i++) {
+        if (config->is_set[i]) {
+            return true;
+        }
+    }
     return false;
 }
 
-// Callback functions (simplified implementation)
-PHPAPI kage_error_t kage_config_register_callback(kage_config *config, const char *key, kage_config_change_callback callback) {
-    // Simplified - would need a callback registry
-    return KAGE_SUCCESS;
+// Publishes next as the current snapshot. Called with the update lock
+// held.
+static void kage_config_publish(kage_config_snapshot *next) {
+    kage_config_freeze(&next->config);
+
+    KAGE_CONFIG_SNAPSHOT_LOCK();
+    kage_config_snapshot *previous = kage_config_shared;
+    next->generation = previous->generation + 1;
+    kage_config_shared = next;
+    atomic_store_explicit(&kage_config_generation, next->generation, memory_order_release);
+    KAGE_CONFIG_SNAPSHOT_UNLOCK();
+
+    kage_config_snapshot_release(previous);
 }
 
-PHPAPI kage_error_t kage_config_unregister_callback(kage_config *config, const char *key, kage_config_change_callback callback) {
-    // Simplified - would need a callback registry
+/**
+ * Changes one key of the shared configuration at runtime. Requests in
+ * flight keep the snapshot they started with; requests starting after
+ * this returns see the new value, so subsystems sized from it (the VM
+ * stack, the memory budget) pick it up at their next RINIT.
+ *
+ * @param id Key to change
+ * @param value New value; strings are copied
+ * @return KAGE_SUCCESS, or KAGE_ERROR_CONFIG before MINIT/after MSHUTDOWN
+ */
+PHPAPI kage_error_t kage_config_update(kage_config_id id, kage_config_value value) {
+    if (id < 0 || id >= KAGE_CONFIG_ID_COUNT) return KAGE_ERROR_INVALID_INPUT;
+
+    KAGE_CONFIG_UPDATE_LOCK();
+    if (!kage_config_shared) {
+        KAGE_CONFIG_UPDATE_UNLOCK();
+        return KAGE_ERROR_CONFIG;
+    }
+
+    kage_config_snapshot *next = kage_config_snapshot_copy(&kage_config_shared->config);
+    kage_config_store(&next->config.values, id, value);
+    next->config.is_set[id] = true;
+    kage_config_publish(next);
+    KAGE_CONFIG_UPDATE_UNLOCK();
+
     return KAGE_SUCCESS;
 }
@@ -32,11 +32,13 @@
 // Default values
 #define KAGE_DEFAULT_DEBUG_MODE        0
 #define KAGE_DEFAULT_LOG_LEVEL         0
-#define KAGE_DEFAULT_MAX_MEMORY        (256 * 1024 * 1024)  // 256MB
+#define KAGE_DEFAULT_MAX_MEMORY_MB     256
+#define KAGE_DEFAULT_MAX_MEMORY        (KAGE_DEFAULT_MAX_MEMORY_MB * 1024 * 1024)
 #define KAGE_DEFAULT_STACK_SIZE        1024
 #define KAGE_DEFAULT_TIMEOUT           300
 #define KAGE_DEFAULT_CACHE_ENABLED     1
-#define KAGE_DEFAULT_CACHE_SIZE        (10 * 1024 * 1024)   // 10MB
+#define KAGE_DEFAULT_CACHE_SIZE_MB     10
+#define KAGE_DEFAULT_CACHE_SIZE        (KAGE_DEFAULT_CACHE_SIZE_MB * 1024 * 1024)
 #define KAGE_DEFAULT_CRYPTO_ALGORITHM  "aes256gcm"
 
 // Configuration value types
@@ -57,23 +59,69 @@ typedef union {
     double double_val;
 } kage_config_value;
 
-// Configuration entry
-typedef struct kage_config_entry {
-    const char *key;
-    kage_config_type type;
-    kage_config_value value;
-    kage_config_value default_value;
-    bool is_set;
-} kage_config_entry;
+// Every configuration key as X(ID, field, TYPE, default). ID names the
+// key string (KAGE_CONFIG_<ID>) and the enum constant, field the member
+// of kage_config_values.
+#define KAGE_CONFIG_KEYS(X) \
+    X(ENCRYPTION_KEY,   encryption_key,   STRING, NULL) \
+    X(DEBUG_MODE,       debug_mode,       BOOL,   KAGE_DEFAULT_DEBUG_MODE) \
+    X(LOG_LEVEL,        log_level,        INT,    KAGE_DEFAULT_LOG_LEVEL) \
+    X(MAX_MEMORY,       max_memory,       SIZE,   KAGE_DEFAULT_MAX_MEMORY) \
+    X(STACK_SIZE,       stack_size,       SIZE,   KAGE_DEFAULT_STACK_SIZE) \
+    X(TIMEOUT,          timeout,          INT,    KAGE_DEFAULT_TIMEOUT) \
+    X(CACHE_ENABLED,    cache_enabled,    BOOL,   KAGE_DEFAULT_CACHE_ENABLED) \
+    X(CACHE_SIZE,       cache_size,       SIZE,   KAGE_DEFAULT_CACHE_SIZE) \
+    X(CRYPTO_ALGORITHM, crypto_algorithm, STRING, KAGE_DEFAULT_CRYPTO_ALGORITHM)
+
+// C type and kage_config_value member of each value type
+#define KAGE_CONFIG_CTYPE_BOOL   bool
+#define KAGE_CONFIG_CTYPE_INT    int
+#define KAGE_CONFIG_CTYPE_SIZE   size_t
+#define KAGE_CONFIG_CTYPE_STRING char*
+#define KAGE_CONFIG_CTYPE_DOUBLE double
+#define KAGE_CONFIG_MEMBER_BOOL   bool_val
+#define KAGE_CONFIG_MEMBER_INT    int_val
+#define KAGE_CONFIG_MEMBER_SIZE   size_val
+#define KAGE_CONFIG_MEMBER_STRING string_val
+#define KAGE_CONFIG_MEMBER_DOUBLE double_val
+
+typedef enum {
+#define KAGE_CONFIG_X_ID(id, field, type, def) KAGE_CONFIG_ID_##id,
+    KAGE_CONFIG_KEYS(KAGE_CONFIG_X_ID)
+#undef KAGE_CONFIG_X_ID
+    KAGE_CONFIG_ID_COUNT,
+    KAGE_CONFIG_ID_INVALID = -1
+} kage_config_id;
+
+// All values, typed; strings are owned by the configuration
+typedef struct {
+#define KAGE_CONFIG_X_FIELD(id, field, type, def) KAGE_CONFIG_CTYPE_##type field;
+    KAGE_CONFIG_KEYS(KAGE_CONFIG_X_FIELD)
+#undef KAGE_CONFIG_X_FIELD
+} kage_config_values;
 
 // Main configuration structure
 typedef struct kage_config {
-    HashTable *entries;
+    kage_config_values values;
+    bool is_set[KAGE_CONFIG_ID_COUNT];
     bool initialized;
+    bool immutable;     // frozen after startup; setters fail
 } kage_config;
 
-// Global configuration accessor
+// Value of the shared configuration as of the start of the current
+// request, with the request's own settings applied; only valid during
+// requests
+#define KAGE_CONFIG(field) (KAGE_G(config)->values.field)
+
+// Shared configuration. Each published version is immutable; runtime
+// changes publish a new one (kage_config_update), picked up at RINIT.
+// Values set for a single request stay with that request's thread.
 PHPAPI kage_config* kage_config_get(void);
+PHPAPI kage_error_t kage_config_startup(void);
+PHPAPI void kage_config_shutdown(void);
+PHPAPI void kage_config_freeze(kage_config *config);
+void kage_config_activate(void);
+void kage_config_globals_shutdown(zend_kage_globals *globals);
 
 // Configuration management functions
 PHPAPI kage_config* kage_config_create(void);
@@ -81,7 +129,7 @@ PHPAPI void kage_config_destroy(kage_config *config);
 PHPAPI kage_error_t kage_config_init(kage_config *config);
 PHPAPI kage_error_t kage_config_load_defaults(kage_config *config);
 
-// Configuration setting/getting functions
+// String-keyed access, for PHP-facing code; C code reads KAGE_CONFIG()
 PHPAPI kage_error_t kage_config_set_bool(kage_config *config, const char *key, bool value);
 PHPAPI kage_error_t kage_config_set_int(kage_config *config, const char *key, int value);
 PHPAPI kage_error_t kage_config_set_size(kage_config *config, const char *key, size_t value);
@@ -99,8 +147,12 @@ PHPAPI kage_error_t kage_config_load_from_php_ini(kage_config *config);
 PHPAPI kage_error_t kage_config_load_from_env(kage_config *config);
 PHPAPI kage_error_t kage_config_load_from_array(kage_config *config, HashTable *array);
 
+// on_modify handler of the kage.<key> php.ini entries; mh_arg1 is the id
+ZEND_INI_MH(OnUpdateKageConfig);
+
 // Validation functions
 PHPAPI kage_error_t kage_config_validate(kage_config *config);
+PHPAPI kage_config_id kage_config_lookup(const char *key);
 PHPAPI bool kage_config_is_valid_key(const char *key);
 PHPAPI kage_config_type kage_config_get_key_type(const char *key);
 
@@ -109,17 +161,7 @@ PHPAPI void kage_config_dump(kage_config *config);
 PHPAPI kage_error_t kage_config_reset_to_defaults(kage_config *config);
 PHPAPI bool kage_config_is_modified(kage_config *config);
 
-// Memory-safe configuration access macros
-#define KAGE_CONFIG_BOOL(key) kage_config_get_bool(kage_config_get(), key)
-#define KAGE_CONFIG_INT(key) kage_config_get_int(kage_config_get(), key)
-#define KAGE_CONFIG_SIZE(key) kage_config_get_size(kage_config_get(), key)
-#define KAGE_CONFIG_STRING(key) kage_config_get_string(kage_config_get(), key)
-#define KAGE_CONFIG_DOUBLE(key) kage_config_get_double(kage_config_get(), key)
-
-// Configuration change callbacks
-typedef void (*kage_config_change_callback)(const char *key, kage_config_value old_value, kage_config_value new_value);
-
-PHPAPI kage_error_t kage_config_register_callback(kage_config *config, const char *key, kage_config_change_callback callback);
-PHPAPI kage_error_t kage_config_unregister_callback(kage_config *config, const char *key, kage_config_change_callback callback);
+// Runtime updates of the shared configuration
+PHPAPI kage_error_t kage_config_update(kage_config_id id, kage_config_value value);
 
 #endif /* PHP_KAGE_CONFIG_H */
@@ -11,37 +11,36 @@
  */
 
 #include "kage_context.h"
+#include "kage_config.h"
 #include "crypto.h"
 #include "ast.h"
 #include "vm.h"
 #include "base64.h"
+#include "kage_memory.h"
 #include <stdarg.h>
 
-// Global context instance
-static kage_context *global_context = NULL;
-
-// Memory interface implementation
-static void* kage_memory_alloc(size_t size) {
-    return emalloc(size);
-}
-
-static void* kage_memory_realloc(void *ptr, size_t size) {
-    return erealloc(ptr, size);
+// Memory interface implementation: request memory, accounted and held to
+// the max_memory budget by kage_memory.c
+static void* kage_context_memory_alloc(size_t size) {
+    return kage_memory_alloc(size, KAGE_MEMORY_TAG_GENERAL);
 }
 
-static void kage_memory_free(void *ptr) {
-    if (ptr) efree(ptr);
+static void* kage_context_memory_realloc(void *ptr, size_t size) {
+    return kage_memory_realloc(ptr, size, KAGE_MEMORY_TAG_GENERAL);
 }
 
-static char* kage_memory_strdup(const char *str) {
-    return estrndup(str, strlen(str));
+static char* kage_context_memory_strdup(const char *str) {
+    size_t length = strlen(str);
+    char *copy = kage_memory_alloc(length + 1, KAGE_MEMORY_TAG_GENERAL);
+    memcpy(copy, str, length + 1);
+    return copy;
 }
 
 static kage_memory_interface memory_interface = {
-    .alloc = kage_memory_alloc,
-    .realloc = kage_memory_realloc,
+    .alloc = kage_context_memory_alloc,
+    .realloc = kage_context_memory_realloc,
     .free = kage_memory_free,
-    .strdup = kage_memory_strdup
+    .strdup = kage_context_memory_strdup
 };
 
 // Crypto interface implementation
@@ -109,17 +108,11 @@ static kage_result_t kage_crypto_encode_base64(const unsigned char *data, size_t
         return result;
     }
 
-    size_t encoded_len;
-    char *encoded = kage_base64_encode(data, data_len, &encoded_len);
-
-    if (!encoded) {
-        result.error = KAGE_ERROR_CRYPTO;
-        return result;
-    }
+    zend_string *encoded = zend_string_alloc(KAGE_BASE64_ENCODED_SIZE(data_len) - 1, 0);
+    ZSTR_LEN(encoded) = kage_base64_encode_to(data, data_len, ZSTR_VAL(encoded));
 
     zval *result_zv = emalloc(sizeof(zval));
-    ZVAL_STRINGL(result_zv, encoded, encoded_len);
-    efree(encoded);
+    ZVAL_NEW_STR(result_zv, encoded);
 
     result.result.value = result_zv;
     return result;
@@ -133,17 +126,18 @@ static kage_result_t kage_crypto_decode_base64(const char *data, size_t data_len
         return result;
     }
 
+    // Decoded straight into the result, sized for the worst case
     size_t decoded_len;
-    unsigned char *decoded = kage_base64_decode(data, data_len, &decoded_len);
-
-    if (!decoded) {
+    zend_string *decoded = zend_string_alloc(KAGE_BASE64_DECODED_SIZE(data_len) - 1, 0);
+    if (kage_base64_decode_to(data, data_len, (unsigned char *)ZSTR_VAL(decoded), &decoded_len) != SUCCESS) {
+        zend_string_efree(decoded);
         result.error = KAGE_ERROR_CRYPTO;
         return result;
     }
+    ZSTR_LEN(decoded) = decoded_len;
 
     zval *result_zv = emalloc(sizeof(zval));
-    ZVAL_STRINGL(result_zv, (char*)decoded, decoded_len);
-    efree(decoded);
+    ZVAL_NEW_STR(result_zv, decoded);
 
     result.result.value = result_zv;
     return result;
@@ -289,14 +283,9 @@ static kage_vm_interface vm_interface = {
     .pop = kage_vm_pop_value
 };
 
-// Context management
+// Context management. Contexts are persistent and owned by one thread.
 PHPAPI kage_context* kage_context_create(void) {
-    kage_context *ctx = emalloc(sizeof(kage_context));
-    if (!ctx) {
-        return NULL;
-    }
-
-    memset(ctx, 0, sizeof(kage_context));
+    kage_context *ctx = pecalloc(1, sizeof(kage_context), 1);
 
     // Initialize interfaces
     ctx->memory = &memory_interface;
@@ -305,17 +294,13 @@ PHPAPI kage_context* kage_context_create(void) {
     ctx->vm = &vm_interface;
 
     // Initialize resource table
-    ctx->resources = emalloc(sizeof(HashTable));
-    if (!ctx->resources) {
-        efree(ctx);
-        return NULL;
-    }
-    zend_hash_init(ctx->resources, 8, NULL, NULL, 0);
+    ctx->resources = pemalloc(sizeof(HashTable), 1);
+    zend_hash_init(ctx->resources, 8, NULL, NULL, 1);
 
     // Set defaults
-    ctx->max_memory = 256 * 1024 * 1024; // 256MB
-    ctx->debug_mode = 0;
-    ctx->log_level = 0;
+    ctx->max_memory = KAGE_DEFAULT_MAX_MEMORY;
+    ctx->debug_mode = KAGE_DEFAULT_DEBUG_MODE;
+    ctx->log_level = KAGE_DEFAULT_LOG_LEVEL;
 
     return ctx;
 }
@@ -329,7 +314,7 @@ PHPAPI void kage_context_destroy(kage_context *ctx) {
     // Free resource table
     if (ctx->resources) {
         zend_hash_destroy(ctx->resources);
-        efree(ctx->resources);
+        pefree(ctx->resources, 1);
     }
 
     // Free encryption key
@@ -337,7 +322,29 @@ PHPAPI void kage_context_destroy(kage_context *ctx) {
         zend_string_release(ctx->encryption_key);
     }
 
-    efree(ctx);
+    pefree(ctx, 1);
+}
+
+// Copies the settings of the configuration the thread has pinned
+static void kage_context_apply_config(kage_context *ctx) {
+    kage_config *config = kage_config_get();
+    if (!config) {
+        return;
+    }
+
+    const char *key = config->values.encryption_key;
+    size_t key_len = key ? strlen(key) : 0;
+    if (!key || !ctx->encryption_key || ZSTR_LEN(ctx->encryption_key) != key_len
+            || memcmp(ZSTR_VAL(ctx->encryption_key), key, key_len) != 0) {
+        if (ctx->encryption_key) {
+            zend_string_release(ctx->encryption_key);
+        }
+        ctx->encryption_key = key ? zend_string_init(key, key_len, 1) : NULL;
+    }
+    ctx->max_memory = config->values.max_memory;
+    ctx->debug_mode = config->values.debug_mode;
+    ctx->log_level = config->values.log_level;
+    ctx->config_generation = KAGE_G(config_generation);
 }
 
 PHPAPI kage_error_t kage_context_init(kage_context *ctx) {
@@ -349,17 +356,43 @@ PHPAPI kage_error_t kage_context_init(kage_context *ctx) {
         return KAGE_ERROR_CRYPTO;
     }
 
+    kage_context_apply_config(ctx);
     return KAGE_SUCCESS;
 }
 
+// Context of the calling thread, created on first use
 kage_context* kage_get_context(void) {
-    if (!global_context) {
-        global_context = kage_context_create();
-        if (global_context) {
-            kage_context_init(global_context);
+    kage_context *ctx = KAGE_G(context);
+    if (EXPECTED(ctx != NULL)) {
+        // The configuration changed since the context copied it
+        if (UNEXPECTED(ctx->config_generation != KAGE_G(config_generation))) {
+            kage_context_apply_config(ctx);
         }
+        return ctx;
+    }
+
+    ctx = kage_context_create();
+    kage_context_init(ctx);
+    KAGE_G(context) = ctx;
+    return ctx;
+}
+
+// RSHUTDOWN: registered resources and errors belong to the request
+void kage_context_deactivate(void) {
+    kage_context *ctx = KAGE_G(context);
+    if (ctx) {
+        kage_cleanup_resources(ctx);
+        ctx->last_error = KAGE_SUCCESS;
+        ctx->error_message[0] = '\0';
+    }
+}
+
+// GSHUTDOWN
+void kage_context_globals_shutdown(zend_kage_globals *globals) {
+    if (globals->context) {
+        kage_context_destroy(globals->context);
+        globals->context = NULL;
     }
-    return global_context;
 }
 
 // Error handling
@@ -463,9 +496,7 @@ PHPAPI kage_result_t kage_parse_and_execute(kage_context *ctx, const char *sourc
 PHPAPI void* kage_register_resource(kage_context *ctx, void *resource, const char *type) {
     if (!ctx || !ctx->resources || !resource) return NULL;
 
-    zend_string *key = zend_string_init(type, strlen(type), 0);
-    zend_hash_add_ptr(ctx->resources, key, resource);
-    zend_string_release(key);
+    zend_hash_str_add_ptr(ctx->resources, type, strlen(type), resource);
 
     return resource;
 }
@@ -83,13 +83,16 @@ typedef struct {
     kage_result_t (*pop)(kage_vm_state *state, zval *result);
 } kage_vm_interface;
 
-// Main context structure that holds all interfaces
-typedef struct {
+// Main context structure that holds all interfaces. There is one per
+// thread (module globals), allocated persistently on first use; the
+// configuration fields are copied from the shared kage_config.
+typedef struct kage_context {
     // Configuration
     zend_string *encryption_key;
     size_t max_memory;
     bool debug_mode;
     int log_level;
+    uint64_t config_generation;     // of the configuration copied above
 
     // Interfaces
     kage_memory_interface *memory;
@@ -101,15 +104,17 @@ typedef struct {
     kage_error_t last_error;
     char error_message[256];
 
-    // Resource management
+    // Resource management, cleared at the end of every request
     HashTable *resources;
 } kage_context;
 
-// Global context accessor and context management functions
+// Context of the calling thread and context management functions
 PHPAPI kage_context* kage_context_create(void);
 PHPAPI void kage_context_destroy(kage_context *ctx);
 PHPAPI kage_error_t kage_context_init(kage_context *ctx);
 kage_context* kage_get_context(void);
+void kage_context_deactivate(void);
+void kage_context_globals_shutdown(zend_kage_globals *globals);
 
 // Error handling functions
 PHPAPI void kage_set_error(kage_context *ctx, kage_error_t error, const char *format, ...);
@@ -13,88 +13,745 @@
 #include "kage_memory.h"
 #include "ast.h"
 #include "vm.h"
+#include <stdatomic.h>
+
+// Memory accounting
+
+// Usage of one thread. Only the owning thread writes, so updates are plain
+// relaxed stores; readers on other threads see untorn values.
+typedef struct {
+    _Atomic size_t allocated;
+    _Atomic size_t freed;
+    _Atomic size_t current;
+    _Atomic size_t peak;
+    _Atomic size_t count;
+} kage_memory_counter;
+
+struct kage_memory_counters {
+    kage_memory_counter total;
+    kage_memory_counter tags[KAGE_MEMORY_TAG_COUNT];
+    size_t request[KAGE_MEMORY_TAG_COUNT];  // request heap bytes still charged
+    struct kage_memory_counters *next;  // registry link
+    bool registered;
+};
+
+// Registry of live threads' counters, plus totals of threads that ended
+static kage_memory_counters *kage_memory_registry = NULL;
+static kage_memory_usage kage_memory_retired[KAGE_MEMORY_TAG_COUNT + 1];
+
+#ifdef ZTS
+static MUTEX_T kage_memory_mutex = NULL;
+# define KAGE_MEMORY_LOCK()   tsrm_mutex_lock(kage_memory_mutex)
+# define KAGE_MEMORY_UNLOCK() tsrm_mutex_unlock(kage_memory_mutex)
+#else
+# define KAGE_MEMORY_LOCK()
+# define KAGE_MEMORY_UNLOCK()
+#endif
+
+static const char *kage_memory_tag_names[KAGE_MEMORY_TAG_COUNT] = {
+    "general",
+    "crypto",
+    "ast",
+    "vm",
+    "package",
+};
+
+// Header of kage_memory_alloc() blocks; keeps the payload 16-byte aligned
+typedef struct {
+    size_t size;
+    uint32_t tag;
+    uint32_t magic;
+} kage_memory_header;
+
+#define KAGE_MEMORY_MAGIC 0x4b414745u  // "KAGE"
+
+static zend_always_inline size_t kage_memory_load(_Atomic size_t *value) {
+    return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+static zend_always_inline void kage_memory_store(_Atomic size_t *value, size_t new_value) {
+    atomic_store_explicit(value, new_value, memory_order_relaxed);
+}
+
+// Counters of the calling thread, registered on first use
+static kage_memory_counters* kage_memory_counters_get(void) {
+    kage_memory_counters *counters = KAGE_G(memory_counters);
+    if (EXPECTED(counters != NULL)) {
+        return counters;
+    }
+
+    counters = pecalloc(1, sizeof(kage_memory_counters), 1);
+    KAGE_MEMORY_LOCK();
+    counters->next = kage_memory_registry;
+    kage_memory_registry = counters;
+    counters->registered = true;
+    KAGE_MEMORY_UNLOCK();
+
+    KAGE_G(memory_counters) = counters;
+    return counters;
+}
+
+static zend_always_inline void kage_memory_counter_add(kage_memory_counter *counter, size_t size) {
+    size_t current = kage_memory_load(&counter->current) + size;
+    kage_memory_store(&counter->current, current);
+    if (current > kage_memory_load(&counter->peak)) {
+        kage_memory_store(&counter->peak, current);
+    }
+    kage_memory_store(&counter->allocated, kage_memory_load(&counter->allocated) + size);
+    kage_memory_store(&counter->count, kage_memory_load(&counter->count) + 1);
+}
+
+static zend_always_inline void kage_memory_counter_sub(kage_memory_counter *counter, size_t size) {
+    kage_memory_store(&counter->current, kage_memory_load(&counter->current) - size);
+    kage_memory_store(&counter->freed, kage_memory_load(&counter->freed) + size);
+}
+
+// Charges size bytes to a thread; bails out with E_ERROR past the budget,
+// before anything is allocated
+static void kage_memory_counters_charge(kage_memory_counters *counters, kage_memory_tag tag, size_t size, bool persistent) {
+    size_t current = kage_memory_load(&counters->total.current);
+    size_t limit = KAGE_G(memory_limit);
+    if (UNEXPECTED(limit && (size > limit || current > limit - size))) {
+        zend_error_noreturn(E_ERROR, "Kage: Allowed memory budget of %zu bytes exhausted (tried to allocate %zu bytes)",
+                            limit, size);
+    }
+
+    kage_memory_counter_add(&counters->total, size);
+    kage_memory_counter_add(&counters->tags[tag], size);
+    if (!persistent) {
+        counters->request[tag] += size;
+    }
+}
+
+static void kage_memory_counters_uncharge(kage_memory_counters *counters, kage_memory_tag tag, size_t size, bool persistent) {
+    kage_memory_counter_sub(&counters->total, size);
+    kage_memory_counter_sub(&counters->tags[tag], size);
+    if (!persistent) {
+        counters->request[tag] -= size;
+    }
+}
+
+/**
+ * Charges memory allocated outside kage_memory_alloc() and the pools.
+ *
+ * @param tag Subsystem to charge
+ * @param size Bytes allocated
+ * @param persistent Whether the memory outlives the request
+ */
+PHPAPI void kage_memory_charge(kage_memory_tag tag, size_t size, bool persistent) {
+    kage_memory_counters_charge(kage_memory_counters_get(), tag, size, persistent);
+}
 
-// Global memory statistics
-static kage_memory_stats global_stats = {0};
+PHPAPI void kage_memory_uncharge(kage_memory_tag tag, size_t size, bool persistent) {
+    kage_memory_counters_uncharge(kage_memory_counters_get(), tag, size, persistent);
+}
+
+// Request heap memory still charged from an earlier request was never
+// freed one by one (a fatal error skipped the frees); the heap is gone
+static void kage_memory_counters_drop_request(kage_memory_counters *counters) {
+    for (int i = 0; i < KAGE_MEMORY_TAG_COUNT; i++) {
+        if (counters->request[i]) {
+            kage_memory_counters_uncharge(counters, i, counters->request[i], false);
+        }
+    }
+}
+
+// Budget of the calling thread, from the max_memory setting; 0 disables
+// it. Set at RINIT from the request's configuration.
+PHPAPI void kage_memory_set_limit(size_t limit) {
+    KAGE_G(memory_limit) = limit;
+}
+
+PHPAPI const char* kage_memory_tag_name(kage_memory_tag tag) {
+    return tag < KAGE_MEMORY_TAG_COUNT ? kage_memory_tag_names[tag] : "unknown";
+}
+
+static void kage_memory_usage_add(kage_memory_usage *usage, kage_memory_counter *counter) {
+    size_t peak = kage_memory_load(&counter->peak);
+    usage->total_allocated += kage_memory_load(&counter->allocated);
+    usage->total_freed += kage_memory_load(&counter->freed);
+    usage->current_usage += kage_memory_load(&counter->current);
+    usage->allocation_count += kage_memory_load(&counter->count);
+    if (peak > usage->peak_usage) {
+        usage->peak_usage = peak;
+    }
+}
+
+static void kage_memory_usage_merge(kage_memory_usage *usage, const kage_memory_usage *other) {
+    usage->total_allocated += other->total_allocated;
+    usage->total_freed += other->total_freed;
+    usage->current_usage += other->current_usage;
+    usage->allocation_count += other->allocation_count;
+    if (other->peak_usage > usage->peak_usage) {
+        usage->peak_usage = other->peak_usage;
+    }
+}
+
+/**
+ * Sums the counters of every thread, including threads that have ended.
+ * Peaks are the highest usage reached by any single thread.
+ *
+ * @param stats Receives the totals
+ */
+PHPAPI void kage_memory_get_stats(kage_memory_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->limit = KAGE_G(memory_limit);
+
+    KAGE_MEMORY_LOCK();
+    kage_memory_usage_merge(&stats->total, &kage_memory_retired[KAGE_MEMORY_TAG_COUNT]);
+    for (int i = 0; i < KAGE_MEMORY_TAG_COUNT; i++) {
+        kage_memory_usage_merge(&stats->tags[i], &kage_memory_retired[i]);
+    }
+    for (kage_memory_counters *counters = kage_memory_registry; counters; counters = counters->next) {
+        kage_memory_usage_add(&stats->total, &counters->total);
+        for (int i = 0; i < KAGE_MEMORY_TAG_COUNT; i++) {
+            kage_memory_usage_add(&stats->tags[i], &counters->tags[i]);
+        }
+    }
+    KAGE_MEMORY_UNLOCK();
+}
+
+static void kage_memory_counter_reset(kage_memory_counter *counter) {
+    kage_memory_store(&counter->allocated, 0);
+    kage_memory_store(&counter->freed, 0);
+    kage_memory_store(&counter->count, 0);
+    kage_memory_store(&counter->peak, kage_memory_load(&counter->current));
+}
+
+// Clears the calling thread's cumulative counters; current usage is kept
+PHPAPI void kage_memory_reset_stats(void) {
+    kage_memory_counters *counters = kage_memory_counters_get();
+    kage_memory_counter_reset(&counters->total);
+    for (int i = 0; i < KAGE_MEMORY_TAG_COUNT; i++) {
+        kage_memory_counter_reset(&counters->tags[i]);
+    }
+}
+
+// MINIT
+void kage_memory_startup(void) {
+#ifdef ZTS
+    kage_memory_mutex = tsrm_mutex_alloc();
+#endif
+}
+
+// MSHUTDOWN. Globals of the main thread are destroyed after this, so the
+// registry is closed here rather than by the last GSHUTDOWN.
+void kage_memory_shutdown(void) {
+    KAGE_MEMORY_LOCK();
+    for (kage_memory_counters *counters = kage_memory_registry; counters; counters = counters->next) {
+        counters->registered = false;
+    }
+    kage_memory_registry = NULL;
+    KAGE_MEMORY_UNLOCK();
+#ifdef ZTS
+    tsrm_mutex_free(kage_memory_mutex);
+    kage_memory_mutex = NULL;
+#endif
+}
+
+// GSHUTDOWN: fold a thread's counters into the retired totals
+static void kage_memory_counters_retire(kage_memory_counters *counters) {
+    if (counters->registered) {
+        KAGE_MEMORY_LOCK();
+        kage_memory_counters **link = &kage_memory_registry;
+        while (*link != counters) {
+            link = &(*link)->next;
+        }
+        *link = counters->next;
+
+        kage_memory_usage usage = {0};
+        kage_memory_usage_add(&usage, &counters->total);
+        kage_memory_usage_merge(&kage_memory_retired[KAGE_MEMORY_TAG_COUNT], &usage);
+        for (int i = 0; i < KAGE_MEMORY_TAG_COUNT; i++) {
+            memset(&usage, 0, sizeof(usage));
+            kage_memory_usage_add(&usage, &counters->tags[i]);
+            kage_memory_usage_merge(&kage_memory_retired[i], &usage);
+        }
+        KAGE_MEMORY_UNLOCK();
+    }
+
+    pefree(counters, 1);
+}
+
+/**
+ * Allocates from the request heap with a size header, so the block can
+ * be accounted exactly when freed with kage_memory_free().
+ *
+ * @param size Bytes to allocate
+ * @param tag Subsystem to charge
+ * @return The memory
+ */
+PHPAPI void* kage_memory_alloc(size_t size, kage_memory_tag tag) {
+    kage_memory_charge(tag, size, false);
+
+    kage_memory_header *header = emalloc(zend_safe_address_guarded(1, size, sizeof(kage_memory_header)));
+    header->size = size;
+    header->tag = tag;
+    header->magic = KAGE_MEMORY_MAGIC;
+    return header + 1;
+}
+
+PHPAPI void kage_memory_free(void *ptr) {
+    if (!ptr) return;
+
+    kage_memory_header *header = (kage_memory_header *)ptr - 1;
+    ZEND_ASSERT(header->magic == KAGE_MEMORY_MAGIC);
+    header->magic = 0;
+    kage_memory_uncharge(header->tag, header->size, false);
+    efree(header);
+}
+
+// Resizes a kage_memory_alloc() block, which keeps its tag; tag is only
+// used when ptr is NULL
+PHPAPI void* kage_memory_realloc(void *ptr, size_t size, kage_memory_tag tag) {
+    if (!ptr) {
+        return kage_memory_alloc(size, tag);
+    }
+
+    kage_memory_header *header = (kage_memory_header *)ptr - 1;
+    ZEND_ASSERT(header->magic == KAGE_MEMORY_MAGIC);
+    if (size > header->size) {
+        kage_memory_charge(header->tag, size - header->size, false);
+    } else {
+        kage_memory_uncharge(header->tag, header->size - size, false);
+    }
+
+    header = erealloc(header, zend_safe_address_guarded(1, size, sizeof(kage_memory_header)));
+    header->size = size;
+    return header + 1;
+}
 
 // Memory pool implementation
-PHPAPI kage_memory_pool* kage_memory_pool_create(size_t initial_capacity) {
-    kage_memory_pool *pool = emalloc(sizeof(kage_memory_pool));
-    if (!pool) return NULL;
 
-    pool->blocks = emalloc(sizeof(void*) * initial_capacity);
-    if (!pool->blocks) {
-        efree(pool);
-        return NULL;
+// Chunk header; the data area starts at the next aligned offset
+struct kage_memory_chunk {
+    kage_memory_chunk *next;
+    size_t size;    // bytes in the data area
+    size_t used;    // bytes of the data area in use, padding included
+};
+
+#define KAGE_MEMORY_CHUNK_HEADER ZEND_MM_ALIGNED_SIZE_EX(sizeof(kage_memory_chunk), KAGE_MEMORY_ALIGNMENT)
+
+static zend_always_inline char* kage_memory_chunk_data(kage_memory_chunk *chunk) {
+    return (char *)chunk + KAGE_MEMORY_CHUNK_HEADER;
+}
+
+static zend_always_inline size_t kage_memory_align_up(uintptr_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+static kage_memory_chunk* kage_memory_chunk_create(kage_memory_pool *pool, size_t size) {
+    kage_memory_counters_charge(pool->counters, pool->tag, KAGE_MEMORY_CHUNK_HEADER + size, pool->persistent);
+
+    kage_memory_chunk *chunk = pemalloc(KAGE_MEMORY_CHUNK_HEADER + size, pool->persistent);
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+
+    pool->chunk_count++;
+    pool->capacity += size;
+
+    return chunk;
+}
+
+static void kage_memory_chunk_free(kage_memory_pool *pool, kage_memory_chunk *chunk) {
+    pool->chunk_count--;
+    pool->capacity -= chunk->size;
+    kage_memory_counters_uncharge(pool->counters, pool->tag, KAGE_MEMORY_CHUNK_HEADER + chunk->size, pool->persistent);
+
+    pefree(chunk, pool->persistent);
+}
+
+static void kage_memory_chunk_list_free(kage_memory_pool *pool, kage_memory_chunk *chunk) {
+    while (chunk) {
+        kage_memory_chunk *next = chunk->next;
+        kage_memory_chunk_free(pool, chunk);
+        chunk = next;
     }
+}
 
-    pool->block_count = 0;
-    pool->block_capacity = initial_capacity;
-    pool->total_allocated = 0;
+/**
+ * Creates a pool whose memory lives until the end of the request.
+ *
+ * @param chunk_size Size of the first chunk, 0 for the default; later
+ *                   chunks double up to KAGE_MEMORY_POOL_MAX_CHUNK
+ * @param tag Subsystem charged for the chunks
+ * @return The new pool
+ */
+PHPAPI kage_memory_pool* kage_memory_pool_create(size_t chunk_size, kage_memory_tag tag) {
+    return kage_memory_pool_create_ex(chunk_size, tag, false);
+}
 
+/**
+ * Creates a pool, optionally with persistent memory that outlives the
+ * request. No chunk is allocated until the first allocation.
+ *
+ * @param chunk_size Size of the first chunk, 0 for the default
+ * @param tag Subsystem charged for the chunks
+ * @param persistent Use pemalloc(..., 1) instead of the request heap
+ * @return The new pool
+ */
+PHPAPI kage_memory_pool* kage_memory_pool_create_ex(size_t chunk_size, kage_memory_tag tag, bool persistent) {
+    kage_memory_pool *pool = pecalloc(1, sizeof(kage_memory_pool), persistent);
+    pool->chunk_size = chunk_size < KAGE_MEMORY_POOL_MIN_CHUNK ? KAGE_MEMORY_POOL_MIN_CHUNK : chunk_size;
+    pool->persistent = persistent;
+    pool->tag = tag;
+    pool->counters = kage_memory_counters_get();
     return pool;
 }
 
 PHPAPI void kage_memory_pool_destroy(kage_memory_pool *pool) {
     if (!pool) return;
 
-    // Free all blocks
-    for (size_t i = 0; i < pool->block_count; i++) {
-        if (pool->blocks[i]) {
-            efree(pool->blocks[i]);
+    kage_memory_chunk_list_free(pool, pool->head);
+    kage_memory_chunk_list_free(pool, pool->large);
+    pefree(pool, pool->persistent);
+}
+
+// Slow path: the current chunk is full. Requests beyond half the largest
+// chunk size get a chunk of their own; otherwise move on to a chunk kept
+// by reset, or append one.
+static void* kage_memory_pool_alloc_slow(kage_memory_pool *pool, size_t size, size_t alignment) {
+    size_t needed = size + alignment - 1;
+
+    if (needed > KAGE_MEMORY_POOL_MAX_CHUNK / 2) {
+        kage_memory_chunk *chunk = kage_memory_chunk_create(pool, needed);
+        chunk->next = pool->large;
+        pool->large = chunk;
+
+        char *data = kage_memory_chunk_data(chunk);
+        char *ptr = (char *)kage_memory_align_up((uintptr_t)data, alignment);
+        chunk->used = (ptr - data) + size;
+        pool->waste += (ptr - data);
+        pool->last = NULL;
+        return ptr;
+    }
+
+    for (;;) {
+        kage_memory_chunk *chunk = pool->current;
+        if (chunk) {
+            pool->waste += chunk->size - chunk->used;
+        }
+
+        if (chunk && chunk->next) {
+            chunk = chunk->next;
+            chunk->used = 0;
+        } else {
+            size_t chunk_size = pool->chunk_size;
+            while (chunk_size < needed) {
+                chunk_size *= 2;
+            }
+            if (pool->chunk_size < KAGE_MEMORY_POOL_MAX_CHUNK) {
+                pool->chunk_size *= 2;
+            }
+
+            kage_memory_chunk *fresh = kage_memory_chunk_create(pool, chunk_size);
+            if (chunk) {
+                chunk->next = fresh;
+            } else {
+                pool->head = fresh;
+            }
+            chunk = fresh;
+        }
+        pool->current = chunk;
+
+        char *data = kage_memory_chunk_data(chunk);
+        char *ptr = (char *)kage_memory_align_up((uintptr_t)data, alignment);
+        if ((size_t)(ptr - data) + size <= chunk->size) {
+            chunk->used = (ptr - data) + size;
+            pool->waste += (ptr - data);
+            pool->last = ptr;
+            return ptr;
+        }
+        // A chunk kept by reset that is too small for this request; skip it
+    }
+}
+
+/**
+ * Allocates size bytes aligned to alignment, a power of two.
+ *
+ * @param pool The pool
+ * @param size Bytes to allocate
+ * @param alignment Required alignment
+ * @return The memory, valid until the pool is reset or destroyed
+ */
+PHPAPI void* kage_memory_pool_alloc_aligned(kage_memory_pool *pool, size_t size, size_t alignment) {
+    if (!pool || size == 0) return NULL;
+
+    pool->used += size;
+    pool->allocation_count++;
+
+    kage_memory_chunk *chunk = pool->current;
+    if (EXPECTED(chunk != NULL)) {
+        char *data = kage_memory_chunk_data(chunk);
+        char *ptr = (char *)kage_memory_align_up((uintptr_t)(data + chunk->used), alignment);
+        size_t end = (ptr - data) + size;
+        if (EXPECTED(end <= chunk->size)) {
+            pool->waste += (ptr - data) - chunk->used;
+            chunk->used = end;
+            pool->last = ptr;
+            return ptr;
         }
     }
 
-    efree(pool->blocks);
-    efree(pool);
+    return kage_memory_pool_alloc_slow(pool, size, alignment);
 }
 
 PHPAPI void* kage_memory_pool_alloc(kage_memory_pool *pool, size_t size) {
-    if (!pool || size == 0) return NULL;
+    return kage_memory_pool_alloc_aligned(pool, size, KAGE_MEMORY_ALIGNMENT);
+}
 
-    // Expand block array if needed
-    if (pool->block_count >= pool->block_capacity) {
-        size_t new_capacity = pool->block_capacity * 2;
-        void **new_blocks = erealloc(pool->blocks, sizeof(void*) * new_capacity);
-        if (!new_blocks) return NULL;
+/**
+ * Grows or shrinks an allocation. The most recent allocation is resized
+ * in place while its chunk has room; anything else is copied and the old
+ * block counts as waste until the next reset.
+ *
+ * @param pool The pool
+ * @param ptr Allocation to resize, or NULL
+ * @param old_size Its current size
+ * @param new_size The size wanted
+ * @return The resized memory
+ */
+PHPAPI void* kage_memory_pool_realloc(kage_memory_pool *pool, void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) {
+        return kage_memory_pool_alloc(pool, new_size);
+    }
 
-        pool->blocks = new_blocks;
-        pool->block_capacity = new_capacity;
+    kage_memory_chunk *chunk = pool->current;
+    if (ptr == pool->last && chunk) {
+        char *data = kage_memory_chunk_data(chunk);
+        size_t offset = (char *)ptr - data;
+        if (offset + new_size <= chunk->size) {
+            chunk->used = offset + new_size;
+            pool->used += new_size - old_size;
+            return ptr;
+        }
     }
 
-    // Allocate block
-    void *block = emalloc(size);
-    if (!block) return NULL;
+    void *moved = kage_memory_pool_alloc(pool, new_size);
+    memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    pool->used -= old_size;
+    pool->waste += old_size;
+    return moved;
+}
 
-    pool->blocks[pool->block_count++] = block;
-    pool->total_allocated += size;
+PHPAPI char* kage_memory_pool_strndup(kage_memory_pool *pool, const char *str, size_t length) {
+    char *copy = kage_memory_pool_alloc_aligned(pool, length + 1, 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
 
-    global_stats.total_allocated += size;
-    global_stats.current_usage += size;
-    if (global_stats.current_usage > global_stats.peak_usage) {
-        global_stats.peak_usage = global_stats.current_usage;
-    }
-    global_stats.allocation_count++;
+/**
+ * Calls back for every object in a pool that holds objects of a single
+ * size, allocated with the default alignment, in allocation order. Used
+ * to release what the objects reference before the pool goes away.
+ *
+ * @param pool The pool
+ * @param object_size Size every allocation was made with
+ * @param callback Called with each object
+ */
+PHPAPI void kage_memory_pool_walk(kage_memory_pool *pool, size_t object_size, void (*callback)(void *object)) {
+    if (!pool || !pool->current) return;
+
+    size_t stride = ZEND_MM_ALIGNED_SIZE_EX(object_size, KAGE_MEMORY_ALIGNMENT);
 
-    return block;
+    for (kage_memory_chunk *chunk = pool->head; chunk; chunk = chunk->next) {
+        char *data = kage_memory_chunk_data(chunk);
+        char *end = data + chunk->used;
+        for (char *ptr = (char *)kage_memory_align_up((uintptr_t)data, KAGE_MEMORY_ALIGNMENT); ptr + object_size <= end; ptr += stride) {
+            callback(ptr);
+        }
+        if (chunk == pool->current) {
+            break;
+        }
+    }
 }
 
+/**
+ * Forgets every allocation in O(1): chunks are kept for reuse, only
+ * oversized allocations are returned to the heap.
+ *
+ * @param pool The pool
+ */
 PHPAPI void kage_memory_pool_reset(kage_memory_pool *pool) {
     if (!pool) return;
 
-    global_stats.current_usage -= pool->total_allocated;
-    global_stats.total_freed += pool->total_allocated;
+    kage_memory_chunk_list_free(pool, pool->large);
+    pool->large = NULL;
+
+    pool->current = pool->head;
+    if (pool->head) {
+        pool->head->used = 0;
+    }
+    pool->last = NULL;
+    pool->used = 0;
+    pool->waste = 0;
+    pool->allocation_count = 0;
+}
+
+PHPAPI void kage_memory_pool_get_stats(const kage_memory_pool *pool, kage_memory_pool_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!pool) return;
+
+    stats->chunk_count = pool->chunk_count;
+    stats->capacity = pool->capacity;
+    stats->used = pool->used;
+    stats->waste = pool->waste;
+    stats->allocation_count = pool->allocation_count;
+    stats->utilisation = pool->capacity ? (double)pool->used / (double)pool->capacity : 0.0;
+}
+
+/**
+ * Records the current position of a pool, so that a call can use it for
+ * temporaries and give everything back with kage_memory_pool_restore().
+ *
+ * @param pool The pool
+ * @param mark Receives the position
+ */
+PHPAPI void kage_memory_pool_save(const kage_memory_pool *pool, kage_memory_pool_mark *mark) {
+    mark->current = pool->current;
+    mark->chunk_used = pool->current ? pool->current->used : 0;
+    mark->large = pool->large;
+    mark->used = pool->used;
+    mark->waste = pool->waste;
+    mark->allocation_count = pool->allocation_count;
+}
+
+/**
+ * Releases everything allocated since the mark was saved. Marks must be
+ * restored in the reverse order of saving; chunks are kept for reuse.
+ *
+ * @param pool The pool
+ * @param mark Position from kage_memory_pool_save()
+ */
+PHPAPI void kage_memory_pool_restore(kage_memory_pool *pool, const kage_memory_pool_mark *mark) {
+    while (pool->large != mark->large) {
+        kage_memory_chunk *next = pool->large->next;
+        kage_memory_chunk_free(pool, pool->large);
+        pool->large = next;
+    }
 
-    // Free all blocks but keep the array
-    for (size_t i = 0; i < pool->block_count; i++) {
-        if (pool->blocks[i]) {
-            efree(pool->blocks[i]);
-            pool->blocks[i] = NULL;
+    if (mark->current) {
+        pool->current = mark->current;
+        pool->current->used = mark->chunk_used;
+    } else {
+        // Nothing was allocated when the mark was saved
+        pool->current = pool->head;
+        if (pool->head) {
+            pool->head->used = 0;
         }
     }
+    pool->last = NULL;
+    pool->used = mark->used;
+    pool->waste = mark->waste;
+    pool->allocation_count = mark->allocation_count;
+}
+
+// Request arena and scratch buffer
 
-    pool->block_count = 0;
-    pool->total_allocated = 0;
+/**
+ * Returns the request arena of the calling thread. Its chunks are
+ * persistent and survive the request, so steady-state requests allocate
+ * nothing from the heap; the contents are released at request end.
+ * Transient users bracket their allocations with kage_memory_pool_save()
+ * and kage_memory_pool_restore().
+ *
+ * @return The request arena
+ */
+PHPAPI kage_memory_pool* kage_memory_request_pool(void) {
+    if (UNEXPECTED(KAGE_G(request_pool) == NULL)) {
+        KAGE_G(request_pool) = kage_memory_pool_create_ex(KAGE_REQUEST_POOL_CHUNK, KAGE_MEMORY_TAG_GENERAL, true);
+    }
+    return KAGE_G(request_pool);
+}
+
+/**
+ * Returns a temporary buffer of at least size bytes, valid until
+ * kage_scratch_release(). The thread's scratch buffer is reused across
+ * calls; a nested acquire, or one above KAGE_SCRATCH_RETAIN, falls back to
+ * the request heap. Both are charged to the crypto tag.
+ *
+ * @param size Bytes needed
+ * @return The buffer
+ */
+PHPAPI void* kage_scratch_acquire(size_t size) {
+    if (UNEXPECTED(KAGE_G(scratch_busy) || size > KAGE_SCRATCH_RETAIN)) {
+        return kage_memory_alloc(size, KAGE_MEMORY_TAG_CRYPTO);
+    }
+
+    if (UNEXPECTED(size > KAGE_G(scratch_size))) {
+        size_t scratch_size = KAGE_G(scratch_size) ? KAGE_G(scratch_size) : 4096;
+        while (scratch_size < size) {
+            scratch_size *= 2;
+        }
+        if (scratch_size > KAGE_SCRATCH_RETAIN) {
+            scratch_size = KAGE_SCRATCH_RETAIN;
+        }
+        // Contents are not preserved, so no realloc copy
+        if (KAGE_G(scratch)) {
+            pefree(KAGE_G(scratch), 1);
+            kage_memory_uncharge(KAGE_MEMORY_TAG_CRYPTO, KAGE_G(scratch_size), true);
+            KAGE_G(scratch) = NULL;
+            KAGE_G(scratch_size) = 0;
+        }
+        kage_memory_charge(KAGE_MEMORY_TAG_CRYPTO, scratch_size, true);
+        KAGE_G(scratch) = pemalloc(scratch_size, 1);
+        KAGE_G(scratch_size) = scratch_size;
+    }
+
+    KAGE_G(scratch_busy) = 1;
+    return KAGE_G(scratch);
+}
+
+PHPAPI void kage_scratch_release(void *buffer) {
+    if (EXPECTED(buffer == KAGE_G(scratch))) {
+        KAGE_G(scratch_busy) = 0;
+    } else {
+        kage_memory_free(buffer);
+    }
+}
+
+// RINIT: the arena is created on first use. Resources are freed after
+// RSHUTDOWN, so leftovers of the last request are only known here.
+void kage_memory_activate(void) {
+    KAGE_G(scratch_busy) = 0;
+    if (KAGE_G(memory_counters)) {
+        kage_memory_counters_drop_request(KAGE_G(memory_counters));
+    }
+}
+
+// RSHUTDOWN: empty the request arena, keeping its chunks unless it grew large
+void kage_memory_deactivate(void) {
+    kage_memory_pool *pool = KAGE_G(request_pool);
+    if (!pool) {
+        return;
+    }
+
+    if (pool->capacity > KAGE_REQUEST_POOL_RETAIN) {
+        kage_memory_pool_destroy(pool);
+        KAGE_G(request_pool) = NULL;
+    } else {
+        kage_memory_pool_reset(pool);
+    }
+}
+
+// GSHUTDOWN; may run on another thread, so only globals is used
+void kage_memory_globals_shutdown(zend_kage_globals *globals) {
+    if (globals->request_pool) {
+        kage_memory_pool_destroy(globals->request_pool);
+        globals->request_pool = NULL;
+    }
+    if (globals->scratch) {
+        pefree(globals->scratch, 1);
+        kage_memory_counters_uncharge(globals->memory_counters, KAGE_MEMORY_TAG_CRYPTO, globals->scratch_size, true);
+        globals->scratch = NULL;
+        globals->scratch_size = 0;
+    }
+    if (globals->memory_counters) {
+        kage_memory_counters_retire(globals->memory_counters);
+        globals->memory_counters = NULL;
+    }
 }
 
 // Scope implementation (RAII-like)
@@ -102,7 +759,9 @@ PHPAPI kage_scope* kage_scope_create(kage_scope *parent) {
     kage_scope *scope = emalloc(sizeof(kage_scope));
     if (!scope) return NULL;
 
-    scope->resources = NULL;
+    scope->entries = scope->inline_entries;
+    scope->count = 0;
+    scope->capacity = KAGE_SCOPE_INLINE_ENTRIES;
     scope->parent = parent;
     scope->cleanup_on_exit = true;
 
@@ -116,118 +775,93 @@ PHPAPI void kage_scope_destroy(kage_scope *scope) {
         kage_scope_cleanup(scope);
     }
 
+    if (scope->entries != scope->inline_entries) {
+        efree(scope->entries);
+    }
     efree(scope);
 }
 
+// Releases every registration, newest first. The stack keeps its
+// capacity, so a scope reused in a loop does not grow again.
 PHPAPI void kage_scope_cleanup(kage_scope *scope) {
     if (!scope) return;
 
-    kage_resource *current = scope->resources;
-    while (current) {
-        kage_resource *next = current->next;
-
-        if (current->cleanup && current->data) {
-            current->cleanup(current->data);
+    kage_scope_entry *entries = scope->entries;
+    for (uint32_t i = scope->count; i-- > 0; ) {
+        void *data = entries[i].data;
+        switch (entries[i].type) {
+            case KAGE_RESOURCE_ZVAL:
+                zval_ptr_dtor((zval*)data);
+                efree(data);
+                break;
+            case KAGE_RESOURCE_AST_NODE:
+                kage_ast_free((kage_ast_node*)data);
+                break;
+            case KAGE_RESOURCE_VM_STATE:
+                kage_vm_destroy((kage_vm_state*)data);
+                efree(data);
+                break;
+            case KAGE_RESOURCE_STRING:
+            case KAGE_RESOURCE_BUFFER:
+                efree(data);
+                break;
         }
-
-        efree(current);
-        current = next;
     }
 
-    scope->resources = NULL;
-}
-
-// Resource cleanup functions
-static void kage_cleanup_zval(void *resource) {
-    if (resource) {
-        zval_ptr_dtor((zval*)resource);
-        efree(resource);
-    }
-}
-
-static void kage_cleanup_string(void *resource) {
-    if (resource) {
-        efree(resource);
-    }
+    scope->count = 0;
 }
 
-static void kage_cleanup_ast_node(void *resource) {
-    if (resource) {
-        kage_ast_free((kage_ast_node*)resource);
+static zend_never_inline bool kage_scope_grow(kage_scope *scope) {
+    if (scope->capacity > UINT32_MAX / 2) {
+        return false;
     }
-}
 
-static void kage_cleanup_vm_state(void *resource) {
-    if (resource) {
-        kage_vm_destroy((kage_vm_state*)resource);
-        efree(resource);
+    uint32_t capacity = scope->capacity * 2;
+    if (scope->entries == scope->inline_entries) {
+        scope->entries = safe_emalloc(capacity, sizeof(kage_scope_entry), 0);
+        memcpy(scope->entries, scope->inline_entries, sizeof(scope->inline_entries));
+    } else {
+        scope->entries = safe_erealloc(scope->entries, capacity, sizeof(kage_scope_entry), 0);
     }
-}
+    scope->capacity = capacity;
 
-static void kage_cleanup_buffer(void *resource) {
-    if (resource) {
-        efree(resource);
-    }
+    return true;
 }
 
-// Helper function to add resource to scope
-static bool kage_scope_add_resource(kage_scope *scope, void *data, kage_resource_type type) {
+// Pushes a registration; only allocates when the stack doubles
+static zend_always_inline bool kage_scope_push(kage_scope *scope, void *data, kage_resource_type type) {
     if (!scope || !data) return false;
 
-    kage_resource *resource = emalloc(sizeof(kage_resource));
-    if (!resource) return false;
-
-    resource->data = data;
-    resource->type = type;
-
-    // Set appropriate cleanup function
-    switch (type) {
-        case KAGE_RESOURCE_ZVAL:
-            resource->cleanup = kage_cleanup_zval;
-            break;
-        case KAGE_RESOURCE_STRING:
-            resource->cleanup = kage_cleanup_string;
-            break;
-        case KAGE_RESOURCE_AST_NODE:
-            resource->cleanup = kage_cleanup_ast_node;
-            break;
-        case KAGE_RESOURCE_VM_STATE:
-            resource->cleanup = kage_cleanup_vm_state;
-            break;
-        case KAGE_RESOURCE_BUFFER:
-            resource->cleanup = kage_cleanup_buffer;
-            break;
-        default:
-            efree(resource);
-            return false;
+    if (UNEXPECTED(scope->count == scope->capacity) && !kage_scope_grow(scope)) {
+        return false;
     }
 
-    // Add to linked list
-    resource->next = scope->resources;
-    scope->resources = resource;
+    kage_scope_entry *entry = &scope->entries[scope->count++];
+    entry->data = data;
+    entry->type = type;
 
     return true;
 }
 
 // Public resource registration functions
 PHPAPI bool kage_scope_register_zval(kage_scope *scope, zval *zv) {
-    return kage_scope_add_resource(scope, zv, KAGE_RESOURCE_ZVAL);
+    return kage_scope_push(scope, zv, KAGE_RESOURCE_ZVAL);
 }
 
 PHPAPI bool kage_scope_register_string(kage_scope *scope, char *str) {
-    return kage_scope_add_resource(scope, str, KAGE_RESOURCE_STRING);
+    return kage_scope_push(scope, str, KAGE_RESOURCE_STRING);
 }
 
 PHPAPI bool kage_scope_register_ast_node(kage_scope *scope, kage_ast_node *node) {
-    return kage_scope_add_resource(scope, node, KAGE_RESOURCE_AST_NODE);
+    return kage_scope_push(scope, node, KAGE_RESOURCE_AST_NODE);
 }
 
 PHPAPI bool kage_scope_register_vm_state(kage_scope *scope, kage_vm_state *state) {
-    return kage_scope_add_resource(scope, state, KAGE_RESOURCE_VM_STATE);
+    return kage_scope_push(scope, state, KAGE_RESOURCE_VM_STATE);
 }
 
 PHPAPI bool kage_scope_register_buffer(kage_scope *scope, void *buffer) {
-    return kage_scope_add_resource(scope, buffer, KAGE_RESOURCE_BUFFER);
+    return kage_scope_push(scope, buffer, KAGE_RESOURCE_BUFFER);
 }
 
 // Safe utility functions
@@ -260,44 +894,22 @@ PHPAPI kage_ast_node* kage_safe_ast_node_copy(kage_scope *scope, kage_ast_node *
     return src;
 }
 
-// Memory statistics
-PHPAPI kage_memory_stats* kage_memory_get_stats(void) {
-    return &global_stats;
-}
-
-PHPAPI void kage_memory_reset_stats(void) {
-    memset(&global_stats, 0, sizeof(global_stats));
-}
-
 // Safe allocation wrappers
 PHPAPI void* kage_memory_safe_alloc(size_t size, const char *file, int line) {
-    void *ptr = emalloc(size);
-    if (ptr) {
-        global_stats.total_allocated += size;
-        global_stats.current_usage += size;
-        if (global_stats.current_usage > global_stats.peak_usage) {
-            global_stats.peak_usage = global_stats.current_usage;
-        }
-        global_stats.allocation_count++;
-    }
-    return ptr;
+    return kage_memory_alloc(size, KAGE_MEMORY_TAG_GENERAL);
 }
 
 PHPAPI void kage_memory_safe_free(void *ptr, const char *file, int line) {
-    if (ptr) {
-        // Note: We can't track exact size freed, so we estimate
-        global_stats.total_freed += 1; // Placeholder
-        global_stats.current_usage -= 1; // Placeholder
-        efree(ptr);
-    }
+    kage_memory_free(ptr);
 }
 
 #ifdef KAGE_DEBUG_MEMORY
 PHPAPI void kage_memory_detect_leaks(const char *file, int line) {
-    if (global_stats.current_usage > 0) {
+    size_t current = kage_memory_load(&kage_memory_counters_get()->total.current);
+    if (current > 0) {
         php_error_docref(NULL, E_WARNING,
             "Kage Memory Leak Detected: %zu bytes still allocated (%s:%d)",
-            global_stats.current_usage, file, line);
+            current, file, line);
     }
 }
 #endif
@@ -19,14 +19,69 @@
 #include "ast.h"
 #include <stdbool.h>
 
-// Memory pool for efficient allocation
+// Subsystem an allocation is accounted to
+typedef enum {
+    KAGE_MEMORY_TAG_GENERAL,
+    KAGE_MEMORY_TAG_CRYPTO,
+    KAGE_MEMORY_TAG_AST,
+    KAGE_MEMORY_TAG_VM,
+    KAGE_MEMORY_TAG_PACKAGE,
+    KAGE_MEMORY_TAG_COUNT
+} kage_memory_tag;
+
+// Per-thread usage counters (defined in kage_memory.c)
+typedef struct kage_memory_counters kage_memory_counters;
+
+// Memory pool: bump-pointer arena over large chunks. Allocations are
+// released together by reset or destroy, never one by one.
+#define KAGE_MEMORY_ALIGNMENT 16
+#define KAGE_MEMORY_POOL_MIN_CHUNK (4 * 1024)
+#define KAGE_MEMORY_POOL_MAX_CHUNK (256 * 1024)
+
+typedef struct kage_memory_chunk kage_memory_chunk;
+
 typedef struct kage_memory_pool {
-    void **blocks;
-    size_t block_count;
-    size_t block_capacity;
-    size_t total_allocated;
+    kage_memory_chunk *head;      // chunks kept across resets
+    kage_memory_chunk *current;   // chunk being filled; later ones are free
+    kage_memory_chunk *large;     // oversized allocations, released on reset
+    char *last;                   // most recent allocation, grown in place by realloc
+    size_t chunk_size;            // size of the next chunk, doubling up to the max
+    bool persistent;              // pemalloc'd, survives the request
+    kage_memory_tag tag;
+    kage_memory_counters *counters;  // of the creating thread, charged for every chunk
+    size_t chunk_count;
+    size_t capacity;              // bytes in all chunks
+    size_t used;                  // bytes handed out since the last reset
+    size_t waste;                 // alignment padding, skipped chunk tails, moved reallocs
+    size_t allocation_count;
 } kage_memory_pool;
 
+typedef struct {
+    size_t chunk_count;
+    size_t capacity;
+    size_t used;
+    size_t waste;
+    size_t allocation_count;
+    double utilisation;           // used / capacity
+} kage_memory_pool_stats;
+
+// Pool position saved by kage_memory_pool_save(); restores are LIFO
+typedef struct {
+    kage_memory_chunk *current;
+    size_t chunk_used;
+    kage_memory_chunk *large;
+    size_t used;
+    size_t waste;
+    size_t allocation_count;
+} kage_memory_pool_mark;
+
+// Request arena: persistent chunks reused by every request on the thread
+#define KAGE_REQUEST_POOL_CHUNK (16 * 1024)
+#define KAGE_REQUEST_POOL_RETAIN (1024 * 1024)  // dropped at request end when larger
+
+// Scratch buffers above this size are not kept between calls
+#define KAGE_SCRATCH_RETAIN (1024 * 1024)
+
 // Auto-cleanup resource types
 typedef enum {
     KAGE_RESOURCE_ZVAL,
@@ -36,29 +91,46 @@ typedef enum {
     KAGE_RESOURCE_BUFFER
 } kage_resource_type;
 
-// Resource cleanup function type
-typedef void (*kage_cleanup_func)(void *resource);
+// Registrations kept inside the scope before the stack moves to the heap
+#define KAGE_SCOPE_INLINE_ENTRIES 16
 
-// Resource tracker for automatic cleanup
-typedef struct kage_resource {
+typedef struct {
     void *data;
     kage_resource_type type;
-    kage_cleanup_func cleanup;
-    struct kage_resource *next;
-} kage_resource;
+} kage_scope_entry;
 
-// Scope-based resource manager (RAII-like)
+// Scope-based resource manager (RAII-like). Registrations are pushed on a
+// contiguous stack, which starts in inline_entries, and released LIFO.
 typedef struct kage_scope {
-    kage_resource *resources;
+    kage_scope_entry *entries;
+    uint32_t count;
+    uint32_t capacity;
     struct kage_scope *parent;
     bool cleanup_on_exit;
+    kage_scope_entry inline_entries[KAGE_SCOPE_INLINE_ENTRIES];
 } kage_scope;
 
 // Memory pool functions
-PHPAPI kage_memory_pool* kage_memory_pool_create(size_t initial_capacity);
+PHPAPI kage_memory_pool* kage_memory_pool_create(size_t chunk_size, kage_memory_tag tag);
+PHPAPI kage_memory_pool* kage_memory_pool_create_ex(size_t chunk_size, kage_memory_tag tag, bool persistent);
 PHPAPI void kage_memory_pool_destroy(kage_memory_pool *pool);
 PHPAPI void* kage_memory_pool_alloc(kage_memory_pool *pool, size_t size);
+PHPAPI void* kage_memory_pool_alloc_aligned(kage_memory_pool *pool, size_t size, size_t alignment);
+PHPAPI void* kage_memory_pool_realloc(kage_memory_pool *pool, void *ptr, size_t old_size, size_t new_size);
+PHPAPI char* kage_memory_pool_strndup(kage_memory_pool *pool, const char *str, size_t length);
+PHPAPI void kage_memory_pool_walk(kage_memory_pool *pool, size_t object_size, void (*callback)(void *object));
 PHPAPI void kage_memory_pool_reset(kage_memory_pool *pool);
+PHPAPI void kage_memory_pool_get_stats(const kage_memory_pool *pool, kage_memory_pool_stats *stats);
+PHPAPI void kage_memory_pool_save(const kage_memory_pool *pool, kage_memory_pool_mark *mark);
+PHPAPI void kage_memory_pool_restore(kage_memory_pool *pool, const kage_memory_pool_mark *mark);
+
+// Request arena and scratch buffer, both per thread (module globals)
+PHPAPI kage_memory_pool* kage_memory_request_pool(void);
+PHPAPI void* kage_scratch_acquire(size_t size);
+PHPAPI void kage_scratch_release(void *buffer);
+void kage_memory_activate(void);
+void kage_memory_deactivate(void);
+void kage_memory_globals_shutdown(zend_kage_globals *globals);
 
 // Scope management functions (RAII-like)
 PHPAPI kage_scope* kage_scope_create(kage_scope *parent);
@@ -86,12 +158,6 @@ PHPAPI bool kage_scope_register_buffer(kage_scope *scope, void *buffer);
         kage_scope_register_string(scope, str); \
     }
 
-#define KAGE_SCOPE_ALLOC_AST_NODE(scope, node) \
-    kage_ast_node *node = kage_ast_node_create(0); \
-    if (node) { \
-        kage_scope_register_ast_node(scope, node); \
-    }
-
 #define KAGE_SCOPE_ALLOC_VM_STATE(scope, state) \
     kage_vm_state *state = emalloc(sizeof(kage_vm_state)); \
     if (state) { \
@@ -114,17 +180,35 @@ PHPAPI zval* kage_safe_zval_copy(kage_scope *scope, zval *src);
 PHPAPI char* kage_safe_string_copy(kage_scope *scope, const char *src, size_t len);
 PHPAPI kage_ast_node* kage_safe_ast_node_copy(kage_scope *scope, kage_ast_node *src);
 
-// Memory statistics for debugging
+// Memory accounting. Usage is counted per thread and summed on read;
+// a thread that goes past the max_memory budget fails with E_ERROR.
 typedef struct {
     size_t total_allocated;
     size_t total_freed;
     size_t current_usage;
-    size_t peak_usage;
+    size_t peak_usage;            // highest usage reached by any one thread
     size_t allocation_count;
+} kage_memory_usage;
+
+typedef struct {
+    kage_memory_usage total;
+    kage_memory_usage tags[KAGE_MEMORY_TAG_COUNT];
+    size_t limit;                 // calling thread's budget, 0 for none
 } kage_memory_stats;
 
-PHPAPI kage_memory_stats* kage_memory_get_stats(void);
+PHPAPI void kage_memory_get_stats(kage_memory_stats *stats);
 PHPAPI void kage_memory_reset_stats(void);
+PHPAPI const char* kage_memory_tag_name(kage_memory_tag tag);
+PHPAPI void kage_memory_set_limit(size_t limit);
+PHPAPI void kage_memory_charge(kage_memory_tag tag, size_t size, bool persistent);
+PHPAPI void kage_memory_uncharge(kage_memory_tag tag, size_t size, bool persistent);
+void kage_memory_startup(void);
+void kage_memory_shutdown(void);
+
+// Size-prefixed request allocations, accounted to a tag
+PHPAPI void* kage_memory_alloc(size_t size, kage_memory_tag tag);
+PHPAPI void* kage_memory_realloc(void *ptr, size_t size, kage_memory_tag tag);
+PHPAPI void kage_memory_free(void *ptr);
 
 // Memory-safe wrapper for existing functions
 #define kage_safe_emalloc(size) kage_memory_safe_alloc(size, __FILE__, __LINE__)
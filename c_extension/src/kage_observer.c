@@ -0,0 +1,357 @@
+/**
+ * Function Profiler for Kage Extension
+ *
+ * zend_observer based call counters and timers for protected functions
+ */
+
+#include "php.h"
+#include "zend_observer.h"
+#include "ext/standard/info.h"
+#include "kage_observer.h"
+#include "php_bytecode_extractor.h"
+#include <time.h>
+
+// Process-wide totals, "file\tfunction" => kage_observer_stats (persistent)
+static HashTable kage_observer_totals;
+static bool kage_observer_registered = false;
+
+#ifdef ZTS
+static MUTEX_T kage_observer_mutex;
+# define KAGE_OBSERVER_LOCK()   tsrm_mutex_lock(kage_observer_mutex)
+# define KAGE_OBSERVER_UNLOCK() tsrm_mutex_unlock(kage_observer_mutex)
+#else
+# define KAGE_OBSERVER_LOCK()
+# define KAGE_OBSERVER_UNLOCK()
+#endif
+
+static zend_always_inline uint64_t kage_observer_clock(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void kage_observer_stats_dtor(zval *zv) {
+    kage_observer_stats *stats = Z_PTR_P(zv);
+    while (stats) {
+        kage_observer_stats *previous = stats->previous;
+        zend_string_release(stats->file);
+        zend_string_release(stats->function);
+        if (stats->function_name) {
+            zend_string_release(stats->function_name);
+        }
+        efree(stats);
+        stats = previous;
+    }
+}
+
+static void kage_observer_totals_dtor(zval *zv) {
+    kage_observer_stats *stats = Z_PTR_P(zv);
+    zend_string_release_ex(stats->file, 1);
+    zend_string_release_ex(stats->function, 1);
+    pefree(stats, 1);
+}
+
+// Whether stats were recorded for op_array. The op_array of an include or
+// eval is freed after it runs, and a later one, e.g. the next eval()'d
+// code, can get its opcodes address. Pointers are compared first, so the
+// check is cheap while the op_array is the same.
+static bool kage_observer_stats_match(const kage_observer_stats *stats, const zend_op_array *op_array) {
+    if (stats->line_start != op_array->line_start || !zend_string_equals(stats->file, op_array->filename)) {
+        return false;
+    }
+    if (!stats->function_name || !op_array->function_name) {
+        return stats->function_name == op_array->function_name;
+    }
+    return zend_string_equals(stats->function_name, op_array->function_name);
+}
+
+static kage_observer_stats* kage_observer_stats_create(zend_op_array *op_array) {
+    kage_observer_stats *stats = ecalloc(1, sizeof(kage_observer_stats));
+    stats->file = zend_string_copy(op_array->filename);
+    stats->function = kage_op_array_name(op_array);
+    stats->function_name = op_array->function_name ? zend_string_copy(op_array->function_name) : NULL;
+    stats->line_start = op_array->line_start;
+    return stats;
+}
+
+// Request counters of an op_array; the last one is cached for recursion
+// and tight call loops
+static kage_observer_stats* kage_observer_stats_for(zend_op_array *op_array) {
+    if (op_array->opcodes == KAGE_G(observer_last_opcodes)
+            && kage_observer_stats_match(KAGE_G(observer_last), op_array)) {
+        return KAGE_G(observer_last);
+    }
+
+    zend_ulong key = (zend_ulong)(uintptr_t)op_array->opcodes;
+    zval *slot = zend_hash_index_find(KAGE_G(observer_stats), key);
+    kage_observer_stats *stats;
+    if (!slot) {
+        stats = kage_observer_stats_create(op_array);
+        zend_hash_index_add_new_ptr(KAGE_G(observer_stats), key, stats);
+    } else {
+        stats = Z_PTR_P(slot);
+        if (!kage_observer_stats_match(stats, op_array)) {
+            // A reused address: the old counters are still merged at RSHUTDOWN
+            kage_observer_stats *stale = stats;
+            stats = kage_observer_stats_create(op_array);
+            stats->previous = stale;
+            Z_PTR_P(slot) = stats;
+        }
+    }
+
+    KAGE_G(observer_last_opcodes) = op_array->opcodes;
+    KAGE_G(observer_last) = stats;
+    return stats;
+}
+
+static void kage_observer_begin(zend_execute_data *execute_data) {
+    if (!KAGE_G(observer_stats)) {
+        return;
+    }
+
+    if (KAGE_G(observer_depth) == KAGE_G(observer_stack_size)) {
+        KAGE_G(observer_stack_size) = KAGE_G(observer_stack_size) ? KAGE_G(observer_stack_size) * 2 : 64;
+        KAGE_G(observer_stack) = safe_erealloc(KAGE_G(observer_stack), KAGE_G(observer_stack_size), sizeof(kage_observer_frame), 0);
+    }
+
+    kage_observer_frame *frame = &KAGE_G(observer_stack)[KAGE_G(observer_depth)++];
+    frame->stats = kage_observer_stats_for(&EX(func)->op_array);
+    frame->wall_start = kage_observer_clock(CLOCK_MONOTONIC);
+    frame->cpu_start = kage_observer_clock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+// Also runs when the call unwinds with an exception
+static void kage_observer_end(zend_execute_data *execute_data, zval *retval) {
+    if (!KAGE_G(observer_stats) || KAGE_G(observer_depth) == 0) {
+        return;
+    }
+
+    kage_observer_frame *frame = &KAGE_G(observer_stack)[--KAGE_G(observer_depth)];
+    frame->stats->calls++;
+    frame->stats->wall_ns += kage_observer_clock(CLOCK_MONOTONIC) - frame->wall_start;
+    frame->stats->cpu_ns += kage_observer_clock(CLOCK_THREAD_CPUTIME_ID) - frame->cpu_start;
+}
+
+// Decided once per function; unprotected functions get no handlers at all
+static zend_observer_fcall_handlers kage_observer_init(zend_execute_data *execute_data) {
+    zend_observer_fcall_handlers handlers = {NULL, NULL};
+    zend_function *func = EX(func);
+    const char *filter = KAGE_G(observer_filter);
+
+    if (func->type != ZEND_USER_FUNCTION || !func->op_array.filename) {
+        return handlers;
+    }
+    if (filter && *filter && !zend_memnstr(ZSTR_VAL(func->op_array.filename), filter, strlen(filter),
+                                           ZSTR_VAL(func->op_array.filename) + ZSTR_LEN(func->op_array.filename))) {
+        return handlers;
+    }
+
+    handlers.begin = kage_observer_begin;
+    handlers.end = kage_observer_end;
+    return handlers;
+}
+
+// Observers must be registered at MINIT, so kage.observer is PHP_INI_SYSTEM
+PHPAPI void kage_observer_startup(void) {
+    if (!KAGE_G(observer)) {
+        return;
+    }
+
+    zend_hash_init(&kage_observer_totals, 64, NULL, kage_observer_totals_dtor, 1);
+#ifdef ZTS
+    kage_observer_mutex = tsrm_mutex_alloc();
+#endif
+    zend_observer_fcall_register(kage_observer_init);
+    kage_observer_registered = true;
+}
+
+PHPAPI void kage_observer_shutdown(void) {
+    if (!kage_observer_registered) {
+        return;
+    }
+
+    zend_hash_destroy(&kage_observer_totals);
+#ifdef ZTS
+    tsrm_mutex_free(kage_observer_mutex);
+#endif
+    kage_observer_registered = false;
+}
+
+PHPAPI void kage_observer_activate(void) {
+    KAGE_G(observer_last_opcodes) = NULL;
+    KAGE_G(observer_last) = NULL;
+    KAGE_G(observer_depth) = 0;
+
+    if (!kage_observer_registered) {
+        return;
+    }
+
+    ALLOC_HASHTABLE(KAGE_G(observer_stats));
+    zend_hash_init(KAGE_G(observer_stats), 32, NULL, kage_observer_stats_dtor, 0);
+}
+
+// Adds one function's counters to a totals table
+static void kage_observer_merge(HashTable *totals, kage_observer_stats *stats, bool persistent) {
+    zend_string *key = zend_strpprintf(0, "%s\t%s", ZSTR_VAL(stats->file), ZSTR_VAL(stats->function));
+    kage_observer_stats *total = zend_hash_find_ptr(totals, key);
+
+    if (!total) {
+        total = pecalloc(1, sizeof(kage_observer_stats), persistent);
+        total->file = zend_string_init(ZSTR_VAL(stats->file), ZSTR_LEN(stats->file), persistent);
+        total->function = zend_string_init(ZSTR_VAL(stats->function), ZSTR_LEN(stats->function), persistent);
+        if (persistent) {
+            zend_string *persistent_key = zend_string_init(ZSTR_VAL(key), ZSTR_LEN(key), 1);
+            zend_hash_add_new_ptr(totals, persistent_key, total);
+            zend_string_release_ex(persistent_key, 1);
+        } else {
+            zend_hash_add_new_ptr(totals, key, total);
+        }
+    }
+
+    total->calls += stats->calls;
+    total->wall_ns += stats->wall_ns;
+    total->cpu_ns += stats->cpu_ns;
+    zend_string_release(key);
+}
+
+PHPAPI void kage_observer_deactivate(void) {
+    HashTable *stats_table = KAGE_G(observer_stats);
+    if (!stats_table) {
+        return;
+    }
+
+    KAGE_G(observer_stats) = NULL;
+    KAGE_G(observer_last_opcodes) = NULL;
+    KAGE_G(observer_last) = NULL;
+
+    kage_observer_stats *stats;
+    KAGE_OBSERVER_LOCK();
+    ZEND_HASH_FOREACH_PTR(stats_table, stats) {
+        for (; stats; stats = stats->previous) {
+            if (stats->calls > 0) {
+                kage_observer_merge(&kage_observer_totals, stats, true);
+            }
+        }
+    } ZEND_HASH_FOREACH_END();
+    KAGE_OBSERVER_UNLOCK();
+
+    zend_hash_destroy(stats_table);
+    FREE_HASHTABLE(stats_table);
+
+    if (KAGE_G(observer_stack)) {
+        efree(KAGE_G(observer_stack));
+        KAGE_G(observer_stack) = NULL;
+        KAGE_G(observer_stack_size) = 0;
+    }
+    KAGE_G(observer_depth) = 0;
+}
+
+static int kage_observer_compare_wall(Bucket *a, Bucket *b) {
+    kage_observer_stats *x = Z_PTR(a->val);
+    kage_observer_stats *y = Z_PTR(b->val);
+    return x->wall_ns < y->wall_ns ? 1 : (x->wall_ns > y->wall_ns ? -1 : 0);
+}
+
+// Totals of finished requests plus the current one, hottest first.
+// The caller destroys the table.
+static void kage_observer_snapshot(HashTable *snapshot) {
+    kage_observer_stats *stats;
+
+    zend_hash_init(snapshot, 32, NULL, kage_observer_stats_dtor, 0);
+
+    KAGE_OBSERVER_LOCK();
+    ZEND_HASH_FOREACH_PTR(&kage_observer_totals, stats) {
+        kage_observer_merge(snapshot, stats, false);
+    } ZEND_HASH_FOREACH_END();
+    KAGE_OBSERVER_UNLOCK();
+
+    if (KAGE_G(observer_stats)) {
+        ZEND_HASH_FOREACH_PTR(KAGE_G(observer_stats), stats) {
+            for (; stats; stats = stats->previous) {
+                if (stats->calls > 0) {
+                    kage_observer_merge(snapshot, stats, false);
+                }
+            }
+        } ZEND_HASH_FOREACH_END();
+    }
+
+    zend_hash_sort(snapshot, kage_observer_compare_wall, 0);
+}
+
+PHPAPI void kage_observer_info(void) {
+    php_info_print_table_start();
+    php_info_print_table_header(2, "Function profiler", kage_observer_registered ? "enabled" : "disabled");
+
+    if (kage_observer_registered) {
+        HashTable snapshot;
+        kage_observer_stats *stats;
+        uint32_t shown = 0;
+        char counts[128];
+
+        kage_observer_snapshot(&snapshot);
+        snprintf(counts, sizeof(counts), "%u", zend_hash_num_elements(&snapshot));
+        php_info_print_table_row(2, "Profiled functions", counts);
+
+        ZEND_HASH_FOREACH_PTR(&snapshot, stats) {
+            if (shown++ == 10) {
+                break;
+            }
+            snprintf(counts, sizeof(counts), "%llu calls, %.3f ms wall, %.3f ms CPU",
+                     (unsigned long long)stats->calls, stats->wall_ns / 1e6, stats->cpu_ns / 1e6);
+            php_info_print_table_row(2, ZSTR_VAL(stats->function), counts);
+        } ZEND_HASH_FOREACH_END();
+
+        zend_hash_destroy(&snapshot);
+    }
+
+    php_info_print_table_end();
+}
+
+// PHP Function: kage_observer_stats(bool $reset = false): array|false
+// Returns [['function', 'file', 'calls', 'wall_ns', 'cpu_ns'], ...] sorted by
+// wall time; false when kage.observer is off. $reset clears the totals.
+PHP_FUNCTION(kage_observer_stats) {
+    bool reset = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "|b", &reset) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    if (!kage_observer_registered) {
+        RETURN_FALSE;
+    }
+
+    HashTable snapshot;
+    kage_observer_stats *stats;
+
+    kage_observer_snapshot(&snapshot);
+    array_init_size(return_value, zend_hash_num_elements(&snapshot));
+
+    ZEND_HASH_FOREACH_PTR(&snapshot, stats) {
+        zval entry;
+        array_init(&entry);
+        add_assoc_str(&entry, "function", zend_string_copy(stats->function));
+        add_assoc_str(&entry, "file", zend_string_copy(stats->file));
+        add_assoc_long(&entry, "calls", (zend_long)stats->calls);
+        add_assoc_long(&entry, "wall_ns", (zend_long)stats->wall_ns);
+        add_assoc_long(&entry, "cpu_ns", (zend_long)stats->cpu_ns);
+        add_next_index_zval(return_value, &entry);
+    } ZEND_HASH_FOREACH_END();
+
+    zend_hash_destroy(&snapshot);
+
+    if (reset) {
+        KAGE_OBSERVER_LOCK();
+        zend_hash_clean(&kage_observer_totals);
+        KAGE_OBSERVER_UNLOCK();
+
+        // Calls still on the stack keep their frames; their counters restart
+        if (KAGE_G(observer_stats)) {
+            ZEND_HASH_FOREACH_PTR(KAGE_G(observer_stats), stats) {
+                for (; stats; stats = stats->previous) {
+                    stats->calls = stats->wall_ns = stats->cpu_ns = 0;
+                }
+            } ZEND_HASH_FOREACH_END();
+        }
+    }
+}
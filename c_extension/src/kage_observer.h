@@ -0,0 +1,48 @@
+/**
+ * Function Profiler for Kage Extension
+ *
+ * Counts calls and inclusive wall/CPU time of protected functions through
+ * the Zend observer API. Protected means user code whose file name contains
+ * kage.observer_filter; the default matches eval()'d code, which is where
+ * decrypted Kage sources run. An empty filter observes every user function.
+ *
+ * Counters are per request (per thread under ZTS) and are merged into
+ * process-wide totals at RSHUTDOWN. With kage.observer=0 no observer is
+ * registered and the engine runs unchanged.
+ */
+
+#ifndef PHP_KAGE_OBSERVER_H
+#define PHP_KAGE_OBSERVER_H
+
+#include "kage_context.h"
+
+// Totals of one function
+typedef struct kage_observer_stats {
+    zend_string *file;
+    zend_string *function;
+    zend_string *function_name;   // op_array's, to recognise it again
+    uint32_t line_start;
+    struct kage_observer_stats *previous;  // earlier op_array at the same address
+    uint64_t calls;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+} kage_observer_stats;
+
+// Call in progress
+typedef struct kage_observer_frame {
+    kage_observer_stats *stats;
+    uint64_t wall_start;
+    uint64_t cpu_start;
+} kage_observer_frame;
+
+// Lifecycle
+PHPAPI void kage_observer_startup(void);
+PHPAPI void kage_observer_shutdown(void);
+PHPAPI void kage_observer_activate(void);
+PHPAPI void kage_observer_deactivate(void);
+PHPAPI void kage_observer_info(void);
+
+// PHP functions
+PHP_FUNCTION(kage_observer_stats);
+
+#endif /* PHP_KAGE_OBSERVER_H */
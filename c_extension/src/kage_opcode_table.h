@@ -0,0 +1,663 @@
+/**
+ * Zend opcode names, perfect-hashed
+ *
+ * Generated by tools/gen_opcode_table.php from zend_vm_opcodes.h. Do not edit.
+ */
+
+#ifndef KAGE_OPCODE_TABLE_H
+#define KAGE_OPCODE_TABLE_H
+
+#include <stdint.h>
+
+#define KAGE_OPCODE_TABLE_BUCKETS 64
+#define KAGE_OPCODE_TABLE_SLOTS 256
+
+typedef struct {
+    const char *name;
+    uint8_t length;
+    uint8_t opcode;
+} kage_opcode_table_entry;
+
+static const uint16_t kage_opcode_table_seeds[KAGE_OPCODE_TABLE_BUCKETS] = {
+    1, 1, 1, 19, 2, 6, 4, 3, 3, 7, 3, 6,
+    1, 1, 3, 13, 2, 2, 8, 1, 3, 7, 0, 2,
+    17, 7, 8, 7, 1, 3, 2, 9, 1, 8, 10, 48,
+    20, 21, 13, 14, 1, 33, 9, 6, 14, 2, 14, 1,
+    2, 55, 4, 60, 3, 38, 11, 2, 5, 23, 3, 25,
+    0, 15, 2, 1,
+};
+
+static const kage_opcode_table_entry kage_opcode_table[KAGE_OPCODE_TABLE_SLOTS] = {
+#ifdef ZEND_FETCH_CLASS_CONSTANT
+    [0] = {"FETCH_CLASS_CONSTANT", 20, ZEND_FETCH_CLASS_CONSTANT},
+#endif
+#ifdef ZEND_JMPZ
+    [1] = {"JMPZ", 4, ZEND_JMPZ},
+#endif
+#ifdef ZEND_POST_DEC
+    [2] = {"POST_DEC", 8, ZEND_POST_DEC},
+#endif
+#ifdef ZEND_RECV
+    [3] = {"RECV", 4, ZEND_RECV},
+#endif
+#ifdef ZEND_DECLARE_FUNCTION
+    [4] = {"DECLARE_FUNCTION", 16, ZEND_DECLARE_FUNCTION},
+#endif
+#ifdef ZEND_PRE_DEC_STATIC_PROP
+    [5] = {"PRE_DEC_STATIC_PROP", 19, ZEND_PRE_DEC_STATIC_PROP},
+#endif
+#ifdef ZEND_GENERATOR_RETURN
+    [6] = {"GENERATOR_RETURN", 16, ZEND_GENERATOR_RETURN},
+#endif
+#ifdef ZEND_DIV
+    [7] = {"DIV", 3, ZEND_DIV},
+#endif
+#ifdef ZEND_VERIFY_RETURN_TYPE
+    [8] = {"VERIFY_RETURN_TYPE", 18, ZEND_VERIFY_RETURN_TYPE},
+#endif
+#ifdef ZEND_POST_INC_STATIC_PROP
+    [9] = {"POST_INC_STATIC_PROP", 20, ZEND_POST_INC_STATIC_PROP},
+#endif
+#ifdef ZEND_RECV_INIT
+    [10] = {"RECV_INIT", 9, ZEND_RECV_INIT},
+#endif
+#ifdef ZEND_FRAMELESS_ICALL_2
+    [11] = {"FRAMELESS_ICALL_2", 17, ZEND_FRAMELESS_ICALL_2},
+#endif
+#ifdef ZEND_MAKE_REF
+    [12] = {"MAKE_REF", 8, ZEND_MAKE_REF},
+#endif
+#ifdef ZEND_PRE_DEC_OBJ
+    [13] = {"PRE_DEC_OBJ", 11, ZEND_PRE_DEC_OBJ},
+#endif
+#ifdef ZEND_SEND_VAL
+    [14] = {"SEND_VAL", 8, ZEND_SEND_VAL},
+#endif
+#ifdef ZEND_JMP
+    [15] = {"JMP", 3, ZEND_JMP},
+#endif
+#ifdef ZEND_EXT_FCALL_END
+    [16] = {"EXT_FCALL_END", 13, ZEND_EXT_FCALL_END},
+#endif
+#ifdef ZEND_SEND_VAR_NO_REF
+    [17] = {"SEND_VAR_NO_REF", 15, ZEND_SEND_VAR_NO_REF},
+#endif
+#ifdef ZEND_ASSERT_CHECK
+    [18] = {"ASSERT_CHECK", 12, ZEND_ASSERT_CHECK},
+#endif
+#ifdef ZEND_IS_IDENTICAL
+    [19] = {"IS_IDENTICAL", 12, ZEND_IS_IDENTICAL},
+#endif
+#ifdef ZEND_UNSET_DIM
+    [20] = {"UNSET_DIM", 9, ZEND_UNSET_DIM},
+#endif
+#ifdef ZEND_ISSET_ISEMPTY_DIM_OBJ
+    [21] = {"ISSET_ISEMPTY_DIM_OBJ", 21, ZEND_ISSET_ISEMPTY_DIM_OBJ},
+#endif
+#ifdef ZEND_SWITCH_STRING
+    [22] = {"SWITCH_STRING", 13, ZEND_SWITCH_STRING},
+#endif
+#ifdef ZEND_INIT_NS_FCALL_BY_NAME
+    [23] = {"INIT_NS_FCALL_BY_NAME", 21, ZEND_INIT_NS_FCALL_BY_NAME},
+#endif
+#ifdef ZEND_POST_INC_OBJ
+    [24] = {"POST_INC_OBJ", 12, ZEND_POST_INC_OBJ},
+#endif
+#ifdef ZEND_FETCH_IS
+    [25] = {"FETCH_IS", 8, ZEND_FETCH_IS},
+#endif
+#ifdef ZEND_ASSIGN_DIM
+    [26] = {"ASSIGN_DIM", 10, ZEND_ASSIGN_DIM},
+#endif
+#ifdef ZEND_NEW
+    [28] = {"NEW", 3, ZEND_NEW},
+#endif
+#ifdef ZEND_JMP_NULL
+    [29] = {"JMP_NULL", 8, ZEND_JMP_NULL},
+#endif
+#ifdef ZEND_FETCH_OBJ_RW
+    [31] = {"FETCH_OBJ_RW", 12, ZEND_FETCH_OBJ_RW},
+#endif
+#ifdef ZEND_INIT_STATIC_METHOD_CALL
+    [32] = {"INIT_STATIC_METHOD_CALL", 23, ZEND_INIT_STATIC_METHOD_CALL},
+#endif
+#ifdef ZEND_DO_ICALL
+    [33] = {"DO_ICALL", 8, ZEND_DO_ICALL},
+#endif
+#ifdef ZEND_FETCH_OBJ_IS
+    [34] = {"FETCH_OBJ_IS", 12, ZEND_FETCH_OBJ_IS},
+#endif
+#ifdef ZEND_FETCH_CLASS
+    [35] = {"FETCH_CLASS", 11, ZEND_FETCH_CLASS},
+#endif
+#ifdef ZEND_DISCARD_EXCEPTION
+    [36] = {"DISCARD_EXCEPTION", 17, ZEND_DISCARD_EXCEPTION},
+#endif
+#ifdef ZEND_OP_DATA
+    [37] = {"OP_DATA", 7, ZEND_OP_DATA},
+#endif
+#ifdef ZEND_FE_RESET_RW
+    [38] = {"FE_RESET_RW", 11, ZEND_FE_RESET_RW},
+#endif
+#ifdef ZEND_FUNC_NUM_ARGS
+    [39] = {"FUNC_NUM_ARGS", 13, ZEND_FUNC_NUM_ARGS},
+#endif
+#ifdef ZEND_BIND_STATIC
+    [40] = {"BIND_STATIC", 11, ZEND_BIND_STATIC},
+#endif
+#ifdef ZEND_ARRAY_KEY_EXISTS
+    [41] = {"ARRAY_KEY_EXISTS", 16, ZEND_ARRAY_KEY_EXISTS},
+#endif
+#ifdef ZEND_GET_TYPE
+    [42] = {"GET_TYPE", 8, ZEND_GET_TYPE},
+#endif
+#ifdef ZEND_FETCH_DIM_UNSET
+    [43] = {"FETCH_DIM_UNSET", 15, ZEND_FETCH_DIM_UNSET},
+#endif
+#ifdef ZEND_ISSET_ISEMPTY_CV
+    [45] = {"ISSET_ISEMPTY_CV", 16, ZEND_ISSET_ISEMPTY_CV},
+#endif
+#ifdef ZEND_ECHO
+    [46] = {"ECHO", 4, ZEND_ECHO},
+#endif
+#ifdef ZEND_POST_DEC_OBJ
+    [47] = {"POST_DEC_OBJ", 12, ZEND_POST_DEC_OBJ},
+#endif
+#ifdef ZEND_FRAMELESS_ICALL_0
+    [49] = {"FRAMELESS_ICALL_0", 17, ZEND_FRAMELESS_ICALL_0},
+#endif
+#ifdef ZEND_JMPNZ
+    [50] = {"JMPNZ", 5, ZEND_JMPNZ},
+#endif
+#ifdef ZEND_MOD
+    [51] = {"MOD", 3, ZEND_MOD},
+#endif
+#ifdef ZEND_FETCH_R
+    [54] = {"FETCH_R", 7, ZEND_FETCH_R},
+#endif
+#ifdef ZEND_COPY_TMP
+    [55] = {"COPY_TMP", 8, ZEND_COPY_TMP},
+#endif
+#ifdef ZEND_RECV_VARIADIC
+    [56] = {"RECV_VARIADIC", 13, ZEND_RECV_VARIADIC},
+#endif
+#ifdef ZEND_BW_AND
+    [57] = {"BW_AND", 6, ZEND_BW_AND},
+#endif
+#ifdef ZEND_FETCH_DIM_W
+    [58] = {"FETCH_DIM_W", 11, ZEND_FETCH_DIM_W},
+#endif
+#ifdef ZEND_ASSIGN_OBJ_OP
+    [59] = {"ASSIGN_OBJ_OP", 13, ZEND_ASSIGN_OBJ_OP},
+#endif
+#ifdef ZEND_INIT_DYNAMIC_CALL
+    [62] = {"INIT_DYNAMIC_CALL", 17, ZEND_INIT_DYNAMIC_CALL},
+#endif
+#ifdef ZEND_CHECK_UNDEF_ARGS
+    [63] = {"CHECK_UNDEF_ARGS", 16, ZEND_CHECK_UNDEF_ARGS},
+#endif
+#ifdef ZEND_FETCH_UNSET
+    [64] = {"FETCH_UNSET", 11, ZEND_FETCH_UNSET},
+#endif
+#ifdef ZEND_IN_ARRAY
+    [65] = {"IN_ARRAY", 8, ZEND_IN_ARRAY},
+#endif
+#ifdef ZEND_DECLARE_ATTRIBUTED_CONST
+    [66] = {"DECLARE_ATTRIBUTED_CONST", 24, ZEND_DECLARE_ATTRIBUTED_CONST},
+#endif
+#ifdef ZEND_IS_EQUAL
+    [67] = {"IS_EQUAL", 8, ZEND_IS_EQUAL},
+#endif
+#ifdef ZEND_INIT_PARENT_PROPERTY_HOOK_CALL
+    [68] = {"INIT_PARENT_PROPERTY_HOOK_CALL", 30, ZEND_INIT_PARENT_PROPERTY_HOOK_CALL},
+#endif
+#ifdef ZEND_TYPE_CHECK
+    [69] = {"TYPE_CHECK", 10, ZEND_TYPE_CHECK},
+#endif
+#ifdef ZEND_FETCH_STATIC_PROP_W
+    [70] = {"FETCH_STATIC_PROP_W", 19, ZEND_FETCH_STATIC_PROP_W},
+#endif
+#ifdef ZEND_INIT_USER_CALL
+    [73] = {"INIT_USER_CALL", 14, ZEND_INIT_USER_CALL},
+#endif
+#ifdef ZEND_JMPNZ_EX
+    [74] = {"JMPNZ_EX", 8, ZEND_JMPNZ_EX},
+#endif
+#ifdef ZEND_SEND_ARRAY
+    [75] = {"SEND_ARRAY", 10, ZEND_SEND_ARRAY},
+#endif
+#ifdef ZEND_CLONE
+    [76] = {"CLONE", 5, ZEND_CLONE},
+#endif
+#ifdef ZEND_JMP_SET
+    [78] = {"JMP_SET", 7, ZEND_JMP_SET},
+#endif
+#ifdef ZEND_GET_CALLED_CLASS
+    [79] = {"GET_CALLED_CLASS", 16, ZEND_GET_CALLED_CLASS},
+#endif
+#ifdef ZEND_FETCH_DIM_FUNC_ARG
+    [80] = {"FETCH_DIM_FUNC_ARG", 18, ZEND_FETCH_DIM_FUNC_ARG},
+#endif
+#ifdef ZEND_BW_OR
+    [82] = {"BW_OR", 5, ZEND_BW_OR},
+#endif
+#ifdef ZEND_FE_FETCH_RW
+    [83] = {"FE_FETCH_RW", 11, ZEND_FE_FETCH_RW},
+#endif
+#ifdef ZEND_FETCH_FUNC_ARG
+    [84] = {"FETCH_FUNC_ARG", 14, ZEND_FETCH_FUNC_ARG},
+#endif
+#ifdef ZEND_ASSIGN_OBJ
+    [85] = {"ASSIGN_OBJ", 10, ZEND_ASSIGN_OBJ},
+#endif
+#ifdef ZEND_GENERATOR_CREATE
+    [86] = {"GENERATOR_CREATE", 16, ZEND_GENERATOR_CREATE},
+#endif
+#ifdef ZEND_MATCH_ERROR
+    [87] = {"MATCH_ERROR", 11, ZEND_MATCH_ERROR},
+#endif
+#ifdef ZEND_UNSET_VAR
+    [88] = {"UNSET_VAR", 9, ZEND_UNSET_VAR},
+#endif
+#ifdef ZEND_CHECK_FUNC_ARG
+    [89] = {"CHECK_FUNC_ARG", 14, ZEND_CHECK_FUNC_ARG},
+#endif
+#ifdef ZEND_FETCH_LIST_R
+    [91] = {"FETCH_LIST_R", 12, ZEND_FETCH_LIST_R},
+#endif
+#ifdef ZEND_FETCH_STATIC_PROP_IS
+    [92] = {"FETCH_STATIC_PROP_IS", 20, ZEND_FETCH_STATIC_PROP_IS},
+#endif
+#ifdef ZEND_USER_OPCODE
+    [94] = {"USER_OPCODE", 11, ZEND_USER_OPCODE},
+#endif
+#ifdef ZEND_PRE_INC
+    [95] = {"PRE_INC", 7, ZEND_PRE_INC},
+#endif
+#ifdef ZEND_ASSIGN_DIM_OP
+    [96] = {"ASSIGN_DIM_OP", 13, ZEND_ASSIGN_DIM_OP},
+#endif
+#ifdef ZEND_DO_FCALL_BY_NAME
+    [97] = {"DO_FCALL_BY_NAME", 16, ZEND_DO_FCALL_BY_NAME},
+#endif
+#ifdef ZEND_SEND_VAR_NO_REF_EX
+    [98] = {"SEND_VAR_NO_REF_EX", 18, ZEND_SEND_VAR_NO_REF_EX},
+#endif
+#ifdef ZEND_SEND_VAR
+    [100] = {"SEND_VAR", 8, ZEND_SEND_VAR},
+#endif
+#ifdef ZEND_ASSIGN
+    [101] = {"ASSIGN", 6, ZEND_ASSIGN},
+#endif
+#ifdef ZEND_INIT_ARRAY
+    [102] = {"INIT_ARRAY", 10, ZEND_INIT_ARRAY},
+#endif
+#ifdef ZEND_MATCH
+    [103] = {"MATCH", 5, ZEND_MATCH},
+#endif
+#ifdef ZEND_DEFINED
+    [104] = {"DEFINED", 7, ZEND_DEFINED},
+#endif
+#ifdef ZEND_SEPARATE
+    [105] = {"SEPARATE", 8, ZEND_SEPARATE},
+#endif
+#ifdef ZEND_CONCAT
+    [106] = {"CONCAT", 6, ZEND_CONCAT},
+#endif
+#ifdef ZEND_PRE_INC_STATIC_PROP
+    [107] = {"PRE_INC_STATIC_PROP", 19, ZEND_PRE_INC_STATIC_PROP},
+#endif
+#ifdef ZEND_FETCH_STATIC_PROP_R
+    [108] = {"FETCH_STATIC_PROP_R", 19, ZEND_FETCH_STATIC_PROP_R},
+#endif
+#ifdef ZEND_FRAMELESS_ICALL_1
+    [109] = {"FRAMELESS_ICALL_1", 17, ZEND_FRAMELESS_ICALL_1},
+#endif
+#ifdef ZEND_FAST_CALL
+    [110] = {"FAST_CALL", 9, ZEND_FAST_CALL},
+#endif
+#ifdef ZEND_UNSET_CV
+    [111] = {"UNSET_CV", 8, ZEND_UNSET_CV},
+#endif
+#ifdef ZEND_END_SILENCE
+    [112] = {"END_SILENCE", 11, ZEND_END_SILENCE},
+#endif
+#ifdef ZEND_INCLUDE_OR_EVAL
+    [114] = {"INCLUDE_OR_EVAL", 15, ZEND_INCLUDE_OR_EVAL},
+#endif
+#ifdef ZEND_BIND_GLOBAL
+    [115] = {"BIND_GLOBAL", 11, ZEND_BIND_GLOBAL},
+#endif
+#ifdef ZEND_JMPZNZ
+    [116] = {"JMPZNZ", 6, ZEND_JMPZNZ},
+#endif
+#ifdef ZEND_ASSIGN_OP
+    [117] = {"ASSIGN_OP", 9, ZEND_ASSIGN_OP},
+#endif
+#ifdef ZEND_CATCH
+    [118] = {"CATCH", 5, ZEND_CATCH},
+#endif
+#ifdef ZEND_ROPE_ADD
+    [119] = {"ROPE_ADD", 8, ZEND_ROPE_ADD},
+#endif
+#ifdef ZEND_DECLARE_CLASS
+    [120] = {"DECLARE_CLASS", 13, ZEND_DECLARE_CLASS},
+#endif
+#ifdef ZEND_ADD_ARRAY_ELEMENT
+    [121] = {"ADD_ARRAY_ELEMENT", 17, ZEND_ADD_ARRAY_ELEMENT},
+#endif
+#ifdef ZEND_FETCH_CLASS_NAME
+    [122] = {"FETCH_CLASS_NAME", 16, ZEND_FETCH_CLASS_NAME},
+#endif
+#ifdef ZEND_FUNC_GET_ARGS
+    [123] = {"FUNC_GET_ARGS", 13, ZEND_FUNC_GET_ARGS},
+#endif
+#ifdef ZEND_TICKS
+    [124] = {"TICKS", 5, ZEND_TICKS},
+#endif
+#ifdef ZEND_JMP_FRAMELESS
+    [125] = {"JMP_FRAMELESS", 13, ZEND_JMP_FRAMELESS},
+#endif
+#ifdef ZEND_FETCH_OBJ_UNSET
+    [126] = {"FETCH_OBJ_UNSET", 15, ZEND_FETCH_OBJ_UNSET},
+#endif
+#ifdef ZEND_BEGIN_SILENCE
+    [127] = {"BEGIN_SILENCE", 13, ZEND_BEGIN_SILENCE},
+#endif
+#ifdef ZEND_IS_NOT_EQUAL
+    [128] = {"IS_NOT_EQUAL", 12, ZEND_IS_NOT_EQUAL},
+#endif
+#ifdef ZEND_ASSIGN_OBJ_REF
+    [129] = {"ASSIGN_OBJ_REF", 14, ZEND_ASSIGN_OBJ_REF},
+#endif
+#ifdef ZEND_INIT_METHOD_CALL
+    [130] = {"INIT_METHOD_CALL", 16, ZEND_INIT_METHOD_CALL},
+#endif
+#ifdef ZEND_SEND_UNPACK
+    [132] = {"SEND_UNPACK", 11, ZEND_SEND_UNPACK},
+#endif
+#ifdef ZEND_PRE_INC_OBJ
+    [133] = {"PRE_INC_OBJ", 11, ZEND_PRE_INC_OBJ},
+#endif
+#ifdef ZEND_DECLARE_CLASS_DELAYED
+    [134] = {"DECLARE_CLASS_DELAYED", 21, ZEND_DECLARE_CLASS_DELAYED},
+#endif
+#ifdef ZEND_IS_NOT_IDENTICAL
+    [136] = {"IS_NOT_IDENTICAL", 16, ZEND_IS_NOT_IDENTICAL},
+#endif
+#ifdef ZEND_UNSET_OBJ
+    [137] = {"UNSET_OBJ", 9, ZEND_UNSET_OBJ},
+#endif
+#ifdef ZEND_FETCH_THIS
+    [138] = {"FETCH_THIS", 10, ZEND_FETCH_THIS},
+#endif
+#ifdef ZEND_ASSIGN_STATIC_PROP_OP
+    [139] = {"ASSIGN_STATIC_PROP_OP", 21, ZEND_ASSIGN_STATIC_PROP_OP},
+#endif
+#ifdef ZEND_ISSET_ISEMPTY_THIS
+    [140] = {"ISSET_ISEMPTY_THIS", 18, ZEND_ISSET_ISEMPTY_THIS},
+#endif
+#ifdef ZEND_FETCH_LIST_W
+    [141] = {"FETCH_LIST_W", 12, ZEND_FETCH_LIST_W},
+#endif
+#ifdef ZEND_SWITCH_LONG
+    [144] = {"SWITCH_LONG", 11, ZEND_SWITCH_LONG},
+#endif
+#ifdef ZEND_ROPE_END
+    [146] = {"ROPE_END", 8, ZEND_ROPE_END},
+#endif
+#ifdef ZEND_SL
+    [147] = {"SL", 2, ZEND_SL},
+#endif
+#ifdef ZEND_FETCH_DIM_R
+    [148] = {"FETCH_DIM_R", 11, ZEND_FETCH_DIM_R},
+#endif
+#ifdef ZEND_BW_XOR
+    [149] = {"BW_XOR", 6, ZEND_BW_XOR},
+#endif
+#ifdef ZEND_DECLARE_ANON_CLASS
+    [150] = {"DECLARE_ANON_CLASS", 18, ZEND_DECLARE_ANON_CLASS},
+#endif
+#ifdef ZEND_INSTANCEOF
+    [151] = {"INSTANCEOF", 10, ZEND_INSTANCEOF},
+#endif
+#ifdef ZEND_FAST_RET
+    [153] = {"FAST_RET", 8, ZEND_FAST_RET},
+#endif
+#ifdef ZEND_RETURN
+    [154] = {"RETURN", 6, ZEND_RETURN},
+#endif
+#ifdef ZEND_DECLARE_CONST
+    [155] = {"DECLARE_CONST", 13, ZEND_DECLARE_CONST},
+#endif
+#ifdef ZEND_SEND_VAR_EX
+    [156] = {"SEND_VAR_EX", 11, ZEND_SEND_VAR_EX},
+#endif
+#ifdef ZEND_VERIFY_NEVER_TYPE
+    [157] = {"VERIFY_NEVER_TYPE", 17, ZEND_VERIFY_NEVER_TYPE},
+#endif
+#ifdef ZEND_EXT_STMT
+    [158] = {"EXT_STMT", 8, ZEND_EXT_STMT},
+#endif
+#ifdef ZEND_INIT_FCALL
+    [159] = {"INIT_FCALL", 10, ZEND_INIT_FCALL},
+#endif
+#ifdef ZEND_ADD_ARRAY_UNPACK
+    [160] = {"ADD_ARRAY_UNPACK", 16, ZEND_ADD_ARRAY_UNPACK},
+#endif
+#ifdef ZEND_FETCH_CONSTANT
+    [161] = {"FETCH_CONSTANT", 14, ZEND_FETCH_CONSTANT},
+#endif
+#ifdef ZEND_CHECK_VAR
+    [162] = {"CHECK_VAR", 9, ZEND_CHECK_VAR},
+#endif
+#ifdef ZEND_IS_SMALLER_OR_EQUAL
+    [163] = {"IS_SMALLER_OR_EQUAL", 19, ZEND_IS_SMALLER_OR_EQUAL},
+#endif
+#ifdef ZEND_ASSIGN_STATIC_PROP
+    [164] = {"ASSIGN_STATIC_PROP", 18, ZEND_ASSIGN_STATIC_PROP},
+#endif
+#ifdef ZEND_STRLEN
+    [165] = {"STRLEN", 6, ZEND_STRLEN},
+#endif
+#ifdef ZEND_BOOL
+    [166] = {"BOOL", 4, ZEND_BOOL},
+#endif
+#ifdef ZEND_FAST_CONCAT
+    [167] = {"FAST_CONCAT", 11, ZEND_FAST_CONCAT},
+#endif
+#ifdef ZEND_YIELD_FROM
+    [170] = {"YIELD_FROM", 10, ZEND_YIELD_FROM},
+#endif
+#ifdef ZEND_BIND_LEXICAL
+    [172] = {"BIND_LEXICAL", 12, ZEND_BIND_LEXICAL},
+#endif
+#ifdef ZEND_PRE_DEC
+    [174] = {"PRE_DEC", 7, ZEND_PRE_DEC},
+#endif
+#ifdef ZEND_SEND_USER
+    [175] = {"SEND_USER", 9, ZEND_SEND_USER},
+#endif
+#ifdef ZEND_FE_FREE
+    [176] = {"FE_FREE", 7, ZEND_FE_FREE},
+#endif
+#ifdef ZEND_BW_NOT
+    [177] = {"BW_NOT", 6, ZEND_BW_NOT},
+#endif
+#ifdef ZEND_FETCH_RW
+    [178] = {"FETCH_RW", 8, ZEND_FETCH_RW},
+#endif
+#ifdef ZEND_YIELD
+    [179] = {"YIELD", 5, ZEND_YIELD},
+#endif
+#ifdef ZEND_FETCH_W
+    [180] = {"FETCH_W", 7, ZEND_FETCH_W},
+#endif
+#ifdef ZEND_ADD
+    [181] = {"ADD", 3, ZEND_ADD},
+#endif
+#ifdef ZEND_SEND_FUNC_ARG
+    [182] = {"SEND_FUNC_ARG", 13, ZEND_SEND_FUNC_ARG},
+#endif
+#ifdef ZEND_FE_FETCH_R
+    [183] = {"FE_FETCH_R", 10, ZEND_FE_FETCH_R},
+#endif
+#ifdef ZEND_SPACESHIP
+    [184] = {"SPACESHIP", 9, ZEND_SPACESHIP},
+#endif
+#ifdef ZEND_MUL
+    [185] = {"MUL", 3, ZEND_MUL},
+#endif
+#ifdef ZEND_SEND_VAL_EX
+    [187] = {"SEND_VAL_EX", 11, ZEND_SEND_VAL_EX},
+#endif
+#ifdef ZEND_POST_INC
+    [190] = {"POST_INC", 8, ZEND_POST_INC},
+#endif
+#ifdef ZEND_POW
+    [191] = {"POW", 3, ZEND_POW},
+#endif
+#ifdef ZEND_QM_ASSIGN
+    [192] = {"QM_ASSIGN", 9, ZEND_QM_ASSIGN},
+#endif
+#ifdef ZEND_FETCH_STATIC_PROP_UNSET
+    [193] = {"FETCH_STATIC_PROP_UNSET", 23, ZEND_FETCH_STATIC_PROP_UNSET},
+#endif
+#ifdef ZEND_COALESCE
+    [194] = {"COALESCE", 8, ZEND_COALESCE},
+#endif
+#ifdef ZEND_FETCH_STATIC_PROP_RW
+    [195] = {"FETCH_STATIC_PROP_RW", 20, ZEND_FETCH_STATIC_PROP_RW},
+#endif
+#ifdef ZEND_FETCH_STATIC_PROP_FUNC_ARG
+    [196] = {"FETCH_STATIC_PROP_FUNC_ARG", 26, ZEND_FETCH_STATIC_PROP_FUNC_ARG},
+#endif
+#ifdef ZEND_ASSIGN_STATIC_PROP_REF
+    [198] = {"ASSIGN_STATIC_PROP_REF", 22, ZEND_ASSIGN_STATIC_PROP_REF},
+#endif
+#ifdef ZEND_HANDLE_EXCEPTION
+    [199] = {"HANDLE_EXCEPTION", 16, ZEND_HANDLE_EXCEPTION},
+#endif
+#ifdef ZEND_CALL_TRAMPOLINE
+    [200] = {"CALL_TRAMPOLINE", 15, ZEND_CALL_TRAMPOLINE},
+#endif
+#ifdef ZEND_IS_SMALLER
+    [201] = {"IS_SMALLER", 10, ZEND_IS_SMALLER},
+#endif
+#ifdef ZEND_FE_RESET_R
+    [203] = {"FE_RESET_R", 10, ZEND_FE_RESET_R},
+#endif
+#ifdef ZEND_FETCH_OBJ_W
+    [204] = {"FETCH_OBJ_W", 11, ZEND_FETCH_OBJ_W},
+#endif
+#ifdef ZEND_CAST
+    [205] = {"CAST", 4, ZEND_CAST},
+#endif
+#ifdef ZEND_FETCH_OBJ_R
+    [206] = {"FETCH_OBJ_R", 11, ZEND_FETCH_OBJ_R},
+#endif
+#ifdef ZEND_SEND_REF
+    [208] = {"SEND_REF", 8, ZEND_SEND_REF},
+#endif
+#ifdef ZEND_DECLARE_LAMBDA_FUNCTION
+    [209] = {"DECLARE_LAMBDA_FUNCTION", 23, ZEND_DECLARE_LAMBDA_FUNCTION},
+#endif
+#ifdef ZEND_ISSET_ISEMPTY_VAR
+    [211] = {"ISSET_ISEMPTY_VAR", 17, ZEND_ISSET_ISEMPTY_VAR},
+#endif
+#ifdef ZEND_BOOL_XOR
+    [212] = {"BOOL_XOR", 8, ZEND_BOOL_XOR},
+#endif
+#ifdef ZEND_COUNT
+    [213] = {"COUNT", 5, ZEND_COUNT},
+#endif
+#ifdef ZEND_ISSET_ISEMPTY_PROP_OBJ
+    [214] = {"ISSET_ISEMPTY_PROP_OBJ", 22, ZEND_ISSET_ISEMPTY_PROP_OBJ},
+#endif
+#ifdef ZEND_FETCH_GLOBALS
+    [215] = {"FETCH_GLOBALS", 13, ZEND_FETCH_GLOBALS},
+#endif
+#ifdef ZEND_GET_CLASS
+    [218] = {"GET_CLASS", 9, ZEND_GET_CLASS},
+#endif
+#ifdef ZEND_CALLABLE_CONVERT
+    [220] = {"CALLABLE_CONVERT", 16, ZEND_CALLABLE_CONVERT},
+#endif
+#ifdef ZEND_EXT_NOP
+    [221] = {"EXT_NOP", 7, ZEND_EXT_NOP},
+#endif
+#ifdef ZEND_CASE_STRICT
+    [222] = {"CASE_STRICT", 11, ZEND_CASE_STRICT},
+#endif
+#ifdef ZEND_BOOL_NOT
+    [223] = {"BOOL_NOT", 8, ZEND_BOOL_NOT},
+#endif
+#ifdef ZEND_JMPZ_EX
+    [224] = {"JMPZ_EX", 7, ZEND_JMPZ_EX},
+#endif
+#ifdef ZEND_FRAMELESS_ICALL_3
+    [226] = {"FRAMELESS_ICALL_3", 17, ZEND_FRAMELESS_ICALL_3},
+#endif
+#ifdef ZEND_RETURN_BY_REF
+    [229] = {"RETURN_BY_REF", 13, ZEND_RETURN_BY_REF},
+#endif
+#ifdef ZEND_ROPE_INIT
+    [230] = {"ROPE_INIT", 9, ZEND_ROPE_INIT},
+#endif
+#ifdef ZEND_SUB
+    [231] = {"SUB", 3, ZEND_SUB},
+#endif
+#ifdef ZEND_FETCH_OBJ_FUNC_ARG
+    [232] = {"FETCH_OBJ_FUNC_ARG", 18, ZEND_FETCH_OBJ_FUNC_ARG},
+#endif
+#ifdef ZEND_SR
+    [234] = {"SR", 2, ZEND_SR},
+#endif
+#ifdef ZEND_ASSIGN_REF
+    [236] = {"ASSIGN_REF", 10, ZEND_ASSIGN_REF},
+#endif
+#ifdef ZEND_DO_UCALL
+    [237] = {"DO_UCALL", 8, ZEND_DO_UCALL},
+#endif
+#ifdef ZEND_DO_FCALL
+    [238] = {"DO_FCALL", 8, ZEND_DO_FCALL},
+#endif
+#ifdef ZEND_ISSET_ISEMPTY_STATIC_PROP
+    [239] = {"ISSET_ISEMPTY_STATIC_PROP", 25, ZEND_ISSET_ISEMPTY_STATIC_PROP},
+#endif
+#ifdef ZEND_THROW
+    [240] = {"THROW", 5, ZEND_THROW},
+#endif
+#ifdef ZEND_EXT_FCALL_BEGIN
+    [241] = {"EXT_FCALL_BEGIN", 15, ZEND_EXT_FCALL_BEGIN},
+#endif
+#ifdef ZEND_EXIT
+    [243] = {"EXIT", 4, ZEND_EXIT},
+#endif
+#ifdef ZEND_NOP
+    [244] = {"NOP", 3, ZEND_NOP},
+#endif
+#ifdef ZEND_BIND_INIT_STATIC_OR_JMP
+    [246] = {"BIND_INIT_STATIC_OR_JMP", 23, ZEND_BIND_INIT_STATIC_OR_JMP},
+#endif
+#ifdef ZEND_POST_DEC_STATIC_PROP
+    [247] = {"POST_DEC_STATIC_PROP", 20, ZEND_POST_DEC_STATIC_PROP},
+#endif
+#ifdef ZEND_FREE
+    [248] = {"FREE", 4, ZEND_FREE},
+#endif
+#ifdef ZEND_FETCH_DIM_RW
+    [249] = {"FETCH_DIM_RW", 12, ZEND_FETCH_DIM_RW},
+#endif
+#ifdef ZEND_FETCH_DIM_IS
+    [250] = {"FETCH_DIM_IS", 12, ZEND_FETCH_DIM_IS},
+#endif
+#ifdef ZEND_INIT_FCALL_BY_NAME
+    [253] = {"INIT_FCALL_BY_NAME", 18, ZEND_INIT_FCALL_BY_NAME},
+#endif
+#ifdef ZEND_CASE
+    [254] = {"CASE", 4, ZEND_CASE},
+#endif
+};
+
+#endif /* KAGE_OPCODE_TABLE_H */
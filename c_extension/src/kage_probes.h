@@ -0,0 +1,38 @@
+/**
+ * Static Tracepoints for Kage Extension
+ *
+ * USDT probes in provider "kage", for bpftrace, perf and SystemTap. An
+ * unattached probe is a single nop, so they stay in release builds. They
+ * compile to nothing when sys/sdt.h is missing or KAGE_PROBES is off.
+ *
+ * Probes come in pairs named <operation>__entry and <operation>__return.
+ * Entry probes carry the input size, return probes the output size and
+ * the status (SUCCESS or FAILURE). Sizes are bytes unless noted. See
+ * tools/bpftrace for example scripts; with perf, list them with
+ * "perf list sdt_kage:*" after "perf buildid-cache --add kage.so".
+ *
+ *   operation            entry                 return
+ *   encrypt              input                 output, status
+ *   decrypt              input                 output, status
+ *   base64_decode        input                 output, status
+ *   parse                source                source, status
+ *   vm_execute           instruction count     stack depth, status
+ *   package_serialize    PHP source            output, status
+ *   package_unserialize  -                     PHP source, status
+ */
+
+#ifndef PHP_KAGE_PROBES_H
+#define PHP_KAGE_PROBES_H
+
+#if defined(HAVE_SYS_SDT_H) && defined(KAGE_PROBES)
+# include <sys/sdt.h>
+# define KAGE_PROBE0(name)       DTRACE_PROBE(kage, name)
+# define KAGE_PROBE1(name, a)    DTRACE_PROBE1(kage, name, a)
+# define KAGE_PROBE2(name, a, b) DTRACE_PROBE2(kage, name, a, b)
+#else
+# define KAGE_PROBE0(name)       do { } while (0)
+# define KAGE_PROBE1(name, a)    do { } while (0)
+# define KAGE_PROBE2(name, a, b) do { } while (0)
+#endif
+
+#endif /* PHP_KAGE_PROBES_H */
@@ -0,0 +1,375 @@
+/**
+ * Operation Metrics for Kage Extension
+ *
+ * Lock-free per-process counters and latency histograms
+ */
+
+#include "php.h"
+#include "ext/standard/info.h"
+#include "kage_stats.h"
+#include "kage_memory.h"
+#include "kage_validation.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Histogram layout: values below 16 ns get a bucket each, above that every
+// power of two is split into 16 buckets. Calls of 2^41 ns (about 36 minutes)
+// and longer share the last bucket.
+#define KAGE_STATS_SUB_BITS    4
+#define KAGE_STATS_SUB_BUCKETS (1u << KAGE_STATS_SUB_BITS)
+#define KAGE_STATS_MAX_BIT     40
+#define KAGE_STATS_BUCKETS     ((KAGE_STATS_MAX_BIT - KAGE_STATS_SUB_BITS + 2) * KAGE_STATS_SUB_BUCKETS)
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t failures;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[KAGE_STATS_BUCKETS];
+} kage_stat_counters;
+
+typedef struct {
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+} kage_cache_counters;
+
+// Plain copy of one operation's counters
+typedef struct {
+    uint64_t count;
+    uint64_t failures;
+    uint64_t bytes;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t samples;
+    uint64_t buckets[KAGE_STATS_BUCKETS];
+} kage_stat_snapshot;
+
+static kage_stat_counters kage_stats_ops[KAGE_STAT_COUNT];
+static kage_cache_counters kage_stats_caches[KAGE_CACHE_COUNT];
+
+static const char *kage_stat_names[KAGE_STAT_COUNT] = {
+    "encrypt",
+    "decrypt",
+    "base64_encode",
+    "base64_decode",
+    "parse",
+    "lower",
+    "vm_execute",
+};
+
+static const char *kage_cache_names[KAGE_CACHE_COUNT] = {
+    "program_cache",
+};
+
+static const double kage_stats_percentiles[] = {0.5, 0.9, 0.99, 0.999};
+static const char *kage_stats_percentile_names[] = {"p50_ns", "p90_ns", "p99_ns", "p999_ns"};
+
+static zend_always_inline uint32_t kage_stats_bucket(uint64_t ns) {
+    if (ns < KAGE_STATS_SUB_BUCKETS) {
+        return (uint32_t)ns;
+    }
+
+    uint32_t msb = 63 - (uint32_t)__builtin_clzll(ns);
+    if (msb > KAGE_STATS_MAX_BIT) {
+        return KAGE_STATS_BUCKETS - 1;
+    }
+
+    uint32_t shift = msb - KAGE_STATS_SUB_BITS;
+    return (shift + 1) * KAGE_STATS_SUB_BUCKETS + (uint32_t)((ns >> shift) & (KAGE_STATS_SUB_BUCKETS - 1));
+}
+
+// Highest value that lands in a bucket
+static uint64_t kage_stats_bucket_limit(uint32_t bucket) {
+    if (bucket < KAGE_STATS_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    uint32_t shift = bucket / KAGE_STATS_SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(KAGE_STATS_SUB_BUCKETS + bucket % KAGE_STATS_SUB_BUCKETS) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+/**
+ * Records one finished operation.
+ *
+ * @param id The operation
+ * @param bytes Input size, 0 where it does not apply
+ * @param started kage_stats_now() taken before the operation
+ * @param ok false counts a failure; failures are timed as well
+ */
+PHPAPI void kage_stats_record(kage_stat_id id, size_t bytes, uint64_t started, bool ok) {
+    uint64_t ns = kage_stats_now() - started;
+    kage_stat_counters *op = &kage_stats_ops[id];
+
+    atomic_fetch_add_explicit(&op->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&op->bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&op->total_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&op->buckets[kage_stats_bucket(ns)], 1, memory_order_relaxed);
+    if (!ok) {
+        atomic_fetch_add_explicit(&op->failures, 1, memory_order_relaxed);
+    }
+
+    uint64_t max = atomic_load_explicit(&op->max_ns, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&op->max_ns, &max, ns,
+                                                              memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/**
+ * Counts one cache lookup.
+ *
+ * @param id The cache
+ * @param hit Whether the entry was found
+ */
+PHPAPI void kage_stats_cache(kage_cache_id id, bool hit) {
+    atomic_fetch_add_explicit(hit ? &kage_stats_caches[id].hits : &kage_stats_caches[id].misses,
+                              1, memory_order_relaxed);
+}
+
+/**
+ * Clears all counters. Operations in flight on other threads may still
+ * land in the fresh counters.
+ */
+PHPAPI void kage_stats_reset(void) {
+    for (int i = 0; i < KAGE_STAT_COUNT; i++) {
+        kage_stat_counters *op = &kage_stats_ops[i];
+        atomic_store_explicit(&op->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&op->failures, 0, memory_order_relaxed);
+        atomic_store_explicit(&op->bytes, 0, memory_order_relaxed);
+        atomic_store_explicit(&op->total_ns, 0, memory_order_relaxed);
+        atomic_store_explicit(&op->max_ns, 0, memory_order_relaxed);
+        for (uint32_t b = 0; b < KAGE_STATS_BUCKETS; b++) {
+            atomic_store_explicit(&op->buckets[b], 0, memory_order_relaxed);
+        }
+    }
+    for (int i = 0; i < KAGE_CACHE_COUNT; i++) {
+        atomic_store_explicit(&kage_stats_caches[i].hits, 0, memory_order_relaxed);
+        atomic_store_explicit(&kage_stats_caches[i].misses, 0, memory_order_relaxed);
+    }
+    kage_validation_reset_stats();
+}
+
+// Counters are read one by one, so a snapshot taken under load can be off
+// by the calls in flight; percentiles use the histogram's own total
+static void kage_stats_snapshot(kage_stat_id id, kage_stat_snapshot *snapshot) {
+    kage_stat_counters *op = &kage_stats_ops[id];
+
+    snapshot->count = atomic_load_explicit(&op->count, memory_order_relaxed);
+    snapshot->failures = atomic_load_explicit(&op->failures, memory_order_relaxed);
+    snapshot->bytes = atomic_load_explicit(&op->bytes, memory_order_relaxed);
+    snapshot->total_ns = atomic_load_explicit(&op->total_ns, memory_order_relaxed);
+    snapshot->max_ns = atomic_load_explicit(&op->max_ns, memory_order_relaxed);
+    snapshot->samples = 0;
+    for (uint32_t b = 0; b < KAGE_STATS_BUCKETS; b++) {
+        snapshot->buckets[b] = atomic_load_explicit(&op->buckets[b], memory_order_relaxed);
+        snapshot->samples += snapshot->buckets[b];
+    }
+}
+
+// Upper bound of the bucket holding the given quantile, capped at the maximum
+static uint64_t kage_stats_percentile(const kage_stat_snapshot *snapshot, double quantile) {
+    if (snapshot->samples == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(quantile * (double)snapshot->samples + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < KAGE_STATS_BUCKETS; b++) {
+        seen += snapshot->buckets[b];
+        if (seen >= rank) {
+            uint64_t limit = kage_stats_bucket_limit(b);
+            return limit < snapshot->max_ns ? limit : snapshot->max_ns;
+        }
+    }
+    return snapshot->max_ns;
+}
+
+static uint64_t kage_stats_mean(const kage_stat_snapshot *snapshot) {
+    return snapshot->count ? snapshot->total_ns / snapshot->count : 0;
+}
+
+/**
+ * Appends the counters to kage.stats_file, one line per operation and
+ * cache, tagged with the process id. Called at MSHUTDOWN.
+ */
+PHPAPI void kage_stats_shutdown(void) {
+    const char *path = KAGE_G(stats_file);
+    if (path == NULL || *path == '\0') {
+        return;
+    }
+
+    FILE *fp = fopen(path, "a");
+    if (fp == NULL) {
+        return;
+    }
+
+    long pid = (long)getpid();
+    long now = (long)time(NULL);
+    kage_stat_snapshot *snapshot = malloc(sizeof(kage_stat_snapshot));
+    if (snapshot == NULL) {
+        fclose(fp);
+        return;
+    }
+
+    for (int i = 0; i < KAGE_STAT_COUNT; i++) {
+        kage_stats_snapshot(i, snapshot);
+        if (snapshot->count == 0) {
+            continue;
+        }
+        fprintf(fp, "time=%ld pid=%ld op=%s count=%llu failures=%llu bytes=%llu mean_ns=%llu",
+                now, pid, kage_stat_names[i],
+                (unsigned long long)snapshot->count, (unsigned long long)snapshot->failures,
+                (unsigned long long)snapshot->bytes, (unsigned long long)kage_stats_mean(snapshot));
+        for (size_t p = 0; p < sizeof(kage_stats_percentiles) / sizeof(kage_stats_percentiles[0]); p++) {
+            fprintf(fp, " %s=%llu", kage_stats_percentile_names[p],
+                    (unsigned long long)kage_stats_percentile(snapshot, kage_stats_percentiles[p]));
+        }
+        fprintf(fp, " max_ns=%llu\n", (unsigned long long)snapshot->max_ns);
+    }
+
+    for (int i = 0; i < KAGE_CACHE_COUNT; i++) {
+        uint64_t hits = atomic_load_explicit(&kage_stats_caches[i].hits, memory_order_relaxed);
+        uint64_t misses = atomic_load_explicit(&kage_stats_caches[i].misses, memory_order_relaxed);
+        if (hits + misses == 0) {
+            continue;
+        }
+        fprintf(fp, "time=%ld pid=%ld cache=%s hits=%llu misses=%llu\n",
+                now, pid, kage_cache_names[i], (unsigned long long)hits, (unsigned long long)misses);
+    }
+
+    free(snapshot);
+    fclose(fp);
+}
+
+// phpinfo() rows: one summary per operation that has run
+PHPAPI void kage_stats_info(void) {
+    kage_stat_snapshot *snapshot = emalloc(sizeof(kage_stat_snapshot));
+    char row[192];
+
+    php_info_print_table_start();
+    php_info_print_table_header(2, "Operation", "Calls, bytes, latency");
+
+    for (int i = 0; i < KAGE_STAT_COUNT; i++) {
+        kage_stats_snapshot(i, snapshot);
+        if (snapshot->count == 0) {
+            continue;
+        }
+        snprintf(row, sizeof(row), "%llu calls (%llu failed), %llu bytes, p50 %.1f us, p99 %.1f us, max %.1f us",
+                 (unsigned long long)snapshot->count, (unsigned long long)snapshot->failures,
+                 (unsigned long long)snapshot->bytes,
+                 kage_stats_percentile(snapshot, 0.5) / 1e3,
+                 kage_stats_percentile(snapshot, 0.99) / 1e3,
+                 snapshot->max_ns / 1e3);
+        php_info_print_table_row(2, kage_stat_names[i], row);
+    }
+
+    for (int i = 0; i < KAGE_CACHE_COUNT; i++) {
+        snprintf(row, sizeof(row), "%llu hits, %llu misses",
+                 (unsigned long long)atomic_load_explicit(&kage_stats_caches[i].hits, memory_order_relaxed),
+                 (unsigned long long)atomic_load_explicit(&kage_stats_caches[i].misses, memory_order_relaxed));
+        php_info_print_table_row(2, kage_cache_names[i], row);
+    }
+
+    php_info_print_table_end();
+    efree(snapshot);
+}
+
+// Usage counters of kage_memory_get_stats() as an array
+static void kage_stats_memory_usage(zval *entry, const kage_memory_usage *usage) {
+    array_init(entry);
+    add_assoc_long(entry, "total_allocated", (zend_long)usage->total_allocated);
+    add_assoc_long(entry, "total_freed", (zend_long)usage->total_freed);
+    add_assoc_long(entry, "current_usage", (zend_long)usage->current_usage);
+    add_assoc_long(entry, "peak_usage", (zend_long)usage->peak_usage);
+    add_assoc_long(entry, "allocation_count", (zend_long)usage->allocation_count);
+}
+
+// PHP Function: kage_stats(bool $reset = false): array
+// Returns per-operation counters keyed by operation name:
+// ['count', 'failures', 'bytes', 'total_ns', 'mean_ns', 'p50_ns', 'p90_ns',
+// 'p99_ns', 'p999_ns', 'max_ns', 'histogram' => [upper_ns => calls, ...]],
+// cache counters as ['hits', 'misses'], input 'validation' counters as
+// ['count', 'failures', 'bytes'] and the 'memory' statistics, summed over
+// threads, with the per-thread 'limit' and a breakdown by 'tags'.
+// $reset clears the operation, cache and validation counters after
+// reading them.
+PHP_FUNCTION(kage_stats) {
+    bool reset = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "|b", &reset) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    kage_stat_snapshot *snapshot = emalloc(sizeof(kage_stat_snapshot));
+    array_init_size(return_value, KAGE_STAT_COUNT + KAGE_CACHE_COUNT + 2);
+
+    for (int i = 0; i < KAGE_STAT_COUNT; i++) {
+        zval entry, histogram;
+
+        kage_stats_snapshot(i, snapshot);
+        array_init(&entry);
+        add_assoc_long(&entry, "count", (zend_long)snapshot->count);
+        add_assoc_long(&entry, "failures", (zend_long)snapshot->failures);
+        add_assoc_long(&entry, "bytes", (zend_long)snapshot->bytes);
+        add_assoc_long(&entry, "total_ns", (zend_long)snapshot->total_ns);
+        add_assoc_long(&entry, "mean_ns", (zend_long)kage_stats_mean(snapshot));
+        for (size_t p = 0; p < sizeof(kage_stats_percentiles) / sizeof(kage_stats_percentiles[0]); p++) {
+            add_assoc_long(&entry, kage_stats_percentile_names[p],
+                           (zend_long)kage_stats_percentile(snapshot, kage_stats_percentiles[p]));
+        }
+        add_assoc_long(&entry, "max_ns", (zend_long)snapshot->max_ns);
+
+        // Only buckets that were hit, keyed by their upper bound
+        array_init(&histogram);
+        for (uint32_t b = 0; b < KAGE_STATS_BUCKETS; b++) {
+            if (snapshot->buckets[b]) {
+                add_index_long(&histogram, (zend_ulong)kage_stats_bucket_limit(b), (zend_long)snapshot->buckets[b]);
+            }
+        }
+        add_assoc_zval(&entry, "histogram", &histogram);
+
+        add_assoc_zval(return_value, kage_stat_names[i], &entry);
+    }
+
+    for (int i = 0; i < KAGE_CACHE_COUNT; i++) {
+        zval entry;
+        array_init(&entry);
+        add_assoc_long(&entry, "hits", (zend_long)atomic_load_explicit(&kage_stats_caches[i].hits, memory_order_relaxed));
+        add_assoc_long(&entry, "misses", (zend_long)atomic_load_explicit(&kage_stats_caches[i].misses, memory_order_relaxed));
+        add_assoc_zval(return_value, kage_cache_names[i], &entry);
+    }
+
+    zval entry, tags;
+    kage_validation_stats validation;
+    kage_validation_get_stats(&validation);
+    array_init(&entry);
+    add_assoc_long(&entry, "count", (zend_long)validation.total_validations);
+    add_assoc_long(&entry, "failures", (zend_long)validation.validation_failures);
+    add_assoc_long(&entry, "bytes", (zend_long)validation.bytes_validated);
+    add_assoc_zval(return_value, "validation", &entry);
+
+    kage_memory_stats memory;
+    kage_memory_get_stats(&memory);
+    kage_stats_memory_usage(&entry, &memory.total);
+    add_assoc_long(&entry, "limit", (zend_long)memory.limit);
+    array_init(&tags);
+    for (int i = 0; i < KAGE_MEMORY_TAG_COUNT; i++) {
+        zval usage;
+        kage_stats_memory_usage(&usage, &memory.tags[i]);
+        add_assoc_zval(&tags, kage_memory_tag_name(i), &usage);
+    }
+    add_assoc_zval(&entry, "tags", &tags);
+    add_assoc_zval(return_value, "memory", &entry);
+
+    efree(snapshot);
+
+    if (reset) {
+        kage_stats_reset();
+    }
+}
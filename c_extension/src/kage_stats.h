@@ -0,0 +1,59 @@
+/**
+ * Operation Metrics for Kage Extension
+ *
+ * Per-process counters for the hot operations of the extension: calls,
+ * failures, bytes processed and a log-linear latency histogram (HDR style,
+ * 16 sub-buckets per power of two, so percentiles are within about 6%).
+ * Cache layers count hits and misses.
+ *
+ * Counters are updated with relaxed atomics and never locked; under ZTS
+ * all threads of the process share them. They are read by kage_stats(),
+ * shown in phpinfo() and, when kage.stats_file is set, appended to that
+ * file at MSHUTDOWN.
+ */
+
+#ifndef PHP_KAGE_STATS_H
+#define PHP_KAGE_STATS_H
+
+#include "config.h"
+#include <stdint.h>
+#include <time.h>
+
+// Timed operations
+typedef enum {
+    KAGE_STAT_ENCRYPT,
+    KAGE_STAT_DECRYPT,
+    KAGE_STAT_BASE64_ENCODE,
+    KAGE_STAT_BASE64_DECODE,
+    KAGE_STAT_PARSE,
+    KAGE_STAT_LOWER,
+    KAGE_STAT_VM_EXECUTE,
+    KAGE_STAT_COUNT
+} kage_stat_id;
+
+// Cache layers
+typedef enum {
+    KAGE_CACHE_PROGRAM,
+    KAGE_CACHE_COUNT
+} kage_cache_id;
+
+// Monotonic clock in nanoseconds, the start value for kage_stats_record()
+static zend_always_inline uint64_t kage_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Recording
+PHPAPI void kage_stats_record(kage_stat_id id, size_t bytes, uint64_t started, bool ok);
+PHPAPI void kage_stats_cache(kage_cache_id id, bool hit);
+PHPAPI void kage_stats_reset(void);
+
+// Lifecycle
+PHPAPI void kage_stats_shutdown(void);
+PHPAPI void kage_stats_info(void);
+
+// PHP functions
+PHP_FUNCTION(kage_stats);
+
+#endif /* PHP_KAGE_STATS_H */
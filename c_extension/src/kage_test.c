@@ -0,0 +1,170 @@
+/**
+ * Kage Unit Test Framework
+ *
+ * Benchmark runner. Each benchmark is calibrated until one timed batch
+ * takes at least the requested time; allocations are counted in a
+ * separate untimed call, so the counting does not skew the timings.
+ *
+ * Copyright (c) 2025 [Your Name], Individual Entrepreneur
+ * INN: [Your Tax ID Number]
+ * Created: 2025-12-09
+ * All rights reserved. Unauthorized copying, modification,
+ * distribution, or use is strictly prohibited.
+ */
+
+#include "kage_context.h"
+#include "kage_test.h"
+#include "kage_stats.h"
+#include "zend_alloc.h"
+
+static kage_benchmark *kage_benchmarks = NULL;
+static size_t kage_benchmark_count = 0;
+static size_t kage_benchmark_capacity = 0;
+
+// Allocation counting: the request heap forwards to itself through
+// custom handlers for the duration of one call
+static zend_mm_heap *kage_benchmark_heap = NULL;
+static size_t kage_benchmark_allocations = 0;
+static size_t kage_benchmark_allocated = 0;
+
+static void* kage_benchmark_malloc(size_t size) {
+    kage_benchmark_allocations++;
+    kage_benchmark_allocated += size;
+    return zend_mm_alloc(kage_benchmark_heap, size);
+}
+
+static void kage_benchmark_free(void *ptr) {
+    zend_mm_free(kage_benchmark_heap, ptr);
+}
+
+static void* kage_benchmark_realloc(void *ptr, size_t size) {
+    kage_benchmark_allocations++;
+    kage_benchmark_allocated += size;
+    return zend_mm_realloc(kage_benchmark_heap, ptr, size);
+}
+
+// Runs one call with counting handlers; false when ZendMM is not in use
+// (USE_ZEND_ALLOC=0), as the heap is custom already
+static bool kage_benchmark_count_allocations(kage_benchmark *bench) {
+    if (!is_zend_mm()) {
+        return false;
+    }
+
+    kage_benchmark_heap = zend_mm_get_heap();
+    kage_benchmark_allocations = 0;
+    kage_benchmark_allocated = 0;
+
+    zend_mm_set_custom_handlers(kage_benchmark_heap, kage_benchmark_malloc, kage_benchmark_free, kage_benchmark_realloc);
+    bench->function(bench->arg);
+    zend_mm_set_custom_handlers(kage_benchmark_heap, NULL, NULL, NULL);
+
+    bench->allocations = kage_benchmark_allocations;
+    bench->allocated_bytes = kage_benchmark_allocated;
+    return true;
+}
+
+static uint64_t kage_benchmark_batch(kage_benchmark *bench, size_t iterations) {
+    uint64_t started = kage_stats_now();
+    for (size_t i = 0; i < iterations; i++) {
+        bench->function(bench->arg);
+    }
+    return kage_stats_now() - started;
+}
+
+/**
+ * Runs a benchmark and keeps its result for the reports.
+ *
+ * @param name Benchmark name
+ * @param bytes Input size per call, for throughput; 0 if not applicable
+ * @param function Code under test; must release whatever it allocates
+ * @param arg Passed to function
+ * @param min_time Minimum duration of the timed batch in seconds
+ * @return The stored result, or NULL when out of memory
+ */
+PHPAPI kage_benchmark* kage_test_benchmark(const char *name, size_t bytes, kage_benchmark_func function, void *arg, double min_time) {
+    if (kage_benchmark_count == kage_benchmark_capacity) {
+        size_t capacity = kage_benchmark_capacity ? kage_benchmark_capacity * 2 : 32;
+        kage_benchmark *benchmarks = realloc(kage_benchmarks, capacity * sizeof(kage_benchmark));
+        if (benchmarks == NULL) {
+            return NULL;
+        }
+        kage_benchmarks = benchmarks;
+        kage_benchmark_capacity = capacity;
+    }
+
+    kage_benchmark *bench = &kage_benchmarks[kage_benchmark_count++];
+    memset(bench, 0, sizeof(*bench));
+    bench->name = name;
+    bench->function = function;
+    bench->arg = arg;
+    bench->bytes = bytes;
+
+    // The counting call doubles as warm-up
+    if (!kage_benchmark_count_allocations(bench)) {
+        function(arg);
+    }
+
+    uint64_t min_ns = (uint64_t)(min_time * 1e9);
+    size_t iterations = 1;
+    uint64_t elapsed;
+
+    for (;;) {
+        elapsed = kage_benchmark_batch(bench, iterations);
+        if (elapsed >= min_ns) {
+            break;
+        }
+        // Aim 20% past the target, growing at least twofold and at most 100x
+        double scale = elapsed ? (double)min_ns / (double)elapsed * 1.2 : 100.0;
+        scale = scale < 2.0 ? 2.0 : (scale > 100.0 ? 100.0 : scale);
+        iterations = (size_t)((double)iterations * scale);
+    }
+
+    bench->iterations = iterations;
+    bench->execution_time = elapsed / 1e9;
+    return bench;
+}
+
+static double kage_benchmark_ns_per_op(const kage_benchmark *bench) {
+    return bench->execution_time * 1e9 / (double)bench->iterations;
+}
+
+static double kage_benchmark_bytes_per_sec(const kage_benchmark *bench) {
+    return bench->bytes ? (double)bench->bytes * (double)bench->iterations / bench->execution_time : 0.0;
+}
+
+// Human-readable table on stdout
+PHPAPI void kage_test_print_benchmarks(void) {
+    printf("%-24s %10s %12s %15s %12s %10s %14s\n",
+           "benchmark", "bytes", "iterations", "ns/op", "MB/s", "allocs/op", "alloc B/op");
+
+    for (size_t i = 0; i < kage_benchmark_count; i++) {
+        const kage_benchmark *bench = &kage_benchmarks[i];
+        printf("%-24s %10zu %12zu %15.1f %12.1f %10zu %14zu\n",
+               bench->name, bench->bytes, bench->iterations, kage_benchmark_ns_per_op(bench),
+               kage_benchmark_bytes_per_sec(bench) / (1024.0 * 1024.0),
+               bench->allocations, bench->allocated_bytes);
+    }
+}
+
+// Results as one JSON document, for comparing releases
+PHPAPI void kage_test_write_benchmarks_json(FILE *out) {
+    fprintf(out, "{\n  \"kage_version\": \"%s\",\n  \"php_version\": \"%s\",\n  \"zend_mm\": %s,\n  \"results\": [",
+            PHP_KAGE_VERSION, PHP_VERSION, is_zend_mm() ? "true" : "false");
+
+    for (size_t i = 0; i < kage_benchmark_count; i++) {
+        const kage_benchmark *bench = &kage_benchmarks[i];
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"bytes\": %zu, \"iterations\": %zu, \"ns_per_op\": %.1f, "
+                     "\"bytes_per_sec\": %.0f, \"allocations_per_op\": %zu, \"allocated_bytes_per_op\": %zu}",
+                i ? "," : "", bench->name, bench->bytes, bench->iterations, kage_benchmark_ns_per_op(bench),
+                kage_benchmark_bytes_per_sec(bench), bench->allocations, bench->allocated_bytes);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+}
+
+PHPAPI void kage_test_free_benchmarks(void) {
+    free(kage_benchmarks);
+    kage_benchmarks = NULL;
+    kage_benchmark_count = 0;
+    kage_benchmark_capacity = 0;
+}
@@ -16,6 +16,7 @@
 #include "config.h"
 #include <stdbool.h>
 #include <setjmp.h>
+#include <stdio.h>
 
 // Test result types
 typedef enum {
@@ -133,16 +134,24 @@ PHPAPI kage_test_suite* kage_test_create_base64_suite(void);
 PHPAPI kage_test_suite* kage_test_create_memory_suite(void);
 PHPAPI kage_test_suite* kage_test_create_config_suite(void);
 
-// Benchmarking support
+// Benchmarking support (kage_test.c)
+typedef void (*kage_benchmark_func)(void *arg);
+
 typedef struct {
     const char *name;
-    void (*function)(void);
-    double execution_time;
+    kage_benchmark_func function;
+    void *arg;
+    size_t bytes;              // input size per call, 0 if not applicable
+    double execution_time;     // seconds for all iterations
     size_t iterations;
+    size_t allocations;        // emalloc/erealloc calls per call
+    size_t allocated_bytes;    // bytes requested per call
 } kage_benchmark;
 
-PHPAPI void kage_test_benchmark(const char *name, void (*function)(void), size_t iterations);
+PHPAPI kage_benchmark* kage_test_benchmark(const char *name, size_t bytes, kage_benchmark_func function, void *arg, double min_time);
 PHPAPI void kage_test_print_benchmarks(void);
+PHPAPI void kage_test_write_benchmarks_json(FILE *out);
+PHPAPI void kage_test_free_benchmarks(void);
 
 // Memory leak detection
 PHPAPI void kage_test_enable_memory_checking(void);
@@ -0,0 +1,480 @@
+/**
+ * Kage Input Validation
+ *
+ * Byte-level checks that run fused in a single pass and allocate nothing.
+ * A 256-entry class table drives the scalar scan, which stops only on a
+ * byte that some requested check cares about. On x86 with SSSE3 the input
+ * is first scanned 64 bytes at a time: NUL, control and base64 alphabet
+ * tests are vector compares, and UTF-8 is validated with the Keiser-Lemire
+ * lookup algorithm ("Validating UTF-8 In Less Than One Instruction Per
+ * Byte", 2021). The vector pass only decides whether a block is clean; the
+ * scalar scan takes over at the first dirty block to find the exact
+ * offset and the message, so both paths report the same result.
+ *
+ * Copyright (c) 2025 [Your Name], Individual Entrepreneur
+ * INN: [Your Tax ID Number]
+ * Created: 2025-12-09
+ * All rights reserved. Unauthorized copying, modification,
+ * distribution, or use is strictly prohibited.
+ */
+
+#include "php.h"
+#include "kage_validation.h"
+#include <stdatomic.h>
+
+// Define KAGE_VALIDATION_SCALAR to build the scalar scan only
+#if !defined(KAGE_VALIDATION_SCALAR) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+# define KAGE_VALIDATION_SSSE3 1
+# include <tmmintrin.h>
+#endif
+
+// Byte classes of the scalar scan
+#define KAGE_BYTE_NUL        0x01
+#define KAGE_BYTE_CONTROL    0x02
+#define KAGE_BYTE_NOT_BASE64 0x04
+#define KAGE_BYTE_NON_ASCII  0x08
+
+#define N (KAGE_BYTE_NUL | KAGE_BYTE_CONTROL | KAGE_BYTE_NOT_BASE64)
+#define C (KAGE_BYTE_CONTROL | KAGE_BYTE_NOT_BASE64)
+#define B KAGE_BYTE_NOT_BASE64
+#define U (KAGE_BYTE_NON_ASCII | KAGE_BYTE_NOT_BASE64)
+static const unsigned char kage_validation_class[256] = {
+    N, C, C, C, C, C, C, C, C, B, B, C, C, B, C, C,   // \t \n \r are not controls here
+    C, C, C, C, C, C, C, C, C, C, C, C, C, C, C, C,
+    B, B, B, B, B, B, B, B, B, B, B, 0, B, B, B, 0,   // '+' '/'
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, B, B, B, B, B, B,   // '=' is padding, see kage_validate_bytes()
+    B, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, B, B, B, B, B,
+    B, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, B, B, B, B, C,   // DEL
+    U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,
+    U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,
+    U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,
+    U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,
+    U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,
+    U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,
+    U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,
+    U, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U
+};
+#undef N
+#undef C
+#undef B
+#undef U
+
+typedef struct {
+    _Atomic uint64_t validations;
+    _Atomic uint64_t failures;
+    _Atomic uint64_t bytes;
+} kage_validation_counters;
+
+static kage_validation_counters kage_validation_counts;
+
+/**
+ * Length of the UTF-8 sequence starting at str, per RFC 3629: no
+ * overlong forms, no surrogates, nothing above U+10FFFF.
+ *
+ * @param str Start of the sequence, a byte >= 0x80
+ * @param available Bytes from str to the end of the input
+ * @return Length of the sequence, 0 if it is malformed or truncated
+ */
+static size_t kage_utf8_sequence(const unsigned char *str, size_t available) {
+    unsigned char lead = str[0];
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    size_t length;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) {
+            low = 0xA0;
+        } else if (lead == 0xED) {
+            high = 0x9F;
+        }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) {
+            low = 0x90;
+        } else if (lead == 0xF4) {
+            high = 0x8F;
+        }
+    } else {
+        return 0;
+    }
+
+    if (available < length || str[1] < low || str[1] > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; i++) {
+        if ((str[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+/**
+ * Scans from position to the end of the input for the first byte that
+ * fails one of the checks.
+ *
+ * @param str The input
+ * @param position Where to start, on a character boundary
+ * @param length Length of the input
+ * @param checks KAGE_CHECK_* flags
+ * @param padding Start of the base64 padding, length if there is none
+ * @param error Set to the message of the failed check
+ * @return Offset of the failing byte, length if every byte passed
+ */
+static size_t kage_validation_scan_scalar(const unsigned char *str, size_t position, size_t length,
+                                          uint32_t checks, size_t padding, const char **error) {
+    unsigned char stop = 0;
+    if (checks & KAGE_CHECK_NO_NULL) {
+        stop |= KAGE_BYTE_NUL;
+    }
+    if (checks & KAGE_CHECK_NO_CONTROL) {
+        stop |= KAGE_BYTE_CONTROL;
+    }
+    if (checks & KAGE_CHECK_BASE64) {
+        stop |= KAGE_BYTE_NOT_BASE64;
+    }
+    if (checks & KAGE_CHECK_UTF8) {
+        stop |= KAGE_BYTE_NON_ASCII;
+    }
+
+    while (position < length) {
+        unsigned char found = kage_validation_class[str[position]] & stop;
+        if (EXPECTED(found == 0)) {
+            position++;
+            continue;
+        }
+
+        if (found & KAGE_BYTE_NUL) {
+            *error = "NUL byte";
+            return position;
+        }
+        if (found & KAGE_BYTE_CONTROL) {
+            *error = "control character";
+            return position;
+        }
+        if (found & KAGE_BYTE_NOT_BASE64) {
+            if (str[position] == '=' && position >= padding) {
+                position++;
+                continue;
+            }
+            *error = "invalid base64 character";
+            return position;
+        }
+
+        size_t sequence = kage_utf8_sequence(str + position, length - position);
+        if (sequence == 0) {
+            *error = "invalid UTF-8 sequence";
+            return position;
+        }
+        position += sequence;
+    }
+    return position;
+}
+
+#ifdef KAGE_VALIDATION_SSSE3
+
+#define KAGE_SSSE3 __attribute__((target("ssse3")))
+
+/**
+ * Backs up from position to the lead byte of a UTF-8 sequence that
+ * crosses it, so the scalar scan can resume there.
+ *
+ * @param str The input, valid UTF-8 before position
+ * @param position Where the vector pass stopped
+ * @return Start of the character that position is in
+ */
+static size_t kage_utf8_boundary(const unsigned char *str, size_t position) {
+    for (size_t back = 1; back <= 3 && back <= position; back++) {
+        unsigned char byte = str[position - back];
+        if (byte < 0x80) {
+            break;
+        }
+        if (byte >= 0xC0) {
+            // A lead byte; the sequence needs 2, 3 or 4 bytes
+            size_t needed = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : 2;
+            return needed > back ? position - back : position;
+        }
+    }
+    return position;
+}
+
+// Error classes of the Keiser-Lemire lookup; a pair of bytes is invalid
+// when the three table lookups for it share a bit
+#define KAGE_UTF8_TOO_SHORT  (1 << 0)   // lead byte not followed by a continuation
+#define KAGE_UTF8_TOO_LONG   (1 << 1)   // ASCII followed by a continuation
+#define KAGE_UTF8_OVERLONG_3 (1 << 2)
+#define KAGE_UTF8_TOO_LARGE  (1 << 3)
+#define KAGE_UTF8_SURROGATE  (1 << 4)
+#define KAGE_UTF8_OVERLONG_2 (1 << 5)
+#define KAGE_UTF8_TOO_LARGE_1000 (1 << 6)
+#define KAGE_UTF8_OVERLONG_4 (1 << 6)
+#define KAGE_UTF8_TWO_CONTS  (1 << 7)   // continuation after continuation, checked by length
+#define KAGE_UTF8_CARRY      (KAGE_UTF8_TOO_SHORT | KAGE_UTF8_TOO_LONG | KAGE_UTF8_TWO_CONTS)
+
+// Errors in the pairs (previous byte, byte) of one vector
+KAGE_SSSE3 static inline __m128i kage_utf8_special_cases(__m128i input, __m128i previous1) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    // High nibble of the first byte of the pair
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        KAGE_UTF8_TOO_LONG, KAGE_UTF8_TOO_LONG, KAGE_UTF8_TOO_LONG, KAGE_UTF8_TOO_LONG,
+        KAGE_UTF8_TOO_LONG, KAGE_UTF8_TOO_LONG, KAGE_UTF8_TOO_LONG, KAGE_UTF8_TOO_LONG,
+        (char)KAGE_UTF8_TWO_CONTS, (char)KAGE_UTF8_TWO_CONTS, (char)KAGE_UTF8_TWO_CONTS, (char)KAGE_UTF8_TWO_CONTS,
+        KAGE_UTF8_TOO_SHORT | KAGE_UTF8_OVERLONG_2,
+        KAGE_UTF8_TOO_SHORT,
+        KAGE_UTF8_TOO_SHORT | KAGE_UTF8_OVERLONG_3 | KAGE_UTF8_SURROGATE,
+        KAGE_UTF8_TOO_SHORT | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000 | KAGE_UTF8_OVERLONG_4);
+
+    // Low nibble of the first byte of the pair
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_OVERLONG_3 | KAGE_UTF8_OVERLONG_2 | KAGE_UTF8_OVERLONG_4),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_OVERLONG_2),
+        (char)KAGE_UTF8_CARRY,
+        (char)KAGE_UTF8_CARRY,
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000 | KAGE_UTF8_SURROGATE),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000),
+        (char)(KAGE_UTF8_CARRY | KAGE_UTF8_TOO_LARGE | KAGE_UTF8_TOO_LARGE_1000));
+
+    // High nibble of the second byte of the pair
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT,
+        KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT,
+        (char)(KAGE_UTF8_TOO_LONG | KAGE_UTF8_OVERLONG_2 | KAGE_UTF8_TWO_CONTS | KAGE_UTF8_OVERLONG_3 |
+               KAGE_UTF8_TOO_LARGE_1000 | KAGE_UTF8_OVERLONG_4),
+        (char)(KAGE_UTF8_TOO_LONG | KAGE_UTF8_OVERLONG_2 | KAGE_UTF8_TWO_CONTS | KAGE_UTF8_OVERLONG_3 |
+               KAGE_UTF8_TOO_LARGE),
+        (char)(KAGE_UTF8_TOO_LONG | KAGE_UTF8_OVERLONG_2 | KAGE_UTF8_TWO_CONTS | KAGE_UTF8_SURROGATE |
+               KAGE_UTF8_TOO_LARGE),
+        (char)(KAGE_UTF8_TOO_LONG | KAGE_UTF8_OVERLONG_2 | KAGE_UTF8_TWO_CONTS | KAGE_UTF8_SURROGATE |
+               KAGE_UTF8_TOO_LARGE),
+        KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT, KAGE_UTF8_TOO_SHORT);
+
+    __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table,
+                                           _mm_and_si128(_mm_srli_epi16(previous1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(previous1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table,
+                                           _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    return _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+}
+
+// Errors of one vector given the vector before it
+KAGE_SSSE3 static inline __m128i kage_utf8_check(__m128i input, __m128i previous) {
+    __m128i previous1 = _mm_alignr_epi8(input, previous, 15);
+    __m128i special_cases = kage_utf8_special_cases(input, previous1);
+
+    // Third and fourth bytes of a sequence must be continuations; the
+    // lookup flagged them as TWO_CONTS, so the two cancel out
+    __m128i previous2 = _mm_alignr_epi8(input, previous, 14);
+    __m128i previous3 = _mm_alignr_epi8(input, previous, 13);
+    __m128i third = _mm_subs_epu8(previous2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i fourth = _mm_subs_epu8(previous3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must_be_continuation = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must_be_continuation, special_cases);
+}
+
+// Non-zero where the vector ends in the middle of a sequence
+KAGE_SSSE3 static inline __m128i kage_utf8_incomplete(__m128i input) {
+    const __m128i max = _mm_setr_epi8(
+        (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+        (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xEF, (char)0xDF, (char)0xBF);
+    return _mm_subs_epu8(input, max);
+}
+
+// Bytes in [low, high]
+KAGE_SSSE3 static inline __m128i kage_validation_in_range(__m128i input, char low, char high) {
+    __m128i shifted = _mm_sub_epi8(input, _mm_set1_epi8(low));
+    __m128i limit = _mm_set1_epi8((char)(high - low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, limit), shifted);
+}
+
+// Bytes that fail the NUL, control or base64 checks
+KAGE_SSSE3 static inline __m128i kage_validation_bad_bytes(__m128i input, uint32_t checks) {
+    __m128i bad = _mm_setzero_si128();
+
+    if (checks & KAGE_CHECK_NO_CONTROL) {
+        __m128i control = kage_validation_in_range(input, 0x00, 0x1F);
+        __m128i allowed = _mm_or_si128(_mm_cmpeq_epi8(input, _mm_set1_epi8('\t')),
+                          _mm_or_si128(_mm_cmpeq_epi8(input, _mm_set1_epi8('\n')),
+                                       _mm_cmpeq_epi8(input, _mm_set1_epi8('\r'))));
+        bad = _mm_or_si128(_mm_andnot_si128(allowed, control), _mm_cmpeq_epi8(input, _mm_set1_epi8(0x7F)));
+    } else if (checks & KAGE_CHECK_NO_NULL) {
+        bad = _mm_cmpeq_epi8(input, _mm_setzero_si128());
+    }
+
+    if (checks & KAGE_CHECK_BASE64) {
+        // '=' counts as bad here; the scalar scan accepts it as padding
+        __m128i alphabet = _mm_or_si128(
+            _mm_or_si128(kage_validation_in_range(input, 'A', 'Z'), kage_validation_in_range(input, 'a', 'z')),
+            _mm_or_si128(kage_validation_in_range(input, '0', '9'),
+                         _mm_or_si128(_mm_cmpeq_epi8(input, _mm_set1_epi8('+')),
+                                      _mm_cmpeq_epi8(input, _mm_set1_epi8('/')))));
+        bad = _mm_or_si128(bad, _mm_andnot_si128(alphabet, _mm_set1_epi8((char)0xFF)));
+    }
+
+    return bad;
+}
+
+/**
+ * Runs the checks over whole 64-byte blocks until one fails.
+ *
+ * @param str The input
+ * @param length Length of the input
+ * @param checks KAGE_CHECK_* flags
+ * @return End of the clean blocks; the scalar scan resumes there
+ */
+KAGE_SSSE3 static size_t kage_validation_scan_ssse3(const unsigned char *str, size_t length, uint32_t checks) {
+    bool utf8 = (checks & KAGE_CHECK_UTF8) != 0;
+    bool bytes = (checks & (KAGE_CHECK_NO_NULL | KAGE_CHECK_NO_CONTROL | KAGE_CHECK_BASE64)) != 0;
+    __m128i previous = _mm_setzero_si128();
+    __m128i previous_incomplete = _mm_setzero_si128();
+    size_t position = 0;
+
+    for (; position + 64 <= length; position += 64) {
+        __m128i input0 = _mm_loadu_si128((const __m128i*)(str + position));
+        __m128i input1 = _mm_loadu_si128((const __m128i*)(str + position + 16));
+        __m128i input2 = _mm_loadu_si128((const __m128i*)(str + position + 32));
+        __m128i input3 = _mm_loadu_si128((const __m128i*)(str + position + 48));
+        __m128i error = _mm_setzero_si128();
+
+        if (bytes) {
+            error = _mm_or_si128(_mm_or_si128(kage_validation_bad_bytes(input0, checks),
+                                              kage_validation_bad_bytes(input1, checks)),
+                                 _mm_or_si128(kage_validation_bad_bytes(input2, checks),
+                                              kage_validation_bad_bytes(input3, checks)));
+        }
+
+        if (utf8) {
+            __m128i any = _mm_or_si128(_mm_or_si128(input0, input1), _mm_or_si128(input2, input3));
+            if (_mm_movemask_epi8(any) == 0) {
+                // All ASCII: only a sequence left open by the last block can fail
+                error = _mm_or_si128(error, previous_incomplete);
+            } else {
+                error = _mm_or_si128(error, _mm_or_si128(
+                    _mm_or_si128(kage_utf8_check(input0, previous), kage_utf8_check(input1, input0)),
+                    _mm_or_si128(kage_utf8_check(input2, input1), kage_utf8_check(input3, input2))));
+                previous_incomplete = kage_utf8_incomplete(input3);
+            }
+            previous = input3;
+        }
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+    }
+
+    return position;
+}
+
+#endif /* KAGE_VALIDATION_SSSE3 */
+
+PHPAPI kage_validation_result_t kage_validate_bytes(const char *str, size_t length, uint32_t checks) {
+    const unsigned char *input = (const unsigned char*)str;
+    kage_validation_result_t result = {true, NULL, 0};
+    size_t position = 0;
+    size_t padding = length;
+
+    if (checks & KAGE_CHECK_BASE64) {
+        // Up to two trailing '=', and only if the last byte is one
+        if (length >= 1 && input[length - 1] == '=') {
+            padding--;
+            if (length >= 2 && input[length - 2] == '=') {
+                padding--;
+            }
+        }
+    }
+
+#ifdef KAGE_VALIDATION_SSSE3
+    if (length >= 64 && __builtin_cpu_supports("ssse3")) {
+        position = kage_validation_scan_ssse3(input, length, checks);
+        if (checks & KAGE_CHECK_UTF8) {
+            position = kage_utf8_boundary(input, position);
+        }
+    }
+#endif
+
+    position = kage_validation_scan_scalar(input, position, length, checks, padding, &result.error_message);
+    if (position < length) {
+        result.is_valid = false;
+        result.error_offset = position;
+    } else if ((checks & KAGE_CHECK_BASE64) && length % 4 != 0) {
+        result.is_valid = false;
+        result.error_message = "base64 length is not a multiple of 4";
+        result.error_offset = length;
+    }
+
+    atomic_fetch_add_explicit(&kage_validation_counts.validations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&kage_validation_counts.bytes, length, memory_order_relaxed);
+    if (!result.is_valid) {
+        atomic_fetch_add_explicit(&kage_validation_counts.failures, 1, memory_order_relaxed);
+    }
+    return result;
+}
+
+PHPAPI kage_validation_result_t kage_validate_source_code(const char *source, size_t source_length) {
+    // Packages store the source as a C string
+    return kage_validate_bytes(source, source_length, KAGE_CHECK_NO_NULL);
+}
+
+PHPAPI bool kage_is_valid_utf8(const char *str, size_t length) {
+    return kage_validate_bytes(str, length, KAGE_CHECK_UTF8).is_valid;
+}
+
+PHPAPI bool kage_is_valid_base64(const char *str, size_t length) {
+    return kage_validate_bytes(str, length, KAGE_CHECK_BASE64).is_valid;
+}
+
+PHPAPI bool kage_contains_null_bytes(const char *str, size_t length) {
+    return !kage_validate_bytes(str, length, KAGE_CHECK_NO_NULL).is_valid;
+}
+
+PHPAPI bool kage_contains_control_chars(const char *str, size_t length) {
+    return !kage_validate_bytes(str, length, KAGE_CHECK_NO_CONTROL).is_valid;
+}
+
+PHPAPI void kage_validation_get_stats(kage_validation_stats *stats) {
+    stats->total_validations = (size_t)atomic_load_explicit(&kage_validation_counts.validations, memory_order_relaxed);
+    stats->validation_failures = (size_t)atomic_load_explicit(&kage_validation_counts.failures, memory_order_relaxed);
+    stats->bytes_validated = (size_t)atomic_load_explicit(&kage_validation_counts.bytes, memory_order_relaxed);
+}
+
+PHPAPI void kage_validation_reset_stats(void) {
+    atomic_store_explicit(&kage_validation_counts.validations, 0, memory_order_relaxed);
+    atomic_store_explicit(&kage_validation_counts.failures, 0, memory_order_relaxed);
+    atomic_store_explicit(&kage_validation_counts.bytes, 0, memory_order_relaxed);
+}
+
+// PHP Function: kage_validate(string $data, int $checks): true|array
+// Runs the KAGE_CHECK_* checks; returns ['error' => ..., 'offset' => ...]
+// for the first byte that fails one
+PHP_FUNCTION(kage_validate) {
+    zend_string *data;
+    zend_long checks;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sl", &data, &checks) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    kage_validation_result_t result = kage_validate_bytes(ZSTR_VAL(data), ZSTR_LEN(data), (uint32_t)checks);
+    if (result.is_valid) {
+        RETURN_TRUE;
+    }
+
+    array_init_size(return_value, 2);
+    add_assoc_string(return_value, "error", (char *)result.error_message);
+    add_assoc_long(return_value, "offset", (zend_long)result.error_offset);
+}
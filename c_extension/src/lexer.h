@@ -0,0 +1,65 @@
+/**
+ * Kage Lexer
+ *
+ * Pull-based tokenizer for the Kage language. The source is classified
+ * 64 bytes at a time into whitespace, quote and backslash bitmasks
+ * (SSE2 when available, a table-driven scalar fallback otherwise), and
+ * tokens are cut out of the masks with count-trailing-zeros instead of
+ * testing one byte at a time.
+ *
+ * Copyright (c) 2025 [Your Name], Individual Entrepreneur
+ * INN: [Your Tax ID Number]
+ * Created: 2025-12-09
+ * All rights reserved. Unauthorized copying, modification,
+ * distribution, or use is strictly prohibited.
+ */
+
+#ifndef PHP_KAGE_LEXER_H
+#define PHP_KAGE_LEXER_H
+
+#include "config.h"
+#include <stdint.h>
+
+// Define KAGE_LEXER_SCALAR to build the scalar classifier only
+#if !defined(KAGE_LEXER_SCALAR) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# define KAGE_LEXER_SSE2 1
+#endif
+
+// Bytes classified per block
+#define KAGE_LEXER_BLOCK_SIZE 64
+
+// Token types
+typedef enum {
+    KAGE_TOKEN_EOF,
+    KAGE_TOKEN_STRING,            // body is [start, start + length) without quotes
+    KAGE_TOKEN_ENCRYPT,
+    KAGE_TOKEN_DECRYPT,
+    KAGE_TOKEN_INVALID,           // run of bytes up to whitespace or a quote
+    KAGE_TOKEN_UNCLOSED_STRING    // opening quote with no closing quote
+} kage_token_type;
+
+// Token; positions are byte offsets into the source
+typedef struct {
+    kage_token_type type;
+    size_t start;
+    size_t length;
+    size_t escape;                // STRING only: offset of the first backslash, or SIZE_MAX
+} kage_token;
+
+// Lexer state, including the masks of the block under the cursor
+typedef struct {
+    const char *source;
+    size_t length;
+    size_t position;
+    size_t block;                 // offset of the classified block, or SIZE_MAX
+    uint64_t whitespace;
+    uint64_t quote;
+    uint64_t backslash;
+} kage_lexer;
+
+// Lexer functions
+PHPAPI void kage_lexer_init(kage_lexer *lexer, const char *source, size_t length);
+PHPAPI void kage_lexer_next(kage_lexer *lexer, kage_token *token);
+
+#endif /* PHP_KAGE_LEXER_H */
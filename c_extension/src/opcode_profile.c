@@ -0,0 +1,409 @@
+/**
+ * Opcode Execution Profile for Kage Extension
+ *
+ * Runtime counters behind kage.profile, and the hot/cold split the opcode
+ * encoder derives from a recorded profile
+ */
+
+#include "php.h"
+#include "zend_compile.h"
+#include "zend_execute.h"
+#include "php_streams.h"
+#include "zend_smart_str.h"
+#include "opcode_profile.h"
+#include "php_bytecode_extractor.h"
+
+static void kage_profile_entry_dtor(zval *zv) {
+    kage_profile_entry *entry = Z_PTR_P(zv);
+    while (entry) {
+        kage_profile_entry *previous = entry->previous;
+        if (entry->file) {
+            zend_string_release(entry->file);
+        }
+        if (entry->function) {
+            zend_string_release(entry->function);
+        }
+        efree(entry);
+        entry = previous;
+    }
+}
+
+static kage_profile_entry* kage_profile_entry_create(uint32_t count) {
+    kage_profile_entry *entry = ecalloc(1, sizeof(kage_profile_entry) + count * sizeof(uint64_t));
+    entry->count = count;
+    return entry;
+}
+
+// Whether entry was recorded for op_array. Without opcache, the op_array of
+// an include or eval is freed after it runs and its opcodes address can be
+// handed to a different one later in the request.
+static bool kage_profile_entry_matches(const kage_profile_entry *entry, const zend_op_array *op_array) {
+    if (entry->count != op_array->last || entry->line_start != op_array->line_start) {
+        return false;
+    }
+    if (!entry->file || !op_array->filename) {
+        return entry->file == op_array->filename;
+    }
+    return zend_string_equals(entry->file, op_array->filename);
+}
+
+static kage_profile_entry* kage_profile_entry_for(const zend_op_array *op_array) {
+    kage_profile_entry *entry = kage_profile_entry_create(op_array->last);
+    entry->file = op_array->filename ? zend_string_copy(op_array->filename) : NULL;
+    entry->function = kage_op_array_name(op_array);
+    entry->line_start = op_array->line_start;
+    return entry;
+}
+
+// Counters of the op_array being executed. The last one is cached, so
+// straight-line code costs one pointer compare per opcode.
+static kage_profile_entry* kage_opcode_profile_entry(zend_op_array *op_array) {
+    if (op_array->opcodes == KAGE_G(profile_last_opcodes)) {
+        return KAGE_G(profile_last_entry);
+    }
+
+    // Closures share opcodes with the op_array they were created from
+    zend_ulong key = (zend_ulong)(uintptr_t)op_array->opcodes;
+    zval *slot = zend_hash_index_find(KAGE_G(profile_counts), key);
+    kage_profile_entry *entry;
+    if (!slot) {
+        entry = kage_profile_entry_for(op_array);
+        zend_hash_index_add_new_ptr(KAGE_G(profile_counts), key, entry);
+    } else {
+        entry = Z_PTR_P(slot);
+        if (!kage_profile_entry_matches(entry, op_array)) {
+            // A reused address: keep the old counts for the flush, behind the new entry
+            kage_profile_entry *stale = entry;
+            entry = kage_profile_entry_for(op_array);
+            entry->previous = stale;
+            Z_PTR_P(slot) = entry;
+        }
+    }
+
+    KAGE_G(profile_last_opcodes) = op_array->opcodes;
+    KAGE_G(profile_last_entry) = entry;
+    return entry;
+}
+
+// Runs before every opcode while profiling, then hands over to the engine
+static int kage_opcode_profile_handler(zend_execute_data *execute_data) {
+    if (KAGE_G(profile_counts)) {
+        zend_op_array *op_array = &EX(func)->op_array;
+        uint32_t position = (uint32_t)(EX(opline) - op_array->opcodes);
+        kage_profile_entry *entry = kage_opcode_profile_entry(op_array);
+
+        if (position < entry->count) {
+            entry->counts[position]++;
+        }
+    }
+    return ZEND_USER_OPCODE_DISPATCH;
+}
+
+// User opcode handlers are picked up when scripts are compiled, so this
+// has to run at MINIT; kage.profile is therefore PHP_INI_SYSTEM
+PHPAPI void kage_opcode_profile_startup(void) {
+    if (!KAGE_G(profile)) {
+        return;
+    }
+
+    for (uint32_t opcode = 0; opcode <= ZEND_VM_LAST_OPCODE; opcode++) {
+        if (opcode == ZEND_HANDLE_EXCEPTION || zend_get_user_opcode_handler((zend_uchar)opcode)) {
+            continue;
+        }
+        zend_set_user_opcode_handler((zend_uchar)opcode, kage_opcode_profile_handler);
+    }
+}
+
+PHPAPI void kage_opcode_profile_activate(void) {
+    KAGE_G(profile_last_opcodes) = NULL;
+    KAGE_G(profile_last_entry) = NULL;
+
+    if (!KAGE_G(profile)) {
+        return;
+    }
+
+    ALLOC_HASHTABLE(KAGE_G(profile_counts));
+    zend_hash_init(KAGE_G(profile_counts), 64, NULL, kage_profile_entry_dtor, 0);
+}
+
+// Appends the counts of this request to kage.profile_file. The record is
+// written with a single append, so concurrent workers don't interleave lines.
+static void kage_opcode_profile_flush(HashTable *counts) {
+    const char *path = KAGE_G(profile_file);
+    if (!path || !*path || zend_hash_num_elements(counts) == 0) {
+        return;
+    }
+
+    smart_str record = {0};
+    kage_profile_entry *entry;
+
+    ZEND_HASH_FOREACH_PTR(counts, entry) {
+        for (; entry; entry = entry->previous) {
+            if (!entry->file || entry->count == 0 ||
+                strpbrk(ZSTR_VAL(entry->file), "\t\n") || strpbrk(ZSTR_VAL(entry->function), "\t\n")) {
+                continue;
+            }
+            smart_str_append(&record, entry->file);
+            smart_str_appendc(&record, '\t');
+            smart_str_append(&record, entry->function);
+            smart_str_appendc(&record, '\t');
+            for (uint32_t i = 0; i < entry->count; i++) {
+                if (i > 0) {
+                    smart_str_appendc(&record, ',');
+                }
+                smart_str_append_unsigned(&record, (zend_ulong)entry->counts[i]);
+            }
+            smart_str_appendc(&record, '\n');
+        }
+    } ZEND_HASH_FOREACH_END();
+
+    if (!record.s) {
+        return;
+    }
+
+    php_stream *stream = php_stream_open_wrapper((char *)path, "ab", REPORT_ERRORS, NULL);
+    if (stream) {
+        php_stream_write(stream, ZSTR_VAL(record.s), ZSTR_LEN(record.s));
+        php_stream_close(stream);
+    }
+    smart_str_free(&record);
+}
+
+PHPAPI void kage_opcode_profile_deactivate(void) {
+    HashTable *counts = KAGE_G(profile_counts);
+    if (!counts) {
+        return;
+    }
+
+    KAGE_G(profile_counts) = NULL;
+    KAGE_G(profile_last_opcodes) = NULL;
+    KAGE_G(profile_last_entry) = NULL;
+
+    kage_opcode_profile_flush(counts);
+    zend_hash_destroy(counts);
+    FREE_HASHTABLE(counts);
+}
+
+// Parses "c0,c1,..." into a new entry; NULL on malformed input
+static kage_profile_entry* kage_opcode_profile_parse_counts(const char *p, const char *end) {
+    uint32_t count = 1;
+    for (const char *c = p; c < end; c++) {
+        if (*c == ',') {
+            count++;
+        }
+    }
+
+    kage_profile_entry *entry = kage_profile_entry_create(count);
+    uint32_t i = 0;
+    bool digits = false;
+
+    for (; p < end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            entry->counts[i] = entry->counts[i] * 10 + (uint64_t)(*p - '0');
+            digits = true;
+        } else if (*p == ',' && digits) {
+            i++;
+            digits = false;
+        } else {
+            efree(entry);
+            return NULL;
+        }
+    }
+
+    if (!digits) {
+        efree(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+// Merges one "file\tfunction\tcounts" line into the profile
+static void kage_opcode_profile_add_line(kage_opcode_profile *profile, const char *line, const char *end) {
+    const char *tab1 = memchr(line, '\t', end - line);
+    const char *tab2 = tab1 ? memchr(tab1 + 1, '\t', end - tab1 - 1) : NULL;
+    if (!tab2 || tab2 == tab1 + 1) {
+        return;
+    }
+
+    kage_profile_entry *parsed = kage_opcode_profile_parse_counts(tab2 + 1, end);
+    if (!parsed) {
+        return;
+    }
+
+    zend_string *key = zend_string_init(line, tab2 - line, 0);
+    kage_profile_entry *entry = zend_hash_find_ptr(&profile->entries, key);
+
+    if (entry && entry->count == parsed->count) {
+        for (uint32_t i = 0; i < entry->count; i++) {
+            entry->counts[i] += parsed->counts[i];
+        }
+        efree(parsed);
+    } else {
+        // New function, or the code changed since the earlier lines: the latest layout wins
+        parsed->file = zend_string_init(line, tab1 - line, 0);
+        parsed->function = zend_string_init(tab1 + 1, tab2 - tab1 - 1, 0);
+
+        // Repoint the by-name index before the replaced entry is freed
+        zval *existing = zend_hash_find(&profile->functions, parsed->function);
+        if (!existing) {
+            zend_hash_add_new_ptr(&profile->functions, parsed->function, parsed);
+        } else if (Z_PTR_P(existing)) {
+            kage_profile_entry *other = Z_PTR_P(existing);
+            ZVAL_PTR(existing, zend_string_equals(other->file, parsed->file) ? parsed : NULL);
+        }
+
+        zend_hash_update_ptr(&profile->entries, key, parsed);
+    }
+
+    zend_string_release(key);
+}
+
+// Loads a profile written by kage.profile; NULL when the file can't be read
+PHPAPI kage_opcode_profile* kage_opcode_profile_load(const char *path) {
+    php_stream *stream = php_stream_open_wrapper((char *)path, "rb", REPORT_ERRORS, NULL);
+    if (!stream) {
+        return NULL;
+    }
+
+    zend_string *contents = php_stream_copy_to_mem(stream, PHP_STREAM_COPY_ALL, 0);
+    php_stream_close(stream);
+
+    kage_opcode_profile *profile = emalloc(sizeof(kage_opcode_profile));
+    zend_hash_init(&profile->entries, 64, NULL, kage_profile_entry_dtor, 0);
+    zend_hash_init(&profile->functions, 64, NULL, NULL, 0);
+
+    if (contents) {
+        const char *p = ZSTR_VAL(contents);
+        const char *end = p + ZSTR_LEN(contents);
+
+        while (p < end) {
+            const char *eol = memchr(p, '\n', end - p);
+            if (!eol) {
+                eol = end;
+            }
+            if (*p != '#') {
+                kage_opcode_profile_add_line(profile, p, eol > p && eol[-1] == '\r' ? eol - 1 : eol);
+            }
+            p = eol + 1;
+        }
+        zend_string_release(contents);
+    }
+
+    return profile;
+}
+
+PHPAPI void kage_opcode_profile_free(kage_opcode_profile *profile) {
+    if (!profile) {
+        return;
+    }
+
+    zend_hash_destroy(&profile->functions);
+    zend_hash_destroy(&profile->entries);
+    efree(profile);
+}
+
+static int kage_compare_counts_desc(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+static int kage_compare_offsets(const void *a, const void *b) {
+    zend_long x = *(const zend_long *)a;
+    zend_long y = *(const zend_long *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Picks the hottest hot_percent of the opcodes in bytecode, by execution
+// count. Functions are matched by file and name, or by name alone when it
+// is unique in the profile; a function whose opcode count differs from
+// the profile (edited since, or profiled with the optimizer on) stays cold.
+// Returns one flag per opcode index, or NULL when nothing is hot.
+PHPAPI bool* kage_opcode_profile_hot_set(vld_bytecode_info *bytecode, kage_opcode_profile *profile, double hot_percent) {
+    size_t total = bytecode ? bytecode->total_opcodes : 0;
+    if (!profile || total == 0 || hot_percent <= 0) {
+        return NULL;
+    }
+
+    uint64_t *counts = ecalloc(total, sizeof(uint64_t));
+
+    // Functions own contiguous opcode ranges; the next start ends the previous range
+    uint32_t function_count = zend_hash_num_elements(bytecode->functions);
+    zend_long *starts = safe_emalloc(function_count + 1, sizeof(zend_long), 0);
+    uint32_t n = 0;
+    zval *first;
+
+    ZEND_HASH_FOREACH_VAL(bytecode->functions, first) {
+        starts[n++] = Z_LVAL_P(first);
+    } ZEND_HASH_FOREACH_END();
+    starts[n] = (zend_long)total;
+    qsort(starts, n, sizeof(zend_long), kage_compare_offsets);
+
+    zend_string *name;
+    ZEND_HASH_FOREACH_STR_KEY_VAL(bytecode->functions, name, first) {
+        if (!name) {
+            continue;
+        }
+
+        zend_long start = Z_LVAL_P(first);
+        zend_long end = (zend_long)total;
+        for (uint32_t i = 0; i < n; i++) {
+            if (starts[i] > start) {
+                end = starts[i];
+                break;
+            }
+        }
+
+        kage_profile_entry *entry = NULL;
+        if (bytecode->source_file) {
+            zend_string *key = zend_strpprintf(0, "%s\t%s", bytecode->source_file, ZSTR_VAL(name));
+            entry = zend_hash_find_ptr(&profile->entries, key);
+            zend_string_release(key);
+        }
+        if (!entry) {
+            entry = zend_hash_find_ptr(&profile->functions, name);
+        }
+
+        if (entry && (zend_long)entry->count == end - start) {
+            memcpy(counts + start, entry->counts, entry->count * sizeof(uint64_t));
+        }
+    } ZEND_HASH_FOREACH_END();
+    efree(starts);
+
+    // Threshold is the count of the last opcode that still fits in the budget
+    size_t budget = (size_t)((double)total * (hot_percent >= 100 ? 100 : hot_percent) / 100.0 + 0.5);
+    uint64_t *sorted = safe_emalloc(total, sizeof(uint64_t), 0);
+    size_t executed = 0;
+
+    for (size_t i = 0; i < total; i++) {
+        if (counts[i] > 0) {
+            sorted[executed++] = counts[i];
+        }
+    }
+
+    bool *hot = NULL;
+    if (budget > 0 && executed > 0) {
+        qsort(sorted, executed, sizeof(uint64_t), kage_compare_counts_desc);
+        uint64_t threshold = sorted[(budget < executed ? budget : executed) - 1];
+
+        // Everything above the threshold fits; ties fill what is left
+        hot = ecalloc(total, sizeof(bool));
+        size_t marked = 0;
+        for (size_t i = 0; i < total; i++) {
+            if (counts[i] > threshold) {
+                hot[i] = true;
+                marked++;
+            }
+        }
+        for (size_t i = 0; i < total && marked < budget; i++) {
+            if (counts[i] == threshold) {
+                hot[i] = true;
+                marked++;
+            }
+        }
+    }
+
+    efree(sorted);
+    efree(counts);
+    return hot;
+}
@@ -0,0 +1,46 @@
+/**
+ * Opcode Execution Profile for Kage Extension
+ *
+ * With kage.profile=1 every executed Zend opcode is counted per op_array,
+ * and each request appends its counts to kage.profile_file. The encoder
+ * loads that file and keeps the hottest opcodes on a cheap fast path while
+ * the rest gets the configured strong algorithm.
+ *
+ * Profile lines are "file<TAB>function<TAB>count,count,..." with one count
+ * per opcode, in the order kage_extract_opcodes() lists them. Functions are
+ * named as by kage_op_array_name(). Lines for the same function are summed.
+ */
+
+#ifndef PHP_KAGE_OPCODE_PROFILE_H
+#define PHP_KAGE_OPCODE_PROFILE_H
+
+#include "kage_context.h"
+#include "bytecode_crypto.h"
+
+// Execution counts of one op_array
+typedef struct kage_profile_entry {
+    zend_string *file;
+    zend_string *function;
+    uint32_t line_start;
+    struct kage_profile_entry *previous;  // recorder: an earlier op_array at the same address
+    uint32_t count;
+    uint64_t counts[];
+} kage_profile_entry;
+
+// Loaded profile
+typedef struct kage_opcode_profile {
+    HashTable entries;    // "file\tfunction" => kage_profile_entry
+    HashTable functions;  // "function" => entry, NULL when the name occurs in several files
+} kage_opcode_profile;
+
+// Runtime recording, driven by kage.profile and kage.profile_file
+PHPAPI void kage_opcode_profile_startup(void);
+PHPAPI void kage_opcode_profile_activate(void);
+PHPAPI void kage_opcode_profile_deactivate(void);
+
+// Encoder side
+PHPAPI kage_opcode_profile* kage_opcode_profile_load(const char *path);
+PHPAPI void kage_opcode_profile_free(kage_opcode_profile *profile);
+PHPAPI bool* kage_opcode_profile_hot_set(vld_bytecode_info *bytecode, kage_opcode_profile *profile, double hot_percent);
+
+#endif /* PHP_KAGE_OPCODE_PROFILE_H */
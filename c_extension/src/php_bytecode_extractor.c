@@ -1,16 +1,19 @@
 /**
  * PHP Bytecode Extractor for Kage Extension
  * 
- * Extracts Zend bytecode from PHP source code using tokenizer
+ * Extracts Kage VM bytecode and Zend opcodes from PHP source in-process
  */
 
 #include "php.h"
 #include "zend.h"
 #include "zend_compile.h"
 #include "kage_context.h"
+#include "php_bytecode_extractor.h"
+#include "php_compiler.h"
+#include "vm_program.h"
 
-// Function to extract PHP tokens and convert to our format
-PHPAPI kage_result_t kage_extract_php_bytecode(const char *php_code) {
+// Parse natively and lower straight to a VM image; no token arrays or text dumps
+PHPAPI kage_result_t kage_extract_php_bytecode(const char *php_code, size_t length) {
     kage_result_t result = {KAGE_SUCCESS, {NULL}};
     
     if (!php_code) {
@@ -18,104 +21,394 @@ PHPAPI kage_result_t kage_extract_php_bytecode(const char *php_code) {
         return result;
     }
     
-    // Get PHP tokens
-    zval tokens_zv;
-    php_token_get_all(php_code, strlen(php_code), &tokens_zv);
-    
-    if (Z_TYPE(tokens_zv) != IS_ARRAY) {
-        result.error = KAGE_ERROR_INVALID_INPUT;
+    zend_arena *arena;
+    zend_ast *ast = kage_php_parse(php_code, length, &arena);
+    if (!ast) {
+        result.error = KAGE_ERROR_AST;
         return result;
     }
     
-    // Convert tokens to our internal format
-    HashTable *tokens = Z_ARRVAL(tokens_zv);
-    zval *token_entry;
-    
-    // Create result string with token information
-    smart_str bytecode = {0};
-    smart_str_appends(&bytecode, "PHP_BYTECODE_DUMP\n");
-    
-    ZEND_HASH_FOREACH_VAL(tokens, token_entry) {
-        if (Z_TYPE_P(token_entry) == IS_ARRAY) {
-            zval *token_type = zend_hash_index_find(Z_ARRVAL_P(token_entry), 0);
-            zval *token_value = zend_hash_index_find(Z_ARRVAL_P(token_entry), 1);
-            
-            if (token_type && token_value && Z_TYPE_P(token_type) == IS_LONG) {
-                const char *token_name = token_name(Z_LVAL_P(token_type));
-                smart_str_appends(&bytecode, token_name);
-                smart_str_appends(&bytecode, ": ");
-                
-                if (Z_TYPE_P(token_value) == IS_STRING) {
-                    smart_str_appendl(&bytecode, Z_STRVAL_P(token_value), Z_STRLEN_P(token_value));
-                }
-                smart_str_appends(&bytecode, "\n");
-            }
-        } else if (Z_TYPE_P(token_entry) == IS_STRING) {
-            smart_str_appends(&bytecode, "RAW: ");
-            smart_str_appendl(&bytecode, Z_STRVAL_P(token_entry), Z_STRLEN_P(token_entry));
-            smart_str_appends(&bytecode, "\n");
-        }
-    } ZEND_HASH_FOREACH_END();
+    kage_compiled_program *program = kage_php_compile(ast);
+    zend_ast_destroy(ast);
+    zend_arena_destroy(arena);
+    if (!program) {
+        result.error = KAGE_ERROR_AST;
+        return result;
+    }
     
-    smart_str_0(&bytecode);
+    zend_string *image = kage_vm_program_export(program);
+    kage_compiled_program_free(program);
+    if (!image) {
+        result.error = KAGE_ERROR_VM;
+        return result;
+    }
     
     // Create result zval
     zval *result_zv = emalloc(sizeof(zval));
-    ZVAL_STRINGL(result_zv, bytecode.s->val, bytecode.s->len);
-    smart_str_free(&bytecode);
-    
-    zval_ptr_dtor(&tokens_zv); // Clean up tokens
+    ZVAL_STR(result_zv, image);
     
     result.result.value = result_zv;
     return result;
 }
 
-// Function to compile PHP code to Zend opcodes (simplified)
-PHPAPI kage_result_t kage_compile_php_code(const char *php_code) {
-    kage_result_t result = {KAGE_SUCCESS, {NULL}};
-    
-    if (!php_code) {
-        result.error = KAGE_ERROR_INVALID_INPUT;
-        return result;
+// Converts one operand to VLD notation: literals as values, !N for CVs,
+// ~N for temporaries, $N for vars; unused operands stay UNDEF
+static void kage_extract_operand(zval *dst, zend_op *opline, zend_uchar type, znode_op node) {
+    switch (type) {
+        case IS_CONST: {
+            // String literals are often interned, e.g. the function table's
+            // key for 'strlen', or live in opcache memory. The encoder
+            // transforms operands in place, so it gets its own copy.
+            zval *literal = RT_CONSTANT(opline, node);
+            if (Z_TYPE_P(literal) == IS_STRING) {
+                ZVAL_STRINGL(dst, Z_STRVAL_P(literal), Z_STRLEN_P(literal));
+            } else {
+                ZVAL_COPY(dst, literal);
+            }
+            break;
+        }
+        case IS_CV:
+            ZVAL_STR(dst, zend_strpprintf(0, "!%u", (uint32_t)EX_VAR_TO_NUM(node.var)));
+            break;
+        case IS_TMP_VAR:
+            ZVAL_STR(dst, zend_strpprintf(0, "~%u", (uint32_t)EX_VAR_TO_NUM(node.var)));
+            break;
+        case IS_VAR:
+            ZVAL_STR(dst, zend_strpprintf(0, "$%u", (uint32_t)EX_VAR_TO_NUM(node.var)));
+            break;
+        default:
+            ZVAL_UNDEF(dst);
+            break;
     }
-    
-    // Create a temporary PHP file
-    char temp_file[] = "/tmp/kage_compile_XXXXXX";
-    int fd = mkstemp(temp_file);
-    if (fd == -1) {
-        result.error = KAGE_ERROR_IO;
-        return result;
+}
+
+// Name an op_array is listed under: "{main}", "function", "Class::method"
+// or "{closure}:line". The opcode profiler records executions under the
+// same names, so a profile lines up with what the extractor returns.
+PHPAPI zend_string* kage_op_array_name(const zend_op_array *op_array) {
+    if (op_array->fn_flags & ZEND_ACC_CLOSURE) {
+        return zend_strpprintf(0, "{closure}:%u", op_array->line_start);
     }
-    
-    // Write PHP code to temp file
-    write(fd, php_code, strlen(php_code));
-    close(fd);
-    
-    // Try to compile with opcache if available
-    zval *bytecode_result = emalloc(sizeof(zval));
-    ZVAL_BOOL(bytecode_result, 0); // Default to false
-    
-    if (zend_hash_str_exists(&module_registry, "Zend OPcache", sizeof("Zend OPcache") - 1)) {
-        // Opcache is available, try to compile
-        zval file_zv;
-        ZVAL_STRING(&file_zv, temp_file);
-        
-        // Call opcache_compile_file if available
-        if (zend_function_exists("opcache_compile_file", sizeof("opcache_compile_file") - 1)) {
-            zval retval;
-            zend_call_known_function(opcache_compile_file, NULL, NULL, 1, &retval, &file_zv);
-            
-            if (Z_TYPE(retval) == IS_TRUE) {
-                ZVAL_TRUE(bytecode_result);
+    if (!op_array->function_name) {
+        return zend_string_init("{main}", sizeof("{main}") - 1, 0);
+    }
+    if (op_array->scope) {
+        return zend_strpprintf(0, "%s::%s", ZSTR_VAL(op_array->scope->name), ZSTR_VAL(op_array->function_name));
+    }
+    return zend_string_copy(op_array->function_name);
+}
+
+// Appends the opcodes of an op_array, then those of the closures and
+// conditional functions declared inside it
+static void kage_extract_op_array(vld_bytecode_info *info, zend_op_array *op_array) {
+    zend_string *name = kage_op_array_name(op_array);
+    zval first;
+    ZVAL_LONG(&first, (zend_long)info->total_opcodes);
+    zend_hash_update(info->functions, name, &first);
+    zend_string_release(name);
+
+    for (uint32_t i = 0; i < op_array->last; i++) {
+        zend_op *opline = &op_array->opcodes[i];
+        zend_op_encrypted *op = emalloc(sizeof(zend_op_encrypted));
+
+        op->lineno = (int)opline->lineno;
+        op->opcode = opline->opcode;
+        kage_extract_operand(&op->op1, opline, opline->op1_type, opline->op1);
+        kage_extract_operand(&op->op2, opline, opline->op2_type, opline->op2);
+        kage_extract_operand(&op->result, opline, opline->result_type, opline->result);
+        op->extended_value = opline->extended_value;
+        op->handler = (void *)opline->handler;
+
+        zend_hash_index_add_new_ptr(info->opcodes, info->total_opcodes++, op);
+    }
+
+    for (uint32_t i = 0; i < op_array->num_dynamic_func_defs; i++) {
+        kage_extract_op_array(info, op_array->dynamic_func_defs[i]);
+    }
+}
+
+// Copies the internal entries of a symbol table, so compile-time lookups
+// of built-in functions and classes behave as usual
+static void kage_shadow_table(HashTable *shadow, HashTable *table, bool functions) {
+    zend_string *key;
+    void *ptr;
+
+    zend_hash_init(shadow, zend_hash_num_elements(table), NULL, NULL, 0);
+    ZEND_HASH_FOREACH_STR_KEY_PTR(table, key, ptr) {
+        bool internal = functions ? ((zend_function *)ptr)->type == ZEND_INTERNAL_FUNCTION
+                                  : ((zend_class_entry *)ptr)->type == ZEND_INTERNAL_CLASS;
+        if (internal && key) {
+            zend_hash_add_new_ptr(shadow, key, ptr);
+        }
+    } ZEND_HASH_FOREACH_END();
+}
+
+// Compiles source (or a file when filename is set and source is NULL)
+// against shadow symbol tables and extracts every op_array it produced.
+// Nothing is declared in the running request: functions and classes the
+// script defines are walked and then destroyed with the shadow tables.
+static vld_bytecode_info* kage_extract_compiled(zend_string *source, zend_string *filename) {
+    HashTable functions, classes;
+    HashTable *orig_functions = CG(function_table);
+    HashTable *orig_classes = CG(class_table);
+    zend_op_array *op_array = NULL;
+
+    kage_shadow_table(&functions, orig_functions, true);
+    kage_shadow_table(&classes, orig_classes, false);
+    CG(function_table) = &functions;
+    EG(class_table) = CG(class_table) = &classes;
+
+    zend_try {
+        if (source) {
+#if PHP_VERSION_ID >= 80200
+            op_array = compile_string(source, ZSTR_VAL(filename), ZEND_COMPILE_POSITION_AFTER_OPEN_TAG);
+#else
+            op_array = compile_string(source, ZSTR_VAL(filename));
+#endif
+        } else {
+            zend_file_handle file_handle;
+            zend_stream_init_filename_ex(&file_handle, filename);
+            op_array = compile_file(&file_handle, ZEND_INCLUDE);
+            zend_destroy_file_handle(&file_handle);
+        }
+    } zend_catch {
+        /* Compile errors are fatal; put the real tables back before unwinding */
+        CG(function_table) = orig_functions;
+        EG(class_table) = CG(class_table) = orig_classes;
+        zend_bailout();
+    } zend_end_try();
+
+    CG(function_table) = orig_functions;
+    EG(class_table) = CG(class_table) = orig_classes;
+
+    vld_bytecode_info *info = NULL;
+    if (op_array) {
+        info = emalloc(sizeof(vld_bytecode_info));
+        info->functions = emalloc(sizeof(HashTable));
+        info->opcodes = emalloc(sizeof(HashTable));
+        info->source_file = estrndup(ZSTR_VAL(filename), ZSTR_LEN(filename));
+        info->total_opcodes = 0;
+        zend_hash_init(info->functions, 8, NULL, NULL, 0);
+        zend_hash_init(info->opcodes, op_array->last * 2, NULL, NULL, 0);
+
+        kage_extract_op_array(info, op_array);
+    } else {
+        kage_php_report_exception();
+    }
+
+    // Functions and classes declared by the script. When opcache serves a
+    // file, they live in shared memory (ZEND_ACC_IMMUTABLE) and stay there.
+    zend_function *func;
+    zend_class_entry *ce;
+
+    ZEND_HASH_FOREACH_PTR(&functions, func) {
+        if (func->type == ZEND_USER_FUNCTION) {
+            if (info) {
+                kage_extract_op_array(info, &func->op_array);
+            }
+            if (!(func->op_array.fn_flags & ZEND_ACC_IMMUTABLE)) {
+                destroy_op_array(&func->op_array);
+            }
+        }
+    } ZEND_HASH_FOREACH_END();
+
+    ZEND_HASH_FOREACH_PTR(&classes, ce) {
+        if (ce->type != ZEND_USER_CLASS) {
+            continue;
+        }
+        if (info) {
+            ZEND_HASH_FOREACH_PTR(&ce->function_table, func) {
+                if (func->type == ZEND_USER_FUNCTION && func->common.scope == ce) {
+                    kage_extract_op_array(info, &func->op_array);
+                }
+            } ZEND_HASH_FOREACH_END();
+        }
+        if (!(ce->ce_flags & ZEND_ACC_IMMUTABLE)) {
+            zval tmp;
+            ZVAL_PTR(&tmp, ce);
+            destroy_zend_class(&tmp);
+        }
+    } ZEND_HASH_FOREACH_END();
+
+    zend_hash_destroy(&functions);
+    zend_hash_destroy(&classes);
+
+    // opcache hands out a request copy of the main op_array whose
+    // opcodes are still shared; only the copy is ours
+    if (op_array) {
+        if (!(op_array->fn_flags & ZEND_ACC_IMMUTABLE)) {
+            destroy_op_array(op_array);
+        }
+        efree_size(op_array, sizeof(zend_op_array));
+    }
+
+    return info;
+}
+
+// Extracts the opcodes of PHP source; a leading open tag is optional
+PHPAPI vld_bytecode_info* kage_extract_opcodes(zend_string *source) {
+    if (!source) {
+        return NULL;
+    }
+
+    // compile_string() starts inside PHP code, as eval() does; the
+    // whitespace after the tag is kept so line numbers stay right
+    const char *code = ZSTR_VAL(source);
+    size_t length = ZSTR_LEN(source);
+    if (length >= 5 && zend_binary_strncasecmp(code, 5, "<?php", 5, 5) == 0 &&
+        (length == 5 || isspace((unsigned char)code[5]))) {
+        code += 5;
+        length -= 5;
+    }
+
+    zend_string *body = zend_string_init(code, length, 0);
+    zend_string *filename = zend_string_init("kage php code", sizeof("kage php code") - 1, 0);
+    vld_bytecode_info *info = kage_extract_compiled(body, filename);
+    zend_string_release(filename);
+    zend_string_release(body);
+
+    return info;
+}
+
+// Extracts the opcodes of a PHP file without including it
+PHPAPI vld_bytecode_info* kage_extract_opcodes_from_file(zend_string *filename) {
+    if (!filename || ZSTR_LEN(filename) == 0) {
+        return NULL;
+    }
+
+    return kage_extract_compiled(NULL, filename);
+}
+
+// Adds 'file', 'functions' (name => first opcode index) and 'opcodes' to
+// an array; kage_bytecode_info_import() reads the same layout back
+PHPAPI void kage_bytecode_info_export(vld_bytecode_info *info, zval *array) {
+    zval functions, opcodes;
+    array_init_size(&functions, zend_hash_num_elements(info->functions));
+    array_init_size(&opcodes, (uint32_t)info->total_opcodes);
+
+    zend_string *name;
+    zval *start;
+    ZEND_HASH_FOREACH_STR_KEY_VAL(info->functions, name, start) {
+        add_assoc_long_ex(&functions, ZSTR_VAL(name), ZSTR_LEN(name), Z_LVAL_P(start));
+    } ZEND_HASH_FOREACH_END();
+
+    zend_op_encrypted *op;
+    ZEND_HASH_FOREACH_PTR(info->opcodes, op) {
+        zval entry;
+        array_init_size(&entry, 7);
+        add_assoc_long(&entry, "line", op->lineno);
+        add_assoc_long(&entry, "opcode", op->opcode);
+        const char *opcode_name = zend_get_opcode_name(op->opcode);
+        add_assoc_string(&entry, "name", opcode_name ? opcode_name : "UNKNOWN");
+        if (Z_TYPE(op->op1) != IS_UNDEF) {
+            Z_TRY_ADDREF(op->op1);
+            add_assoc_zval(&entry, "op1", &op->op1);
+        }
+        if (Z_TYPE(op->op2) != IS_UNDEF) {
+            Z_TRY_ADDREF(op->op2);
+            add_assoc_zval(&entry, "op2", &op->op2);
+        }
+        if (Z_TYPE(op->result) != IS_UNDEF) {
+            Z_TRY_ADDREF(op->result);
+            add_assoc_zval(&entry, "result", &op->result);
+        }
+        add_assoc_long(&entry, "extended_value", op->extended_value);
+        add_next_index_zval(&opcodes, &entry);
+    } ZEND_HASH_FOREACH_END();
+
+    add_assoc_string(array, "file", info->source_file ? info->source_file : "");
+    add_assoc_zval(array, "functions", &functions);
+    add_assoc_zval(array, "opcodes", &opcodes);
+}
+
+// Operand of an exported opcode; strings are copied, since the encoder
+// transforms them in place
+static void kage_import_operand(zval *dst, HashTable *entry, const char *name) {
+    zval *value = zend_hash_str_find(entry, name, strlen(name));
+    if (!value) {
+        ZVAL_UNDEF(dst);
+    } else if (Z_TYPE_P(value) == IS_STRING) {
+        ZVAL_STRINGL(dst, Z_STRVAL_P(value), Z_STRLEN_P(value));
+    } else {
+        ZVAL_COPY(dst, value);
+    }
+}
+
+/**
+ * Rebuilds opcodes exported by kage_bytecode_info_export(), e.g. the
+ * output of kage_encrypt_bytecode() handed to kage_decrypt_bytecode().
+ *
+ * @param exported Array with 'opcodes' and optionally 'functions', 'file'
+ * @return The opcodes, or NULL if 'opcodes' is missing or not a list of arrays
+ */
+PHPAPI vld_bytecode_info* kage_bytecode_info_import(HashTable *exported) {
+    zval *opcodes = zend_hash_str_find(exported, "opcodes", sizeof("opcodes") - 1);
+    if (!opcodes || Z_TYPE_P(opcodes) != IS_ARRAY) {
+        return NULL;
+    }
+
+    vld_bytecode_info *info = emalloc(sizeof(vld_bytecode_info));
+    info->functions = emalloc(sizeof(HashTable));
+    info->opcodes = emalloc(sizeof(HashTable));
+    zval *file = zend_hash_str_find(exported, "file", sizeof("file") - 1);
+    info->source_file = file && Z_TYPE_P(file) == IS_STRING ? estrndup(Z_STRVAL_P(file), Z_STRLEN_P(file)) : NULL;
+    info->total_opcodes = 0;
+    zend_hash_init(info->functions, 8, NULL, NULL, 0);
+    zend_hash_init(info->opcodes, zend_hash_num_elements(Z_ARRVAL_P(opcodes)), NULL, NULL, 0);
+
+    zval *functions = zend_hash_str_find(exported, "functions", sizeof("functions") - 1);
+    if (functions && Z_TYPE_P(functions) == IS_ARRAY) {
+        zend_string *name;
+        zval *start;
+        ZEND_HASH_FOREACH_STR_KEY_VAL(Z_ARRVAL_P(functions), name, start) {
+            if (name) {
+                zval first;
+                ZVAL_LONG(&first, zval_get_long(start));
+                zend_hash_update(info->functions, name, &first);
             }
+        } ZEND_HASH_FOREACH_END();
+    }
+
+    zval *entry;
+    ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(opcodes), entry) {
+        if (Z_TYPE_P(entry) != IS_ARRAY) {
+            kage_free_bytecode_info(info);
+            return NULL;
         }
-        
-        zval_ptr_dtor(&file_zv);
+
+        HashTable *fields = Z_ARRVAL_P(entry);
+        zval *value;
+        zend_op_encrypted *op = ecalloc(1, sizeof(zend_op_encrypted));
+        op->lineno = (value = zend_hash_str_find(fields, "line", sizeof("line") - 1)) ? (int)zval_get_long(value) : 0;
+        op->opcode = (value = zend_hash_str_find(fields, "opcode", sizeof("opcode") - 1)) ? (unsigned char)zval_get_long(value) : 0;
+        op->extended_value = (value = zend_hash_str_find(fields, "extended_value", sizeof("extended_value") - 1))
+            ? (uint32_t)zval_get_long(value) : 0;
+        kage_import_operand(&op->op1, fields, "op1");
+        kage_import_operand(&op->op2, fields, "op2");
+        kage_import_operand(&op->result, fields, "result");
+
+        zend_hash_index_add_new_ptr(info->opcodes, info->total_opcodes++, op);
+    } ZEND_HASH_FOREACH_END();
+
+    return info;
+}
+
+// PHP Function: kage_extract_opcodes(string $source_or_file, bool $is_file = false)
+// Returns ['file' => ..., 'functions' => [name => first opcode index], 'opcodes' => [...]]
+PHP_FUNCTION(kage_extract_opcodes) {
+    zend_string *input;
+    bool is_file = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "S|b", &input, &is_file) == FAILURE) {
+        RETURN_FALSE;
     }
-    
-    // Cleanup
-    unlink(temp_file);
-    
-    result.result.value = bytecode_result;
-    return result;
+
+    vld_bytecode_info *info = is_file ? kage_extract_opcodes_from_file(input) : kage_extract_opcodes(input);
+    if (!info) {
+        RETURN_FALSE;
+    }
+
+    array_init(return_value);
+    kage_bytecode_info_export(info, return_value);
+    kage_free_bytecode_info(info);
 }
@@ -0,0 +1,33 @@
+/**
+ * PHP Bytecode Extractor for Kage Extension
+ *
+ * Compiles PHP source or files in-process and reads the opcodes straight
+ * out of the resulting zend_op_array, instead of running VLD in a
+ * subprocess and parsing its text dump.
+ */
+
+#ifndef PHP_KAGE_BYTECODE_EXTRACTOR_H
+#define PHP_KAGE_BYTECODE_EXTRACTOR_H
+
+#include "kage_context.h"
+#include "bytecode_crypto.h"
+
+// Kage VM image of a PHP-subset program (see php_compiler.h)
+PHPAPI kage_result_t kage_extract_php_bytecode(const char *php_code, size_t length);
+
+// Zend opcodes of the main script, its functions, closures and methods
+PHPAPI vld_bytecode_info* kage_extract_opcodes(zend_string *source);
+PHPAPI vld_bytecode_info* kage_extract_opcodes_from_file(zend_string *filename);
+
+// Array form of extracted or encrypted opcodes, as kage_extract_opcodes()
+// returns them, and back
+PHPAPI void kage_bytecode_info_export(vld_bytecode_info *info, zval *array);
+PHPAPI vld_bytecode_info* kage_bytecode_info_import(HashTable *exported);
+
+// Name an op_array is listed under in vld_bytecode_info.functions
+PHPAPI zend_string* kage_op_array_name(const zend_op_array *op_array);
+
+// PHP functions
+PHP_FUNCTION(kage_extract_opcodes);
+
+#endif /* PHP_KAGE_BYTECODE_EXTRACTOR_H */
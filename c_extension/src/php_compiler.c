@@ -1,220 +1,831 @@
 /**
  * PHP Compiler Implementation for Kage Extension
+ *
+ * Source is parsed by the engine's own parser into a zend_ast, which is
+ * lowered to Kage VM instructions in a single walk. Variables are
+ * resolved to numbered local slots at compile time, so the VM never
+ * looks names up while running.
  */
 
 #include "php_compiler.h"
-#include "kage_memory.h"
-#include <zend_language_parser.h>
+#include "vm_program.h"
+#include "crypto.h"
+#include "kage_stats.h"
+#include "kage_probes.h"
+#include "zend_compile.h"
+#include "zend_constants.h"
+#include "zend_exceptions.h"
 
-// Simple PHP tokenizer (basic implementation)
+/* Enclosing loop; unresolved jumps are chained through their operands */
+typedef struct php_loop {
+    struct php_loop *outer;
+    zend_long breaks;            /* head of the pending break chain, or -1 */
+    zend_long continues;         /* head of the pending continue chain, or -1 */
+} php_loop;
+
+/* Code generator state */
 typedef struct {
-    const char *source;
-    size_t position;
-    size_t length;
-    int current_token;
-    char *token_value;
-    size_t token_length;
-} php_tokenizer;
-
-static void php_tokenizer_init(php_tokenizer *tokenizer, const char *source) {
-    tokenizer->source = source;
-    tokenizer->position = 0;
-    tokenizer->length = strlen(source);
-    tokenizer->current_token = 0;
-    tokenizer->token_value = NULL;
-    tokenizer->token_length = 0;
-}
-
-static int php_tokenizer_next(php_tokenizer *tokenizer) {
-    // Skip whitespace
-    while (tokenizer->position < tokenizer->length && 
-           isspace(tokenizer->source[tokenizer->position])) {
-        tokenizer->position++;
-    }
-    
-    if (tokenizer->position >= tokenizer->length) {
-        return 0; // EOF
-    }
-    
-    char c = tokenizer->source[tokenizer->position];
-    
-    // Simple token recognition
-    if (c == '$') {
-        // Variable
-        size_t start = tokenizer->position;
-        tokenizer->position++;
-        while (tokenizer->position < tokenizer->length && 
-               (isalnum(tokenizer->source[tokenizer->position]) || tokenizer->source[tokenizer->position] == '_')) {
-            tokenizer->position++;
+    kage_instruction *instructions;
+    size_t count;
+    size_t capacity;
+    HashTable locals;            /* variable name -> slot (IS_LONG) */
+    php_loop *loop;
+    bool failed;
+} php_codegen;
+
+#define PHP_CODEGEN_INITIAL_CAPACITY 64
+
+static void php_compile_expression(php_codegen *cg, zend_ast *ast);
+static void php_compile_statement(php_codegen *cg, zend_ast *ast);
+
+/**
+ * Turns a pending exception (typically a ParseError from the engine's
+ * parser) into a warning and clears it, so callers can return FALSE.
+ */
+PHPAPI void kage_php_report_exception(void) {
+    if (!EG(exception)) {
+        return;
+    }
+
+    zend_object *ex = EG(exception);
+    zval rv_message, rv_line;
+    zval *message = zend_read_property_ex(zend_get_exception_base(ex), ex, ZSTR_KNOWN(ZEND_STR_MESSAGE), 1, &rv_message);
+    zval *line = zend_read_property_ex(zend_get_exception_base(ex), ex, ZSTR_KNOWN(ZEND_STR_LINE), 1, &rv_line);
+    zend_string *text = zval_get_string(message);
+
+    zend_error(E_WARNING, "Kage PHP: %s on line " ZEND_LONG_FMT, ZSTR_VAL(text), zval_get_long(line));
+    zend_string_release(text);
+    zend_clear_exception();
+}
+
+/**
+ * Parses PHP source with the engine's parser. A missing open tag is
+ * supplied, so bare code is accepted as eval() would; "?>" switches to
+ * inline HTML as usual. Parse errors are reported as warnings.
+ *
+ * @param php_code The source
+ * @param length Source length in bytes
+ * @param arena Receives the arena holding the AST
+ * @return Statement list, or NULL on error; release it with
+ *         zend_ast_destroy() and zend_arena_destroy()
+ */
+static zend_ast* php_parse_source(const char *php_code, size_t length, zend_arena **arena) {
+    if (php_code == NULL) {
+        zend_error(E_WARNING, "Kage PHP: Cannot parse NULL source");
+        return NULL;
+    }
+
+    zend_string *source;
+    if (length >= 2 && php_code[0] == '<' && php_code[1] == '?') {
+        source = zend_string_init(php_code, length, 0);
+    } else {
+        source = zend_string_concat2("<?php ", sizeof("<?php ") - 1, php_code, length);
+    }
+    zend_string *filename = zend_string_init("kage php code", sizeof("kage php code") - 1, 0);
+
+    zend_arena *ast_arena = NULL;
+    zend_ast *ast = zend_compile_string_to_ast(source, &ast_arena, filename);
+
+    zend_string_release(filename);
+    zend_string_release(source);
+
+    if (ast == NULL) {
+        /* The arena was released by the engine */
+        kage_php_report_exception();
+        return NULL;
+    }
+
+    *arena = ast_arena;
+    return ast;
+}
+
+/**
+ * Timed wrapper around php_parse_source(); see there.
+ */
+PHPAPI zend_ast* kage_php_parse(const char *php_code, size_t length, zend_arena **arena) {
+    KAGE_PROBE1(parse__entry, length);
+    uint64_t started = kage_stats_now();
+    zend_ast *ast = php_parse_source(php_code, length, arena);
+    kage_stats_record(KAGE_STAT_PARSE, length, started, ast != NULL);
+    KAGE_PROBE2(parse__return, length, ast ? SUCCESS : FAILURE);
+    return ast;
+}
+
+/**
+ * Reports a compile error once; later errors are usually follow-ups.
+ *
+ * @param cg The code generator
+ * @param ast Offending node
+ * @param message What went wrong
+ */
+static void php_codegen_error(php_codegen *cg, zend_ast *ast, const char *message) {
+    if (!cg->failed) {
+        zend_error(E_WARNING, "Kage PHP: %s on line %u", message, zend_ast_get_lineno(ast));
+        cg->failed = true;
+    }
+}
+
+/**
+ * Appends an instruction with a NULL operand.
+ *
+ * @param cg The code generator
+ * @param opcode The opcode
+ * @return Index of the new instruction
+ */
+static size_t php_emit(php_codegen *cg, kage_opcode opcode) {
+    if (cg->count == cg->capacity) {
+        cg->capacity = cg->capacity ? cg->capacity * 2 : PHP_CODEGEN_INITIAL_CAPACITY;
+        cg->instructions = safe_erealloc(cg->instructions, cg->capacity, sizeof(kage_instruction), 0);
+    }
+
+    kage_instruction *instr = &cg->instructions[cg->count];
+    instr->opcode = opcode;
+    ZVAL_NULL(&instr->operand);
+    return cg->count++;
+}
+
+static size_t php_emit_long(php_codegen *cg, kage_opcode opcode, zend_long operand) {
+    size_t index = php_emit(cg, opcode);
+    ZVAL_LONG(&cg->instructions[index].operand, operand);
+    return index;
+}
+
+static void php_emit_push(php_codegen *cg, zval *value) {
+    size_t index = php_emit(cg, KAGE_OP_PUSH);
+    ZVAL_COPY(&cg->instructions[index].operand, value);
+}
+
+/* Points a previously emitted jump at the next instruction */
+static void php_patch_jump(php_codegen *cg, size_t jump) {
+    ZVAL_LONG(&cg->instructions[jump].operand, (zend_long)cg->count);
+}
+
+/* Emits a jump whose target is not known yet, linking it into a chain */
+static void php_emit_pending_jump(php_codegen *cg, zend_long *chain) {
+    *chain = (zend_long)php_emit_long(cg, KAGE_OP_JMP, *chain);
+}
+
+/* Resolves every jump in a chain to the given target */
+static void php_patch_chain(php_codegen *cg, zend_long chain, size_t target) {
+    while (chain >= 0) {
+        zval *operand = &cg->instructions[chain].operand;
+        chain = Z_LVAL_P(operand);
+        ZVAL_LONG(operand, (zend_long)target);
+    }
+}
+
+/**
+ * Returns the local slot of a variable, allocating one on first use.
+ *
+ * @param cg The code generator
+ * @param var ZEND_AST_VAR node
+ * @return Slot index, or -1 if the variable cannot live in a slot
+ */
+static zend_long php_local_slot(php_codegen *cg, zend_ast *var) {
+    if (var->kind != ZEND_AST_VAR || var->child[0]->kind != ZEND_AST_ZVAL ||
+        Z_TYPE_P(zend_ast_get_zval(var->child[0])) != IS_STRING) {
+        php_codegen_error(cg, var, "Only plain variables are supported");
+        return -1;
+    }
+
+    zend_string *name = zend_ast_get_str(var->child[0]);
+    zval *slot = zend_hash_find(&cg->locals, name);
+    if (slot != NULL) {
+        return Z_LVAL_P(slot);
+    }
+
+    if (zend_string_equals_literal(name, "this") || zend_is_auto_global(name)) {
+        php_codegen_error(cg, var, "$this and superglobals are not supported");
+        return -1;
+    }
+
+    zval fresh;
+    ZVAL_LONG(&fresh, (zend_long)zend_hash_num_elements(&cg->locals));
+    zend_hash_add_new(&cg->locals, name, &fresh);
+    return Z_LVAL(fresh);
+}
+
+/**
+ * Maps a Zend binary operator to the VM opcode.
+ *
+ * @param zend_opcode ZEND_ADD, ZEND_IS_EQUAL, ...
+ * @param opcode Receives the VM opcode
+ * @return true if the operator is supported
+ */
+static bool php_binary_opcode(uint32_t zend_opcode, kage_opcode *opcode) {
+    switch (zend_opcode) {
+        case ZEND_ADD:                 *opcode = KAGE_OP_ADD;           return true;
+        case ZEND_SUB:                 *opcode = KAGE_OP_SUB;           return true;
+        case ZEND_MUL:                 *opcode = KAGE_OP_MUL;           return true;
+        case ZEND_DIV:                 *opcode = KAGE_OP_DIV;           return true;
+        case ZEND_MOD:                 *opcode = KAGE_OP_MOD;           return true;
+        case ZEND_CONCAT:              *opcode = KAGE_OP_CONCAT;        return true;
+        case ZEND_IS_EQUAL:            *opcode = KAGE_OP_EQUAL;         return true;
+        case ZEND_IS_NOT_EQUAL:        *opcode = KAGE_OP_NOT_EQUAL;     return true;
+        case ZEND_IS_IDENTICAL:        *opcode = KAGE_OP_IDENTICAL;     return true;
+        case ZEND_IS_NOT_IDENTICAL:    *opcode = KAGE_OP_NOT_IDENTICAL; return true;
+        case ZEND_IS_SMALLER:          *opcode = KAGE_OP_LESS;          return true;
+        case ZEND_IS_SMALLER_OR_EQUAL: *opcode = KAGE_OP_LESS_EQUAL;    return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Resolves a constant at compile time: true/false/null and constants
+ * already defined by the engine or extensions.
+ *
+ * @param cg The code generator
+ * @param ast ZEND_AST_CONST node
+ */
+static void php_compile_constant(php_codegen *cg, zend_ast *ast) {
+    zend_string *name = zend_ast_get_str(ast->child[0]);
+    zval value;
+
+    if (zend_string_equals_literal_ci(name, "true")) {
+        ZVAL_TRUE(&value);
+    } else if (zend_string_equals_literal_ci(name, "false")) {
+        ZVAL_FALSE(&value);
+    } else if (zend_string_equals_literal_ci(name, "null")) {
+        ZVAL_NULL(&value);
+    } else {
+        zval *constant = zend_get_constant(name);
+        if (constant == NULL) {
+            php_codegen_error(cg, ast, "Undefined constant");
+            return;
         }
-        tokenizer->token_value = estrndup(tokenizer->source + start, tokenizer->position - start);
-        tokenizer->token_length = tokenizer->position - start;
-        return PHP_NODE_VARIABLE;
-    }
-    
-    if (c == '=' && tokenizer->position + 1 < tokenizer->length && tokenizer->source[tokenizer->position + 1] == '=') {
-        tokenizer->position += 2;
-        return PHP_OP_ASSIGN;
-    }
-    
-    if (c == '"') {
-        // String literal
-        size_t start = tokenizer->position;
-        tokenizer->position++;
-        while (tokenizer->position < tokenizer->length && tokenizer->source[tokenizer->position] != '"') {
-            if (tokenizer->source[tokenizer->position] == '\\') {
-                tokenizer->position++; // Skip escaped character
-            }
-            tokenizer->position++;
+        php_emit_push(cg, constant);
+        return;
+    }
+
+    php_emit_push(cg, &value);
+}
+
+/**
+ * Emits a call: callee, arguments, then CALL with the argument count.
+ *
+ * @param cg The code generator
+ * @param ast ZEND_AST_CALL node
+ */
+static void php_compile_call(php_codegen *cg, zend_ast *ast) {
+    zend_ast *name = ast->child[0];
+
+    if (ast->child[1]->kind != ZEND_AST_ARG_LIST) {
+        php_codegen_error(cg, ast, "First-class callable syntax is not supported");
+        return;
+    }
+
+    /* Named functions are pushed by name; anything else is evaluated */
+    if (name->kind == ZEND_AST_ZVAL) {
+        php_emit_push(cg, zend_ast_get_zval(name));
+    } else {
+        php_compile_expression(cg, name);
+    }
+
+    zend_ast_list *args = zend_ast_get_list(ast->child[1]);
+    for (uint32_t i = 0; i < args->children; i++) {
+        zend_ast *arg = args->child[i];
+        if (arg->kind == ZEND_AST_UNPACK || arg->kind == ZEND_AST_NAMED_ARG) {
+            php_codegen_error(cg, arg, "Unpacked and named arguments are not supported");
+            return;
         }
-        if (tokenizer->position < tokenizer->length) {
-            tokenizer->position++; // Skip closing quote
+        php_compile_expression(cg, arg);
+    }
+
+    php_emit_long(cg, KAGE_OP_CALL, (zend_long)args->children);
+}
+
+/**
+ * Emits code that leaves the value of an expression on the stack.
+ *
+ * @param cg The code generator
+ * @param ast Expression node
+ */
+static void php_compile_expression(php_codegen *cg, zend_ast *ast) {
+    kage_opcode opcode;
+    zend_long slot;
+    zval value;
+
+    if (cg->failed) {
+        return;
+    }
+
+    switch (ast->kind) {
+        case ZEND_AST_ZVAL:
+            php_emit_push(cg, zend_ast_get_zval(ast));
+            return;
+
+        case ZEND_AST_CONST:
+            php_compile_constant(cg, ast);
+            return;
+
+        case ZEND_AST_VAR:
+            if ((slot = php_local_slot(cg, ast)) >= 0) {
+                php_emit_long(cg, KAGE_OP_LOAD, slot);
+            }
+            return;
+
+        case ZEND_AST_ASSIGN:
+            if ((slot = php_local_slot(cg, ast->child[0])) >= 0) {
+                php_compile_expression(cg, ast->child[1]);
+                php_emit_long(cg, KAGE_OP_STORE, slot);
+            }
+            return;
+
+        case ZEND_AST_ASSIGN_OP:
+            if (!php_binary_opcode(ast->attr, &opcode) || opcode > KAGE_OP_CONCAT) {
+                php_codegen_error(cg, ast, "Unsupported assignment operator");
+                return;
+            }
+            if ((slot = php_local_slot(cg, ast->child[0])) >= 0) {
+                php_emit_long(cg, KAGE_OP_LOAD, slot);
+                php_compile_expression(cg, ast->child[1]);
+                php_emit(cg, opcode);
+                php_emit_long(cg, KAGE_OP_STORE, slot);
+            }
+            return;
+
+        case ZEND_AST_BINARY_OP:
+            if (!php_binary_opcode(ast->attr, &opcode)) {
+                php_codegen_error(cg, ast, "Unsupported operator");
+                return;
+            }
+            php_compile_expression(cg, ast->child[0]);
+            php_compile_expression(cg, ast->child[1]);
+            php_emit(cg, opcode);
+            return;
+
+        case ZEND_AST_GREATER:
+        case ZEND_AST_GREATER_EQUAL:
+            php_compile_expression(cg, ast->child[0]);
+            php_compile_expression(cg, ast->child[1]);
+            php_emit(cg, ast->kind == ZEND_AST_GREATER ? KAGE_OP_GREATER : KAGE_OP_GREATER_EQUAL);
+            return;
+
+        case ZEND_AST_AND:
+        case ZEND_AST_OR: {
+            /* a && b: a; JMPZ short; b; BOOL; JMP end; short: PUSH false; end: */
+            bool is_and = ast->kind == ZEND_AST_AND;
+            ZVAL_BOOL(&value, !is_and);
+
+            php_compile_expression(cg, ast->child[0]);
+            size_t to_short = php_emit(cg, is_and ? KAGE_OP_JMPZ : KAGE_OP_JMPNZ);
+            php_compile_expression(cg, ast->child[1]);
+            php_emit(cg, KAGE_OP_BOOL);
+            size_t to_end = php_emit(cg, KAGE_OP_JMP);
+            php_patch_jump(cg, to_short);
+            php_emit_push(cg, &value);
+            php_patch_jump(cg, to_end);
+            return;
         }
-        tokenizer->token_value = estrndup(tokenizer->source + start, tokenizer->position - start);
-        tokenizer->token_length = tokenizer->position - start;
-        return PHP_NODE_STRING;
-    }
-    
-    // Keywords
-    if (tokenizer->position + 4 < tokenizer->length && 
-        strncmp(tokenizer->source + tokenizer->position, "echo", 4) == 0) {
-        tokenizer->position += 4;
-        return PHP_NODE_ECHO_STATEMENT;
-    }
-    
-    if (tokenizer->position + 6 < tokenizer->length && 
-        strncmp(tokenizer->source + tokenizer->position, "return", 6) == 0) {
-        tokenizer->position += 6;
-        return PHP_NODE_RETURN_STATEMENT;
-    }
-    
-    return -1; // Unknown token
-}
-
-// PHP AST parser (extended version)
-static kage_ast_node* php_parse_expression(php_tokenizer *tokenizer, kage_scope *scope) {
-    int token = php_tokenizer_next(tokenizer);
-    
-    switch (token) {
-        case PHP_NODE_STRING: {
-            kage_ast_node *node = kage_ast_node_create(PHP_NODE_STRING);
-            if (node) {
-                ZVAL_STRINGL(&node->value, tokenizer->token_value, tokenizer->token_length);
-                if (scope) kage_scope_register_ast_node(scope, node);
-            }
-            efree(tokenizer->token_value);
-            return node;
+
+        case ZEND_AST_CONDITIONAL: {
+            if (ast->child[1] == NULL) {
+                php_codegen_error(cg, ast, "The ?: shorthand is not supported");
+                return;
+            }
+            php_compile_expression(cg, ast->child[0]);
+            size_t to_else = php_emit(cg, KAGE_OP_JMPZ);
+            php_compile_expression(cg, ast->child[1]);
+            size_t to_end = php_emit(cg, KAGE_OP_JMP);
+            php_patch_jump(cg, to_else);
+            php_compile_expression(cg, ast->child[2]);
+            php_patch_jump(cg, to_end);
+            return;
         }
-        
-        case PHP_NODE_VARIABLE: {
-            kage_ast_node *node = kage_ast_node_create(PHP_NODE_VARIABLE);
-            if (node) {
-                ZVAL_STRINGL(&node->value, tokenizer->token_value, tokenizer->token_length);
-                if (scope) kage_scope_register_ast_node(scope, node);
-            }
-            efree(tokenizer->token_value);
-            return node;
+
+        case ZEND_AST_UNARY_OP:
+            if (ast->attr != ZEND_BOOL_NOT) {
+                php_codegen_error(cg, ast, "Unsupported operator");
+                return;
+            }
+            php_compile_expression(cg, ast->child[0]);
+            php_emit(cg, KAGE_OP_NOT);
+            return;
+
+        case ZEND_AST_UNARY_MINUS:
+            php_compile_expression(cg, ast->child[0]);
+            php_emit(cg, KAGE_OP_NEGATE);
+            return;
+
+        case ZEND_AST_UNARY_PLUS:
+            /* Numeric conversion, as unary plus does */
+            ZVAL_LONG(&value, 1);
+            php_compile_expression(cg, ast->child[0]);
+            php_emit_push(cg, &value);
+            php_emit(cg, KAGE_OP_MUL);
+            return;
+
+        case ZEND_AST_PRE_INC:
+        case ZEND_AST_PRE_DEC:
+        case ZEND_AST_POST_INC:
+        case ZEND_AST_POST_DEC: {
+            bool post = ast->kind == ZEND_AST_POST_INC || ast->kind == ZEND_AST_POST_DEC;
+            bool inc = ast->kind == ZEND_AST_PRE_INC || ast->kind == ZEND_AST_POST_INC;
+
+            if ((slot = php_local_slot(cg, ast->child[0])) < 0) {
+                return;
+            }
+            if (post) {
+                /* Old value stays below the updated one */
+                php_emit_long(cg, KAGE_OP_LOAD, slot);
+            }
+            ZVAL_LONG(&value, 1);
+            php_emit_long(cg, KAGE_OP_LOAD, slot);
+            php_emit_push(cg, &value);
+            php_emit(cg, inc ? KAGE_OP_ADD : KAGE_OP_SUB);
+            php_emit_long(cg, KAGE_OP_STORE, slot);
+            if (post) {
+                php_emit(cg, KAGE_OP_POP);
+            }
+            return;
         }
-        
+
+        case ZEND_AST_ENCAPS_LIST: {
+            /* "a $b c" is a concatenation chain starting from a string */
+            zend_ast_list *parts = zend_ast_get_list(ast);
+            uint32_t first = 0;
+
+            if (parts->children > 0 && parts->child[0]->kind == ZEND_AST_ZVAL) {
+                php_compile_expression(cg, parts->child[0]);
+                first = 1;
+            } else {
+                ZVAL_EMPTY_STRING(&value);
+                php_emit_push(cg, &value);
+            }
+            for (uint32_t i = first; i < parts->children; i++) {
+                php_compile_expression(cg, parts->child[i]);
+                php_emit(cg, KAGE_OP_CONCAT);
+            }
+            return;
+        }
+
+        case ZEND_AST_CALL:
+            php_compile_call(cg, ast);
+            return;
+
         default:
-            return NULL;
+            php_codegen_error(cg, ast, "Unsupported syntax");
+            return;
     }
 }
 
-static kage_ast_node* php_parse_statement(php_tokenizer *tokenizer, kage_scope *scope) {
-    int token = php_tokenizer_next(tokenizer);
-    
-    switch (token) {
-        case PHP_NODE_ECHO_STATEMENT: {
-            kage_ast_node *node = kage_ast_node_create(PHP_NODE_ECHO_STATEMENT);
-            if (node && scope) kage_scope_register_ast_node(scope, node);
-            
-            // Parse expression to echo
-            node->left = php_parse_expression(tokenizer, scope);
-            return node;
+/**
+ * Emits a jump out of, or to the next iteration of, an enclosing loop.
+ *
+ * @param cg The code generator
+ * @param ast ZEND_AST_BREAK or ZEND_AST_CONTINUE node
+ */
+static void php_compile_loop_jump(php_codegen *cg, zend_ast *ast) {
+    zend_long depth = 1;
+    php_loop *loop = cg->loop;
+
+    if (ast->child[0] != NULL) {
+        zval *levels = zend_ast_get_zval(ast->child[0]);
+        depth = Z_TYPE_P(levels) == IS_LONG ? Z_LVAL_P(levels) : 0;
+    }
+
+    while (loop != NULL && depth > 1) {
+        loop = loop->outer;
+        depth--;
+    }
+
+    if (loop == NULL || depth < 1) {
+        php_codegen_error(cg, ast, ast->kind == ZEND_AST_BREAK ? "'break' not in the loop context" : "'continue' not in the loop context");
+        return;
+    }
+
+    php_emit_pending_jump(cg, ast->kind == ZEND_AST_BREAK ? &loop->breaks : &loop->continues);
+}
+
+/**
+ * Compiles a loop body with its own break/continue frame.
+ *
+ * @param cg The code generator
+ * @param body Body statement
+ * @param loop Frame to fill in; the caller resolves its chains
+ */
+static void php_compile_loop_body(php_codegen *cg, zend_ast *body, php_loop *loop) {
+    loop->outer = cg->loop;
+    loop->breaks = -1;
+    loop->continues = -1;
+
+    cg->loop = loop;
+    php_compile_statement(cg, body);
+    cg->loop = loop->outer;
+}
+
+/* Evaluates a for() expression list, optionally keeping the last value */
+static void php_compile_expression_list(php_codegen *cg, zend_ast *list_ast, bool keep_last) {
+    if (list_ast == NULL) {
+        return;
+    }
+
+    zend_ast_list *list = zend_ast_get_list(list_ast);
+    for (uint32_t i = 0; i < list->children; i++) {
+        php_compile_expression(cg, list->child[i]);
+        if (!keep_last || i + 1 < list->children) {
+            php_emit(cg, KAGE_OP_POP);
         }
-        
-        case PHP_NODE_RETURN_STATEMENT: {
-            kage_ast_node *node = kage_ast_node_create(PHP_NODE_RETURN_STATEMENT);
-            if (node && scope) kage_scope_register_ast_node(scope, node);
-            
-            // Parse return expression
-            node->left = php_parse_expression(tokenizer, scope);
-            return node;
+    }
+}
+
+/**
+ * Emits code for a statement; the stack is balanced afterwards.
+ *
+ * @param cg The code generator
+ * @param ast Statement node
+ */
+static void php_compile_statement(php_codegen *cg, zend_ast *ast) {
+    php_loop loop;
+
+    if (ast == NULL || cg->failed) {
+        return;
+    }
+
+    switch (ast->kind) {
+        case ZEND_AST_STMT_LIST: {
+            zend_ast_list *list = zend_ast_get_list(ast);
+            for (uint32_t i = 0; i < list->children; i++) {
+                php_compile_statement(cg, list->child[i]);
+            }
+            return;
+        }
+
+        case ZEND_AST_ECHO:
+            php_compile_expression(cg, ast->child[0]);
+            php_emit(cg, KAGE_OP_ECHO);
+            return;
+
+        case ZEND_AST_RETURN:
+            if (ast->child[0] != NULL) {
+                php_compile_expression(cg, ast->child[0]);
+            } else {
+                php_emit(cg, KAGE_OP_PUSH);
+            }
+            php_emit(cg, KAGE_OP_RETURN);
+            return;
+
+        case ZEND_AST_IF: {
+            /* Each taken branch jumps to the end; those jumps form a chain */
+            zend_ast_list *elems = zend_ast_get_list(ast);
+            zend_long to_end = -1;
+
+            for (uint32_t i = 0; i < elems->children; i++) {
+                zend_ast *elem = elems->child[i];
+                if (elem->child[0] == NULL) {
+                    php_compile_statement(cg, elem->child[1]);
+                    break;
+                }
+
+                php_compile_expression(cg, elem->child[0]);
+                size_t to_next = php_emit(cg, KAGE_OP_JMPZ);
+                php_compile_statement(cg, elem->child[1]);
+                if (i + 1 < elems->children) {
+                    php_emit_pending_jump(cg, &to_end);
+                }
+                php_patch_jump(cg, to_next);
+            }
+
+            php_patch_chain(cg, to_end, cg->count);
+            return;
+        }
+
+        case ZEND_AST_WHILE: {
+            size_t top = cg->count;
+            php_compile_expression(cg, ast->child[0]);
+            size_t to_end = php_emit(cg, KAGE_OP_JMPZ);
+            php_compile_loop_body(cg, ast->child[1], &loop);
+            php_emit_long(cg, KAGE_OP_JMP, (zend_long)top);
+            php_patch_jump(cg, to_end);
+            php_patch_chain(cg, loop.continues, top);
+            php_patch_chain(cg, loop.breaks, cg->count);
+            return;
         }
-        
+
+        case ZEND_AST_DO_WHILE: {
+            size_t top = cg->count;
+            php_compile_loop_body(cg, ast->child[0], &loop);
+            size_t condition = cg->count;
+            php_compile_expression(cg, ast->child[1]);
+            php_emit_long(cg, KAGE_OP_JMPNZ, (zend_long)top);
+            php_patch_chain(cg, loop.continues, condition);
+            php_patch_chain(cg, loop.breaks, cg->count);
+            return;
+        }
+
+        case ZEND_AST_FOR: {
+            /* for (init; conditions; step) body; the last condition decides */
+            php_compile_expression_list(cg, ast->child[0], false);
+            size_t top = cg->count;
+            zend_long to_end = -1;
+            if (ast->child[1] != NULL) {
+                php_compile_expression_list(cg, ast->child[1], true);
+                to_end = (zend_long)php_emit(cg, KAGE_OP_JMPZ);
+            }
+            php_compile_loop_body(cg, ast->child[3], &loop);
+            size_t step = cg->count;
+            php_compile_expression_list(cg, ast->child[2], false);
+            php_emit_long(cg, KAGE_OP_JMP, (zend_long)top);
+            if (to_end >= 0) {
+                php_patch_jump(cg, (size_t)to_end);
+            }
+            php_patch_chain(cg, loop.continues, step);
+            php_patch_chain(cg, loop.breaks, cg->count);
+            return;
+        }
+
+        case ZEND_AST_BREAK:
+        case ZEND_AST_CONTINUE:
+            php_compile_loop_jump(cg, ast);
+            return;
+
         default:
-            return NULL;
+            /* Expression statement */
+            php_compile_expression(cg, ast);
+            php_emit(cg, KAGE_OP_POP);
+            return;
     }
 }
 
+/**
+ * Compiles a statement list from kage_php_parse() into a VM program.
+ * Falling off the end returns NULL, like an include without return.
+ *
+ * @param ast Statement list
+ * @return Compiled program, or NULL on error
+ */
+static kage_compiled_program* php_compile_program(zend_ast *ast) {
+    if (ast == NULL) {
+        return NULL;
+    }
+
+    php_codegen cg = {NULL, 0, 0, {0}, NULL, false};
+    zend_hash_init(&cg.locals, 8, NULL, NULL, 0);
+
+    php_compile_statement(&cg, ast);
+    php_emit(&cg, KAGE_OP_PUSH);
+    php_emit(&cg, KAGE_OP_RETURN);
+
+    uint32_t local_count = zend_hash_num_elements(&cg.locals);
+    zend_hash_destroy(&cg.locals);
+
+    if (cg.failed) {
+        for (size_t i = 0; i < cg.count; i++) {
+            zval_ptr_dtor(&cg.instructions[i].operand);
+        }
+        efree(cg.instructions);
+        return NULL;
+    }
+
+    kage_compiled_program *compiled = emalloc(sizeof(kage_compiled_program));
+    compiled->instructions = erealloc(cg.instructions, cg.count * sizeof(kage_instruction));
+    compiled->instruction_count = cg.count;
+    compiled->requires_key_check = false;
+    compiled->local_count = local_count;
+    compiled->pool = NULL;
+    return compiled;
+}
+
+/**
+ * Timed wrapper around php_compile_program(); see there.
+ */
+PHPAPI kage_compiled_program* kage_php_compile(zend_ast *ast) {
+    uint64_t started = kage_stats_now();
+    kage_compiled_program *program = php_compile_program(ast);
+    kage_stats_record(KAGE_STAT_LOWER, 0, started, program != NULL);
+    return program;
+}
+
 // Main PHP compiler function
-PHPAPI kage_result_t kage_compile_php_to_bytecode(const char *php_code, const char *encryption_key) {
+PHPAPI kage_result_t kage_compile_php_to_bytecode(const char *php_code, size_t length, zend_string *encryption_key, zval *bytecode) {
     kage_result_t result = {KAGE_SUCCESS, {NULL}};
-    
-    if (!php_code || !encryption_key) {
+
+    if (!php_code || !encryption_key || !bytecode) {
         result.error = KAGE_ERROR_INVALID_INPUT;
         return result;
     }
-    
-    KAGE_WITH_SCOPE(scope,
-        // Initialize tokenizer
-        php_tokenizer tokenizer;
-        php_tokenizer_init(&tokenizer, php_code);
-        
-        // Create program node
-        kage_ast_node *program = kage_ast_node_create(PHP_NODE_PROGRAM);
-        if (!program) {
-            result.error = KAGE_ERROR_MEMORY;
-            return result;
-        }
-        kage_scope_register_ast_node(scope, program);
-        
-        // Parse statements
-        kage_ast_node *current = program;
-        while (tokenizer.position < tokenizer.length) {
-            kage_ast_node *stmt = php_parse_statement(&tokenizer, scope);
-            if (!stmt) break;
-            
-            current->next = stmt;
-            current = stmt;
-        }
-        
-        // Generate bytecode
-        kage_vm_state *vm_state = NULL;
-        if (kage_ast_to_bytecode(program, vm_state) != SUCCESS) {
-            result.error = KAGE_ERROR_AST;
-            return result;
-        }
-        
-        // Encrypt bytecode with Kage encryption
-        zval encrypted_bytecode;
-        if (kage_internal_encrypt(&encrypted_bytecode, /* bytecode data */, encryption_key) != SUCCESS) {
-            result.error = KAGE_ERROR_CRYPTO;
-            return result;
-        }
-        
-        result.result.value = &encrypted_bytecode;
-    );
-    
+
+    zend_arena *arena;
+    zend_ast *ast = kage_php_parse(php_code, length, &arena);
+    if (!ast) {
+        result.error = KAGE_ERROR_AST;
+        return result;
+    }
+
+    kage_compiled_program *program = kage_php_compile(ast);
+    zend_ast_destroy(ast);
+    zend_arena_destroy(arena);
+    if (!program) {
+        result.error = KAGE_ERROR_AST;
+        return result;
+    }
+
+    // Serialise with the VM image format, then encrypt the image
+    zend_string *image = kage_vm_program_export(program);
+    kage_compiled_program_free(program);
+    if (!image) {
+        result.error = KAGE_ERROR_VM;
+        return result;
+    }
+
+    zval plain;
+    ZVAL_STR(&plain, image);
+    if (kage_internal_encrypt(bytecode, &plain, encryption_key) != SUCCESS) {
+        result.error = KAGE_ERROR_CRYPTO;
+    }
+    zval_ptr_dtor(&plain);
+
+    result.result.value = bytecode;
     return result;
 }
 
-PHPAPI kage_result_t kage_execute_php_bytecode(const char *bytecode_data, size_t data_length, zval *result) {
+PHPAPI kage_result_t kage_execute_php_bytecode(const char *bytecode_data, size_t data_length, zend_string *encryption_key, zval *result) {
     kage_result_t kage_result = {KAGE_SUCCESS, {NULL}};
-    
-    if (!bytecode_data || !result) {
+
+    if (!bytecode_data || !encryption_key || !result) {
         kage_result.error = KAGE_ERROR_INVALID_INPUT;
         return kage_result;
     }
-    
-    // TODO: Implement bytecode execution
-    // This would involve:
-    // 1. Decrypt the bytecode
-    // 2. Load it into VM
-    // 3. Execute instructions
-    // 4. Return result
-    
-    ZVAL_NULL(result);
+
+    // Decrypt the image
+    zval encrypted, plain;
+    ZVAL_STRINGL(&encrypted, bytecode_data, data_length);
+    int status = kage_internal_decrypt(&plain, &encrypted, encryption_key);
+    zval_ptr_dtor(&encrypted);
+    if (status != SUCCESS) {
+        kage_result.error = KAGE_ERROR_CRYPTO;
+        return kage_result;
+    }
+
+    // Load it into a program; constants are copied out of the image. It
+    // passed authenticated decryption, so its function calls may run.
+    kage_vm_image image;
+    kage_compiled_program *program = NULL;
+    if (kage_vm_image_open(&image, Z_STRVAL(plain), Z_STRLEN(plain)) == SUCCESS) {
+        program = kage_vm_program_import(&image, true);
+    }
+    zval_ptr_dtor(&plain);
+    if (!program) {
+        kage_result.error = KAGE_ERROR_VM;
+        return kage_result;
+    }
+
+    // Execute instructions and return the result
+    if (kage_compiled_program_execute(program, encryption_key, result) != SUCCESS) {
+        kage_result.error = KAGE_ERROR_VM;
+    } else {
+        kage_result.result.value = result;
+    }
+
+    kage_compiled_program_free(program);
     return kage_result;
 }
+
+/**
+ * PHP Function: kage_compile_php
+ *
+ * @param string $php_code PHP source in the supported subset
+ * @param string $encryption_key 32-byte key
+ * @return string|false Encrypted program
+ */
+PHP_FUNCTION(kage_compile_php) {
+    zend_string *code;
+    zend_string *key;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "SS", &code, &key) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    zval bytecode;
+    kage_result_t result = kage_compile_php_to_bytecode(ZSTR_VAL(code), ZSTR_LEN(code), key, &bytecode);
+    if (result.error != KAGE_SUCCESS) {
+        RETURN_FALSE;
+    }
+
+    RETURN_ZVAL(&bytecode, 0, 1);
+}
+
+/**
+ * PHP Function: kage_execute_php_bytecode
+ *
+ * @param string $bytecode_data Output of kage_compile_php()
+ * @param string $encryption_key The key it was compiled with
+ * @return mixed The program's return value, or FALSE on error
+ */
+PHP_FUNCTION(kage_execute_php_bytecode) {
+    zend_string *data;
+    zend_string *key;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "SS", &data, &key) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    zval value;
+    kage_result_t result = kage_execute_php_bytecode(ZSTR_VAL(data), ZSTR_LEN(data), key, &value);
+    if (result.error != KAGE_SUCCESS) {
+        RETURN_FALSE;
+    }
+
+    RETURN_ZVAL(&value, 0, 1);
+}
@@ -1,51 +1,38 @@
 /**
  * PHP Compiler for Kage Extension
- * 
- * Extends Kage to compile full PHP syntax to Zend bytecode
+ *
+ * Compiles a subset of PHP to Kage VM programs:
+ *   statements   echo, return, if/elseif/else, while, do-while, for,
+ *                blocks, inline HTML, expressions
+ *   expressions  literals, constants, $variables, assignment
+ *                (= += -= *= /= .= %=), arithmetic, concatenation,
+ *                interpolated strings, comparison, && || !, ?:, ++/--,
+ *                calls to functions by name
+ *
+ * Source is parsed by the engine itself (zend_compile_string_to_ast) and
+ * the resulting zend_ast is lowered in one walk. Programs are exported
+ * with the Kage VM image format (vm_program.h) and encrypted with the
+ * Kage key for distribution.
  */
 
 #ifndef PHP_KAGE_COMPILER_H
 #define PHP_KAGE_COMPILER_H
 
 #include "kage_context.h"
+#include "zend_ast.h"
+#include "zend_arena.h"
 
-// PHP opcodes that we can generate
-typedef enum {
-    PHP_OP_NOP = 0,
-    PHP_OP_ADD,
-    PHP_OP_SUB,
-    PHP_OP_MUL,
-    PHP_OP_DIV,
-    PHP_OP_ASSIGN,
-    PHP_OP_ECHO,
-    PHP_OP_RETURN,
-    // ... more opcodes
-} php_opcode;
-
-// Extended AST node types for full PHP syntax
-typedef enum {
-    // Existing Kage types
-    PHP_NODE_PROGRAM = KAGE_AST_PROGRAM,
-    PHP_NODE_ENCRYPT = KAGE_AST_ENCRYPT,
-    PHP_NODE_DECRYPT = KAGE_AST_DECRYPT,
-    PHP_NODE_STRING = KAGE_AST_STRING,
-    
-    // New PHP syntax types
-    PHP_NODE_VARIABLE,
-    PHP_NODE_ASSIGNMENT,
-    PHP_NODE_BINARY_OP,
-    PHP_NODE_FUNCTION_CALL,
-    PHP_NODE_IF_STATEMENT,
-    PHP_NODE_WHILE_LOOP,
-    PHP_NODE_ECHO_STATEMENT,
-    PHP_NODE_RETURN_STATEMENT,
-    PHP_NODE_CLASS_DECLARATION,
-    PHP_NODE_FUNCTION_DECLARATION,
-    // ... more node types
-} php_node_type;
+// Front-end and code generation
+PHPAPI zend_ast* kage_php_parse(const char *php_code, size_t length, zend_arena **arena);
+PHPAPI kage_compiled_program* kage_php_compile(zend_ast *ast);
+PHPAPI void kage_php_report_exception(void);
 
 // Function declarations
-PHPAPI kage_result_t kage_compile_php_to_bytecode(const char *php_code, const char *encryption_key);
-PHPAPI kage_result_t kage_execute_php_bytecode(const char *bytecode_data, size_t data_length, zval *result);
+PHPAPI kage_result_t kage_compile_php_to_bytecode(const char *php_code, size_t length, zend_string *encryption_key, zval *bytecode);
+PHPAPI kage_result_t kage_execute_php_bytecode(const char *bytecode_data, size_t data_length, zend_string *encryption_key, zval *result);
+
+// PHP functions
+PHP_FUNCTION(kage_compile_php);
+PHP_FUNCTION(kage_execute_php_bytecode);
 
 #endif /* PHP_KAGE_COMPILER_H */
@@ -10,16 +10,23 @@
 #include "vm.h"
 #include "crypto.h"
 #include "base64.h"
+#include "kage_stats.h"
+#include "kage_probes.h"
+#include "kage_config.h"
 
 // Initialize VM state
 PHPAPI int kage_vm_init(kage_vm_state *state, size_t stack_size) {
     state->stack = ecalloc(stack_size, sizeof(zval));
     state->stack_size = 0;  // Current stack size
     state->stack_ptr = 0;   // Stack pointer
+    state->stack_capacity = stack_size;
     state->variables = emalloc(sizeof(HashTable));
     zend_hash_init(state->variables, 8, NULL, ZVAL_PTR_DTOR, 0);
     state->instructions = NULL;
     state->instruction_count = 0;
+    state->owns_instructions = true;
+    state->locals = NULL;
+    state->local_count = 0;
     return SUCCESS;
 }
 
@@ -38,7 +45,13 @@ PHPAPI void kage_vm_destroy(kage_vm_state *state) {
         zend_hash_destroy(state->variables);
         efree(state->variables);
     }
-    if (state->instructions) {
+    if (state->locals) {
+        for (uint32_t i = 0; i < state->local_count; i++) {
+            zval_ptr_dtor(&state->locals[i]);
+        }
+        efree(state->locals);
+    }
+    if (state->instructions && state->owns_instructions) {
         for (size_t i = 0; i < state->instruction_count; i++) {
             zval_ptr_dtor(&state->instructions[i].operand);
         }
@@ -48,7 +61,7 @@ PHPAPI void kage_vm_destroy(kage_vm_state *state) {
 
 // Push value onto stack
 PHPAPI int kage_vm_push(kage_vm_state *state, zval *value) {
-    if (state->stack_ptr >= KAGE_VM_STACK_SIZE) {
+    if (state->stack_ptr >= state->stack_capacity) {
         return FAILURE;
     }
     ZVAL_COPY(&state->stack[state->stack_ptr++], value);
@@ -56,84 +69,320 @@ PHPAPI int kage_vm_push(kage_vm_state *state, zval *value) {
     return SUCCESS;
 }
 
-// Pop value from stack
+// Pop value from stack; ownership moves to the caller
 PHPAPI int kage_vm_pop(kage_vm_state *state, zval *result) {
     if (state->stack_ptr == 0) {
         return FAILURE;
     }
-    ZVAL_COPY(result, &state->stack[--state->stack_ptr]);
+    ZVAL_COPY_VALUE(result, &state->stack[--state->stack_ptr]);
+    ZVAL_UNDEF(&state->stack[state->stack_ptr]);
     state->stack_size = state->stack_ptr;
     return SUCCESS;
 }
 
+// Replace the top of the stack with crypto(top)
+static int kage_vm_apply(kage_vm_state *state, int (*crypto)(zval *, zval *, zend_string *)) {
+    zval operand, result;
+    int status;
+
+    if (kage_vm_pop(state, &operand) != SUCCESS) {
+        return FAILURE;
+    }
+    status = crypto(&result, &operand, state->key);
+    zval_ptr_dtor(&operand);
+    if (status != SUCCESS) {
+        return FAILURE;
+    }
+
+    status = kage_vm_push(state, &result);
+    zval_ptr_dtor(&result);
+    return status;
+}
+
+// Zend implementations of the binary operators, indexed from KAGE_OP_ADD
+static const binary_op_type kage_vm_binary_ops[] = {
+    add_function,                   // KAGE_OP_ADD
+    sub_function,                   // KAGE_OP_SUB
+    mul_function,                   // KAGE_OP_MUL
+    div_function,                   // KAGE_OP_DIV
+    mod_function,                   // KAGE_OP_MOD
+    concat_function,                // KAGE_OP_CONCAT
+    is_equal_function,              // KAGE_OP_EQUAL
+    is_not_equal_function,          // KAGE_OP_NOT_EQUAL
+    is_identical_function,          // KAGE_OP_IDENTICAL
+    is_not_identical_function,      // KAGE_OP_NOT_IDENTICAL
+    is_smaller_function,            // KAGE_OP_LESS
+    is_smaller_or_equal_function,   // KAGE_OP_LESS_EQUAL
+    is_smaller_function,            // KAGE_OP_GREATER, operands swapped
+    is_smaller_or_equal_function    // KAGE_OP_GREATER_EQUAL, operands swapped
+};
+
+// Apply a binary operator to the two top values, leaving the result on top
+static int kage_vm_binary(kage_vm_state *state, kage_opcode opcode) {
+    if (state->stack_ptr < 2) {
+        return FAILURE;
+    }
+
+    zval *op1 = &state->stack[state->stack_ptr - 2];
+    zval *op2 = &state->stack[state->stack_ptr - 1];
+    zval result;
+
+    // Integer fast paths for the loop-counter shapes
+    if (Z_TYPE_P(op1) == IS_LONG && Z_TYPE_P(op2) == IS_LONG) {
+        switch (opcode) {
+            case KAGE_OP_ADD:
+                fast_long_add_function(&result, op1, op2);
+                ZVAL_COPY_VALUE(op1, &result);
+                state->stack_ptr--;
+                return SUCCESS;
+            case KAGE_OP_SUB:
+                fast_long_sub_function(&result, op1, op2);
+                ZVAL_COPY_VALUE(op1, &result);
+                state->stack_ptr--;
+                return SUCCESS;
+            case KAGE_OP_LESS:
+                ZVAL_BOOL(op1, Z_LVAL_P(op1) < Z_LVAL_P(op2));
+                state->stack_ptr--;
+                return SUCCESS;
+            case KAGE_OP_LESS_EQUAL:
+                ZVAL_BOOL(op1, Z_LVAL_P(op1) <= Z_LVAL_P(op2));
+                state->stack_ptr--;
+                return SUCCESS;
+            case KAGE_OP_GREATER:
+                ZVAL_BOOL(op1, Z_LVAL_P(op1) > Z_LVAL_P(op2));
+                state->stack_ptr--;
+                return SUCCESS;
+            case KAGE_OP_GREATER_EQUAL:
+                ZVAL_BOOL(op1, Z_LVAL_P(op1) >= Z_LVAL_P(op2));
+                state->stack_ptr--;
+                return SUCCESS;
+            default:
+                break;
+        }
+    }
+
+    binary_op_type handler = kage_vm_binary_ops[opcode - KAGE_OP_ADD];
+    int status = (opcode == KAGE_OP_GREATER || opcode == KAGE_OP_GREATER_EQUAL)
+        ? handler(&result, op2, op1)
+        : handler(&result, op1, op2);
+
+    zval_ptr_dtor(op1);
+    zval_ptr_dtor(op2);
+    state->stack_ptr--;
+
+    if (status != SUCCESS || EG(exception)) {
+        if (status == SUCCESS) {
+            zval_ptr_dtor(&result);
+        }
+        state->stack_ptr--;
+        return FAILURE;
+    }
+
+    ZVAL_COPY_VALUE(op1, &result);
+    return SUCCESS;
+}
+
+// Call a function by name: [name, arg1..argN] on the stack become [retval]
+static int kage_vm_call(kage_vm_state *state, uint32_t argc) {
+    if (state->stack_ptr < (size_t)argc + 1) {
+        return FAILURE;
+    }
+
+    zval *callee = &state->stack[state->stack_ptr - argc - 1];
+    zval retval;
+    int status = call_user_function(NULL, NULL, callee, &retval, argc, callee + 1);
+
+    for (uint32_t i = 0; i <= argc; i++) {
+        zval_ptr_dtor(&callee[i]);
+    }
+    state->stack_ptr -= argc + 1;
+
+    if (status != SUCCESS || EG(exception)) {
+        if (status == SUCCESS) {
+            zval_ptr_dtor(&retval);
+        }
+        return FAILURE;
+    }
+
+    ZVAL_COPY_VALUE(&state->stack[state->stack_ptr++], &retval);
+    return SUCCESS;
+}
+
+// Resolve a jump operand, rejecting targets outside the program
+static inline int kage_vm_jump_target(kage_vm_state *state, kage_instruction *instr, size_t *pc) {
+    if (Z_TYPE(instr->operand) != IS_LONG ||
+        (zend_ulong)Z_LVAL(instr->operand) > state->instruction_count) {
+        return FAILURE;
+    }
+    *pc = (size_t)Z_LVAL(instr->operand);
+    return SUCCESS;
+}
+
+// Resolve a local slot operand
+static inline zval* kage_vm_local(kage_vm_state *state, kage_instruction *instr) {
+    if (Z_TYPE(instr->operand) != IS_LONG ||
+        (zend_ulong)Z_LVAL(instr->operand) >= state->local_count) {
+        return NULL;
+    }
+    return &state->locals[Z_LVAL(instr->operand)];
+}
+
 // Execute VM instructions
 PHPAPI int kage_vm_execute(kage_vm_state *state) {
     if (!state || !state->instructions) {
         return FAILURE;
     }
 
-    zval temp, encrypted, decrypted;
-    ZVAL_NULL(&temp);
-    ZVAL_NULL(&encrypted);
-    ZVAL_NULL(&decrypted);
+    if (state->local_count > 0 && state->locals == NULL) {
+        // ecalloc leaves every local IS_UNDEF
+        state->locals = ecalloc(state->local_count, sizeof(zval));
+    }
 
-    for (size_t i = 0; i < state->instruction_count; i++) {
-        kage_instruction *instr = &state->instructions[i];
+    zval temp;
+    zval *local;
+    size_t pc = 0;
+    int status = SUCCESS;
+    KAGE_PROBE1(vm_execute__entry, state->instruction_count);
+    uint64_t started = kage_stats_now();
+
+    while (pc < state->instruction_count && status == SUCCESS) {
+        kage_instruction *instr = &state->instructions[pc++];
         
         switch (instr->opcode) {
             case KAGE_OP_PUSH:
-                if (kage_vm_push(state, &instr->operand) != SUCCESS) {
-                    goto cleanup;
-                }
+                status = kage_vm_push(state, &instr->operand);
                 break;
 
             case KAGE_OP_POP:
-                if (kage_vm_pop(state, &temp) != SUCCESS) {
-                    goto cleanup;
+                status = kage_vm_pop(state, &temp);
+                if (status == SUCCESS) {
+                    zval_ptr_dtor(&temp);
                 }
                 break;
 
             case KAGE_OP_ENCRYPT:
-                if (kage_vm_pop(state, &temp) != SUCCESS) {
-                    goto cleanup;
+                status = kage_vm_apply(state, kage_internal_encrypt);
+                break;
+
+            case KAGE_OP_DECRYPT:
+                status = kage_vm_apply(state, kage_internal_decrypt);
+                break;
+
+            case KAGE_OP_LOAD:
+                local = kage_vm_local(state, instr);
+                if (local == NULL) {
+                    status = FAILURE;
+                } else if (Z_ISUNDEF_P(local)) {
+                    ZVAL_NULL(&temp);
+                    status = kage_vm_push(state, &temp);
+                } else {
+                    status = kage_vm_push(state, local);
                 }
-                if (kage_internal_encrypt(&encrypted, &temp, state->key) != SUCCESS) {
-                    goto cleanup;
+                break;
+
+            case KAGE_OP_STORE:
+                local = kage_vm_local(state, instr);
+                if (local == NULL || state->stack_ptr == 0) {
+                    status = FAILURE;
+                } else {
+                    ZVAL_COPY_VALUE(&temp, local);
+                    ZVAL_COPY(local, &state->stack[state->stack_ptr - 1]);
+                    zval_ptr_dtor(&temp);
                 }
-                if (kage_vm_push(state, &encrypted) != SUCCESS) {
-                    goto cleanup;
+                break;
+
+            case KAGE_OP_ADD:
+            case KAGE_OP_SUB:
+            case KAGE_OP_MUL:
+            case KAGE_OP_DIV:
+            case KAGE_OP_MOD:
+            case KAGE_OP_CONCAT:
+            case KAGE_OP_EQUAL:
+            case KAGE_OP_NOT_EQUAL:
+            case KAGE_OP_IDENTICAL:
+            case KAGE_OP_NOT_IDENTICAL:
+            case KAGE_OP_LESS:
+            case KAGE_OP_LESS_EQUAL:
+            case KAGE_OP_GREATER:
+            case KAGE_OP_GREATER_EQUAL:
+                status = kage_vm_binary(state, instr->opcode);
+                break;
+
+            case KAGE_OP_NOT:
+            case KAGE_OP_BOOL:
+                if (state->stack_ptr == 0) {
+                    status = FAILURE;
+                    break;
+                }
+                local = &state->stack[state->stack_ptr - 1];
+                {
+                    bool truthy = zend_is_true(local);
+                    zval_ptr_dtor(local);
+                    ZVAL_BOOL(local, instr->opcode == KAGE_OP_BOOL ? truthy : !truthy);
                 }
                 break;
 
-            case KAGE_OP_DECRYPT:
-                if (kage_vm_pop(state, &temp) != SUCCESS) {
-                    goto cleanup;
+            case KAGE_OP_NEGATE:
+                if (state->stack_ptr == 0) {
+                    status = FAILURE;
+                    break;
                 }
-                if (kage_internal_decrypt(&decrypted, &temp, state->key) != SUCCESS) {
-                    goto cleanup;
+                ZVAL_LONG(&temp, -1);
+                status = kage_vm_push(state, &temp);
+                if (status == SUCCESS) {
+                    status = kage_vm_binary(state, KAGE_OP_MUL);
                 }
-                if (kage_vm_push(state, &decrypted) != SUCCESS) {
-                    goto cleanup;
+                break;
+
+            case KAGE_OP_JMP:
+                status = kage_vm_jump_target(state, instr, &pc);
+                break;
+
+            case KAGE_OP_JMPZ:
+            case KAGE_OP_JMPNZ:
+                status = kage_vm_pop(state, &temp);
+                if (status == SUCCESS) {
+                    bool truthy = zend_is_true(&temp);
+                    zval_ptr_dtor(&temp);
+                    if (truthy == (instr->opcode == KAGE_OP_JMPNZ)) {
+                        status = kage_vm_jump_target(state, instr, &pc);
+                    }
                 }
                 break;
 
+            case KAGE_OP_ECHO:
+                status = kage_vm_pop(state, &temp);
+                if (status == SUCCESS) {
+                    zend_print_zval(&temp, 0);
+                    zval_ptr_dtor(&temp);
+                }
+                break;
+
+            case KAGE_OP_CALL:
+                if (Z_TYPE(instr->operand) != IS_LONG || Z_LVAL(instr->operand) < 0 ||
+                    Z_LVAL(instr->operand) > UINT32_MAX) {
+                    status = FAILURE;
+                } else {
+                    status = kage_vm_call(state, (uint32_t)Z_LVAL(instr->operand));
+                }
+                break;
+
+            case KAGE_OP_RETURN:
+                // Leave the result on top of the stack and stop
+                status = state->stack_ptr > 0 ? SUCCESS : FAILURE;
+                pc = state->instruction_count;
+                break;
+
             default:
-                goto cleanup;
+                status = FAILURE;
+                break;
         }
     }
 
-    // Clean up temporary values
-    zval_ptr_dtor(&temp);
-    zval_ptr_dtor(&encrypted);
-    zval_ptr_dtor(&decrypted);
-
-    return SUCCESS;
-
-cleanup:
-    zval_ptr_dtor(&temp);
-    zval_ptr_dtor(&encrypted);
-    zval_ptr_dtor(&decrypted);
-    return FAILURE;
+    state->stack_size = state->stack_ptr;
+    kage_stats_record(KAGE_STAT_VM_EXECUTE, 0, started, status == SUCCESS);
+    KAGE_PROBE2(vm_execute__return, state->stack_ptr, status);
+    return status;
 }
 
 // PHP Function: VM-based encryption
@@ -147,7 +396,7 @@ PHP_FUNCTION(kage_vm_encrypt) {
     
     // Initialize VM state
     kage_vm_state state;
-    if (kage_vm_init(&state, KAGE_VM_STACK_SIZE) != SUCCESS) {
+    if (kage_vm_init(&state, KAGE_CONFIG(stack_size)) != SUCCESS) {
         RETURN_FALSE;
     }
     
@@ -164,7 +413,7 @@ PHP_FUNCTION(kage_vm_encrypt) {
     
     // Initialize instructions
     state.instructions[0].opcode = KAGE_OP_PUSH;
-    ZVAL_STR(&state.instructions[0].operand, data);
+    ZVAL_STR_COPY(&state.instructions[0].operand, data);
     
     state.instructions[1].opcode = KAGE_OP_ENCRYPT;
     ZVAL_NULL(&state.instructions[1].operand);
@@ -173,6 +422,7 @@ PHP_FUNCTION(kage_vm_encrypt) {
     zval result;
     if (kage_vm_execute(&state) == SUCCESS && 
         kage_vm_pop(&state, &result) == SUCCESS) {
+        kage_vm_destroy(&state);
         RETURN_ZVAL(&result, 0, 1);
     }
     
@@ -191,7 +441,7 @@ PHP_FUNCTION(kage_vm_decrypt) {
     
     // Initialize VM state
     kage_vm_state state;
-    if (kage_vm_init(&state, KAGE_VM_STACK_SIZE) != SUCCESS) {
+    if (kage_vm_init(&state, KAGE_CONFIG(stack_size)) != SUCCESS) {
         RETURN_FALSE;
     }
     
@@ -208,7 +458,7 @@ PHP_FUNCTION(kage_vm_decrypt) {
     
     // Initialize instructions
     state.instructions[0].opcode = KAGE_OP_PUSH;
-    ZVAL_STR(&state.instructions[0].operand, data);
+    ZVAL_STR_COPY(&state.instructions[0].operand, data);
     
     state.instructions[1].opcode = KAGE_OP_DECRYPT;
     ZVAL_NULL(&state.instructions[1].operand);
@@ -217,6 +467,7 @@ PHP_FUNCTION(kage_vm_decrypt) {
     zval result;
     if (kage_vm_execute(&state) == SUCCESS && 
         kage_vm_pop(&state, &result) == SUCCESS) {
+        kage_vm_destroy(&state);
         RETURN_ZVAL(&result, 0, 1);
     }
     
@@ -11,15 +11,46 @@
 #define PHP_KAGE_VM_H
 
 #include "config.h"
+#include <stdbool.h>
 
 // VM instruction types
 typedef enum {
     KAGE_OP_PUSH,
     KAGE_OP_POP,
     KAGE_OP_ENCRYPT,
-    KAGE_OP_DECRYPT
+    KAGE_OP_DECRYPT,
+
+    // PHP subset (see php_compiler.c); values are part of the image format
+    KAGE_OP_LOAD,           // push local (operand: slot)
+    KAGE_OP_STORE,          // copy top into local, keep it on the stack (operand: slot)
+    KAGE_OP_ADD,            // binary operators pop two values and push one
+    KAGE_OP_SUB,
+    KAGE_OP_MUL,
+    KAGE_OP_DIV,
+    KAGE_OP_MOD,
+    KAGE_OP_CONCAT,
+    KAGE_OP_EQUAL,
+    KAGE_OP_NOT_EQUAL,
+    KAGE_OP_IDENTICAL,
+    KAGE_OP_NOT_IDENTICAL,
+    KAGE_OP_LESS,
+    KAGE_OP_LESS_EQUAL,
+    KAGE_OP_GREATER,
+    KAGE_OP_GREATER_EQUAL,
+    KAGE_OP_NOT,            // unary operators replace the top value
+    KAGE_OP_NEGATE,
+    KAGE_OP_BOOL,
+    KAGE_OP_JMP,            // operand: target instruction index
+    KAGE_OP_JMPZ,           // pop, jump if falsy
+    KAGE_OP_JMPNZ,          // pop, jump if truthy
+    KAGE_OP_ECHO,           // pop and print
+    KAGE_OP_CALL,           // operand: argc; callee name sits below the arguments
+    KAGE_OP_RETURN          // stop, the top value is the result
 } kage_opcode;
 
+// Highest valid opcode, used to validate serialised programs
+#define KAGE_OP_LAST KAGE_OP_RETURN
+
 // VM instruction structure
 typedef struct {
     kage_opcode opcode;
@@ -31,13 +62,17 @@ typedef struct {
     zval *stack;
     size_t stack_size;
     size_t stack_ptr;
+    size_t stack_capacity;   // slots allocated by kage_vm_init
     HashTable *variables;
     zend_string *key;
     kage_instruction *instructions;
     size_t instruction_count;
+    bool owns_instructions;  // false when borrowing a cached program
+    zval *locals;            // allocated on first execution when local_count > 0
+    uint32_t local_count;
 } kage_vm_state;
 
-// VM stack size constant
+// Default VM stack size; programs run with kage.stack_size
 #define KAGE_VM_STACK_SIZE 1024
 
 // VM functions
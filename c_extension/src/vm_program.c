@@ -0,0 +1,593 @@
+/**
+ * Kage VM Program Images Implementation
+ *
+ * Serialises compiled Kage VM programs into a compact, relocatable binary
+ * image and loads them back, either from a string or from a file mapped
+ * straight into memory.
+ *
+ * Copyright (c) 2025 [Your Name], Individual Entrepreneur
+ * INN: [Your Tax ID Number]
+ * Created: 2025-12-09
+ * All rights reserved. Unauthorized copying, modification,
+ * distribution, or use is strictly prohibited.
+ */
+
+#include "vm_program.h"
+#include "php_streams.h"
+
+#define KAGE_VM_IMAGE_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+/**
+ * FNV-1a checksum over the image body.
+ *
+ * @param data Start of the checksummed region
+ * @param length Length of the region in bytes
+ * @return 32-bit checksum
+ */
+static uint32_t kage_vm_image_checksum(const unsigned char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Validates an image in place and fills the read-only view.
+ * Nothing is copied, so the data must outlive the view.
+ *
+ * @param image View to populate
+ * @param data Image bytes (must be 8-byte aligned)
+ * @param length Image length in bytes
+ * @return SUCCESS if the image is well-formed, FAILURE otherwise
+ */
+PHPAPI int kage_vm_image_open(kage_vm_image *image, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    if (image == NULL || bytes == NULL || length < sizeof(kage_vm_image_header)) {
+        zend_error(E_WARNING, "Kage VM: Truncated program image");
+        return FAILURE;
+    }
+
+    if (((uintptr_t)bytes & 7) != 0) {
+        zend_error(E_WARNING, "Kage VM: Misaligned program image");
+        return FAILURE;
+    }
+
+    const kage_vm_image_header *header = (const kage_vm_image_header *)bytes;
+    if (memcmp(header->magic, KAGE_VM_IMAGE_MAGIC, 4) != 0) {
+        zend_error(E_WARNING, "Kage VM: Not a Kage program image");
+        return FAILURE;
+    }
+    /* The marker as a host of the other byte order wrote it */
+    if (header->byte_order == 0x04030201) {
+        zend_error(E_WARNING, "Kage VM: Program image was written with a different byte order");
+        return FAILURE;
+    }
+    if (header->version != KAGE_VM_IMAGE_VERSION || header->byte_order != KAGE_VM_IMAGE_BYTE_ORDER) {
+        zend_error(E_WARNING, "Kage VM: Unsupported program image version %u", (unsigned)header->version);
+        return FAILURE;
+    }
+
+    size_t instructions_size = (size_t)header->instruction_count * sizeof(kage_vm_image_instruction);
+    size_t constants_size = (size_t)header->constant_count * sizeof(kage_vm_image_constant);
+    size_t expected = sizeof(kage_vm_image_header) + instructions_size + constants_size + header->pool_size;
+    if (expected != length) {
+        zend_error(E_WARNING, "Kage VM: Program image size mismatch");
+        return FAILURE;
+    }
+
+    size_t body_length = length - sizeof(kage_vm_image_header);
+    if (kage_vm_image_checksum(bytes + sizeof(kage_vm_image_header), body_length) != header->checksum) {
+        zend_error(E_WARNING, "Kage VM: Program image checksum mismatch");
+        return FAILURE;
+    }
+
+    image->header = header;
+    image->instructions = (const kage_vm_image_instruction *)(bytes + sizeof(kage_vm_image_header));
+    image->constants = (const kage_vm_image_constant *)((const unsigned char *)image->instructions + instructions_size);
+    image->pool = (const char *)image->constants + constants_size;
+
+    /* Bounds-check constants so readers never leave the pool */
+    for (uint32_t i = 0; i < header->constant_count; i++) {
+        const kage_vm_image_constant *constant = &image->constants[i];
+
+        if (constant->type > KAGE_VM_CONST_STRING) {
+            zend_error(E_WARNING, "Kage VM: Invalid constant type in program image");
+            return FAILURE;
+        }
+        if (constant->type == KAGE_VM_CONST_STRING &&
+            (constant->value.offset >= header->pool_size ||
+             constant->length >= header->pool_size - constant->value.offset ||
+             image->pool[constant->value.offset + constant->length] != '\0')) {
+            zend_error(E_WARNING, "Kage VM: Invalid string constant in program image");
+            return FAILURE;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->instruction_count; i++) {
+        const kage_vm_image_instruction *instr = &image->instructions[i];
+
+        if (instr->opcode > KAGE_OP_LAST ||
+            (instr->operand != KAGE_VM_IMAGE_NO_OPERAND && instr->operand >= header->constant_count)) {
+            zend_error(E_WARNING, "Kage VM: Invalid instruction in program image");
+            return FAILURE;
+        }
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Returns a string constant without copying it out of the image.
+ *
+ * @param image Validated image view
+ * @param index Constant index
+ * @param length Receives the string length (may be NULL)
+ * @return NUL-terminated string inside the pool, or NULL if not a string
+ */
+PHPAPI const char* kage_vm_image_string(const kage_vm_image *image, uint32_t index, size_t *length) {
+    if (image == NULL || index >= image->header->constant_count) {
+        return NULL;
+    }
+
+    const kage_vm_image_constant *constant = &image->constants[index];
+    if (constant->type != KAGE_VM_CONST_STRING) {
+        return NULL;
+    }
+
+    if (length) {
+        *length = constant->length;
+    }
+    return image->pool + constant->value.offset;
+}
+
+/**
+ * Encodes a zval operand as an image constant.
+ *
+ * @param constant Constant to fill
+ * @param value Operand value
+ * @param pool_size Running pool size, advanced for string constants
+ * @return SUCCESS, or FAILURE for operand types the format cannot hold
+ */
+static int kage_vm_encode_constant(kage_vm_image_constant *constant, zval *value, size_t *pool_size) {
+    memset(constant, 0, sizeof(kage_vm_image_constant));
+
+    switch (Z_TYPE_P(value)) {
+        case IS_NULL:
+            constant->type = KAGE_VM_CONST_NULL;
+            return SUCCESS;
+        case IS_FALSE:
+            constant->type = KAGE_VM_CONST_FALSE;
+            return SUCCESS;
+        case IS_TRUE:
+            constant->type = KAGE_VM_CONST_TRUE;
+            return SUCCESS;
+        case IS_LONG:
+            constant->type = KAGE_VM_CONST_LONG;
+            constant->value.lval = (int64_t)Z_LVAL_P(value);
+            return SUCCESS;
+        case IS_DOUBLE:
+            constant->type = KAGE_VM_CONST_DOUBLE;
+            constant->value.dval = Z_DVAL_P(value);
+            return SUCCESS;
+        case IS_STRING:
+            if (Z_STRLEN_P(value) >= UINT32_MAX) {
+                return FAILURE;
+            }
+            constant->type = KAGE_VM_CONST_STRING;
+            constant->length = (uint32_t)Z_STRLEN_P(value);
+            constant->value.offset = *pool_size;
+            *pool_size += Z_STRLEN_P(value) + 1;
+            return SUCCESS;
+        default:
+            return FAILURE;
+    }
+}
+
+/**
+ * Serialises a compiled program into a binary image.
+ * Identical string operands share one pool entry.
+ *
+ * @param program The program to serialise
+ * @return Image as a zend_string, or NULL on error
+ */
+PHPAPI zend_string* kage_vm_program_export(const kage_compiled_program *program) {
+    if (program == NULL || program->instruction_count >= UINT32_MAX) {
+        return NULL;
+    }
+
+    size_t count = program->instruction_count;
+    uint32_t *operands = safe_emalloc(count, sizeof(uint32_t), 0);
+    kage_vm_image_constant *constants = safe_emalloc(count, sizeof(kage_vm_image_constant), 0);
+    uint32_t constant_count = 0;
+    size_t pool_size = 0;
+
+    HashTable string_index;
+    zend_hash_init(&string_index, 8, NULL, NULL, 0);
+
+    /* Pass 1: assign constant slots and lay out the pool */
+    for (size_t i = 0; i < count; i++) {
+        zval *operand = &program->instructions[i].operand;
+
+        if (Z_TYPE_P(operand) == IS_NULL) {
+            operands[i] = KAGE_VM_IMAGE_NO_OPERAND;
+            continue;
+        }
+
+        if (Z_TYPE_P(operand) == IS_STRING) {
+            zval *existing = zend_hash_find(&string_index, Z_STR_P(operand));
+            if (existing) {
+                operands[i] = (uint32_t)Z_LVAL_P(existing);
+                continue;
+            }
+        }
+
+        if (kage_vm_encode_constant(&constants[constant_count], operand, &pool_size) != SUCCESS) {
+            zend_error(E_WARNING, "Kage VM: Operand type %s cannot be serialised", zend_zval_type_name(operand));
+            zend_hash_destroy(&string_index);
+            efree(constants);
+            efree(operands);
+            return NULL;
+        }
+
+        if (Z_TYPE_P(operand) == IS_STRING) {
+            zval index;
+            ZVAL_LONG(&index, constant_count);
+            zend_hash_add_new(&string_index, Z_STR_P(operand), &index);
+        }
+        operands[i] = constant_count++;
+    }
+
+    pool_size = KAGE_VM_IMAGE_ALIGN(pool_size);
+    if (pool_size >= UINT32_MAX) {
+        zend_hash_destroy(&string_index);
+        efree(constants);
+        efree(operands);
+        return NULL;
+    }
+
+    size_t instructions_size = count * sizeof(kage_vm_image_instruction);
+    size_t constants_size = (size_t)constant_count * sizeof(kage_vm_image_constant);
+    size_t total = sizeof(kage_vm_image_header) + instructions_size + constants_size + pool_size;
+
+    zend_string *image = zend_string_alloc(total, 0);
+    unsigned char *out = (unsigned char *)ZSTR_VAL(image);
+    memset(out, 0, total);
+
+    /* Pass 2: emit sections */
+    kage_vm_image_instruction *instrs = (kage_vm_image_instruction *)(out + sizeof(kage_vm_image_header));
+    for (size_t i = 0; i < count; i++) {
+        instrs[i].opcode = (uint8_t)program->instructions[i].opcode;
+        instrs[i].operand = operands[i];
+    }
+
+    unsigned char *constant_out = (unsigned char *)instrs + instructions_size;
+    memcpy(constant_out, constants, constants_size);
+
+    char *pool = (char *)constant_out + constants_size;
+    for (size_t i = 0; i < count; i++) {
+        zval *operand = &program->instructions[i].operand;
+        if (operands[i] == KAGE_VM_IMAGE_NO_OPERAND || Z_TYPE_P(operand) != IS_STRING) {
+            continue;
+        }
+        /* Shared entries are rewritten with identical bytes */
+        const kage_vm_image_constant *constant = &constants[operands[i]];
+        memcpy(pool + constant->value.offset, Z_STRVAL_P(operand), constant->length);
+    }
+
+    kage_vm_image_header *header = (kage_vm_image_header *)out;
+    memcpy(header->magic, KAGE_VM_IMAGE_MAGIC, 4);
+    header->version = KAGE_VM_IMAGE_VERSION;
+    header->flags = program->requires_key_check ? KAGE_VM_IMAGE_FLAG_KEY_CHECK : 0;
+    header->instruction_count = (uint32_t)count;
+    header->constant_count = constant_count;
+    header->pool_size = (uint32_t)pool_size;
+    header->local_count = program->local_count;
+    header->byte_order = KAGE_VM_IMAGE_BYTE_ORDER;
+    header->checksum = kage_vm_image_checksum(out + sizeof(kage_vm_image_header), total - sizeof(kage_vm_image_header));
+
+    ZSTR_VAL(image)[total] = '\0';
+
+    zend_hash_destroy(&string_index);
+    efree(constants);
+    efree(operands);
+    return image;
+}
+
+/**
+ * Materialises a compiled program from a validated image.
+ * Each distinct constant is turned into a zval once and shared.
+ *
+ * The checksum and flags of an image are not authenticated, so anyone
+ * can write one. Only an image that came out of authenticated decryption
+ * may call PHP functions; others are rejected if they contain a CALL.
+ *
+ * @param image Validated image view
+ * @param trusted Whether the image was decrypted with the caller's key
+ * @return Compiled program, or NULL on error
+ */
+PHPAPI kage_compiled_program* kage_vm_program_import(const kage_vm_image *image, bool trusted) {
+    if (image == NULL || image->header == NULL) {
+        return NULL;
+    }
+
+    uint32_t count = image->header->instruction_count;
+    uint32_t constant_count = image->header->constant_count;
+    uint32_t local_count = image->header->local_count;
+
+    /* Every LOAD/STORE slot must lie inside the frame, and the frame may
+     * not be larger than its highest slot: it is allocated up front */
+    uint32_t used_locals = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const kage_vm_image_instruction *encoded = &image->instructions[i];
+
+        if (!trusted && encoded->opcode == KAGE_OP_CALL) {
+            zend_error(E_WARNING, "Kage VM: Unencrypted program images cannot call functions");
+            return NULL;
+        }
+        if (encoded->opcode != KAGE_OP_LOAD && encoded->opcode != KAGE_OP_STORE) {
+            continue;
+        }
+
+        const kage_vm_image_constant *slot = encoded->operand == KAGE_VM_IMAGE_NO_OPERAND
+            ? NULL : &image->constants[encoded->operand];
+        if (slot == NULL || slot->type != KAGE_VM_CONST_LONG
+                || slot->value.lval < 0 || slot->value.lval >= local_count) {
+            zend_error(E_WARNING, "Kage VM: Program image instruction %u uses a local slot outside its frame", i);
+            return NULL;
+        }
+        if ((uint32_t)slot->value.lval >= used_locals) {
+            used_locals = (uint32_t)slot->value.lval + 1;
+        }
+    }
+
+    if (local_count > used_locals || local_count > KAGE_VM_IMAGE_MAX_LOCALS) {
+        zend_error(E_WARNING, "Kage VM: Program image declares %u local slots but uses %u", local_count, used_locals);
+        return NULL;
+    }
+
+    /* ecalloc leaves every slot IS_UNDEF until first use */
+    zval *values = constant_count ? ecalloc(constant_count, sizeof(zval)) : NULL;
+
+    kage_compiled_program *program = emalloc(sizeof(kage_compiled_program));
+    program->instructions = safe_emalloc(count, sizeof(kage_instruction), 0);
+    program->instruction_count = count;
+    program->requires_key_check = (image->header->flags & KAGE_VM_IMAGE_FLAG_KEY_CHECK) != 0;
+    program->local_count = local_count;
+    program->pool = NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const kage_vm_image_instruction *encoded = &image->instructions[i];
+        kage_instruction *instr = &program->instructions[i];
+
+        instr->opcode = (kage_opcode)encoded->opcode;
+        if (encoded->operand == KAGE_VM_IMAGE_NO_OPERAND) {
+            ZVAL_NULL(&instr->operand);
+            continue;
+        }
+
+        zval *value = &values[encoded->operand];
+        if (Z_ISUNDEF_P(value)) {
+            const kage_vm_image_constant *constant = &image->constants[encoded->operand];
+            switch (constant->type) {
+                case KAGE_VM_CONST_FALSE:
+                    ZVAL_FALSE(value);
+                    break;
+                case KAGE_VM_CONST_TRUE:
+                    ZVAL_TRUE(value);
+                    break;
+                case KAGE_VM_CONST_LONG:
+                    ZVAL_LONG(value, (zend_long)constant->value.lval);
+                    break;
+                case KAGE_VM_CONST_DOUBLE:
+                    ZVAL_DOUBLE(value, constant->value.dval);
+                    break;
+                case KAGE_VM_CONST_STRING:
+                    ZVAL_STRINGL(value, image->pool + constant->value.offset, constant->length);
+                    break;
+                default:
+                    ZVAL_NULL(value);
+                    break;
+            }
+        }
+        ZVAL_COPY(&instr->operand, value);
+    }
+
+    for (uint32_t i = 0; i < constant_count; i++) {
+        zval_ptr_dtor(&values[i]);
+    }
+    if (values) {
+        efree(values);
+    }
+
+    return program;
+}
+
+/**
+ * Writes a program image to a file.
+ *
+ * @param program The program to save
+ * @param path Destination path (subject to open_basedir)
+ * @return SUCCESS on success, FAILURE on error
+ */
+PHPAPI int kage_vm_program_save(const kage_compiled_program *program, const char *path) {
+    zend_string *image = kage_vm_program_export(program);
+    if (image == NULL) {
+        return FAILURE;
+    }
+
+    php_stream *stream = php_stream_open_wrapper((char *)path, "wb", REPORT_ERRORS, NULL);
+    if (stream == NULL) {
+        zend_string_release(image);
+        return FAILURE;
+    }
+
+    ssize_t written = php_stream_write(stream, ZSTR_VAL(image), ZSTR_LEN(image));
+    php_stream_close(stream);
+
+    int result = (written >= 0 && (size_t)written == ZSTR_LEN(image)) ? SUCCESS : FAILURE;
+    zend_string_release(image);
+    return result;
+}
+
+/**
+ * Loads a program image from a file. The file is memory-mapped when the
+ * stream supports it, so validation and constant reads happen in place;
+ * otherwise it is read into memory first.
+ *
+ * @param path Source path (subject to open_basedir)
+ * @return Compiled program, or NULL on error
+ */
+PHPAPI kage_compiled_program* kage_vm_program_load(const char *path) {
+    php_stream *stream = php_stream_open_wrapper((char *)path, "rb", REPORT_ERRORS, NULL);
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    kage_compiled_program *program = NULL;
+    kage_vm_image image;
+    size_t mapped_length = 0;
+
+    char *mapped = php_stream_mmap_range(stream, 0, PHP_STREAM_MMAP_ALL,
+                                         PHP_STREAM_MAP_MODE_SHARED_READONLY, &mapped_length);
+    if (mapped) {
+        if (kage_vm_image_open(&image, mapped, mapped_length) == SUCCESS) {
+            program = kage_vm_program_import(&image, false);
+        }
+        php_stream_mmap_unmap(stream);
+    } else {
+        zend_string *contents = php_stream_copy_to_mem(stream, PHP_STREAM_COPY_ALL, 0);
+        if (contents) {
+            if (kage_vm_image_open(&image, ZSTR_VAL(contents), ZSTR_LEN(contents)) == SUCCESS) {
+                program = kage_vm_program_import(&image, false);
+            }
+            zend_string_release(contents);
+        }
+    }
+
+    php_stream_close(stream);
+    return program;
+}
+
+/**
+ * Wraps a loaded program in a "Kage AST" resource with no tree attached,
+ * so it runs through kage_ast_to_bytecode() like a freshly parsed one.
+ */
+static void kage_vm_return_program(zval *return_value, kage_compiled_program *program) {
+    kage_ast_resource *payload = emalloc(sizeof(kage_ast_resource));
+    payload->root = NULL;
+    payload->program = program;
+
+    RETURN_RES(zend_register_resource(payload, le_kage_ast));
+}
+
+/**
+ * Fetches the (possibly lazily compiled) program behind an AST resource.
+ */
+static kage_compiled_program* kage_vm_fetch_program(zval *ast_zv) {
+    kage_ast_resource *payload = (kage_ast_resource*)zend_fetch_resource(Z_RES_P(ast_zv), "Kage AST", le_kage_ast);
+    if (payload == NULL) {
+        return NULL;
+    }
+    return kage_ast_resource_program(payload);
+}
+
+/**
+ * PHP Function: kage_vm_export
+ *
+ * @param resource $ast AST resource from kage_ast_parse() or kage_vm_load()
+ * @return string|false Binary program image
+ */
+PHP_FUNCTION(kage_vm_export) {
+    zval *ast_zv;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "r", &ast_zv) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    kage_compiled_program *program = kage_vm_fetch_program(ast_zv);
+    if (program == NULL) {
+        RETURN_FALSE;
+    }
+
+    zend_string *image = kage_vm_program_export(program);
+    if (image == NULL) {
+        RETURN_FALSE;
+    }
+
+    RETURN_STR(image);
+}
+
+/**
+ * PHP Function: kage_vm_import
+ *
+ * @param string $image Binary program image from kage_vm_export()
+ * @return resource|false Program resource executable with kage_ast_to_bytecode()
+ */
+PHP_FUNCTION(kage_vm_import) {
+    zend_string *data;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &data) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    kage_vm_image image;
+    if (kage_vm_image_open(&image, ZSTR_VAL(data), ZSTR_LEN(data)) != SUCCESS) {
+        RETURN_FALSE;
+    }
+
+    kage_compiled_program *program = kage_vm_program_import(&image, false);
+    if (program == NULL) {
+        RETURN_FALSE;
+    }
+
+    kage_vm_return_program(return_value, program);
+}
+
+/**
+ * PHP Function: kage_vm_save
+ *
+ * @param resource $ast AST resource from kage_ast_parse() or kage_vm_load()
+ * @param string $filename Destination file
+ * @return bool TRUE on success
+ */
+PHP_FUNCTION(kage_vm_save) {
+    zval *ast_zv;
+    char *path;
+    size_t path_len;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "rp", &ast_zv, &path, &path_len) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    kage_compiled_program *program = kage_vm_fetch_program(ast_zv);
+    if (program == NULL) {
+        RETURN_FALSE;
+    }
+
+    RETURN_BOOL(kage_vm_program_save(program, path) == SUCCESS);
+}
+
+/**
+ * PHP Function: kage_vm_load
+ *
+ * @param string $filename Program image written by kage_vm_save()
+ * @return resource|false Program resource executable with kage_ast_to_bytecode()
+ */
+PHP_FUNCTION(kage_vm_load) {
+    char *path;
+    size_t path_len;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS(), "p", &path, &path_len) == FAILURE) {
+        RETURN_FALSE;
+    }
+
+    kage_compiled_program *program = kage_vm_program_load(path);
+    if (program == NULL) {
+        RETURN_FALSE;
+    }
+
+    kage_vm_return_program(return_value, program);
+}
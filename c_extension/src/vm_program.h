@@ -0,0 +1,115 @@
+/**
+ * Kage VM Program Images
+ *
+ * Compact binary format for lowered Kage VM programs, so deployments can
+ * ship precompiled programs and skip parsing at startup.
+ *
+ * Layout (byte order of the writing host, recorded in the header and
+ * checked on load; every section 8-byte aligned):
+ *   header        kage_vm_image_header
+ *   instructions  instruction_count x kage_vm_image_instruction
+ *   constants     constant_count x kage_vm_image_constant
+ *   pool          NUL-terminated string payloads referenced by constants
+ *
+ * The image can be validated and read in place (e.g. from an mmap'd file).
+ * Importing copies each distinct string constant once, into a zval that
+ * outlives the mapping.
+ *
+ * Copyright (c) 2025 [Your Name], Individual Entrepreneur
+ * INN: [Your Tax ID Number]
+ * Created: 2025-12-09
+ * All rights reserved. Unauthorized copying, modification,
+ * distribution, or use is strictly prohibited.
+ */
+
+#ifndef PHP_KAGE_VM_PROGRAM_H
+#define PHP_KAGE_VM_PROGRAM_H
+
+#include "config.h"
+#include "vm.h"
+#include "ast.h"
+#include <stdint.h>
+
+#define KAGE_VM_IMAGE_MAGIC "KGVM"
+#define KAGE_VM_IMAGE_VERSION 2
+
+// Written in host order; reads back differently on a host of the other
+// byte order
+#define KAGE_VM_IMAGE_BYTE_ORDER 0x01020304
+
+// Header flags
+#define KAGE_VM_IMAGE_FLAG_KEY_CHECK 0x0001
+
+// Instruction operand index used when the instruction has no operand
+#define KAGE_VM_IMAGE_NO_OPERAND UINT32_MAX
+
+// Upper bound on local_count accepted from an image
+#define KAGE_VM_IMAGE_MAX_LOCALS 65536
+
+// Constant types
+typedef enum {
+    KAGE_VM_CONST_NULL = 0,
+    KAGE_VM_CONST_FALSE,
+    KAGE_VM_CONST_TRUE,
+    KAGE_VM_CONST_LONG,
+    KAGE_VM_CONST_DOUBLE,
+    KAGE_VM_CONST_STRING
+} kage_vm_const_type;
+
+// File header (32 bytes)
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t instruction_count;
+    uint32_t constant_count;
+    uint32_t pool_size;
+    uint32_t checksum;        // FNV-1a over everything after the header
+    uint32_t local_count;     // local variable slots (0 for pure Kage programs)
+    uint32_t byte_order;      // KAGE_VM_IMAGE_BYTE_ORDER
+} kage_vm_image_header;
+
+// Encoded instruction (8 bytes)
+typedef struct {
+    uint8_t opcode;
+    uint8_t reserved[3];
+    uint32_t operand;         // constant index or KAGE_VM_IMAGE_NO_OPERAND
+} kage_vm_image_instruction;
+
+// Encoded constant (16 bytes)
+typedef struct {
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t length;          // string length, excluding the terminating NUL
+    union {
+        int64_t lval;
+        double dval;
+        uint64_t offset;      // string offset inside the pool
+    } value;
+} kage_vm_image_constant;
+
+// Validated, read-only view over an image held in memory
+typedef struct {
+    const kage_vm_image_header *header;
+    const kage_vm_image_instruction *instructions;
+    const kage_vm_image_constant *constants;
+    const char *pool;
+} kage_vm_image;
+
+// Image functions
+PHPAPI int kage_vm_image_open(kage_vm_image *image, const void *data, size_t length);
+PHPAPI const char* kage_vm_image_string(const kage_vm_image *image, uint32_t index, size_t *length);
+
+// Program serialisation
+PHPAPI zend_string* kage_vm_program_export(const kage_compiled_program *program);
+PHPAPI kage_compiled_program* kage_vm_program_import(const kage_vm_image *image, bool trusted);
+PHPAPI int kage_vm_program_save(const kage_compiled_program *program, const char *path);
+PHPAPI kage_compiled_program* kage_vm_program_load(const char *path);
+
+// PHP functions
+PHP_FUNCTION(kage_vm_export);
+PHP_FUNCTION(kage_vm_import);
+PHP_FUNCTION(kage_vm_save);
+PHP_FUNCTION(kage_vm_load);
+
+#endif /* PHP_KAGE_VM_PROGRAM_H */
@@ -0,0 +1,132 @@
+<?php
+/**
+ * Generates the Zend opcode name table for the VLD dump parser
+ *
+ * Reads the ZEND_* opcode defines of the engine the extension is built
+ * against and writes a perfect hash over their names (without the
+ * ZEND_ prefix, as VLD prints them). The hash is two-level: the name picks
+ * a bucket, the bucket's seed picks a unique slot. A lookup is two FNV-1a
+ * passes over the name and one comparison, with no probing.
+ *
+ * Entries name the ZEND_* constants rather than their values, each under
+ * #ifdef, so the table builds against any engine: opcodes it lacks drop
+ * out. The output is committed as src/kage_opcode_table.h and CMake
+ * regenerates it when a php CLI is available. It must match
+ * kage_opcode_lookup() in bytecode_crypto.c.
+ *
+ * Usage: php gen_opcode_table.php <zend_vm_opcodes.h> <output.h>
+ */
+
+if ($argc !== 3) {
+    fwrite(STDERR, "Usage: php {$argv[0]} <zend_vm_opcodes.h> <output.h>\n");
+    exit(1);
+}
+
+$header = @file_get_contents($argv[1]);
+if ($header === false) {
+    fwrite(STDERR, "Cannot read {$argv[1]}\n");
+    exit(1);
+}
+
+// #define ZEND_NOP 0, skipping ZEND_VM_* configuration and hex flag values
+preg_match_all('/^#define\s+ZEND_(?!VM_)([A-Z0-9_]+)\s+(\d+)\s*$/m', $header, $matches, PREG_SET_ORDER);
+
+$opcodes = [];
+foreach ($matches as $match) {
+    if ((int)$match[2] <= 255) {
+        $opcodes[$match[1]] = (int)$match[2];
+    }
+}
+
+if (count($opcodes) === 0) {
+    fwrite(STDERR, "No opcodes found in {$argv[1]}\n");
+    exit(1);
+}
+
+function fnv1a($name, $seed) {
+    $hash = (2166136261 ^ $seed) & 0xFFFFFFFF;
+    for ($i = 0, $n = strlen($name); $i < $n; $i++) {
+        $hash = (($hash ^ ord($name[$i])) * 16777619) & 0xFFFFFFFF;
+    }
+    return $hash;
+}
+
+function next_pow2($n) {
+    $p = 1;
+    while ($p < $n) {
+        $p <<= 1;
+    }
+    return $p;
+}
+
+$slot_count = next_pow2(count($opcodes));
+$bucket_count = next_pow2(intdiv(count($opcodes), 4) + 1);
+
+$buckets = array_fill(0, $bucket_count, []);
+foreach ($opcodes as $name => $value) {
+    $buckets[fnv1a($name, 0) & ($bucket_count - 1)][] = $name;
+}
+
+// Place the largest buckets first, while most slots are still free
+$order = range(0, $bucket_count - 1);
+usort($order, function ($a, $b) use ($buckets) {
+    return count($buckets[$b]) <=> count($buckets[$a]);
+});
+
+$seeds = array_fill(0, $bucket_count, 0);
+$slots = array_fill(0, $slot_count, null);
+
+foreach ($order as $bucket) {
+    if (!$buckets[$bucket]) {
+        continue;
+    }
+    for ($seed = 1; ; $seed++) {
+        if ($seed > 0xFFFF) {
+            fwrite(STDERR, "No seed found for bucket $bucket\n");
+            exit(1);
+        }
+        $taken = [];
+        foreach ($buckets[$bucket] as $name) {
+            $slot = fnv1a($name, $seed) & ($slot_count - 1);
+            if ($slots[$slot] !== null || isset($taken[$slot])) {
+                continue 2;
+            }
+            $taken[$slot] = $name;
+        }
+        foreach ($taken as $slot => $name) {
+            $slots[$slot] = $name;
+        }
+        $seeds[$bucket] = $seed;
+        break;
+    }
+}
+
+$out = "/**\n";
+$out .= " * Zend opcode names, perfect-hashed\n";
+$out .= " *\n";
+$out .= " * Generated by tools/gen_opcode_table.php from " . basename($argv[1]) . ". Do not edit.\n";
+$out .= " */\n\n";
+$out .= "#ifndef KAGE_OPCODE_TABLE_H\n#define KAGE_OPCODE_TABLE_H\n\n";
+$out .= "#include <stdint.h>\n\n";
+$out .= "#define KAGE_OPCODE_TABLE_BUCKETS $bucket_count\n";
+$out .= "#define KAGE_OPCODE_TABLE_SLOTS $slot_count\n\n";
+$out .= "typedef struct {\n    const char *name;\n    uint8_t length;\n    uint8_t opcode;\n} kage_opcode_table_entry;\n\n";
+
+$out .= "static const uint16_t kage_opcode_table_seeds[KAGE_OPCODE_TABLE_BUCKETS] = {";
+foreach ($seeds as $i => $seed) {
+    $out .= ($i % 12 === 0 ? "\n    " : " ") . $seed . ",";
+}
+$out .= "\n};\n\n";
+
+$out .= "static const kage_opcode_table_entry kage_opcode_table[KAGE_OPCODE_TABLE_SLOTS] = {\n";
+foreach ($slots as $i => $name) {
+    if ($name !== null) {
+        $out .= sprintf("#ifdef ZEND_%s\n    [%d] = {\"%s\", %d, ZEND_%s},\n#endif\n", $name, $i, $name, strlen($name), $name);
+    }
+}
+$out .= "};\n\n#endif /* KAGE_OPCODE_TABLE_H */\n";
+
+if (file_put_contents($argv[2], $out) === false) {
+    fwrite(STDERR, "Cannot write {$argv[2]}\n");
+    exit(1);
+}
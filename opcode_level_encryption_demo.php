@@ -20,44 +20,35 @@ echo "Исходный PHP код:\n$php_code\n";
 
 echo "=== ПОЛУЧЕНИЕ ZEND БАЙТКОДА ===\n";
 
-// Получаем VLD вывод
-$temp_file = tempnam(sys_get_temp_dir(), 'opcode_demo_');
-file_put_contents($temp_file, $php_code);
-
-$command = "php -d vld.active=1 -d vld.execute=0 " . escapeshellarg($temp_file) . " 2>&1";
-$vld_output = shell_exec($command);
-unlink($temp_file);
-
-echo "VLD анализ:\n";
-echo "$vld_output\n";
+// Компилируем в текущем процессе - без VLD и shell_exec
+$extracted = kage_extract_opcodes($php_code);
+if ($extracted === false) {
+    die("Не удалось скомпилировать код\n");
+}
 
 echo "=== ПАРСИНГ ОПКОДОВ ===\n";
 
-// Парсим опкоды из VLD вывода
-$opcodes = [];
-$lines = explode("\n", $vld_output);
-
-$in_table = false;
-foreach ($lines as $line) {
-    // Ищем начало таблицы опкодов
-    if (strpos($line, 'op') !== false && strpos($line, 'fetch') !== false) {
-        $in_table = true;
-        continue;
-    }
-    
-    // Конец таблицы
-    if ($in_table && trim($line) === '') {
-        break;
+// Операнды в нотации VLD: !N - переменные, ~N/$N - временные, литералы как есть
+function format_operand($value) {
+    if (is_string($value) && preg_match('/^[!~$]\d+$/', $value)) {
+        return $value;
     }
-    
-    // Парсим строку опкода: line #* E I O op fetch ext return operands
-    if ($in_table && preg_match('/^\s*(\d+)\s+\d+\s+[EIO>\s*]*\s*([A-Z_]+)\s+(.+)$/', $line, $matches)) {
-        $opcodes[] = [
-            'line' => (int)$matches[1],
-            'opcode' => $matches[2],
-            'operands' => trim($matches[3])
-        ];
+    return var_export($value, true);
+}
+
+$opcodes = [];
+foreach ($extracted['opcodes'] as $op) {
+    $operands = [];
+    foreach (['op1', 'op2'] as $operand) {
+        if (array_key_exists($operand, $op)) {
+            $operands[] = format_operand($op[$operand]);
+        }
     }
+    $opcodes[] = [
+        'line' => $op['line'],
+        'opcode' => preg_replace('/^ZEND_/', '', $op['name']),
+        'operands' => implode(', ', $operands)
+    ];
 }
 
 echo "Найдено " . count($opcodes) . " опкодов:\n";
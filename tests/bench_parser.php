@@ -0,0 +1,66 @@
+<?php
+/**
+ * Benchmark for the Kage AST parser front-end
+ *
+ * Generates multi-megabyte Kage sources and reports parse throughput next
+ * to a single substr_count() pass over the same bytes, which is roughly
+ * what one memchr-speed scan of memory costs.
+ *
+ * Build with -DKAGE_LEXER_SCALAR=ON to measure the scalar fallback.
+ *
+ * Usage: php bench_parser.php [megabytes] [iterations]
+ */
+
+$megabytes = isset($argv[1]) ? (int)$argv[1] : 16;
+$iterations = isset($argv[2]) ? (int)$argv[2] : 5;
+
+$shapes = [
+    'statements' => [
+        'encrypt "The quick brown fox jumps over the lazy dog"' . "\n",
+        'decrypt encrypt "x"  ',
+        '    "literal with some \\"escaped\\" text"' . "\t",
+    ],
+    'long literals' => [
+        '"' . str_repeat('Lorem ipsum dolor sit amet, consectetur adipiscing elit. ', 64) . '"' . "\n",
+    ],
+    'whitespace heavy' => [
+        str_repeat(' ', 200) . '"a"' . str_repeat("\n\t", 100),
+    ],
+];
+
+function generate_source(array $pieces, $bytes) {
+    $chunk = implode('', $pieces);
+    return str_repeat($chunk, max(1, intdiv($bytes, strlen($chunk))));
+}
+
+function best_time(callable $fn, $iterations) {
+    $best = INF;
+    for ($i = 0; $i < $iterations; $i++) {
+        $start = hrtime(true);
+        $fn();
+        $best = min($best, (hrtime(true) - $start) / 1e9);
+    }
+    return $best;
+}
+
+echo "Kage parser benchmark ({$megabytes} MB per input, best of {$iterations}):\n\n";
+printf("%-18s %12s %12s %8s\n", "input", "parse MB/s", "scan MB/s", "ratio");
+
+foreach ($shapes as $name => $pieces) {
+    $source = generate_source($pieces, $megabytes * 1024 * 1024);
+    $mb = strlen($source) / (1024 * 1024);
+
+    $parse = best_time(function () use ($source) {
+        $ast = kage_ast_parse($source);
+        if ($ast === false) {
+            fwrite(STDERR, "Parse failed\n");
+            exit(1);
+        }
+    }, $iterations);
+
+    $scan = best_time(function () use ($source) {
+        substr_count($source, '"');
+    }, $iterations);
+
+    printf("%-18s %12.1f %12.1f %7.2fx\n", $name, $mb / $parse, $mb / $scan, $scan / $parse);
+}
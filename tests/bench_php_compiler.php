@@ -0,0 +1,57 @@
+<?php
+/**
+ * Benchmark for the Kage PHP-subset compiler
+ *
+ * Runs the same loop-heavy programs through kage_execute_php_bytecode()
+ * and eval(). Compilation and encryption happen once, outside the timed
+ * region; each Kage run still pays for decryption and image loading.
+ *
+ * Usage: php bench_php_compiler.php [iterations]
+ */
+
+$iterations = isset($argv[1]) ? (int)$argv[1] : 20;
+$key = str_repeat("A", 32);
+
+$programs = [
+    'sum loop' => '$sum = 0; $i = 0; while ($i < 100000) { $sum += $i * 2 % 7; $i++; } return $sum;',
+    'nested if' => '$n = 0; $i = 0; while ($i < 50000) { if ($i % 3 == 0) { $n += 3; } elseif ($i % 5 == 0) { $n -= 1; } else { $n++; } $i++; } return $n;',
+    'concat' => '$s = ""; $i = 0; while ($i < 20000) { $s .= "x"; $i++; } return strlen($s);',
+    'calls' => '$n = 0; $i = 0; while ($i < 20000) { $n += strlen(str_repeat("ab", 4)); $i++; } return $n;',
+];
+
+function best_time(callable $fn, $iterations) {
+    $best = INF;
+    for ($i = 0; $i < $iterations; $i++) {
+        $start = hrtime(true);
+        $fn();
+        $best = min($best, (hrtime(true) - $start) / 1e9);
+    }
+    return $best;
+}
+
+echo "Kage PHP compiler benchmark (best of {$iterations}):\n\n";
+printf("%-12s %12s %12s %8s\n", "program", "kage ms", "eval ms", "ratio");
+
+foreach ($programs as $name => $code) {
+    $bytecode = kage_compile_php($code, $key);
+    if ($bytecode === false) {
+        fwrite(STDERR, "Compile failed: {$name}\n");
+        exit(1);
+    }
+
+    $expected = eval($code);
+    if (kage_execute_php_bytecode($bytecode, $key) !== $expected) {
+        fwrite(STDERR, "Result mismatch: {$name}\n");
+        exit(1);
+    }
+
+    $kage = best_time(function () use ($bytecode, $key) {
+        kage_execute_php_bytecode($bytecode, $key);
+    }, $iterations);
+
+    $native = best_time(function () use ($code) {
+        eval($code);
+    }, $iterations);
+
+    printf("%-12s %12.2f %12.2f %7.2fx\n", $name, $kage * 1000, $native * 1000, $kage / $native);
+}
@@ -0,0 +1,41 @@
+<?php
+/**
+ * Benchmark for the VLD dump parser behind kage_encrypt_bytecode()
+ *
+ * Parses a multi-megabyte synthetic VLD dump with the ROTATE algorithm,
+ * which touches no operand bytes, so the time is dominated by parsing.
+ *
+ * Usage: php bench_vld_parser.php [megabytes] [iterations]
+ */
+
+$megabytes = isset($argv[1]) ? (int)$argv[1] : 64;
+$iterations = isset($argv[2]) ? (int)$argv[2] : 5;
+
+$function = <<<'VLD'
+function name:  kage_bench
+number of ops:  6
+compiled vars:  !0 = $a
+line      #* E I O op                           fetch          ext  return  operands
+-------------------------------------------------------------------------------------
+    3     0  E >   ASSIGN                                                   !0, 'Hello, world'
+    4     1        CONCAT                                           ~2      !0, '+'
+          2        ECHO                                                     ~2
+    5     3        INIT_FCALL                                               'strlen'
+          4        SEND_VAR                                                 !0
+    6     5      > RETURN                                                   1
+
+
+VLD;
+
+$dump = "filename:       /in/bench.php\n" . str_repeat($function, max(1, intdiv($megabytes * 1024 * 1024, strlen($function))));
+$mb = strlen($dump) / (1024 * 1024);
+
+$best = INF;
+for ($i = 0; $i < $iterations; $i++) {
+    $start = hrtime(true);
+    $report = kage_encrypt_bytecode(['vld_output' => $dump], ['algorithm' => 'ROTATE']);
+    $best = min($best, (hrtime(true) - $start) / 1e9);
+}
+
+printf("VLD parser: %.1f MB, %d opcodes, %.1f MB/s (best of %d)\n",
+    $mb, $report['total_opcodes'], $mb / $best, $iterations);
@@ -54,6 +54,24 @@ $test_cases = [
     [
         'input' => 'encrypt ""' ,
         'expected' => ''
+    ],
+
+    // Escape sequences in string literals
+    [
+        'input' => 'encrypt "Say \\"hi\\"\\n\\tTab\\\\ \\x41\\q"',
+        'expected' => "Say \"hi\"\n\tTab\\ A\\q"
+    ],
+
+    // Single-character literal
+    [
+        'input' => 'encrypt "x"',
+        'expected' => 'x'
+    ],
+
+    // Embedded NUL bytes are kept (the source length is used, not strlen)
+    [
+        'input' => "encrypt \"nul\0byte\"",
+        'expected' => "nul\0byte"
     ]
 ];
 
@@ -97,6 +115,7 @@ $invalid_cases = [
     'encrypt decrypt',  // Invalid nesting
     'unknown "test"',   // Unknown operation
     '"unclosed string', // Unclosed string
+    '"escaped quote\\"', // Closing quote is escaped
 ];
 
 foreach ($invalid_cases as $i => $input) {
@@ -125,6 +144,44 @@ foreach ($invalid_cases as $i => $input) {
     }
 }
 
+echo "\nTesting repeated execution of a parsed program:\n\n";
+
+// The lowered program is cached on the resource; every run must match
+$ast = kage_ast_parse('decrypt encrypt "Cached program!"');
+if ($ast === false) {
+    echo "Repeated execution: Failed to parse AST (Unexpected)\n";
+    $all_tests_passed = false;
+} else {
+    $runs_ok = true;
+    for ($run = 0; $run < 100; $run++) {
+        if (kage_ast_to_bytecode($ast, $key) !== 'Cached program!') {
+            $runs_ok = false;
+            break;
+        }
+    }
+    echo "Repeated execution: " . ($runs_ok ? "Passed" : "Failed at run " . ($run + 1)) . "\n";
+    $all_tests_passed = $all_tests_passed && $runs_ok;
+
+    // Folded encrypt/decrypt pairs must still reject an invalid key
+    $bad_key_result = @kage_ast_to_bytecode($ast, "short key");
+    echo "Invalid key on cached program: " . ($bad_key_result === false ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $bad_key_result === false;
+}
+
+echo "\nTesting large inputs:\n\n";
+
+// Deep nesting must not depend on the C stack; the pairs fold away when lowered
+$deep = kage_ast_parse(str_repeat('decrypt encrypt ', 100000) . '"Deeply nested!"');
+$deep_ok = $deep !== false && kage_ast_to_bytecode($deep, $key) === 'Deeply nested!';
+echo "Deep nesting: " . ($deep_ok ? "Passed" : "Failed") . "\n";
+$all_tests_passed = $all_tests_passed && $deep_ok;
+
+// Long programs must not overflow the instruction buffer or the VM stack
+$long = kage_ast_parse(str_repeat('"filler" ', 200000) . 'encrypt "Last statement!"');
+$long_ok = $long !== false && kage_ast_to_bytecode($long, $key) === 'Last statement!';
+echo "Many statements: " . ($long_ok ? "Passed" : "Failed") . "\n";
+$all_tests_passed = $all_tests_passed && $long_ok;
+
 echo "\n-- Test Summary --\n";
 if ($all_tests_passed) {
     echo "All tests passed successfully!\n";
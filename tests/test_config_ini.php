@@ -0,0 +1,166 @@
+<?php
+/**
+ * Test script for the kage.* php.ini settings of the shared configuration
+ */
+
+$all_tests_passed = true;
+
+// Runs $code in a child PHP with the given -d settings and environment
+// prefix; returns its last output line, or false if it failed
+function run_child($code, array $ini = [], $env = '') {
+    global $script;
+    file_put_contents($script, $code);
+    $command = $env . escapeshellarg(PHP_BINARY);
+    foreach ($ini as $name => $value) {
+        $command .= ' -d ' . escapeshellarg("$name=$value");
+    }
+    exec($command . ' ' . escapeshellarg($script) . ' 2>&1', $output, $status);
+    return $status === 0 ? end($output) : false;
+}
+
+// FastCGI record of the given type for request 1
+function fcgi_record($type, $content) {
+    return pack('CCnnCx', 1, $type, 1, strlen($content), 0) . $content;
+}
+
+// Runs a script through the php-fpm pool listening on $socket; returns
+// the response body, or false
+function fcgi_request($socket, $script, array $params = []) {
+    $connection = @stream_socket_client('unix://' . $socket, $errno, $error, 5);
+    if (!$connection) {
+        return false;
+    }
+
+    $pairs = '';
+    $params += ['SCRIPT_FILENAME' => $script, 'REQUEST_METHOD' => 'GET',
+                'GATEWAY_INTERFACE' => 'CGI/1.1', 'SERVER_PROTOCOL' => 'HTTP/1.1'];
+    foreach ($params as $name => $value) {
+        $pairs .= chr(strlen($name)) . chr(strlen($value)) . $name . $value;
+    }
+    fwrite($connection, fcgi_record(1, pack('nCx5', 1, 0)) . fcgi_record(4, $pairs)
+        . fcgi_record(4, '') . fcgi_record(5, ''));
+
+    // Collect stdout up to the end-of-request record
+    $stdout = '';
+    while (strlen($header = stream_get_contents($connection, 8)) === 8) {
+        $record = unpack('Cversion/Ctype/nid/nlength/Cpadding', $header);
+        $content = $record['length'] ? stream_get_contents($connection, $record['length']) : '';
+        if ($record['padding']) {
+            stream_get_contents($connection, $record['padding']);
+        }
+        if ($record['type'] === 6) {
+            $stdout .= $content;
+        } elseif ($record['type'] === 3) {
+            break;
+        }
+    }
+    fclose($connection);
+
+    $parts = explode("\r\n\r\n", $stdout, 2);
+    return isset($parts[1]) ? trim($parts[1]) : false;
+}
+
+echo "Testing Kage php.ini settings:\n\n";
+
+$settings = ['kage.log_level', 'kage.max_memory', 'kage.stack_size', 'kage.timeout',
+             'kage.cache_enabled', 'kage.cache_size', 'kage.crypto_algorithm'];
+
+// The memory budget shows which value the shared configuration picked up
+$limit = '<?php echo kage_stats()["memory"]["limit"], "\n";';
+// Every VM run sizes its stack from kage.stack_size; 1 + (2 + 3) needs three slots
+$stack = '<?php $key = str_repeat("k", 32);
+var_export(kage_execute_php_bytecode(kage_compile_php("return 1 + (2 + 3);", $key), $key)); echo "\n";';
+$script = tempnam(sys_get_temp_dir(), 'kage_ini_');
+
+// An invalid value is reported and the default stays in effect
+file_put_contents($script, $limit);
+exec(escapeshellarg(PHP_BINARY) . ' -d ' . escapeshellarg('kage.max_memory=plenty') . ' ' . escapeshellarg($script) . ' 2>&1', $invalid);
+$invalid = implode("\n", $invalid);
+
+// A php-fpm pool value is published before the worker's first request;
+// a value given with one request must not outlive it
+$fpm = null;
+$version = PHP_MAJOR_VERSION . '.' . PHP_MINOR_VERSION;
+foreach ([dirname(PHP_BINARY) . '/../sbin/php-fpm', "/usr/sbin/php-fpm$version", '/usr/sbin/php-fpm'] as $candidate) {
+    if (is_executable($candidate)) {
+        $fpm = $candidate;
+        break;
+    }
+}
+
+$socket = null;
+if ($fpm !== null) {
+    $directory = sys_get_temp_dir() . '/kage_fpm_' . getmypid();
+    mkdir($directory);
+    $socket = "$directory/fpm.sock";
+    file_put_contents("$directory/fpm.conf", "[global]
+error_log = $directory/fpm.log
+[kage]
+listen = $socket
+pm = static
+pm.max_children = 1
+php_admin_value[kage.max_memory] = 3M
+");
+
+    $command = [$fpm, '-F', '-R', '-y', "$directory/fpm.conf"];
+    if (php_ini_loaded_file()) {
+        array_push($command, '-c', php_ini_loaded_file());
+    }
+    $process = proc_open($command, [['file', '/dev/null', 'r'], ['file', "$directory/fpm.out", 'w'],
+                                    ['file', "$directory/fpm.out", 'a']], $pipes);
+    for ($wait = 0; $wait < 50 && !file_exists($socket); $wait++) {
+        usleep(100000);
+    }
+}
+
+// Runs the budget script through the pool
+function pool_limit(array $params = []) {
+    global $socket, $script, $limit;
+    file_put_contents($script, $limit);
+    return fcgi_request($socket, $script, $params);
+}
+
+// Each check returns whether it passed, or null if it cannot run here
+$test_cases = [
+    'Settings registered' => fn() => !in_array(false, array_map('ini_get', $settings), true),
+    'Encryption key not exposed' => fn() => ini_get('kage.encryption_key') === false,
+    'Defaults' => fn() => ini_get('kage.max_memory') === '256M' && ini_get('kage.crypto_algorithm') === 'aes256gcm',
+    'Not changeable at runtime' => fn() => @ini_set('kage.cache_size', '1M') === false && ini_get('kage.cache_size') === '10M',
+    'Applied at startup' => fn() => run_child($limit, ['kage.max_memory' => '64K']) === '65536',
+    'Gigabyte suffix' => fn() => run_child($limit, ['kage.max_memory' => '2G']) === (string)(2 * 1024 * 1024 * 1024),
+    'Environment overrides php.ini' => fn() => run_child($limit, ['kage.max_memory' => '64K'], 'KAGE_MAX_MEMORY=1M ') === '1048576',
+    'ini_get() shows the environment value' => fn() => run_child('<?php echo ini_get("kage.max_memory"), "\n";',
+        ['kage.max_memory' => '64K'], 'KAGE_MAX_MEMORY=1M ') === '1M',
+    'Stack size applied' => fn() => run_child($stack, ['kage.stack_size' => '3']) === '6',
+    'Stack size enforced' => fn() => run_child($stack, ['kage.stack_size' => '2']) !== '6',
+    'Invalid value rejected' => fn() => strpos($invalid, 'Invalid value "plenty" for kage.max_memory') !== false,
+    'Default kept' => fn() => substr($invalid, -strlen('268435456')) === '268435456',
+    'php-fpm pool: Pool value reaches requests' => fn() => $fpm === null ? null : pool_limit() === '3145728',
+    'php-fpm pool: Per-request value applied' => fn() => $fpm === null ? null : pool_limit(['PHP_ADMIN_VALUE' => 'kage.max_memory=1M']) === '1048576',
+    'php-fpm pool: Per-request value dropped afterwards' => fn() => $fpm === null ? null : pool_limit() === '3145728',
+];
+
+foreach ($test_cases as $name => $check) {
+    $ok = $check();
+    if ($ok === null) {
+        echo $name . ": Skipped\n";
+        continue;
+    }
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+if ($fpm !== null) {
+    proc_terminate($process);
+    proc_close($process);
+    array_map('unlink', glob("$directory/*"));
+    rmdir($directory);
+}
+unlink($script);
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
@@ -0,0 +1,74 @@
+<?php
+/**
+ * Test script for memory accounting: exact per-subsystem usage in
+ * kage_stats()['memory'] and the KAGE_MAX_MEMORY budget.
+ */
+
+$all_tests_passed = true;
+
+function memory_tag($tag) {
+    return kage_stats()['memory']['tags'][$tag];
+}
+
+echo "Testing Kage memory accounting:\n\n";
+
+$key = str_repeat('k', 32);
+
+$memory = kage_stats()['memory'];
+
+// AST nodes are charged to "ast" and given back when the tree is freed
+$before = memory_tag('ast');
+$ast = kage_ast_parse(str_repeat('encrypt "Accounted" ', 1000));
+$parsed = memory_tag('ast');
+
+// The cached program is charged to "vm"
+$vm_before = memory_tag('vm');
+$ran = is_string(kage_ast_to_bytecode($ast, $key));
+$vm_charged = memory_tag('vm');
+
+unset($ast);
+$freed = memory_tag('ast');
+$vm_freed = memory_tag('vm');
+$totals = kage_stats()['memory'];
+
+// Going past KAGE_MAX_MEMORY is fatal; checked in a child process
+$script = tempnam(sys_get_temp_dir(), 'kage_memory_');
+file_put_contents($script, '<?php kage_ast_parse(str_repeat(\'encrypt "x" \', 100000)); echo "survived";');
+exec('KAGE_MAX_MEMORY=65536 ' . escapeshellarg(PHP_BINARY) . ' -d display_errors=1 ' . escapeshellarg($script) . ' 2>&1', $limited, $limited_status);
+$limited = implode("\n", $limited);
+exec('KAGE_MAX_MEMORY=0 ' . escapeshellarg(PHP_BINARY) . ' ' . escapeshellarg($script) . ' 2>&1', $unlimited, $unlimited_status);
+unlink($script);
+
+$test_cases = [
+    'Tags reported' => fn() => array_keys($memory['tags']) === ['general', 'crypto', 'ast', 'vm', 'package'],
+    'Default budget' => fn() => $memory['limit'] === 256 * 1024 * 1024,
+    'AST charged' => fn() => $parsed['current_usage'] > $before['current_usage'],
+    'AST allocations counted' => fn() => $parsed['allocation_count'] > $before['allocation_count'],
+    'Program runs' => fn() => $ran,
+    'Program charged' => fn() => $vm_charged['current_usage'] > $vm_before['current_usage'],
+    'AST released exactly' => fn() => $freed['current_usage'] === $before['current_usage'],
+    'Freed bytes tracked' => fn() => $freed['total_freed'] - $before['total_freed'] === $parsed['current_usage'] - $before['current_usage'],
+    'Program released exactly' => fn() => $vm_freed['current_usage'] === $vm_before['current_usage'],
+    'Peak kept' => fn() => $freed['peak_usage'] >= $parsed['current_usage'],
+    // Totals are the sum of the tags
+    'Totals add up' => fn() => $totals['current_usage'] === array_sum(array_column($totals['tags'], 'current_usage'))
+        && $totals['total_allocated'] === array_sum(array_column($totals['tags'], 'total_allocated')),
+    // Packages are charged while they exist
+    'Package round trip' => fn() => kage_decrypt_c(kage_encrypt_c('<?php echo "Accounted";', $key), $key) === '<?php echo "Accounted";',
+    'Budget enforced' => fn() => $limited_status !== 0 && strpos($limited, 'memory budget of 65536 bytes exhausted') !== false,
+    'Budget stops the request' => fn() => strpos($limited, 'survived') === false,
+    'Zero disables the budget' => fn() => $unlimited_status === 0 && in_array('survived', $unlimited, true),
+];
+
+foreach ($test_cases as $name => $check) {
+    $ok = $check();
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
@@ -0,0 +1,88 @@
+<?php
+/**
+ * Test script for the zend_observer function profiler (kage.observer)
+ */
+
+$all_tests_passed = true;
+
+// kage.observer is PHP_INI_SYSTEM, so the profiled script runs in a child process
+function run_observed($code, array $ini) {
+    $script = tempnam(sys_get_temp_dir(), 'kage_observer_');
+    file_put_contents($script, $code);
+    $command = escapeshellarg(PHP_BINARY);
+    foreach ($ini as $name => $value) {
+        $command .= ' -d ' . escapeshellarg("$name=$value");
+    }
+    exec($command . ' ' . escapeshellarg($script), $output, $status);
+    unlink($script);
+    return $status === 0 ? json_decode(implode("\n", $output), true) : null;
+}
+
+function find_function($stats, $name) {
+    foreach ($stats as $entry) {
+        if ($entry['function'] === $name) {
+            return $entry;
+        }
+    }
+    return null;
+}
+
+echo "Testing Kage function profiler:\n\n";
+
+// Protected code runs from eval(), as decrypted Kage sources do
+$code = '<?php
+eval(\'function kage_observed_protected($n) { $s = 0; for ($i = 0; $i < $n; $i++) { $s += $i; } return $s; }\');
+function kage_observed_plain() { return 1; }
+for ($i = 0; $i < 5; $i++) { kage_observed_protected(1000); kage_observed_plain(); }
+try { eval(\'function kage_observed_throws() { throw new Exception("x"); }\'); kage_observed_throws(); } catch (Exception $e) {}
+echo json_encode(kage_observer_stats());
+';
+
+$stats = run_observed($code, ['kage.observer' => 1]);
+$protected = $stats ? find_function($stats, 'kage_observed_protected') : null;
+$walls = $stats ? array_column($stats, 'wall_ns') : [];
+$sorted = $walls;
+rsort($sorted);
+
+// An empty filter observes all user code
+$unfiltered = run_observed($code, ['kage.observer' => 1, 'kage.observer_filter' => '']);
+
+$reset = run_observed('<?php function f() {} f(); kage_observer_stats(true); f(); f(); echo json_encode(kage_observer_stats());',
+    ['kage.observer' => 1, 'kage.observer_filter' => '']);
+
+// Each eval()'d op_array is freed after it runs, so the two sites reuse
+// each other's addresses; every run must be charged to its own site
+$reused = run_observed('<?php
+for ($i = 0; $i < 20; $i++) {
+    eval(\'$a = $i;\');
+    eval(\'$b = [$i, $i + 1]; $c = $b[0] . $b[1];\');
+}
+echo json_encode(kage_observer_stats());', ['kage.observer' => 1]);
+$sites = $reused ? array_filter($reused, function ($entry) { return $entry['function'] === '{main}'; }) : [];
+
+$test_cases = [
+    'Disabled by default' => fn() => ini_get('kage.observer') !== '1' ? kage_observer_stats() === false : true,
+    'Protected function counted' => fn() => $protected && $protected['calls'] === 5,
+    'Wall and CPU time' => fn() => $protected && $protected['wall_ns'] > 0 && $protected['cpu_ns'] > 0
+        && $protected['cpu_ns'] <= $protected['wall_ns'] * 2,
+    "Eval'd file recorded" => fn() => $protected && strpos($protected['file'], "eval()'d code") !== false,
+    'Unprotected function skipped' => fn() => $stats !== null && find_function($stats, 'kage_observed_plain') === null,
+    'Call ending in exception' => fn() => $stats && find_function($stats, 'kage_observed_throws')['calls'] === 1,
+    'Sorted by wall time' => fn() => $walls && $walls === $sorted,
+    'Empty filter observes everything' => fn() => $unfiltered && (find_function($unfiltered, 'kage_observed_plain')['calls'] ?? 0) === 5,
+    'Reset' => fn() => $reset && find_function($reset, 'f')['calls'] === 2,
+    'Reused op_array addresses counted apart' => fn() => count($sites) === 2 && array_unique(array_column($sites, 'calls')) === [20],
+];
+
+foreach ($test_cases as $name => $check) {
+    $ok = (bool)$check();
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
@@ -0,0 +1,108 @@
+<?php
+/**
+ * Test script for in-process Zend opcode extraction
+ */
+
+$all_tests_passed = true;
+
+function opcode_names($extracted) {
+    return array_column($extracted['opcodes'], 'name');
+}
+
+echo "Testing Kage opcode extraction:\n\n";
+
+$source = '<?php
+$x = 10;
+$y = $x * 2;
+echo "Result: " . $y;
+function kage_extracted_helper($a) { return $a + 1; }
+class KageExtractedClass { public function run() { return strlen("abc"); } }
+$f = function () { return 42; };
+';
+
+$extracted = kage_extract_opcodes($source);
+$names = is_array($extracted) ? opcode_names($extracted) : [];
+$first = is_array($extracted) ? $extracted['opcodes'][0] : [];
+
+// File mode compiles without including
+function extract_file() {
+    $file = tempnam(sys_get_temp_dir(), 'kage_ops_');
+    file_put_contents($file, "<html><?php echo 'hi'; ?></html>\n");
+    $from_file = kage_extract_opcodes($file, true);
+    $ok = is_array($from_file) && $from_file['file'] === $file && in_array('ZEND_ECHO', opcode_names($from_file))
+        && !in_array(realpath($file), get_included_files());
+    unlink($file);
+    return $ok;
+}
+
+// With opcache, a cached file's functions and classes live in shared
+// memory; extracting it repeatedly must leave them alone. Null when
+// opcache is not loaded.
+function extract_cached_file($source) {
+    $file = tempnam(sys_get_temp_dir(), 'kage_ops_');
+    file_put_contents($file, $source);
+    $script = tempnam(sys_get_temp_dir(), 'kage_opcache_');
+    file_put_contents($script, '<?php
+$file = ' . var_export($file, true) . ';
+if (!function_exists("opcache_get_status") || !opcache_get_status(false)) { echo "no opcache"; exit; }
+opcache_compile_file($file);
+$runs = [];
+for ($i = 0; $i < 3; $i++) { $runs[] = kage_extract_opcodes($file, true); }
+echo $runs[0] && $runs[0] == $runs[2] && opcache_is_script_cached($file) ? "ok" : "mismatch";
+');
+    exec(escapeshellarg(PHP_BINARY) . ' -d opcache.enable=1 -d opcache.enable_cli=1 ' . escapeshellarg($script), $output, $status);
+    unlink($script);
+    unlink($file);
+    return end($output) === 'no opcache' ? null : $status === 0 && end($output) === 'ok';
+}
+
+// The literals 'strlen' and 'PHP_EOL' are interned and shared with the
+// function and constant tables; encrypting must leave those intact
+function encrypt_calls() {
+    $calls = '<?php echo strlen("abc"), PHP_EOL, str_repeat("x", 2);';
+    kage_encrypt_bytecode(['source' => $calls], ['algorithm' => 'XOR', 'key' => 'secret']);
+    kage_encrypt_bytecode(['source' => $calls], ['algorithm' => 'CUSTOM', 'key' => 'secret']);
+    return strlen('abc') === 3 && function_exists('str_repeat') && str_repeat('x', 2) === 'xx'
+        && in_array(PHP_EOL, ["\n", "\r\n"], true) && eval('return strlen("abc");') === 3;
+}
+
+// Each check returns whether it passed, or null if it cannot run here
+$test_cases = [
+    'Extract from source' => fn() => is_array($extracted) && count($extracted['opcodes']) > 0,
+    'Main script opcodes' => fn() => in_array('ZEND_ASSIGN', $names) && in_array('ZEND_MUL', $names) && in_array('ZEND_ECHO', $names),
+    'Functions, methods and closures' => fn() => isset($extracted['functions']['{main}'])
+        && isset($extracted['functions']['kage_extracted_helper'])
+        && isset($extracted['functions']['KageExtractedClass::run'])
+        && count(preg_grep('/^\{closure\}:/', array_keys($extracted['functions']))) === 1,
+    'Operands in VLD notation' => fn() => $first['name'] === 'ZEND_ASSIGN' && $first['op1'] === '!0' && $first['op2'] === 10,
+    'Line numbers' => fn() => $first['line'] === 2,
+    // Extraction must not declare anything in the running request
+    'No functions declared' => fn() => !function_exists('kage_extracted_helper'),
+    'No classes declared' => fn() => !class_exists('KageExtractedClass', false),
+    'Extract again' => fn() => kage_extract_opcodes($source) !== false,
+    'Extract from file without including it' => fn() => extract_file(),
+    'Extract cached file' => fn() => extract_cached_file($source),
+    'Reject syntax error' => fn() => @kage_extract_opcodes('$x = ;') === false,
+    'Reject missing file' => fn() => @kage_extract_opcodes('/nonexistent/kage.php', true) === false,
+    // The opcode encryption API takes source directly
+    'Encrypt from source' => fn() => ($report = kage_encrypt_bytecode(['source' => $source], ['algorithm' => 'XOR', 'key' => 'secret']))
+        && $report['total_opcodes'] === count($extracted['opcodes']),
+    'Functions still callable after encryption' => fn() => encrypt_calls(),
+];
+
+foreach ($test_cases as $name => $check) {
+    $ok = $check();
+    if ($ok === null) {
+        echo $name . ": Skipped\n";
+        continue;
+    }
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
@@ -0,0 +1,175 @@
+<?php
+/**
+ * Test script for profile-guided selective opcode encryption
+ */
+
+$all_tests_passed = true;
+
+function profile_line($file, $function, $count, $executions) {
+    return $file . "\t" . $function . "\t" . implode(',', array_fill(0, $count, $executions)) . "\n";
+}
+
+function function_length($extracted, $name) {
+    $starts = array_values($extracted['functions']);
+    sort($starts);
+    $start = $extracted['functions'][$name];
+    foreach ($starts as $next) {
+        if ($next > $start) {
+            return $next - $start;
+        }
+    }
+    return count($extracted['opcodes']) - $start;
+}
+
+echo "Testing Kage profile-guided opcode encryption:\n\n";
+
+$source = '<?php
+function kage_profiled_hot($n) { $s = 0; for ($i = 0; $i < $n; $i++) { $s += $i; } return $s; }
+function kage_profiled_cold() { return strrev("cold"); }
+echo kage_profiled_hot(100), kage_profiled_cold();
+';
+
+$extracted = kage_extract_opcodes($source);
+$total = count($extracted['opcodes']);
+$hot_length = function_length($extracted, 'kage_profiled_hot');
+$cold_length = function_length($extracted, 'kage_profiled_cold');
+$main_length = function_length($extracted, '{main}');
+$file = $extracted['file'];
+
+$profile = tempnam(sys_get_temp_dir(), 'kage_profile_');
+file_put_contents($profile,
+    profile_line($file, '{main}', $main_length, 1) .
+    profile_line($file, 'kage_profiled_hot', $hot_length, 60) .
+    profile_line($file, 'kage_profiled_hot', $hot_length, 40) .
+    profile_line($file, 'kage_profiled_cold', $cold_length, 1));
+
+$options = ['algorithm' => 'XOR', 'key' => 'secret', 'profile' => $profile];
+$percent = $hot_length * 100 / $total;
+$hot_start = $extracted['functions']['kage_profiled_hot'];
+$encrypted = kage_encrypt_bytecode(['source' => $source], $options + ['hot_percent' => $percent]);
+
+// Encrypts $source against a profile; null $contents leaves no profile file
+function encrypt_with_profile($contents, $percent) {
+    global $source, $options, $profile;
+    if ($contents === null) {
+        @unlink($profile);
+    } else {
+        file_put_contents($profile, $contents);
+    }
+    return @kage_encrypt_bytecode(['source' => $source], $options + ['hot_percent' => $percent]);
+}
+
+// Cold opcodes are sealed whole: a NOP carrying only the ciphertext
+function cold_opcodes_sealed($encrypted) {
+    global $extracted, $total, $hot_start, $hot_length;
+    $ok = count($encrypted['opcodes']) === $total;
+    foreach ($encrypted['opcodes'] as $i => $op) {
+        if ($i >= $hot_start && $i < $hot_start + $hot_length) {
+            continue;
+        }
+        $plain = $extracted['opcodes'][$i];
+        $ok = $ok && $op['opcode'] === 0 && $op['line'] === 0
+            && is_string($op['op1']) && $op['op1'] !== ($plain['op1'] ?? null)
+            && !isset($op['op2']) && !isset($op['result']);
+    }
+    return $ok;
+}
+
+// Recording: runs $code with kage.profile=1 $times times and returns the
+// lines appended to a fresh profile, or false if a run failed
+function record_profile($code, $times) {
+    global $profile, $script;
+    @unlink($profile);
+    file_put_contents($script, $code);
+    $command = escapeshellarg(PHP_BINARY) . ' -d kage.profile=1 -d kage.profile_file=' . escapeshellarg($profile) . ' ' . escapeshellarg($script);
+    for ($run = 0; $run < $times; $run++) {
+        exec($command, $output, $status);
+        if ($status !== 0) {
+            return false;
+        }
+    }
+    return file_exists($profile) ? file($profile, FILE_IGNORE_NEW_LINES) : [];
+}
+
+// Eval'd op_arrays are freed after each run, so their addresses get reused
+// by the other eval site; every run must land in the counts of its own code.
+// Runs of one site may be split over several lines, but all of them must
+// have that site's opcode count and add up to one execution per run.
+function eval_sites_recorded_apart($runs) {
+    $lines = record_profile('<?php
+for ($i = 0; $i < ' . $runs . '; $i++) {
+    eval(\'$a = $i;\');
+    eval(\'$b = [$i, $i + 1, $i + 2]; $c = $b[0] . $b[1] . $b[2]; $d = strlen($c);\');
+}
+', 1);
+    if ($lines === false) {
+        return false;
+    }
+
+    $sums = [];
+    foreach ($lines as $line) {
+        [$file, $function, $counts] = explode("\t", $line);
+        if (strpos($file, "eval()'d code") === false) {
+            continue;
+        }
+        $counts = array_map('intval', explode(',', $counts));
+        if (!isset($sums[$file])) {
+            $sums[$file] = array_fill(0, count($counts), 0);
+        }
+        if (count($counts) !== count($sums[$file])) {
+            $sums[$file] = [-1];
+            continue;
+        }
+        foreach ($counts as $i => $count) {
+            $sums[$file][$i] += $count;
+        }
+    }
+    $exact = count($sums) === 2;
+    foreach ($sums as $counts) {
+        $exact = $exact && array_unique($counts) === [$runs];
+    }
+    return $exact;
+}
+
+$script = tempnam(sys_get_temp_dir(), 'kage_script_');
+
+$test_cases = [
+    'Hottest function on the fast path' => fn() => ($report = kage_encrypt_bytecode(['source' => $source], $options + ['hot_percent' => $percent]))
+        && $report['fast_path_opcodes'] === $hot_length && $report['encrypted_opcodes'] === $total - $hot_length,
+    'Every executed opcode at 100%' => fn() => kage_encrypt_bytecode(['source' => $source], $options + ['hot_percent' => 100])['fast_path_opcodes'] === $total,
+    'Nothing hot at 0%' => fn() => ($report = kage_encrypt_bytecode(['source' => $source], $options + ['hot_percent' => 0]))
+        && $report['fast_path_opcodes'] === 0 && $report['encrypted_opcodes'] === $total,
+    'Cold opcodes differ from the plaintext' => fn() => cold_opcodes_sealed($encrypted),
+    'Decryption applies the same split' => fn() => ($decrypted = kage_decrypt_bytecode($encrypted, $options + ['hot_percent' => $percent]))
+        && $decrypted['fast_path_opcodes'] === $hot_length && $decrypted['opcodes'] == $extracted['opcodes'],
+    'Wrong key rejected' => fn() => @kage_decrypt_bytecode($encrypted, ['key' => 'wrong'] + $options + ['hot_percent' => $percent]) === false,
+    'AES without a profile rejected' => fn() => @kage_encrypt_bytecode(['source' => $source], ['algorithm' => 'AES', 'key' => 'secret']) === false,
+    // A function whose opcode count changed since profiling is left cold
+    'Stale profile ignored' => fn() => encrypt_with_profile(profile_line($file, 'kage_profiled_hot', $hot_length + 1, 100), 100)['fast_path_opcodes'] === 0,
+    // Unique function names match even when the profiled path differs
+    'Match by function name' => fn() => encrypt_with_profile(profile_line('/srv/app/lib.php', 'kage_profiled_hot', $hot_length, 100), 100)['fast_path_opcodes'] === $hot_length,
+    'Malformed lines skipped' => fn() => encrypt_with_profile("garbage\n/srv/a.php\tf\t1,x,3\n", 10)['fast_path_opcodes'] === 0,
+    'Missing profile' => fn() => encrypt_with_profile(null, 10) === false,
+    // Scripts must not be able to point the recorder at another file
+    'Profile file is system-only' => fn() => @ini_set('kage.profile_file', '/tmp/elsewhere') === false,
+    'Profile recorded per request' => fn() => ($lines = record_profile($source, 2)) !== false
+        && count(preg_grep('/^' . preg_quote(realpath($script), '/') . '\tkage_profiled_hot\t/', $lines)) === 2,
+    'Recorded profile drives the encoder' => fn() => kage_encrypt_bytecode(['file' => realpath($script)], $options + ['hot_percent' => 10])['fast_path_opcodes'] > 0,
+    'Reused op_array addresses recorded apart' => fn() => eval_sites_recorded_apart(50),
+];
+
+foreach ($test_cases as $name => $check) {
+    $ok = $check();
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+@unlink($profile);
+unlink($script);
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
@@ -0,0 +1,81 @@
+<?php
+/**
+ * Test script for the Kage PHP-subset compiler
+ */
+
+$key = str_repeat("A", 32); // 32 bytes for crypto_secretbox_KEYBYTES
+
+$all_tests_passed = true;
+
+// Compiles and runs a program, returning [return value, echoed output,
+// bytecode]; $run_key overrides the key used to run it
+function run($code, $run_key = null) {
+    global $key;
+    $bytecode = @kage_compile_php($code, $key);
+    if ($bytecode === false) {
+        return [false, '', ''];
+    }
+    ob_start();
+    $result = @kage_execute_php_bytecode($bytecode, $run_key ?? $key);
+    return [$result, ob_get_clean(), $bytecode];
+}
+
+echo "Testing Kage PHP compiler:\n\n";
+
+$cases = [
+    'Return literal'     => ['<?php return 42;', 42, ''],
+    'Echo'               => ['<?php echo "Hello", " ", \'World\';', null, 'Hello World'],
+    'Arithmetic'         => ['return 2 + 3 * 4 - 10 / 5;', 12, ''],
+    'Modulo and negate'  => ['return -(17 % 5);', -2, ''],
+    'Concatenation'      => ['$a = "x"; $a .= "y"; return $a . 1 + 1;', 'xy2', ''],
+    'Comparison'         => ['return var_export(1 < 2, true) . var_export(2 <= 1, true) . var_export("1" == 1, true) . var_export("1" === 1, true);', 'truefalsetruefalse', ''],
+    'Short circuit'      => ['$n = 0; $ok = false && ($n = 1); $ok2 = true || ($n = 2); return $n;', 0, ''],
+    'Boolean result'     => ['return 1 && "a";', true, ''],
+    'Increments'         => ['$i = 5; $a = $i++; $b = ++$i; return $a . "," . $b . "," . $i--;', '5,7,7', ''],
+    'If/elseif/else'     => ['$x = 7; if ($x < 5) { return "low"; } elseif ($x < 10) { return "mid"; } else { return "high"; }', 'mid', ''],
+    'While loop'         => ['$sum = 0; $i = 1; while ($i <= 100) { $sum += $i; $i++; } return $sum;', 5050, ''],
+    'Nested loops'       => ['$n = 0; $i = 0; while ($i < 10) { $j = 0; while ($j < 10) { $n++; $j++; } $i++; } return $n;', 100, ''],
+    'Function calls'     => ['return strlen(str_repeat("ab", 3)) + max(1, 9, 4);', 15, ''],
+    'Escapes'            => ['return "a\tb\n\x41\101\$";', "a\tb\nAA\$", ''],
+    'Falls off the end'  => ['$a = 1;', null, ''],
+    'Close tag'          => ['<?php echo "in" ?>out', null, 'inout'],
+    'Interpolation'      => ['$name = "Kage"; $n = 3; return "Hi $name x{$n}";', 'Hi Kage x3', ''],
+    'For loop'           => ['$s = ""; for ($i = 0, $j = 10; $i < 5; $i++, $j--) { $s .= $i . $j; } return $s;', '01019283746', ''],
+    'Break and continue' => ['$n = 0; for ($i = 0; ; $i++) { if ($i % 2) continue; if ($i > 8) break; $n += $i; } return $n;', 20, ''],
+    'Nested break'       => ['$n = 0; while (true) { while (true) { $n++; break 2; } } return $n;', 1, ''],
+    'Do-while'           => ['$i = 0; do { $i++; } while ($i < 3); return $i;', 3, ''],
+    'Ternary'            => ['$x = 4; return $x > 3 ? "big" : "small";', 'big', ''],
+    'Engine constants'   => ['return PHP_INT_MAX === 9223372036854775807 || PHP_INT_SIZE === 4;', true, ''],
+    'Comments'           => ["// line\n# hash\n/* block */ return 1;", 1, ''],
+
+    // Compiled programs are encrypted with the key
+    'Bytecode hides literals' => ['<?php return "secret";', 'secret', ''],
+    'Wrong key is rejected'   => ['<?php return "secret";', false, '', str_repeat("B", 32)],
+
+    // Syntax outside the subset must be rejected, not miscompiled
+    'Reject: Missing semicolon'    => ['echo 1', false, ''],
+    'Reject: Unbalanced brace'     => ['if (1) { echo 1;', false, ''],
+    'Reject: Assign to literal'    => ['1 = 2;', false, ''],
+    'Reject: Unterminated string'  => ['echo "abc;', false, ''],
+    'Reject: Function declaration' => ['function f() {}', false, ''],
+    'Reject: Array access'         => ['return $a[0];', false, ''],
+    'Reject: Break outside loop'   => ['break;', false, ''],
+    'Reject: Unknown character'    => ['return 1 @ 2;', false, ''],
+];
+
+foreach ($cases as $label => $case) {
+    [$code, $expected, $output] = $case;
+    [$result, $echoed, $bytecode] = run($code, $case[3] ?? null);
+    // String results never appear in the encrypted bytecode
+    $ok = $result === $expected && $echoed === $output
+        && (!is_string($expected) || $expected === '' || strpos($bytecode, $expected) === false);
+    echo $label . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
@@ -0,0 +1,63 @@
+<?php
+/**
+ * Test script for the request arena and scratch buffer: temporaries on
+ * the encrypt/decrypt paths are reused, so repeated calls do not grow
+ * the request heap and results stay intact.
+ */
+
+$all_tests_passed = true;
+
+echo "Testing Kage request arena:\n\n";
+
+$key = str_repeat('k', 32);
+$code = '<?php echo "Hello from the arena";';
+
+// Package round trip through the request arena
+$encrypted = kage_encrypt_c($code, $key);
+
+// Warm up, then repeat: the arena is rewound after every call
+for ($i = 0; $i < 10; $i++) {
+    kage_decrypt_c(kage_encrypt_c($code, $key), $key);
+}
+$before = memory_get_usage();
+$round_trips = true;
+for ($i = 0; $i < 500; $i++) {
+    $round_trips = $round_trips && kage_decrypt_c(kage_encrypt_c($code, $key), $key) === $code;
+}
+$growth = memory_get_usage() - $before;
+
+// Internal crypto: the ciphertext and decoded input use the scratch buffer
+$ast = kage_ast_parse('encrypt "Scratch"');
+$scratch = true;
+for ($i = 0; $i < 200; $i++) {
+    $scratch = $scratch && kage_ast_to_bytecode($ast, $key) === 'Scratch';
+}
+
+// Payloads above the retained scratch size fall back to the heap
+$large = '<?php return "' . str_repeat("0123456789abcdef", 128 * 1024) . '";';
+
+$test_cases = [
+    'Package encrypts' => fn() => is_string($encrypted) && $encrypted !== '',
+    'Package decrypts' => fn() => kage_decrypt_c($encrypted, $key) === $code,
+    'Repeated package round trips' => fn() => $round_trips,
+    'Request heap does not grow' => fn() => $growth < 4096,
+    'Scratch buffer reused' => fn() => $scratch,
+    'Large package round trip' => fn() => kage_decrypt_c(kage_encrypt_c($large, $key), $key) === $large,
+    // Failures release the scratch buffer and rewind the arena
+    'Invalid base64 rejected' => fn() => @kage_decrypt_c("not base64!", $key) === false,
+    'Garbage package rejected' => fn() => @kage_decrypt_c(base64_encode("garbage"), $key) === false,
+    'Usable after failures' => fn() => kage_decrypt_c(kage_encrypt_c($code, $key), $key) === $code,
+];
+
+foreach ($test_cases as $name => $check) {
+    $ok = $check();
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
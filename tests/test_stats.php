@@ -0,0 +1,84 @@
+<?php
+/**
+ * Test script for the operation metrics (kage_stats)
+ */
+
+$all_tests_passed = true;
+
+echo "Testing Kage operation metrics:\n\n";
+
+$key = str_repeat('k', 32);
+$operations = ['encrypt', 'decrypt', 'base64_encode', 'base64_decode', 'parse', 'lower', 'vm_execute'];
+
+$reported = kage_stats(true);
+$empty = kage_stats();
+
+// Parse once, lower once, then run from the cached program. The result is
+// decrypted until that fails, so each run decrypts twice and fails once.
+$ast = kage_ast_parse('encrypt "Measured!"');
+$runs = 20;
+$ran = true;
+for ($i = 0; $i < $runs; $i++) {
+    $ran = $ran && kage_ast_to_bytecode($ast, $key) === 'Measured!';
+}
+$stats = kage_stats();
+$decrypt = $stats['decrypt'];
+// Buckets are keyed by their upper bound, in ascending order
+$bounds = array_keys($decrypt['histogram']);
+$sorted = $bounds;
+sort($sorted);
+
+// Failures are counted and timed
+@kage_ast_to_bytecode($ast, "short key");
+$after_failure = kage_stats();
+$failed = @kage_ast_parse('encrypt');
+$after_parse_failure = kage_stats();
+
+// kage.stats_file is written at module shutdown, so check it from a child process
+$dump = tempnam(sys_get_temp_dir(), 'kage_stats_');
+$script = tempnam(sys_get_temp_dir(), 'kage_stats_script_');
+file_put_contents($script, '<?php $a = kage_ast_parse(\'encrypt "x"\'); kage_ast_to_bytecode($a, str_repeat("k", 32));');
+exec(escapeshellarg(PHP_BINARY) . ' -d ' . escapeshellarg("kage.stats_file=$dump") . ' ' . escapeshellarg($script), $output, $status);
+$lines = file($dump, FILE_IGNORE_NEW_LINES);
+$decrypt_line = $lines ? preg_grep('/ op=decrypt /', $lines) : [];
+unlink($script);
+unlink($dump);
+
+$test_cases = [
+    'All operations reported' => fn() => count(array_intersect($operations, array_keys($reported))) === count($operations),
+    'Cache and memory sections' => fn() => isset($reported['program_cache']['hits'], $reported['program_cache']['misses'], $reported['memory']['peak_usage']),
+    'Reset clears counters' => fn() => $empty['decrypt']['count'] === 0 && $empty['decrypt']['histogram'] === [] && $empty['program_cache']['hits'] === 0,
+    'Programs ran' => fn() => $ran,
+    'Decrypt count' => fn() => $decrypt['count'] === 2 * $runs && $decrypt['failures'] === $runs,
+    'Encrypt count' => fn() => $stats['encrypt']['count'] === $runs && $stats['encrypt']['failures'] === 0,
+    'Base64 nested in crypto' => fn() => $stats['base64_encode']['count'] === $runs && $stats['base64_decode']['count'] === 2 * $runs,
+    'Decrypt bytes' => fn() => $decrypt['bytes'] > 0 && $decrypt['bytes'] === $stats['base64_decode']['bytes'],
+    'Parsed once, lowered once' => fn() => $stats['parse']['count'] === 1 && $stats['lower']['count'] === 1,
+    'Program cache' => fn() => $stats['program_cache']['misses'] === 1 && $stats['program_cache']['hits'] === $runs - 1,
+    'VM runs' => fn() => $stats['vm_execute']['count'] === $runs,
+    'Histogram matches count' => fn() => array_sum($decrypt['histogram']) === $decrypt['count'],
+    'Percentiles ordered' => fn() => $decrypt['p50_ns'] > 0 && $decrypt['p50_ns'] <= $decrypt['p90_ns']
+        && $decrypt['p90_ns'] <= $decrypt['p99_ns'] && $decrypt['p99_ns'] <= $decrypt['p999_ns']
+        && $decrypt['p999_ns'] <= $decrypt['max_ns'],
+    'Mean within range' => fn() => $decrypt['mean_ns'] > 0 && $decrypt['mean_ns'] <= $decrypt['max_ns']
+        && $decrypt['mean_ns'] === intdiv($decrypt['total_ns'], $decrypt['count']),
+    'Histogram keyed by bucket bound' => fn() => $bounds === $sorted,
+    'Failure counted' => fn() => $after_failure['encrypt']['failures'] === 1 && $after_failure['encrypt']['count'] === $runs + 1,
+    'Parse failure counted' => fn() => $failed === false && $after_parse_failure['parse']['failures'] === 1,
+    'Dump written at shutdown' => fn() => $status === 0 && count($decrypt_line) === 1,
+    'Dump has pid and percentiles' => fn() => $decrypt_line
+        && preg_match('/pid=\d+ op=decrypt count=2 .*p50_ns=\d+ .*p99_ns=\d+ .*max_ns=\d+$/', reset($decrypt_line)),
+];
+
+foreach ($test_cases as $name => $check) {
+    $ok = (bool)$check();
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
@@ -0,0 +1,212 @@
+<?php
+/**
+ * Test script for input validation on the encrypt/decrypt paths and its
+ * counters in kage_stats()
+ */
+
+$all_tests_passed = true;
+
+echo "Testing Kage input validation:\n\n";
+
+$key = str_repeat('k', 32);
+
+// Calls $call and returns [its result, the last warning it raised]
+function with_warning(callable $call) {
+    $warning = null;
+    set_error_handler(function ($errno, $message) use (&$warning) {
+        $warning = $message;
+        return true;
+    });
+    $result = $call();
+    restore_error_handler();
+    return [$result, $warning];
+}
+
+// The validation counters cover every call from here to the snapshot
+kage_stats(true);
+
+// UTF-8 and line breaks are fine in source code
+$code = "<?php\r\n\techo 'Grüße, €5';\n";
+$encrypted = kage_encrypt_c($code, $key);
+$utf8_round_trip = is_string($encrypted) && kage_decrypt_c($encrypted, $key) === $code;
+
+// A NUL used to cut the stored source short
+[$nul_result, $nul_warning] = with_warning(fn() => kage_encrypt_c("<?php echo 1;\0echo 2;", $key));
+
+// The NUL is found past the vectorised blocks too
+$long = '<?php echo "' . str_repeat('abcdefgh', 1000) . '";';
+$long_round_trip = kage_decrypt_c(kage_encrypt_c($long, $key), $key) === $long;
+$long_nul = @kage_encrypt_c($long . "\0", $key);
+$package_nul = @kage_decrypt_c(base64_encode("P5:ab\0cd"), $key);
+
+// Encrypt checks the source, decrypt the decoded package
+$validation = kage_stats()['validation'];
+kage_stats(true);
+$reset = kage_stats()['validation'];
+
+// Base64 is validated while it is decoded
+$corrupt = $encrypted;
+$corrupt[10] = '*';
+
+// kage_validate() runs the checks directly. Inputs under 64 bytes only
+// take the scalar scan; longer ones go through the SSSE3 blocks first
+// where the CPU has them, and the scalar scan finds the exact offset. Both
+// must agree, so each case runs short and at every position around the
+// first two block boundaries of a long input. Building with
+// -DKAGE_VALIDATION_SCALAR=ON runs every case on the scalar path alone.
+function validation_offset($data, $checks) {
+    $result = kage_validate($data, $checks);
+    return $result === true ? -1 : $result['offset'];
+}
+
+// Offset of the first byte of the first malformed UTF-8 sequence, per
+// RFC 3629; -1 if there is none
+function utf8_error_offset($data) {
+    $length = strlen($data);
+    for ($i = 0; $i < $length;) {
+        $lead = ord($data[$i]);
+        if ($lead < 0x80) {
+            $i++;
+            continue;
+        }
+        if ($lead >= 0xC2 && $lead <= 0xDF) {
+            [$size, $low, $high] = [2, 0x80, 0xBF];
+        } elseif ($lead >= 0xE0 && $lead <= 0xEF) {
+            [$size, $low, $high] = [3, $lead === 0xE0 ? 0xA0 : 0x80, $lead === 0xED ? 0x9F : 0xBF];
+        } elseif ($lead >= 0xF0 && $lead <= 0xF4) {
+            [$size, $low, $high] = [4, $lead === 0xF0 ? 0x90 : 0x80, $lead === 0xF4 ? 0x8F : 0xBF];
+        } else {
+            return $i;
+        }
+        if ($i + $size > $length || ord($data[$i + 1]) < $low || ord($data[$i + 1]) > $high) {
+            return $i;
+        }
+        for ($k = 2; $k < $size; $k++) {
+            if ((ord($data[$i + $k]) & 0xC0) !== 0x80) {
+                return $i;
+            }
+        }
+        $i += $size;
+    }
+    return -1;
+}
+
+// Whether $bad is reported at its own offset, short and around the block
+// boundaries, and $good is accepted in the same places
+function check_everywhere($bad, $good, $checks) {
+    $ok = validation_offset("ab" . $bad . "cd", $checks) === 2 && validation_offset("ab" . $good, $checks) === -1;
+    for ($position = 0; $position <= 136; $position++) {
+        $prefix = str_repeat('a', $position);
+        $ok = $ok && validation_offset($prefix . $bad . str_repeat('b', 200 - $position), $checks) === $position
+                  && validation_offset($prefix . $good . str_repeat('b', 200 - $position), $checks) === -1;
+    }
+    return $ok;
+}
+
+// A sequence cut off by the end of the input, at and around a block end
+function truncated_everywhere() {
+    $ok = true;
+    foreach ([62, 63, 64, 126, 127, 128] as $position) {
+        $ok = $ok && validation_offset(str_repeat('a', $position) . "\xF0\x9F\x98", KAGE_CHECK_UTF8) === $position;
+    }
+    return $ok;
+}
+
+// Random mixes of ASCII, continuation and lead bytes against the reference
+function matches_reference() {
+    $pieces = ["a", "\n", "\x80", "\xBF", "\xC2", "\xDF", "\xE0", "\xED", "\xF0", "\xF4", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80"];
+    mt_srand(49);
+    for ($run = 0; $run < 2000; $run++) {
+        $data = str_repeat('x', mt_rand(0, 130));
+        for ($n = mt_rand(1, 3); $n > 0; $n--) {
+            $data .= $pieces[mt_rand(0, count($pieces) - 1)];
+        }
+        $data .= str_repeat('y', mt_rand(0, 70));
+        if (validation_offset($data, KAGE_CHECK_UTF8) !== utf8_error_offset($data)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Base64 alphabet and padding
+function base64_accepted() {
+    for ($n = 0; $n < 120; $n++) {
+        if (kage_validate(base64_encode(random_bytes($n)), KAGE_CHECK_BASE64) !== true) {
+            return false;
+        }
+    }
+    return true;
+}
+
+function base64_alphabet() {
+    $ok = validation_offset('ab*d', KAGE_CHECK_BASE64) === 2
+        && validation_offset(str_repeat('+/AZaz09', 25), KAGE_CHECK_BASE64) === -1;
+    for ($position = 0; $position <= 136; $position++) {
+        $data = str_repeat('QUJD', 50);
+        $data[$position] = '*';
+        $ok = $ok && validation_offset($data, KAGE_CHECK_BASE64) === $position;
+    }
+    return $ok
+        && validation_offset(str_repeat('QUJD', 30) . '-' . 'QUJ', KAGE_CHECK_BASE64) === 120
+        && validation_offset(str_repeat('QUJD', 15) . "QU\nD", KAGE_CHECK_BASE64) === 62;
+}
+
+$all = KAGE_CHECK_UTF8 | KAGE_CHECK_NO_NULL | KAGE_CHECK_NO_CONTROL;
+
+$test_cases = [
+    'Source with UTF-8 encrypts' => fn() => $utf8_round_trip,
+    'NUL in source rejected' => fn() => $nul_result === false,
+    'Offset reported' => fn() => $nul_warning === 'Kage: Invalid PHP code: NUL byte at offset 13',
+    'Long source encrypts' => fn() => $long_round_trip,
+    'NUL in long source rejected' => fn() => $long_nul === false,
+    'NUL in package rejected' => fn() => $package_nul === false,
+    'Validations counted' => fn() => $validation['count'] === 7 && $validation['failures'] === 3,
+    'Bytes counted' => fn() => $validation['bytes'] > 2 * strlen($long),
+    'Reset clears counters' => fn() => $reset === ['count' => 0, 'failures' => 0, 'bytes' => 0],
+    'Surrounding whitespace skipped' => fn() => kage_decrypt_c("\n " . $encrypted . "\r\n", $key) === $code,
+    'Bad base64 offset reported' => fn() => with_warning(fn() => kage_decrypt_c($corrupt, $key))
+        === [false, 'Kage: Failed to decode encrypted data at offset 10'],
+    'Padding only at the end' => fn() => @kage_decrypt_c('QQ==' . $encrypted, $key) === false,
+
+    'Overlong 2-byte form'      => fn() => check_everywhere("\xC0\xAF", "\xC2\x80", KAGE_CHECK_UTF8),
+    'Overlong 3-byte form'      => fn() => check_everywhere("\xE0\x9F\xBF", "\xE0\xA0\x80", KAGE_CHECK_UTF8),
+    'Overlong 4-byte form'      => fn() => check_everywhere("\xF0\x8F\xBF\xBF", "\xF0\x90\x80\x80", KAGE_CHECK_UTF8),
+    'Surrogate'                 => fn() => check_everywhere("\xED\xA0\x80", "\xED\x9F\xBF", KAGE_CHECK_UTF8),
+    'Above U+10FFFF'            => fn() => check_everywhere("\xF4\x90\x80\x80", "\xF4\x8F\xBF\xBF", KAGE_CHECK_UTF8),
+    'Invalid lead byte'         => fn() => check_everywhere("\xF5\x80\x80\x80", "\xEF\xBF\xBF", KAGE_CHECK_UTF8),
+    'Stray continuation'        => fn() => check_everywhere("\x80", "\xDF\xBF", KAGE_CHECK_UTF8),
+    'Truncated 3-byte sequence' => fn() => check_everywhere("\xE2\x82", "\xE2\x82\xAC", KAGE_CHECK_UTF8),
+    'Truncated 4-byte sequence' => fn() => check_everywhere("\xF0\x9F\x98", "\xF0\x9F\x98\x80", KAGE_CHECK_UTF8),
+    'Sequence truncated by the end of the input' => fn() => truncated_everywhere(),
+
+    'Control characters' => fn() => check_everywhere("\x01", "\t", KAGE_CHECK_NO_CONTROL)
+        && check_everywhere("\x1F", "\r\n", KAGE_CHECK_NO_CONTROL)
+        && check_everywhere("\x7F", "~", KAGE_CHECK_NO_CONTROL),
+    'Control character message' => fn() => kage_validate("a\x1Bb", KAGE_CHECK_NO_CONTROL) === ['error' => 'control character', 'offset' => 1],
+    // The first failing check is reported, whichever it is
+    'Checks run together' => fn() => kage_validate("ab\xC3\xA9\0", $all) === ['error' => 'NUL byte', 'offset' => 4]
+        && kage_validate(str_repeat("\xC3\xA9", 40) . "\xC3", $all) === ['error' => 'invalid UTF-8 sequence', 'offset' => 80],
+    'Offsets match the RFC 3629 reference' => fn() => matches_reference(),
+
+    'Base64 accepted' => fn() => base64_accepted(),
+    'Base64 alphabet' => fn() => base64_alphabet(),
+    'Base64 padding only at the end' => fn() => validation_offset('QQ==QUJD', KAGE_CHECK_BASE64) === 2
+        && validation_offset('QUJD' . str_repeat('=', 4), KAGE_CHECK_BASE64) === 4
+        && validation_offset(str_repeat('QUJD', 20) . 'Q===', KAGE_CHECK_BASE64) === 81,
+    'Base64 length' => fn() => kage_validate(str_repeat('QUJD', 20) . 'QU', KAGE_CHECK_BASE64)
+        === ['error' => 'base64 length is not a multiple of 4', 'offset' => 82],
+];
+
+foreach ($test_cases as $name => $check) {
+    $ok = $check();
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
@@ -0,0 +1,71 @@
+<?php
+/**
+ * Test script for the legacy VLD dump parser behind kage_encrypt_bytecode()
+ */
+
+$all_tests_passed = true;
+
+function encrypt_dump($dump, $selective = false) {
+    return kage_encrypt_bytecode(['vld_output' => $dump], ['algorithm' => 'XOR', 'key' => 'secret', 'selective' => $selective]);
+}
+
+echo "Testing Kage VLD dump parser:\n\n";
+
+$dump = <<<'VLD'
+Finding entry points
+Branch analysis from position: 0
+filename:       /in/test.php
+function name:  (null)
+number of ops:  7
+compiled vars:  !0 = $a
+line      #* E I O op                           fetch          ext  return  operands
+-------------------------------------------------------------------------------------
+    3     0  E >   ASSIGN                                                   !0, 'Hello, world'
+    4     1        CONCAT                                           ~2      !0, '+'
+          2        ECHO                                                     ~2
+    5     3        INIT_FCALL                                               'strlen'
+          4        SEND_VAR                                                 !0
+          5        DO_ICALL                                         $3
+    6     6      > RETURN                                                   1
+
+Class Foo:
+function name:  bar
+number of ops:  3
+compiled vars:  !0 = $x
+line      #* E I O op                           fetch          ext  return  operands
+-------------------------------------------------------------------------------------
+    9     0  E >   RECV                                             !0
+   10     1        ECHO                                                     !0
+         2      > RETURN                                                   null
+End of class Foo.
+VLD;
+
+// Each case is [dump, selective, expected report fields]
+$test_cases = [
+    'Parse dump' => [$dump, false, ['total_opcodes' => 10]],
+    'Opcodes of every function' => [$dump, false, ['encrypted_opcodes' => 10]],
+    // Selective mode without a profile has nothing hot to leave on the fast path
+    'Selective without profile' => [$dump, true, ['encrypted_opcodes' => 10, 'fast_path_opcodes' => 0]],
+    'Windows line endings' => [str_replace("\n", "\r\n", $dump), false, ['total_opcodes' => 10]],
+    'Unknown opcode names' => ["    1     0  E >   NOT_AN_OPCODE   !0\n", false, ['total_opcodes' => 1]],
+    // Numbers past zend_long stay strings instead of overflowing
+    'Out of range numbers' => ["99999999999999999999999     0  E >   ASSIGN   !0, 123456789012345678901234567890\n", false, ['total_opcodes' => 1]],
+    // A line of nothing but flags ends inside the dump, with no opcode name
+    'Flags without an opcode' => ["    1     0  E >", false, ['total_opcodes' => 0]],
+    'Flags before an opcode at the end' => ["    1     0  E > ECHO", false, ['total_opcodes' => 1]],
+    'No opcode table' => ["filename: /in/empty.php\n", false, ['total_opcodes' => 0]],
+];
+
+foreach ($test_cases as $name => [$input, $selective, $expected]) {
+    $report = encrypt_dump($input, $selective);
+    $ok = is_array($report) && array_intersect_key($report, $expected) == $expected;
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}
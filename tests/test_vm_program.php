@@ -0,0 +1,102 @@
+<?php
+/**
+ * Test script for Kage VM program images (export/import/save/load)
+ */
+
+$key = str_repeat("A", 32); // 32 bytes for crypto_secretbox_KEYBYTES
+$source = 'encrypt "First" decrypt encrypt "Shipped precompiled!"';
+$expected = 'Shipped precompiled!';
+
+$all_tests_passed = true;
+
+// Builds an image by hand: $instructions are [opcode, constant index or
+// null], $constants are strings or integers
+function build_image(array $instructions, array $constants, $local_count = 0) {
+    $code = '';
+    foreach ($instructions as [$opcode, $operand]) {
+        $code .= pack('CxxxL', $opcode, $operand === null ? 0xFFFFFFFF : $operand);
+    }
+
+    $table = '';
+    $pool = '';
+    foreach ($constants as $constant) {
+        if (is_int($constant)) {
+            $table .= pack('CxxxLq', 3, 0, $constant);
+        } else {
+            $table .= pack('CxxxLQ', 5, strlen($constant), strlen($pool));
+            $pool .= $constant . "\0";
+        }
+    }
+    $pool = str_pad($pool, (strlen($pool) + 7) & ~7, "\0");
+
+    $body = $code . $table . $pool;
+    return 'KGVM' . pack('SSLLLLLL', 2, 0, count($instructions), count($constants), strlen($pool),
+                         hexdec(hash('fnv1a32', $body)), $local_count, 0x01020304) . $body;
+}
+
+echo "Testing Kage VM program images:\n\n";
+
+$ast = kage_ast_parse($source);
+$image = $ast !== false ? kage_vm_export($ast) : false;
+$file = tempnam(sys_get_temp_dir(), 'kage_vm_');
+
+// Corrupted images must be rejected
+$corrupted = (string)$image;
+$corrupted[strlen($corrupted) - 1] = chr(ord($corrupted[strlen($corrupted) - 1]) ^ 0xFF);
+// The byte-order marker is the last header field
+$swapped = substr_replace((string)$image, strrev(substr((string)$image, 28, 4)), 28, 4);
+
+// Anyone can write an image, so a plain one must not reach PHP functions;
+// function calls only run from encrypted programs (kage_execute_php_bytecode)
+$push = 0; $load = 4; $store = 5; $call = 27; $return = 28;
+$plain = build_image([[$push, 0], [$return, null]], ['built by hand']);
+$calling = build_image([[$push, 0], [$push, 1], [$call, 2], [$return, null]], ['strtoupper', 'kage', 1]);
+
+// The locals frame is allocated from the header before the first instruction
+$storing = [[$push, 0], [$store, 1], [$load, 1], [$return, null]];
+
+// Runs an image through kage_vm_load(); false if it is rejected
+function load_image($file, $image) {
+    file_put_contents($file, $image);
+    return @kage_vm_load($file);
+}
+
+// Each case returns the program to run and the output it must produce,
+// or false and false for an image that must be rejected
+$test_cases = [
+    // In-memory round trip
+    'Export and import image' => fn() => [kage_vm_import($image), $expected],
+    // File round trip
+    'Save and load image' => fn() => [kage_vm_save($ast, $file) === true ? kage_vm_load($file) : false, $expected],
+    'Re-export is stable' => fn() => [kage_vm_export(kage_vm_load($file)) === $image ? kage_vm_load($file) : false, $expected],
+    'Reject bad checksum' => fn() => [@kage_vm_import($corrupted), false],
+    'Reject truncated image' => fn() => [@kage_vm_import(substr($image, 0, 16)), false],
+    'Reject foreign data' => fn() => [@kage_vm_import(str_repeat("x", 64)), false],
+    'Reject foreign byte order' => fn() => [@kage_vm_import($swapped), false],
+    'Hand-built image runs' => fn() => [kage_vm_import($plain), 'built by hand'],
+    'Reject function calls in plain images' => fn() => [@kage_vm_import($calling), false],
+    'Reject function calls in loaded images' => fn() => [load_image($file, $calling), false],
+    'Hand-built image with locals runs' => fn() => [kage_vm_import(build_image($storing, ['kept', 0], 1)), 'kept'],
+    'Reject oversized locals frame' => fn() => [@kage_vm_import(build_image($storing, ['kept', 0], 0xFFFFFFFF)), false],
+    'Reject local slot outside the frame' => fn() => [@kage_vm_import(build_image($storing, ['kept', 3], 1)), false],
+];
+
+foreach ($test_cases as $name => $test) {
+    [$program, $output] = $test();
+    if ($output === false) {
+        $ok = $program === false;
+    } else {
+        $ok = $program !== false && kage_ast_to_bytecode($program, $key) === $output;
+    }
+    echo $name . ": " . ($ok ? "Passed" : "Failed") . "\n";
+    $all_tests_passed = $all_tests_passed && $ok;
+}
+
+unlink($file);
+
+echo "\n-- Test Summary --\n";
+if ($all_tests_passed) {
+    echo "All tests passed successfully!\n";
+} else {
+    echo "Some tests failed. Please review the output above.\n";
+}